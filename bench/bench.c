@@ -0,0 +1,978 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <hiredis/hiredis.h>
+#include "../include/redis_operations.h"
+#include "../include/thread_cache.h"
+#include "../include/thread_snapshot.h"
+#include "../include/title_filter.h"
+#include "../include/media_store.h"
+#include "../include/board_index.h"
+#include "../include/post_codec.h"
+#include "../include/board_export.h"
+#include "../include/thread_ingest.h"
+#include "fake_redis.h"
+
+// Thread list benchmarks: generate a synthetic board, then time the list load, the filter
+// pass and the mutation paths at several board sizes. Results go to stdout as a table and,
+// with --out, to a JSON file that can be compared across commits.
+
+// --- Allocation counting ---------------------------------------------------------------------
+
+// Linked with -Wl,--wrap=malloc,... so every allocation of the process goes through here
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+char *__real_strdup(const char *s);
+
+static unsigned long long allocations = 0;
+
+void *__wrap_malloc(size_t size) {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size) {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __real_realloc(p, size);
+}
+
+char *__wrap_strdup(const char *s) {
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    return __real_strdup(s);
+}
+
+// A shared libhiredis doesn't see the wrapped symbols; route it through them explicitly
+static void count_hiredis_allocations() {
+#if HIREDIS_MAJOR >= 1
+    hiredisAllocFuncs funcs = { __wrap_malloc, __wrap_calloc, __wrap_realloc, __wrap_strdup, free };
+    hiredisSetAllocators(&funcs);
+#endif
+}
+
+// --- Measurements ----------------------------------------------------------------------------
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static long rss_kb() {
+    long pages = 0, resident = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (file == NULL) return 0;
+    if (fscanf(file, "%ld %ld", &pages, &resident) != 2) resident = 0;
+    fclose(file);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+static long peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Separate connection for INFO, so the pool's connections are only used by the code under test
+static redisContext *stats_context = NULL;
+
+// Commands the server has processed, excluding the INFO that asked
+static unsigned long long server_commands() {
+    redisReply *reply = redisCommand(stats_context, "INFO stats");
+    unsigned long long total = 0;
+    if (reply && reply->type == REDIS_REPLY_STRING) {
+        const char *field = strstr(reply->str, "total_commands_processed:");
+        if (field) total = strtoull(field + strlen("total_commands_processed:"), NULL, 10);
+    }
+    if (reply) freeReplyObject(reply);
+    return total;
+}
+
+typedef struct {
+    const char *name;
+    size_t threads;
+    int runs;
+    double *samples;
+    double commands;       // Per run; commands the server processed, not pipeline flushes
+    double allocations;    // Per run
+    long rss_kb;
+    long peak_rss_kb;
+} Result;
+
+typedef struct {
+    double started_at;
+    unsigned long long commands;
+    unsigned long long allocations;
+} Sample;
+
+static void sample_begin(Sample *sample) {
+    sample->commands = server_commands();
+    sample->allocations = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+    sample->started_at = now_ms();
+}
+
+static void sample_end(Sample *sample, Result *result, int run) {
+    double elapsed = now_ms() - sample->started_at;
+    unsigned long long allocated = __atomic_load_n(&allocations, __ATOMIC_RELAXED) - sample->allocations;
+    unsigned long long commands = server_commands() - sample->commands - 1;  // The opening INFO
+    result->samples[run] = elapsed;
+    result->commands += (double)commands / result->runs;
+    result->allocations += (double)allocated / result->runs;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile over the sorted samples
+static double percentile(const Result *result, double p) {
+    int rank = (int)(p / 100.0 * result->runs + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > result->runs) rank = result->runs;
+    return result->samples[rank - 1];
+}
+
+static double mean(const Result *result) {
+    double sum = 0;
+    for (int i = 0; i < result->runs; i++) sum += result->samples[i];
+    return sum / result->runs;
+}
+
+static Result *results = NULL;
+static size_t result_count = 0;
+static size_t result_capacity = 0;
+
+static Result *result_new(const char *name, size_t threads, int runs) {
+    if (result_count == result_capacity) {
+        result_capacity = result_capacity ? result_capacity * 2 : 32;
+        results = realloc(results, result_capacity * sizeof(Result));
+    }
+    Result *result = &results[result_count++];
+    memset(result, 0, sizeof(*result));
+    result->name = name;
+    result->threads = threads;
+    result->runs = runs;
+    result->samples = calloc(runs, sizeof(double));
+    return result;
+}
+
+static void result_finish(Result *result) {
+    qsort(result->samples, result->runs, sizeof(double), compare_doubles);
+    result->rss_kb = rss_kb();
+    result->peak_rss_kb = peak_rss_kb();
+    printf("%-20s %9zu %5d %10.3f %10.3f %10.3f %12.1f %12.1f %10ld\n", result->name, result->threads, result->runs,
+           percentile(result, 50), percentile(result, 99), mean(result), result->commands, result->allocations,
+           result->rss_kb);
+    fflush(stdout);
+}
+
+// Fewer runs as the board grows, so the whole suite stays within minutes
+static int runs_for(size_t threads, int runs) {
+    if (threads >= 1000000) return runs / 10 > 3 ? runs / 10 : 3;
+    if (threads >= 100000) return runs / 4 > 3 ? runs / 4 : 3;
+    return runs;
+}
+
+// --- Dataset ---------------------------------------------------------------------------------
+
+static const char *board = "bench";
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+static uint64_t next_random() {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static const char *vocabulary[] = {
+    "general", "thread", "discussion", "new", "old", "question", "help", "build", "linux", "windows",
+    "anime", "music", "games", "retro", "keyboard", "monitor", "edition", "daily", "weekly", "megathread",
+    "battlestation", "desktop", "programming", "rust", "python", "ricing", "audio", "headphones", "camera", "phone",
+};
+#define VOCABULARY_SIZE (sizeof(vocabulary) / sizeof(vocabulary[0]))
+#define RARE_WORD "zyzzyva"   // Roughly one title word in a thousand
+
+static void thread_id_for(size_t index, char *id, size_t size) {
+    snprintf(id, size, "%llu", 10000000ULL + (unsigned long long)index * 7);
+}
+
+static void make_title(char *title, size_t size, size_t index) {
+    int words = 3 + (int)(next_random() % 6);
+    size_t used = snprintf(title, size, "/%s/ #%zu", board, index % 1000);
+    for (int w = 0; w < words && used < size; w++) {
+        const char *word = next_random() % 1000 == 0 ? RARE_WORD : vocabulary[next_random() % VOCABULARY_SIZE];
+        used += snprintf(title + used, size - used, " %s", word);
+    }
+}
+
+static const char *make_status() {
+    unsigned roll = (unsigned)(next_random() % 100);
+    if (roll < 70) return "active";
+    if (roll < 85) return "archived";
+    if (roll < 95) return "closed";
+    return "dead";
+}
+
+#define GENERATE_BATCH 512     // Threads per MSET
+#define GENERATE_IN_FLIGHT 8   // MSETs sent before reading replies
+
+// Write title, count and status for threads [0, threads) with pipelined MSETs
+static int generate_board(redisContext *context, size_t threads) {
+    size_t argc_max = 1 + GENERATE_BATCH * 6;
+    const char **argv = malloc(argc_max * sizeof(char *));
+    size_t *lengths = malloc(argc_max * sizeof(size_t));
+    char (*strings)[160] = malloc(GENERATE_BATCH * 6 * sizeof(*strings));
+    int pending = 0, status = 0;
+
+    for (size_t start = 0; start < threads && status == 0; start += GENERATE_BATCH) {
+        size_t n = threads - start < GENERATE_BATCH ? threads - start : GENERATE_BATCH;
+        size_t argc = 1;
+        argv[0] = "MSET";
+        lengths[0] = 4;
+        for (size_t i = 0; i < n; i++) {
+            char id[THREAD_ID_MAX];
+            thread_id_for(start + i, id, sizeof(id));
+            char (*s)[160] = &strings[i * 6];
+            format_thread_key(s[0], sizeof(s[0]), board, id, "title");
+            make_title(s[1], sizeof(s[1]), start + i);
+            format_thread_key(s[2], sizeof(s[2]), board, id, "count");
+            snprintf(s[3], sizeof(s[3]), "%d", (int)(next_random() % 400) + 1);
+            format_thread_key(s[4], sizeof(s[4]), board, id, "status");
+            snprintf(s[5], sizeof(s[5]), "%s", make_status());
+            for (int f = 0; f < 6; f++) {
+                argv[argc] = s[f];
+                lengths[argc++] = strlen(s[f]);
+            }
+        }
+        // hiredis copies the arguments into its output buffer, so the strings can be reused
+        redisAppendCommandArgv(context, (int)argc, argv, lengths);
+        if (++pending < GENERATE_IN_FLIGHT && start + n < threads) continue;
+
+        while (pending > 0) {
+            redisReply *reply = NULL;
+            if (redisGetReply(context, (void **)&reply) != REDIS_OK || reply->type == REDIS_REPLY_ERROR) status = -1;
+            if (reply) freeReplyObject(reply);
+            pending--;
+        }
+    }
+
+    free(argv);
+    free(lengths);
+    free(strings);
+    return status;
+}
+
+// Only needed on a real server; the fake one is discarded with its data
+static void remove_board(redisContext *context) {
+    char pattern[300];
+    snprintf(pattern, sizeof(pattern), "%s*", board);
+    char cursor[32] = "0";
+    do {
+        redisReply *reply = redisCommand(context, "SCAN %s MATCH %s COUNT 1000", cursor, pattern);
+        if (reply == NULL || reply->type != REDIS_REPLY_ARRAY || reply->elements != 2) {
+            if (reply) freeReplyObject(reply);
+            return;
+        }
+        snprintf(cursor, sizeof(cursor), "%s", reply->element[0]->str);
+        redisReply *keys = reply->element[1];
+        if (keys->elements > 0) {
+            const char **argv = malloc((keys->elements + 1) * sizeof(char *));
+            argv[0] = "UNLINK";
+            for (size_t i = 0; i < keys->elements; i++) argv[i + 1] = keys->element[i]->str;
+            redisReply *unlinked = redisCommandArgv(context, (int)keys->elements + 1, argv, NULL);
+            if (unlinked) freeReplyObject(unlinked);
+            free(argv);
+        }
+        freeReplyObject(reply);
+    } while (strcmp(cursor, "0") != 0);
+
+    // The sorted index and the dictionaries live under their own hash tags, outside the pattern
+    static const char *const index_names[] = { "id", "count", "status", "threads" };
+    char keys[5][320];
+    for (size_t i = 0; i < 4; i++) format_board_index_key(keys[i], sizeof(keys[i]), board, index_names[i]);
+    format_post_dict_key(keys[4], sizeof(keys[4]), board);
+    for (size_t i = 0; i < 5; i++) {
+        redisReply *reply = redisCommand(context, "UNLINK %s", keys[i]);
+        if (reply) freeReplyObject(reply);
+    }
+}
+
+// --- Benchmarks ------------------------------------------------------------------------------
+
+static int scan_count = 500;
+static int fetch_batch = 256;
+static ThreadCache *cache = NULL;  // The board's cache, as the GUI keeps one per tab
+
+static void fill_cache(ThreadSnapshot *snapshot) {
+    thread_cache_clear(cache);
+    for (size_t i = 0; i < snapshot->count; i++) {
+        char id[32];
+        snprintf(id, sizeof(id), "%llu", (unsigned long long)snapshot->records[i].id);
+        thread_cache_add(cache, id, thread_snapshot_title(snapshot, &snapshot->records[i]), snapshot->records[i].count,
+                         thread_snapshot_status(snapshot, &snapshot->records[i]));
+    }
+    thread_cache_set_valid(cache, 1);
+}
+
+static void cache_record(const char *thread_id, const char *title, int count, const char *status, void *user_data) {
+    if (title) thread_cache_add(cache, thread_id, title, count, status);
+    else thread_cache_remove(cache, thread_id);
+}
+
+static void bench_list_load(size_t threads) {
+    Result *result = result_new("list_load", threads, runs_for(threads, 20));
+    for (int run = 0; run < result->runs; run++) {
+        Sample sample;
+        sample_begin(&sample);
+        ThreadSnapshot *snapshot = fetch_thread_list(board, scan_count, fetch_batch);
+        sample_end(&sample, result, run);
+        if (snapshot == NULL || snapshot->count != threads) {
+            fprintf(stderr, "list_load: expected %zu threads, got %zu\n", threads, snapshot ? snapshot->count : 0);
+        }
+        if (snapshot) thread_snapshot_unref(snapshot);
+    }
+    result_finish(result);
+}
+
+static void bench_cache_fill(size_t threads) {
+    ThreadSnapshot *snapshot = fetch_thread_list(board, scan_count, fetch_batch);
+    if (snapshot == NULL) return;
+    Result *result = result_new("cache_fill", threads, runs_for(threads, 20));
+    for (int run = 0; run < result->runs; run++) {
+        Sample sample;
+        sample_begin(&sample);
+        fill_cache(snapshot);
+        sample_end(&sample, result, run);
+    }
+    thread_snapshot_unref(snapshot);
+    result_finish(result);
+}
+
+// Building the sorted index from a full listing, as Rebuild Sorted Index does
+static void bench_index_rebuild(size_t threads) {
+    Result *result = result_new("index_rebuild", threads, runs_for(threads, 5));
+    for (int run = 0; run < result->runs; run++) {
+        BoardIndexStats stats = { 0 };
+        Sample sample;
+        sample_begin(&sample);
+        int status = board_index_rebuild(board, scan_count, fetch_batch, NULL, &stats);
+        sample_end(&sample, result, run);
+        if (status != 0 || stats.threads != threads) {
+            fprintf(stderr, "index_rebuild: expected %zu threads, got %zu\n", threads, stats.threads);
+        }
+    }
+    result_finish(result);
+}
+
+static void count_record(const char *thread_id, const char *title, int count, const char *status, void *user_data) {
+    (*(size_t *)user_data)++;
+}
+
+// The first page of a list sorted by post count, read from the index instead of the whole board
+static void bench_index_page(size_t threads) {
+    Result *result = result_new("index_top_page", threads, 50);
+    for (int run = 0; run < result->runs; run++) {
+        size_t rows = 0;
+        long long total = 0;
+        Sample sample;
+        sample_begin(&sample);
+        fetch_board_index_page(board, BOARD_INDEX_BY_COUNT, 1, 0, 200, count_record, &rows, &total);
+        sample_end(&sample, result, run);
+        if (rows != (threads < 200 ? threads : 200) || total != (long long)threads) {
+            fprintf(stderr, "index_top_page: expected %zu of %zu threads, got %zu of %lld\n", threads < 200 ? threads : 200,
+                    threads, rows, total);
+        }
+    }
+    result_finish(result);
+}
+
+// One pass of the list filter over the cached board, as the GUI runs on every keystroke
+static void bench_filter(const char *name, const char *filter, size_t threads) {
+    Result *result = result_new(name, threads, runs_for(threads, 50));
+    size_t matches = 0;
+    for (int run = 0; run < result->runs; run++) {
+        Sample sample;
+        sample_begin(&sample);
+        ThreadSnapshot *snapshot = thread_cache_share(cache);
+        matches = 0;
+        for (size_t i = 0; i < snapshot->count; i++) {
+            if (thread_record_matches(snapshot, &snapshot->records[i], filter)) matches++;
+        }
+        thread_snapshot_unref(snapshot);
+        sample_end(&sample, result, run);
+    }
+    result_finish(result);
+    if (matches == 0 && strcmp(name, "filter_none") != 0) fprintf(stderr, "%s: no matches for '%s'\n", name, filter);
+}
+
+// Packing the cached titles into a fresh title index, as on the first search after a reload
+static void bench_title_index(size_t threads) {
+    Result *result = result_new("title_index_build", threads, runs_for(threads, 20));
+    ThreadSnapshot *snapshot = thread_cache_share(cache);
+    for (int run = 0; run < result->runs; run++) {
+        Sample sample;
+        sample_begin(&sample);
+        TitleIndex *index = title_index_new();
+        title_index_update(index, snapshot);
+        sample_end(&sample, result, run);
+        title_index_free(index);
+    }
+    thread_snapshot_unref(snapshot);
+    result_finish(result);
+}
+
+// One ranked title search over the cached board with an up-to-date index, as the GUI runs per keystroke
+static void bench_title_search(const char *name, const char *text, TitleMatchMode mode, size_t threads) {
+    ThreadSnapshot *snapshot = thread_cache_share(cache);
+    TitleIndex *index = title_index_new();
+    TitleQuery *query = title_query_new(text, mode, NULL, 0);
+    float *scores = malloc((snapshot->count ? snapshot->count : 1) * sizeof(float));
+    title_index_update(index, snapshot);
+
+    Result *result = result_new(name, threads, runs_for(threads, 50));
+    size_t matches = 0;
+    for (int run = 0; run < result->runs; run++) {
+        Sample sample;
+        sample_begin(&sample);
+        matches = title_index_search(index, snapshot, query, scores);
+        sample_end(&sample, result, run);
+    }
+    result_finish(result);
+    if (matches == 0) fprintf(stderr, "%s: no matches for '%s'\n", name, text);
+
+    free(scores);
+    title_query_free(query);
+    title_index_free(index);
+    thread_snapshot_unref(snapshot);
+}
+
+// Title change followed by a re-read of just that thread into the cache
+static void bench_mutate_targeted(size_t threads) {
+    Result *result = result_new("mutate_targeted", threads, 200);
+    for (int run = 0; run < result->runs; run++) {
+        char id[THREAD_ID_MAX], title[160];
+        thread_id_for(next_random() % threads, id, sizeof(id));
+        snprintf(title, sizeof(title), "renamed %d %s", run, vocabulary[next_random() % VOCABULARY_SIZE]);
+
+        Sample sample;
+        sample_begin(&sample);
+        update_thread_title(board, id, title);
+        fetch_thread_record(board, id, cache_record, NULL);
+        sample_end(&sample, result, run);
+    }
+    result_finish(result);
+}
+
+// Title change followed by a reload of the whole board, the cost a list without a cache pays
+static void bench_mutate_full_refresh(size_t threads) {
+    Result *result = result_new("mutate_full_refresh", threads, runs_for(threads, 10));
+    for (int run = 0; run < result->runs; run++) {
+        char id[THREAD_ID_MAX], title[160];
+        thread_id_for(next_random() % threads, id, sizeof(id));
+        snprintf(title, sizeof(title), "refreshed %d %s", run, vocabulary[next_random() % VOCABULARY_SIZE]);
+
+        Sample sample;
+        sample_begin(&sample);
+        update_thread_title(board, id, title);
+        ThreadSnapshot *snapshot = fetch_thread_list(board, scan_count, fetch_batch);
+        if (snapshot) {
+            fill_cache(snapshot);
+            thread_snapshot_unref(snapshot);
+        }
+        sample_end(&sample, result, run);
+    }
+    result_finish(result);
+}
+
+#define DETAIL_POSTS 1000      // Posts of the thread the detail viewer opens
+#define DETAIL_PAGE 50         // Posts per page, as the viewer fetches them
+
+// One long thread for the detail viewer, written with pipelined RPUSHes
+static int generate_posts(redisContext *context, const char *thread_id) {
+    char key[320];
+    format_thread_key(key, sizeof(key), board, thread_id, "posts");
+    int pending = 0, status = 0;
+    for (int i = 0; i < DETAIL_POSTS; i++) {
+        char post[512];
+        snprintf(post, sizeof(post), "{\"no\":%d,\"time\":%d,\"com\":\"reply %d about %s and %s<br>&gt;&gt;%d\"}", 20000000 + i,
+                 1700000000 + i, i, vocabulary[next_random() % VOCABULARY_SIZE], vocabulary[next_random() % VOCABULARY_SIZE], 20000000 + i / 2);
+        redisAppendCommand(context, "RPUSH %s %s", key, post);
+        pending++;
+    }
+    while (pending-- > 0) {
+        redisReply *reply = NULL;
+        if (redisGetReply(context, (void **)&reply) != REDIS_OK || reply->type == REDIS_REPLY_ERROR) status = -1;
+        if (reply) freeReplyObject(reply);
+    }
+    return status;
+}
+
+// What the detail viewer pays to show its first screen, and to read a whole thread page by page
+static void bench_thread_details(size_t threads) {
+    char id[THREAD_ID_MAX];
+    thread_id_for(threads / 2, id, sizeof(id));
+    if (generate_posts(stats_context, id) != 0) {
+        fprintf(stderr, "Generating posts failed\n");
+        return;
+    }
+
+    Result *first = result_new("detail_first_page", threads, 50);
+    for (int run = 0; run < first->runs; run++) {
+        ThreadPostPage page;
+        Sample sample;
+        sample_begin(&sample);
+        fetch_thread_details(board, id, 0, DETAIL_PAGE, &page);
+        sample_end(&sample, first, run);
+        thread_post_page_free(&page);
+    }
+    result_finish(first);
+
+    Result *all = result_new("detail_all_pages", threads, 10);
+    for (int run = 0; run < all->runs; run++) {
+        Sample sample;
+        sample_begin(&sample);
+        long long total = DETAIL_POSTS;
+        for (long start = 0; start < total; start += DETAIL_PAGE) {
+            ThreadPostPage page;
+            if (fetch_thread_details(board, id, start, DETAIL_PAGE, &page) != 0) break;
+            total = page.total;
+            thread_post_page_free(&page);
+        }
+        sample_end(&sample, all, run);
+    }
+    result_finish(all);
+}
+
+// Compressing the detail thread with a freshly trained dictionary (the rest of the board has no
+// posts, so this also walks the whole board), then the viewer's first page read back from it
+static void bench_post_compression(size_t threads) {
+    char id[THREAD_ID_MAX];
+    thread_id_for(threads / 2, id, sizeof(id));
+    PostRecompressStats stats[3] = { { 0 } };
+    Result *recompress = result_new("post_recompress", threads, 3);
+    for (int run = 0; run < recompress->runs; run++) {
+        Sample sample;
+        sample_begin(&sample);
+        if (post_codec_recompress(board, 1, scan_count, fetch_batch, NULL, &stats[run]) != 0) fprintf(stderr, "post_recompress failed\n");
+        sample_end(&sample, recompress, run);
+    }
+    result_finish(recompress);
+    // Later runs start from compressed posts; the first shows the ratio
+    fprintf(stderr, "post_recompress: %" PRIu64 " posts, %.1f KiB -> %.1f KiB (%.2fx)\n", stats[0].posts, stats[0].bytes_before / 1024.0,
+            stats[0].bytes_after / 1024.0, stats[0].bytes_after ? (double)stats[0].bytes_before / stats[0].bytes_after : 1.0);
+
+    Result *first = result_new("detail_compressed_page", threads, 50);
+    for (int run = 0; run < first->runs; run++) {
+        ThreadPostPage page;
+        Sample sample;
+        sample_begin(&sample);
+        if (fetch_thread_details(board, id, 0, DETAIL_PAGE, &page) != 0 || page.count != DETAIL_PAGE || page.posts[0][0] != '{') {
+            fprintf(stderr, "detail_compressed_page: posts didn't decode\n");
+        }
+        sample_end(&sample, first, run);
+        thread_post_page_free(&page);
+    }
+    result_finish(first);
+}
+
+// --- Export and import -----------------------------------------------------------------------
+
+// The whole board to a file, plain and compressed, then the compressed file imported back over
+// the same threads, which leaves the board as it was
+static void bench_export_import(size_t threads) {
+    char path[] = "/tmp/bench-export-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) return;
+    close(fd);
+    int runs = threads >= 100000 ? 3 : 5;
+    BoardExportStats stats;
+
+    static const struct {
+        const char *name;
+        unsigned flags;
+    } exports[] = { { "export_plain", 0 }, { "export_zstd", BOARD_EXPORT_ZSTD } };
+    for (size_t e = 0; e < sizeof(exports) / sizeof(exports[0]); e++) {
+        Result *result = result_new(exports[e].name, threads, runs);
+        for (int run = 0; run < result->runs; run++) {
+            Sample sample;
+            sample_begin(&sample);
+            if (board_export(board, path, exports[e].flags, scan_count, fetch_batch, NULL, &stats) != 0) fprintf(stderr, "%s failed\n", exports[e].name);
+            sample_end(&sample, result, run);
+        }
+        result_finish(result);
+        fprintf(stderr, "%s: %" PRIu64 " threads, %" PRIu64 " posts, %.1f MiB of posts, %.1f MiB file (%.0f MiB/s at p50)\n",
+                exports[e].name, stats.threads, stats.posts, stats.post_bytes / 1048576.0, stats.file_bytes / 1048576.0,
+                stats.file_bytes / 1048576.0 / (percentile(result, 50) / 1000.0));
+    }
+
+    Result *result = result_new("import_zstd", threads, runs);
+    for (int run = 0; run < result->runs; run++) {
+        Sample sample;
+        sample_begin(&sample);
+        if (board_import(board, path, 2048, NULL, &stats) != 0 || stats.threads == 0) fprintf(stderr, "import_zstd failed\n");
+        sample_end(&sample, result, run);
+    }
+    result_finish(result);
+    fprintf(stderr, "import_zstd: %" PRIu64 " threads, %" PRIu64 " posts (%.0f threads/s at p50)\n", stats.threads, stats.posts,
+            stats.threads / (percentile(result, 50) / 1000.0));
+    unlink(path);
+}
+
+// --- Media cache -----------------------------------------------------------------------------
+
+#define MEDIA_FILES 200
+#define MEDIA_FIXTURE "bench/fixtures/thumbnail.jpg"  // A real 125x94 JPEG thumbnail
+
+static void remove_tree(const char *path) {
+    DIR *dir = opendir(path);
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        char child[1024];
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        struct stat st;
+        if (lstat(child, &st) == 0 && S_ISDIR(st.st_mode)) remove_tree(child);
+        else unlink(child);
+    }
+    if (dir) closedir(dir);
+    rmdir(path);
+}
+
+static int fetch_all_thumbnails(const char *root) {
+    for (int i = 0; i < MEDIA_FILES; i++) {
+        char url[600];
+        snprintf(url, sizeof(url), "file://%s/%s/%ds.jpg", root, board, 1700000000 + i);
+        MediaBlob blob;
+        if (media_store_fetch(url, &blob) != 0) return -1;
+        media_blob_free(&blob);
+    }
+    return 0;
+}
+
+// Thumbnails served from file:// as the stand-in for the image host: downloading them into
+// an empty disk cache, then reading them back from it
+static void bench_media(size_t threads) {
+    char root[] = "/tmp/bench-media-XXXXXX", path[600];
+    if (mkdtemp(root) == NULL) return;
+    snprintf(path, sizeof(path), "%s/%s", root, board);
+    mkdir(path, 0755);
+    unsigned char *image = NULL;
+    size_t image_length = 0;
+    FILE *fixture = fopen(MEDIA_FIXTURE, "rb");
+    if (fixture) {
+        image = malloc(65536);
+        image_length = image ? fread(image, 1, 65536, fixture) : 0;
+        fclose(fixture);
+    }
+    if (image_length < 4 || image[0] != 0xFF || image[1] != 0xD8) {
+        fprintf(stderr, "media: %s not found; run from the repository root\n", MEDIA_FIXTURE);
+        free(image);
+        remove_tree(root);
+        return;
+    }
+    // The store keeps one copy per content, so each file gets a distinct JPEG comment
+    // segment right after the start-of-image marker; it stays a valid JPEG
+    for (int i = 0; i < MEDIA_FILES; i++) {
+        char comment[32];
+        int comment_length = snprintf(comment, sizeof(comment), "thumbnail %d", i);
+        unsigned char segment[4] = { 0xFF, 0xFE, (unsigned char)((comment_length + 2) >> 8), (unsigned char)(comment_length + 2) };
+        snprintf(path, sizeof(path), "%s/%s/%ds.jpg", root, board, 1700000000 + i);
+        FILE *file = fopen(path, "wb");
+        if (file == NULL) break;
+        fwrite(image, 1, 2, file);
+        fwrite(segment, 1, sizeof(segment), file);
+        fwrite(comment, 1, (size_t)comment_length, file);
+        fwrite(image + 2, 1, image_length - 2, file);
+        fclose(file);
+    }
+    free(image);
+
+    Result *cold = result_new("media_cold", threads, 5);
+    for (int run = 0; run < cold->runs; run++) {
+        snprintf(path, sizeof(path), "%s/store%d", root, run);
+        media_store_init(path, 64 * 1024 * 1024);
+        Sample sample;
+        sample_begin(&sample);
+        fetch_all_thumbnails(root);
+        sample_end(&sample, cold, run);
+    }
+    result_finish(cold);
+
+    Result *hit = result_new("media_disk_hit", threads, 20);
+    for (int run = 0; run < hit->runs; run++) {
+        Sample sample;
+        sample_begin(&sample);
+        fetch_all_thumbnails(root);
+        sample_end(&sample, hit, run);
+    }
+    result_finish(hit);
+    remove_tree(root);
+}
+
+// --- Native ingest ---------------------------------------------------------------------------
+
+#define INGEST_FIXTURES "bench/fixtures"  // Laid out like the 4chan API: <board>/thread/<id>.json
+#define INGEST_THREAD "95000001"
+
+static const char *ingest_title = "Linux & BSD desktop thread \xe2\x80\x94 \"rice\" edition";
+
+typedef struct {
+    int seen;
+    char title[256];
+    int count;
+    char status[32];
+} IngestCheck;
+
+static void check_record(const char *thread_id, const char *title, int count, const char *status, void *user_data) {
+    IngestCheck *check = user_data;
+    check->seen = title != NULL;
+    snprintf(check->title, sizeof(check->title), "%s", title ? title : "");
+    check->count = count;
+    snprintf(check->status, sizeof(check->status), "%s", status ? status : "");
+}
+
+// The API parser fed a real-shaped thread from file://: entities, escapes, braces inside
+// strings, nested values and a key after "posts". The stored fields and posts are checked
+// once, so a parser regression shows up as an error line, not just a different time.
+static void bench_ingest(size_t threads) {
+    char cwd[4096], base[4200];
+    if (access(INGEST_FIXTURES, R_OK) != 0 || getcwd(cwd, sizeof(cwd)) == NULL) {
+        fprintf(stderr, "ingest_fixture: %s not found; run from the repository root\n", INGEST_FIXTURES);
+        return;
+    }
+    snprintf(base, sizeof(base), "file://%s/%s", cwd, INGEST_FIXTURES);
+
+    IngestStats stats;
+    Result *result = result_new("ingest_fixture", threads, 20);
+    for (int run = 0; run < result->runs; run++) {
+        Sample sample;
+        sample_begin(&sample);
+        if (thread_ingest_from_api(board, base, INGEST_THREAD, NULL, &stats) != 0) fprintf(stderr, "ingest_fixture failed\n");
+        sample_end(&sample, result, run);
+    }
+    result_finish(result);
+
+    IngestCheck check = { 0 };
+    fetch_thread_record(board, INGEST_THREAD, check_record, &check);
+    if (!check.seen || strcmp(check.title, ingest_title) != 0 || check.count != 6 || strcmp(check.status, "archived") != 0) {
+        fprintf(stderr, "ingest_fixture: stored title \"%s\", count %d, status \"%s\"; expected \"%s\", 6, \"archived\"\n",
+                check.title, check.count, check.status, ingest_title);
+    }
+    ThreadPostPage page;
+    if (fetch_thread_details(board, INGEST_THREAD, 0, 10, &page) != 0 || page.count != 6) {
+        fprintf(stderr, "ingest_fixture: expected 6 stored posts\n");
+    } else {
+        for (size_t i = 0; i < page.count; i++) {
+            char head[32];
+            snprintf(head, sizeof(head), "{\"no\":%zu,", (size_t)95000001 + i);
+            if (strncmp(page.posts[i], head, strlen(head)) != 0 || page.posts[i][page.lengths[i] - 1] != '}') {
+                fprintf(stderr, "ingest_fixture: post %zu stored as %.60s\n", i, page.posts[i]);
+            }
+        }
+        thread_post_page_free(&page);
+    }
+    fprintf(stderr, "ingest_fixture: %u posts, %zu bytes, %u round-trips, at most %zu bytes of posts held\n", stats.posts,
+            stats.bytes, stats.round_trips, stats.peak_buffered_bytes);
+    delete_thread(board, INGEST_THREAD);
+}
+
+// Runs last: it shrinks the board
+static void bench_delete(size_t threads) {
+    Result *result = result_new("delete_refresh", threads, threads >= 100000 ? 3 : 10);
+    for (int run = 0; run < result->runs; run++) {
+        char id[THREAD_ID_MAX];
+        thread_id_for((size_t)run * (threads / result->runs), id, sizeof(id));
+
+        Sample sample;
+        sample_begin(&sample);
+        delete_thread(board, id);
+        fetch_thread_record(board, id, cache_record, NULL);
+        sample_end(&sample, result, run);
+    }
+    result_finish(result);
+}
+
+// --- Driver ----------------------------------------------------------------------------------
+
+static int run_size(const char *host, int port, size_t threads) {
+    stats_context = redisConnect(host, port);
+    if (stats_context == NULL || stats_context->err) {
+        fprintf(stderr, "Cannot connect to %s:%d\n", host, port);
+        if (stats_context) redisFree(stats_context);
+        return -1;
+    }
+    remove_board(stats_context);
+    char endpoint[300];
+    snprintf(endpoint, sizeof(endpoint), "%s:%d", host, port);
+    redis_pool_init(endpoint, 4, 2000, 0);
+    cache = thread_cache_new();
+
+    Result *result = result_new("generate", threads, 1);
+    Sample sample;
+    sample_begin(&sample);
+    int status = generate_board(stats_context, threads);
+    sample_end(&sample, result, 0);
+    result_finish(result);
+
+    if (status == 0) {
+        bench_list_load(threads);
+        bench_cache_fill(threads);
+        bench_index_rebuild(threads);
+        bench_index_page(threads);
+        bench_filter("filter_common", "thread", threads);
+        bench_filter("filter_rare", RARE_WORD, threads);
+        bench_filter("filter_none", "no such title", threads);
+        bench_filter("filter_id", "1000", threads);
+        bench_title_index(threads);
+        bench_title_search("title_substring", "thread", TITLE_MATCH_SUBSTRING, threads);
+        bench_title_search("title_words", "linux thread", TITLE_MATCH_WORDS, threads);
+        bench_title_search("title_rare", RARE_WORD, TITLE_MATCH_WORDS, threads);
+        bench_title_search("title_fuzzy", "lnxkbd", TITLE_MATCH_FUZZY, threads);
+        bench_title_search("title_regex", "^/bench/ #1[0-9]+ (rust|python)", TITLE_MATCH_REGEX, threads);
+        bench_mutate_targeted(threads);
+        bench_mutate_full_refresh(threads);
+        bench_thread_details(threads);
+        bench_post_compression(threads);
+        bench_export_import(threads);
+        bench_media(threads);
+        bench_ingest(threads);
+        bench_delete(threads);
+    } else {
+        fprintf(stderr, "Generating %zu threads failed\n", threads);
+    }
+
+    thread_cache_free(cache);
+    cache = NULL;
+    post_codec_shutdown();
+    redis_pool_shutdown();
+    remove_board(stats_context);
+    redisFree(stats_context);
+    stats_context = NULL;
+    return status;
+}
+
+static void json_string(FILE *out, const char *s) {
+    fputc('"', out);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fputc('\\', out);
+        fputc(*s, out);
+    }
+    fputc('"', out);
+}
+
+static int write_json(const char *path, const char *commit, const char *server) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        perror(path);
+        return -1;
+    }
+    char timestamp[32];
+    time_t now = time(NULL);
+    struct tm tm;
+    gmtime_r(&now, &tm);
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", &tm);
+
+    fprintf(out, "{\n  \"commit\": ");
+    json_string(out, commit);
+    fprintf(out, ",\n  \"timestamp\": \"%s\",\n  \"server\": ", timestamp);
+    json_string(out, server);
+    fprintf(out, ",\n  \"scan_count\": %d,\n  \"fetch_batch\": %d,\n  \"results\": [\n", scan_count, fetch_batch);
+    for (size_t i = 0; i < result_count; i++) {
+        const Result *r = &results[i];
+        fprintf(out,
+                "    {\"benchmark\": \"%s\", \"threads\": %zu, \"runs\": %d, \"p50_ms\": %.3f, \"p99_ms\": %.3f, "
+                "\"mean_ms\": %.3f, \"max_ms\": %.3f, \"commands\": %.1f, \"allocations\": %.1f, "
+                "\"rss_kb\": %ld, \"peak_rss_kb\": %ld}%s\n",
+                r->name, r->threads, r->runs, percentile(r, 50), percentile(r, 99), mean(r), r->samples[r->runs - 1],
+                r->commands, r->allocations, r->rss_kb, r->peak_rss_kb, i + 1 < result_count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    fclose(out);
+    return 0;
+}
+
+static void usage() {
+    fprintf(stderr,
+            "usage: bench [--sizes N,N,...] [--redis HOST:PORT] [--board NAME] [--out FILE] [--commit ID]\n"
+            "             [--scan-count N] [--fetch-batch N]\n"
+            "Without --redis an in-process fake server is started for each size. With --redis, every\n"
+            "key starting with the board name is removed before and after each size.\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *sizes = "1000,10000,100000,1000000";
+    const char *redis = NULL;
+    const char *out_path = NULL;
+    const char *commit = "unknown";
+
+    for (int i = 1; i < argc; i++) {
+        int has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--sizes") == 0 && has_value) sizes = argv[++i];
+        else if (strcmp(argv[i], "--redis") == 0 && has_value) redis = argv[++i];
+        else if (strcmp(argv[i], "--board") == 0 && has_value) board = argv[++i];
+        else if (strcmp(argv[i], "--out") == 0 && has_value) out_path = argv[++i];
+        else if (strcmp(argv[i], "--commit") == 0 && has_value) commit = argv[++i];
+        else if (strcmp(argv[i], "--scan-count") == 0 && has_value) scan_count = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--fetch-batch") == 0 && has_value) fetch_batch = atoi(argv[++i]);
+        else {
+            usage();
+            return 2;
+        }
+    }
+
+    char host[256] = "127.0.0.1";
+    int port = 0;
+    if (redis) {
+        const char *colon = strrchr(redis, ':');
+        if (colon == NULL) {
+            usage();
+            return 2;
+        }
+        snprintf(host, sizeof(host), "%.*s", (int)(colon - redis), redis);
+        port = atoi(colon + 1);
+    }
+
+    count_hiredis_allocations();
+    printf("%-20s %9s %5s %10s %10s %10s %12s %12s %10s\n", "benchmark", "threads", "runs", "p50_ms", "p99_ms", "mean_ms",
+           "commands", "allocations", "rss_kb");
+
+    int failed = 0;
+    for (const char *p = sizes; *p;) {
+        size_t threads = strtoull(p, NULL, 10);
+        p += strcspn(p, ",");
+        if (*p == ',') p++;
+        if (threads == 0) continue;
+
+        FakeRedis server = { 0 };
+        if (redis == NULL) {
+            if (fake_redis_start(&server) != 0) {
+                perror("fake redis");
+                return 1;
+            }
+            port = server.port;
+        }
+        failed |= run_size(host, port, threads) != 0;
+        fake_redis_stop(&server);
+    }
+
+    if (out_path && write_json(out_path, commit, redis ? redis : "fake") == 0) fprintf(stderr, "Results written to %s\n", out_path);
+    return failed ? 1 : 0;
+}
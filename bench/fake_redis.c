@@ -0,0 +1,848 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "fake_redis.h"
+
+#define MAX_CLIENTS 64
+#define READ_CHUNK 65536
+
+// --- Keyspace --------------------------------------------------------------------------------
+
+typedef enum { COLLECTION_ZSET, COLLECTION_HASH } CollectionType;
+
+typedef struct {
+    char *name;              // NULL once removed
+    char *value;             // Hashes only
+    uint32_t name_length;
+    uint32_t value_length;
+    double score;            // Sorted sets only
+} Member;
+
+// A sorted set or hash. Members are found through their own open-addressing table, like
+// entries; a sorted set is sorted again only when it is read after a change.
+typedef struct {
+    CollectionType type;
+    Member *members;
+    size_t member_count;
+    size_t member_capacity;
+    size_t live;
+    uint32_t *slots;         // Member index + 1, 0 when empty
+    size_t slot_capacity;
+    uint32_t *order;         // Live members by score, then name; valid while sorted is set
+    int sorted;
+} Collection;
+
+// Entries keep their position for their lifetime, so SCAN's cursor is simply an entry index
+typedef struct {
+    char *key;               // NULL once deleted
+    char *value;             // A list's items are stored back to back
+    uint32_t key_length;
+    uint32_t value_length;
+    uint32_t *item_ends;     // Lists only: end offset of each item in value
+    uint32_t item_count;
+    uint32_t item_capacity;
+    Collection *collection;  // Sorted sets and hashes only
+} Entry;
+
+static Entry *entries = NULL;
+static size_t entry_count = 0;
+static size_t entry_capacity = 0;
+static size_t live_count = 0;
+static uint32_t *slots = NULL;   // Entry index + 1, 0 when empty; deleted entries act as tombstones
+static size_t slot_capacity = 0;
+static unsigned long long commands_processed = 0;
+
+static uint64_t hash_key(const char *key, size_t length) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < length; i++) hash = (hash ^ (unsigned char)key[i]) * 1099511628211ULL;
+    return hash;
+}
+
+static long find_entry(const char *key, size_t length) {
+    if (slot_capacity == 0) return -1;
+    for (size_t i = hash_key(key, length) & (slot_capacity - 1);; i = (i + 1) & (slot_capacity - 1)) {
+        if (slots[i] == 0) return -1;
+        const Entry *entry = &entries[slots[i] - 1];
+        if (entry->key && entry->key_length == length && memcmp(entry->key, key, length) == 0) return slots[i] - 1;
+    }
+}
+
+static void place_entry(size_t index) {
+    const Entry *entry = &entries[index];
+    size_t i = hash_key(entry->key, entry->key_length) & (slot_capacity - 1);
+    while (slots[i]) i = (i + 1) & (slot_capacity - 1);
+    slots[i] = (uint32_t)index + 1;
+}
+
+// Rehash the live entries; dropping tombstones keeps probe chains short
+static void rebuild_slots(size_t capacity) {
+    free(slots);
+    slot_capacity = capacity;
+    slots = calloc(slot_capacity, sizeof(uint32_t));
+    if (slots == NULL) {
+        fprintf(stderr, "fake redis: out of memory\n");
+        _exit(1);
+    }
+    for (size_t i = 0; i < entry_count; i++) {
+        if (entries[i].key) place_entry(i);
+    }
+}
+
+static char *copy_bytes(const char *data, size_t length) {
+    char *copy = malloc(length + 1);
+    if (copy == NULL) {
+        fprintf(stderr, "fake redis: out of memory\n");
+        _exit(1);
+    }
+    memcpy(copy, data, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+static void free_collection(Collection *collection) {
+    if (collection == NULL) return;
+    for (size_t i = 0; i < collection->member_count; i++) {
+        free(collection->members[i].name);
+        free(collection->members[i].value);
+    }
+    free(collection->members);
+    free(collection->slots);
+    free(collection->order);
+    free(collection);
+}
+
+static void set_key(const char *key, size_t key_length, const char *value, size_t value_length) {
+    long index = find_entry(key, key_length);
+    if (index >= 0) {
+        free(entries[index].value);
+        free(entries[index].item_ends);  // SET replaces a list too
+        free_collection(entries[index].collection);
+        entries[index].value = copy_bytes(value, value_length);
+        entries[index].value_length = (uint32_t)value_length;
+        entries[index].item_ends = NULL;
+        entries[index].item_count = entries[index].item_capacity = 0;
+        entries[index].collection = NULL;
+        return;
+    }
+
+    if (entry_count == entry_capacity) {
+        entry_capacity = entry_capacity ? entry_capacity * 2 : 4096;
+        entries = realloc(entries, entry_capacity * sizeof(Entry));
+        if (entries == NULL) _exit(1);
+    }
+    if ((entry_count + 1) * 2 > slot_capacity) rebuild_slots(slot_capacity ? slot_capacity * 2 : 8192);
+
+    Entry *entry = &entries[entry_count];
+    memset(entry, 0, sizeof(*entry));
+    entry->key = copy_bytes(key, key_length);
+    entry->key_length = (uint32_t)key_length;
+    entry->value = copy_bytes(value, value_length);
+    entry->value_length = (uint32_t)value_length;
+    place_entry(entry_count++);
+    live_count++;
+}
+
+static int delete_key(const char *key, size_t length) {
+    long index = find_entry(key, length);
+    if (index < 0) return 0;
+    free(entries[index].key);
+    free(entries[index].value);
+    free(entries[index].item_ends);
+    free_collection(entries[index].collection);
+    entries[index].key = NULL;
+    entries[index].value = NULL;
+    entries[index].item_ends = NULL;
+    entries[index].collection = NULL;
+    live_count--;
+    return 1;
+}
+
+static void flush_all() {
+    for (size_t i = 0; i < entry_count; i++) {
+        free(entries[i].key);
+        free(entries[i].value);
+        free(entries[i].item_ends);
+        free_collection(entries[i].collection);
+    }
+    free(entries);
+    free(slots);
+    entries = NULL;
+    slots = NULL;
+    entry_count = entry_capacity = live_count = slot_capacity = 0;
+}
+
+// Append items to a list, creating it; the index of the entry, or -1 if the key holds a string
+static long push_items(const char *key, size_t key_length, char **items, size_t *lengths, size_t count) {
+    long index = find_entry(key, key_length);
+    if (index < 0) {
+        set_key(key, key_length, "", 0);
+        index = find_entry(key, key_length);
+        entries[index].item_ends = malloc(sizeof(uint32_t));
+        entries[index].item_capacity = 1;
+    }
+    Entry *entry = &entries[index];
+    if (entry->item_ends == NULL) return -1;
+
+    size_t added = 0;
+    for (size_t i = 0; i < count; i++) added += lengths[i];
+    entry->value = realloc(entry->value, entry->value_length + added + 1);
+    if (entry->item_count + count > entry->item_capacity) {
+        entry->item_capacity = (uint32_t)((entry->item_count + count) * 2);
+        entry->item_ends = realloc(entry->item_ends, entry->item_capacity * sizeof(uint32_t));
+    }
+    if (entry->value == NULL || entry->item_ends == NULL) _exit(1);
+    for (size_t i = 0; i < count; i++) {
+        memcpy(entry->value + entry->value_length, items[i], lengths[i]);
+        entry->value_length += (uint32_t)lengths[i];
+        entry->item_ends[entry->item_count++] = entry->value_length;
+    }
+    return index;
+}
+
+// Move key's value to new_key, replacing whatever new_key held; 0 if key doesn't exist
+static int rename_key(const char *key, size_t key_length, const char *new_key, size_t new_key_length) {
+    long from = find_entry(key, key_length);
+    if (from < 0) return 0;
+    if (key_length == new_key_length && memcmp(key, new_key, key_length) == 0) return 1;
+    delete_key(new_key, new_key_length);
+    set_key(new_key, new_key_length, "", 0);
+    Entry *source = &entries[from], *target = &entries[find_entry(new_key, new_key_length)];
+    free(target->value);
+    target->value = source->value;
+    target->value_length = source->value_length;
+    target->item_ends = source->item_ends;
+    target->item_count = source->item_count;
+    target->item_capacity = source->item_capacity;
+    target->collection = source->collection;
+    source->value = NULL;
+    source->item_ends = NULL;
+    source->collection = NULL;
+    delete_key(key, key_length);
+    return 1;
+}
+
+// --- Sorted sets and hashes ------------------------------------------------------------------
+
+static long find_member(const Collection *collection, const char *name, size_t length) {
+    if (collection->slot_capacity == 0) return -1;
+    for (size_t i = hash_key(name, length) & (collection->slot_capacity - 1);; i = (i + 1) & (collection->slot_capacity - 1)) {
+        if (collection->slots[i] == 0) return -1;
+        const Member *member = &collection->members[collection->slots[i] - 1];
+        if (member->name && member->name_length == length && memcmp(member->name, name, length) == 0) return collection->slots[i] - 1;
+    }
+}
+
+static void place_member(Collection *collection, size_t index) {
+    const Member *member = &collection->members[index];
+    size_t i = hash_key(member->name, member->name_length) & (collection->slot_capacity - 1);
+    while (collection->slots[i]) i = (i + 1) & (collection->slot_capacity - 1);
+    collection->slots[i] = (uint32_t)index + 1;
+}
+
+// Drop removed members and rehash the rest
+static void compact_members(Collection *collection, size_t slot_capacity) {
+    size_t kept = 0;
+    for (size_t i = 0; i < collection->member_count; i++) {
+        if (collection->members[i].name) collection->members[kept++] = collection->members[i];
+    }
+    collection->member_count = kept;
+    free(collection->slots);
+    collection->slot_capacity = slot_capacity;
+    collection->slots = calloc(slot_capacity, sizeof(uint32_t));
+    if (collection->slots == NULL) _exit(1);
+    for (size_t i = 0; i < kept; i++) place_member(collection, i);
+    collection->sorted = 0;
+}
+
+// The collection at key, created if missing; NULL if key holds another type
+static Collection *get_collection(const char *key, size_t key_length, CollectionType type, int create) {
+    long index = find_entry(key, key_length);
+    if (index < 0) {
+        if (!create) return NULL;
+        set_key(key, key_length, "", 0);
+        index = find_entry(key, key_length);
+        entries[index].collection = calloc(1, sizeof(Collection));
+        if (entries[index].collection == NULL) _exit(1);
+        entries[index].collection->type = type;
+    }
+    Collection *collection = entries[index].collection;
+    return collection && collection->type == type ? collection : NULL;
+}
+
+static int key_has_type(const char *key, size_t key_length, CollectionType type) {
+    long index = find_entry(key, key_length);
+    return index < 0 || (entries[index].collection && entries[index].collection->type == type);
+}
+
+// Add or update a member; 1 if it is new
+static int set_member(Collection *collection, const char *name, size_t length, double score, const char *value, size_t value_length) {
+    long index = find_member(collection, name, length);
+    if (index >= 0) {
+        Member *member = &collection->members[index];
+        if (collection->type == COLLECTION_HASH) {
+            free(member->value);
+            member->value = copy_bytes(value, value_length);
+            member->value_length = (uint32_t)value_length;
+        } else if (member->score != score) {
+            member->score = score;
+            collection->sorted = 0;
+        }
+        return 0;
+    }
+
+    if (collection->member_count == collection->member_capacity) {
+        collection->member_capacity = collection->member_capacity ? collection->member_capacity * 2 : 64;
+        collection->members = realloc(collection->members, collection->member_capacity * sizeof(Member));
+        if (collection->members == NULL) _exit(1);
+    }
+    if ((collection->member_count + 1) * 2 > collection->slot_capacity) {
+        compact_members(collection, collection->slot_capacity ? collection->slot_capacity * 2 : 128);
+    }
+    Member *member = &collection->members[collection->member_count];
+    member->name = copy_bytes(name, length);
+    member->name_length = (uint32_t)length;
+    member->value = collection->type == COLLECTION_HASH ? copy_bytes(value, value_length) : NULL;
+    member->value_length = (uint32_t)value_length;
+    member->score = score;
+    place_member(collection, collection->member_count++);
+    collection->live++;
+    collection->sorted = 0;
+    return 1;
+}
+
+// Removed members stay as tombstones until the next compaction
+static int remove_member(Collection *collection, const char *name, size_t length) {
+    long index = find_member(collection, name, length);
+    if (index < 0) return 0;
+    free(collection->members[index].name);
+    free(collection->members[index].value);
+    collection->members[index].name = NULL;
+    collection->members[index].value = NULL;
+    collection->live--;
+    collection->sorted = 0;
+    return 1;
+}
+
+static const Member *sort_members_base;
+
+static int compare_members(const void *a, const void *b) {
+    const Member *x = &sort_members_base[*(const uint32_t *)a], *y = &sort_members_base[*(const uint32_t *)b];
+    if (x->score != y->score) return x->score < y->score ? -1 : 1;
+    size_t shorter = x->name_length < y->name_length ? x->name_length : y->name_length;
+    int compared = memcmp(x->name, y->name, shorter);
+    return compared ? compared : (x->name_length > y->name_length) - (x->name_length < y->name_length);
+}
+
+static void sort_collection(Collection *collection) {
+    if (collection->sorted) return;
+    free(collection->order);
+    collection->order = malloc((collection->live ? collection->live : 1) * sizeof(uint32_t));
+    if (collection->order == NULL) _exit(1);
+    size_t n = 0;
+    for (size_t i = 0; i < collection->member_count; i++) {
+        if (collection->members[i].name) collection->order[n++] = (uint32_t)i;
+    }
+    sort_members_base = collection->members;
+    qsort(collection->order, n, sizeof(uint32_t), compare_members);
+    collection->sorted = 1;
+}
+
+// Redis glob subset: '*' and '?'
+static int glob_match(const char *pattern, size_t pattern_length, const char *text, size_t text_length) {
+    size_t p = 0, t = 0, star = (size_t)-1, resume = 0;
+    while (t < text_length) {
+        if (p < pattern_length && (pattern[p] == '?' || pattern[p] == text[t])) {
+            p++;
+            t++;
+        } else if (p < pattern_length && pattern[p] == '*') {
+            star = p++;
+            resume = t;
+        } else if (star != (size_t)-1) {
+            p = star + 1;
+            t = ++resume;
+        } else {
+            return 0;
+        }
+    }
+    while (p < pattern_length && pattern[p] == '*') p++;
+    return p == pattern_length;
+}
+
+// --- Replies ---------------------------------------------------------------------------------
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} Buffer;
+
+static void buffer_append(Buffer *buffer, const char *data, size_t length) {
+    if (buffer->length + length > buffer->capacity) {
+        buffer->capacity = (buffer->length + length) * 2;
+        buffer->data = realloc(buffer->data, buffer->capacity);
+        if (buffer->data == NULL) _exit(1);
+    }
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+}
+
+static void reply_format(Buffer *out, const char *format, unsigned long long value) {
+    char line[64];
+    int length = snprintf(line, sizeof(line), format, value);
+    buffer_append(out, line, (size_t)length);
+}
+
+static void reply_bulk(Buffer *out, const char *data, size_t length) {
+    if (data == NULL) {
+        buffer_append(out, "$-1\r\n", 5);
+        return;
+    }
+    reply_format(out, "$%llu\r\n", length);
+    buffer_append(out, data, length);
+    buffer_append(out, "\r\n", 2);
+}
+
+// --- Commands --------------------------------------------------------------------------------
+
+static int is_command(const char *name, size_t length, const char *expected) {
+    return strlen(expected) == length && strncasecmp(name, expected, length) == 0;
+}
+
+static void command_scan(Buffer *out, char **argv, size_t *lengths, size_t argc) {
+    size_t cursor = strtoull(argv[1], NULL, 10);
+    const char *pattern = "*";
+    size_t pattern_length = 1, count = 10;
+    for (size_t i = 2; i + 1 < argc; i += 2) {
+        if (is_command(argv[i], lengths[i], "MATCH")) {
+            pattern = argv[i + 1];
+            pattern_length = lengths[i + 1];
+        } else if (is_command(argv[i], lengths[i], "COUNT")) {
+            count = strtoull(argv[i + 1], NULL, 10);
+        }
+    }
+
+    size_t end = cursor + (count ? count : 1);
+    if (end > entry_count) end = entry_count;
+    size_t matches = 0;
+    for (size_t i = cursor; i < end; i++) {
+        if (entries[i].key && glob_match(pattern, pattern_length, entries[i].key, entries[i].key_length)) matches++;
+    }
+
+    char next[32];
+    int next_length = snprintf(next, sizeof(next), "%zu", end >= entry_count ? (size_t)0 : end);
+    buffer_append(out, "*2\r\n", 4);
+    reply_bulk(out, next, (size_t)next_length);
+    reply_format(out, "*%llu\r\n", matches);
+    for (size_t i = cursor; i < end; i++) {
+        if (entries[i].key && glob_match(pattern, pattern_length, entries[i].key, entries[i].key_length)) {
+            reply_bulk(out, entries[i].key, entries[i].key_length);
+        }
+    }
+}
+
+static const char wrong_type[] = "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+
+static void command_lrange(Buffer *out, char **argv, size_t *lengths) {
+    long index = find_entry(argv[1], lengths[1]);
+    if (index >= 0 && entries[index].item_ends == NULL) {
+        buffer_append(out, wrong_type, sizeof(wrong_type) - 1);
+        return;
+    }
+    long long count = index >= 0 ? entries[index].item_count : 0;
+    long long start = strtoll(argv[2], NULL, 10), stop = strtoll(argv[3], NULL, 10);
+    if (start < 0) start = start + count < 0 ? 0 : start + count;
+    if (stop < 0) stop += count;
+    if (stop >= count) stop = count - 1;
+    if (start > stop) {
+        buffer_append(out, "*0\r\n", 4);
+        return;
+    }
+
+    const Entry *entry = &entries[index];
+    reply_format(out, "*%llu\r\n", (unsigned long long)(stop - start + 1));
+    for (long long i = start; i <= stop; i++) {
+        uint32_t begin = i > 0 ? entry->item_ends[i - 1] : 0;
+        reply_bulk(out, entry->value + begin, entry->item_ends[i] - begin);
+    }
+}
+
+static void reply_members(Buffer *out, Collection *collection, long long start, long long stop, int reverse) {
+    long long count = collection ? (long long)collection->live : 0;
+    if (start < 0) start = start + count < 0 ? 0 : start + count;
+    if (stop < 0) stop += count;
+    if (stop >= count) stop = count - 1;
+    if (start > stop) {
+        buffer_append(out, "*0\r\n", 4);
+        return;
+    }
+    sort_collection(collection);
+    reply_format(out, "*%llu\r\n", (unsigned long long)(stop - start + 1));
+    for (long long i = start; i <= stop; i++) {
+        const Member *member = &collection->members[collection->order[reverse ? count - 1 - i : i]];
+        reply_bulk(out, member->name, member->name_length);
+    }
+}
+
+// A score bound: a number, -inf or +inf, exclusive with a leading '('
+static double parse_bound(const char *text, int *exclusive) {
+    *exclusive = *text == '(';
+    return strtod(text + *exclusive, NULL);
+}
+
+// ZRANGEBYSCORE key min max [LIMIT offset count]
+static void command_zrangebyscore(Buffer *out, char **argv, size_t *lengths, size_t argc) {
+    if (!key_has_type(argv[1], lengths[1], COLLECTION_ZSET)) {
+        buffer_append(out, wrong_type, sizeof(wrong_type) - 1);
+        return;
+    }
+    Collection *collection = get_collection(argv[1], lengths[1], COLLECTION_ZSET, 0);
+    int min_exclusive, max_exclusive;
+    double min = parse_bound(argv[2], &min_exclusive), max = parse_bound(argv[3], &max_exclusive);
+    long long offset = 0, limit = -1;
+    if (argc == 7 && is_command(argv[4], lengths[4], "LIMIT")) {
+        offset = strtoll(argv[5], NULL, 10);
+        limit = strtoll(argv[6], NULL, 10);
+    }
+
+    size_t first = 0, matches = 0, live = collection ? collection->live : 0;
+    if (collection) sort_collection(collection);
+    // Binary search for the first member above min
+    for (size_t high = live; first < high;) {
+        size_t middle = (first + high) / 2;
+        double score = collection->members[collection->order[middle]].score;
+        if (score < min || (min_exclusive && score == min)) first = middle + 1;
+        else high = middle;
+    }
+    first += (size_t)offset;
+    for (size_t i = first; i < live && (limit < 0 || matches < (size_t)limit); i++) {
+        double score = collection->members[collection->order[i]].score;
+        if (score > max || (max_exclusive && score == max)) break;
+        matches++;
+    }
+    reply_format(out, "*%llu\r\n", matches);
+    for (size_t i = first; i < first + matches; i++) {
+        const Member *member = &collection->members[collection->order[i]];
+        reply_bulk(out, member->name, member->name_length);
+    }
+}
+
+static void command_collection(Buffer *out, char **argv, size_t *lengths, size_t argc) {
+    const char *name = argv[0];
+    size_t length = lengths[0];
+    int hash = is_command(name, length, "HSET") || is_command(name, length, "HDEL") || is_command(name, length, "HMGET");
+    CollectionType type = hash ? COLLECTION_HASH : COLLECTION_ZSET;
+    if (!key_has_type(argv[1], lengths[1], type)) {
+        buffer_append(out, wrong_type, sizeof(wrong_type) - 1);
+        return;
+    }
+
+    unsigned long long changed = 0;
+    if (is_command(name, length, "ZADD") || is_command(name, length, "HSET")) {
+        Collection *collection = get_collection(argv[1], lengths[1], type, 1);
+        for (size_t i = 2; i + 1 < argc; i += 2) {
+            if (hash) changed += set_member(collection, argv[i], lengths[i], 0, argv[i + 1], lengths[i + 1]);
+            else changed += set_member(collection, argv[i + 1], lengths[i + 1], strtod(argv[i], NULL), NULL, 0);
+        }
+        reply_format(out, ":%llu\r\n", changed);
+        return;
+    }
+
+    Collection *collection = get_collection(argv[1], lengths[1], type, 0);
+    if (is_command(name, length, "ZREM") || is_command(name, length, "HDEL")) {
+        for (size_t i = 2; collection && i < argc; i++) changed += remove_member(collection, argv[i], lengths[i]);
+        if (collection && collection->live == 0) delete_key(argv[1], lengths[1]);
+        reply_format(out, ":%llu\r\n", changed);
+    } else if (is_command(name, length, "ZCARD")) {
+        reply_format(out, ":%llu\r\n", collection ? collection->live : 0);
+    } else if (is_command(name, length, "HMGET")) {
+        reply_format(out, "*%llu\r\n", argc - 2);
+        for (size_t i = 2; i < argc; i++) {
+            long index = collection ? find_member(collection, argv[i], lengths[i]) : -1;
+            const Member *member = index >= 0 ? &collection->members[index] : NULL;
+            reply_bulk(out, member ? member->value : NULL, member ? member->value_length : 0);
+        }
+    } else {
+        reply_members(out, collection, strtoll(argv[2], NULL, 10), strtoll(argv[3], NULL, 10), is_command(name, length, "ZREVRANGE"));
+    }
+}
+
+static int is_collection_command(const char *name, size_t length, size_t argc) {
+    static const struct {
+        const char *name;
+        size_t min_argc;
+    } commands[] = {
+        { "ZADD", 4 }, { "ZREM", 3 }, { "ZCARD", 2 }, { "ZRANGE", 4 }, { "ZREVRANGE", 4 },
+        { "HSET", 4 }, { "HDEL", 3 }, { "HMGET", 3 },
+    };
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        if (is_command(name, length, commands[i].name)) return argc >= commands[i].min_argc;
+    }
+    return 0;
+}
+
+// Like Redis, INFO reports the commands processed before the current one
+static void execute(Buffer *out, char **argv, size_t *lengths, size_t argc) {
+    const char *name = argv[0];
+    size_t length = lengths[0];
+
+    if (is_command(name, length, "PING")) {
+        buffer_append(out, "+PONG\r\n", 7);
+    } else if (is_command(name, length, "GET") && argc == 2) {
+        long index = find_entry(argv[1], lengths[1]);
+        if (index >= 0 && entries[index].item_ends) buffer_append(out, wrong_type, sizeof(wrong_type) - 1);
+        else reply_bulk(out, index >= 0 ? entries[index].value : NULL, index >= 0 ? entries[index].value_length : 0);
+    } else if (is_command(name, length, "RPUSH") && argc >= 3) {
+        long index = push_items(argv[1], lengths[1], argv + 2, lengths + 2, argc - 2);
+        if (index < 0) buffer_append(out, wrong_type, sizeof(wrong_type) - 1);
+        else reply_format(out, ":%llu\r\n", entries[index].item_count);
+    } else if (is_command(name, length, "LLEN") && argc == 2) {
+        long index = find_entry(argv[1], lengths[1]);
+        if (index >= 0 && entries[index].item_ends == NULL) buffer_append(out, wrong_type, sizeof(wrong_type) - 1);
+        else reply_format(out, ":%llu\r\n", index >= 0 ? entries[index].item_count : 0);
+    } else if (is_command(name, length, "LRANGE") && argc == 4) {
+        command_lrange(out, argv, lengths);
+    } else if (is_command(name, length, "SET") && argc >= 3) {
+        // NX is honoured; expiry options are accepted and ignored, as is PEXPIRE below
+        int only_new = 0;
+        for (size_t i = 3; i < argc; i++) only_new |= is_command(argv[i], lengths[i], "NX");
+        if (only_new && find_entry(argv[1], lengths[1]) >= 0) {
+            buffer_append(out, "$-1\r\n", 5);
+        } else {
+            set_key(argv[1], lengths[1], argv[2], lengths[2]);
+            buffer_append(out, "+OK\r\n", 5);
+        }
+    } else if (is_command(name, length, "PEXPIRE") && argc == 3) {
+        reply_format(out, ":%llu\r\n", find_entry(argv[1], lengths[1]) >= 0);
+    } else if (is_command(name, length, "MGET") && argc >= 2) {
+        reply_format(out, "*%llu\r\n", argc - 1);
+        for (size_t i = 1; i < argc; i++) {
+            long index = find_entry(argv[i], lengths[i]);
+            reply_bulk(out, index >= 0 ? entries[index].value : NULL, index >= 0 ? entries[index].value_length : 0);
+        }
+    } else if (is_command(name, length, "MSET") && argc >= 3 && argc % 2 == 1) {
+        for (size_t i = 1; i < argc; i += 2) set_key(argv[i], lengths[i], argv[i + 1], lengths[i + 1]);
+        buffer_append(out, "+OK\r\n", 5);
+    } else if ((is_command(name, length, "DEL") || is_command(name, length, "UNLINK")) && argc >= 2) {
+        unsigned long long deleted = 0;
+        for (size_t i = 1; i < argc; i++) deleted += delete_key(argv[i], lengths[i]);
+        reply_format(out, ":%llu\r\n", deleted);
+    } else if (is_command(name, length, "EXISTS") && argc >= 2) {
+        unsigned long long found = 0;
+        for (size_t i = 1; i < argc; i++) found += find_entry(argv[i], lengths[i]) >= 0;
+        reply_format(out, ":%llu\r\n", found);
+    } else if (is_collection_command(name, length, argc)) {
+        command_collection(out, argv, lengths, argc);
+    } else if (is_command(name, length, "ZRANGEBYSCORE") && argc >= 4) {
+        command_zrangebyscore(out, argv, lengths, argc);
+    } else if (is_command(name, length, "RENAME") && argc == 3) {
+        if (rename_key(argv[1], lengths[1], argv[2], lengths[2])) buffer_append(out, "+OK\r\n", 5);
+        else buffer_append(out, "-ERR no such key\r\n", 19);
+    } else if (is_command(name, length, "SCAN") && argc >= 2) {
+        command_scan(out, argv, lengths, argc);
+    } else if (is_command(name, length, "DBSIZE")) {
+        reply_format(out, ":%llu\r\n", live_count);
+    } else if (is_command(name, length, "FLUSHALL") || is_command(name, length, "FLUSHDB")) {
+        flush_all();
+        buffer_append(out, "+OK\r\n", 5);
+    } else if (is_command(name, length, "INFO")) {
+        char info[128];
+        int info_length = snprintf(info, sizeof(info), "# Stats\r\ntotal_commands_processed:%llu\r\n", commands_processed);
+        reply_bulk(out, info, (size_t)info_length);
+    } else {
+        char error[128];
+        int error_length = snprintf(error, sizeof(error), "-ERR unknown command '%.*s'\r\n", (int)(length < 32 ? length : 32), name);
+        buffer_append(out, error, (size_t)error_length);
+    }
+    commands_processed++;
+}
+
+// --- Connections -----------------------------------------------------------------------------
+
+typedef struct {
+    int fd;
+    Buffer in;
+    Buffer out;
+} Client;
+
+static char **argv_buffer = NULL;
+static size_t *length_buffer = NULL;
+static size_t argv_capacity = 0;
+
+static const char *read_line(const char *p, const char *end, long long *value) {
+    const char *crlf = p;
+    while (crlf + 1 < end && !(crlf[0] == '\r' && crlf[1] == '\n')) crlf++;
+    if (crlf + 1 >= end) return NULL;
+    *value = strtoll(p, NULL, 10);
+    return crlf + 2;
+}
+
+// Execute every complete command in the input buffer; returns -1 on a protocol error
+static int process_input(Client *client) {
+    const char *p = client->in.data;
+    const char *end = client->in.data + client->in.length;
+
+    while (p < end) {
+        if (*p != '*') return -1;  // hiredis always sends multibulk requests
+        long long argc;
+        const char *q = read_line(p + 1, end, &argc);
+        if (q == NULL) break;
+        if (argc <= 0) return -1;
+        if ((size_t)argc > argv_capacity) {
+            argv_capacity = (size_t)argc * 2;
+            argv_buffer = realloc(argv_buffer, argv_capacity * sizeof(char *));
+            length_buffer = realloc(length_buffer, argv_capacity * sizeof(size_t));
+            if (argv_buffer == NULL || length_buffer == NULL) _exit(1);
+        }
+
+        long long i = 0;
+        for (; i < argc; i++) {
+            long long length;
+            if (q >= end || *q != '$') break;
+            const char *data = read_line(q + 1, end, &length);
+            if (data == NULL || length < 0 || data + length + 2 > end) break;
+            argv_buffer[i] = (char *)data;
+            length_buffer[i] = (size_t)length;
+            q = data + length + 2;
+        }
+        if (i < argc) {
+            if (q < end && *q != '$') return -1;
+            break;  // Incomplete; wait for more input
+        }
+
+        // Arguments are CRLF-terminated in the buffer; terminate them for strtoull and friends
+        for (long long a = 0; a < argc; a++) argv_buffer[a][length_buffer[a]] = '\0';
+        execute(&client->out, argv_buffer, length_buffer, (size_t)argc);
+        p = q;
+    }
+
+    size_t consumed = (size_t)(p - client->in.data);
+    memmove(client->in.data, p, client->in.length - consumed);
+    client->in.length -= consumed;
+    return 0;
+}
+
+static int flush_output(Client *client) {
+    size_t written = 0;
+    while (written < client->out.length) {
+        ssize_t n = write(client->fd, client->out.data + written, client->out.length - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        written += (size_t)n;
+    }
+    client->out.length = 0;
+    return 0;
+}
+
+static void close_client(Client *client) {
+    close(client->fd);
+    free(client->in.data);
+    free(client->out.data);
+    memset(client, 0, sizeof(*client));
+    client->fd = -1;
+}
+
+static void serve(int listen_fd) {
+    Client clients[MAX_CLIENTS];
+    struct pollfd fds[MAX_CLIENTS + 1];
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        memset(&clients[i], 0, sizeof(Client));
+        clients[i].fd = -1;
+    }
+
+    for (;;) {
+        fds[0].fd = listen_fd;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            fds[i + 1].fd = clients[i].fd;
+            fds[i + 1].events = POLLIN;
+        }
+        if (poll(fds, MAX_CLIENTS + 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            _exit(1);
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listen_fd, NULL, NULL);
+            int slot = 0;
+            while (slot < MAX_CLIENTS && clients[slot].fd >= 0) slot++;
+            if (fd >= 0 && slot < MAX_CLIENTS) {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                clients[slot].fd = fd;
+            } else if (fd >= 0) {
+                close(fd);
+            }
+        }
+
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            Client *client = &clients[i];
+            if (client->fd < 0 || !(fds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+
+            if (client->in.capacity - client->in.length < READ_CHUNK) {
+                client->in.capacity = client->in.capacity * 2 + READ_CHUNK;
+                client->in.data = realloc(client->in.data, client->in.capacity);
+                if (client->in.data == NULL) _exit(1);
+            }
+            ssize_t n = read(client->fd, client->in.data + client->in.length, READ_CHUNK);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) continue;
+                close_client(client);
+                continue;
+            }
+            client->in.length += (size_t)n;
+            if (process_input(client) < 0 || flush_output(client) < 0) close_client(client);
+        }
+    }
+}
+
+int fake_redis_start(FakeRedis *server) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t address_length = sizeof(address);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 16) != 0 ||
+        getsockname(fd, (struct sockaddr *)&address, &address_length) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fd);
+        return -1;
+    }
+    if (pid == 0) {
+        serve(fd);
+        _exit(0);
+    }
+    close(fd);
+    server->pid = pid;
+    server->port = ntohs(address.sin_port);
+    return 0;
+}
+
+void fake_redis_stop(FakeRedis *server) {
+    if (server->pid <= 0) return;
+    kill(server->pid, SIGTERM);
+    waitpid(server->pid, NULL, 0);
+    server->pid = 0;
+}
@@ -0,0 +1,18 @@
+#ifndef FAKE_REDIS_H
+#define FAKE_REDIS_H
+
+#include <sys/types.h>
+
+// Minimal RESP2 server for benchmarks: strings and lists, with the commands the archiver's
+// list, mutation, delete and thread detail paths use. It runs in a child process so its memory stays
+// out of the benchmark's RSS.
+
+typedef struct {
+    pid_t pid;
+    int port;
+} FakeRedis;
+
+int fake_redis_start(FakeRedis *server);  // Listens on 127.0.0.1 with an ephemeral port
+void fake_redis_stop(FakeRedis *server);
+
+#endif
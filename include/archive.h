@@ -0,0 +1,52 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "redis_operations.h"
+
+// Append-only archive of one board's threads, read through a read-only mapping.
+// <path> holds the thread records, <path>.idx the thread-id -> offset index sorted by id.
+
+typedef struct Archive Archive;
+
+// One archived thread; every pointer refers into the mapping and lives as long as the Archive
+typedef struct {
+    uint64_t id;
+    const char *title;
+    const char *status;
+    uint32_t post_count;
+    int64_t archived_at;      // Unix time the thread was written to the archive
+    const uint32_t *post_ends;
+    const char *posts;
+} ArchiveThread;
+
+Archive *archive_open(const char *path);
+void archive_close(Archive *archive);
+size_t archive_thread_count(const Archive *archive);
+int archive_thread_at(const Archive *archive, size_t index, ArchiveThread *thread);  // In thread-id order
+int archive_find(const Archive *archive, uint64_t id, ArchiveThread *thread);
+const char *archive_thread_post(const ArchiveThread *thread, uint32_t index, size_t *length);  // NUL-terminated JSON
+
+// One writer per file at a time, across threads and processes; commit makes appends durable
+// and visible to new readers
+typedef struct ArchiveWriter ArchiveWriter;
+
+ArchiveWriter *archive_writer_open(const char *path);
+int archive_writer_add(ArchiveWriter *writer, uint64_t id, const char *title, const char *status,
+                       const char *const *posts, const size_t *lengths, uint32_t post_count);
+int archive_writer_commit(ArchiveWriter *writer);
+void archive_writer_close(ArchiveWriter *writer);
+
+typedef struct {
+    unsigned moved;
+    unsigned missing;   // No longer in Redis
+    unsigned posts;
+    size_t bytes;       // Record bytes appended to the archive
+} ArchiveMoveStats;
+
+void format_archive_path(char *buf, size_t size, const char *dir, const char *board);
+int archive_move_threads(const char *board, const char *path, char (*ids)[THREAD_ID_MAX], size_t n,
+                         const int *cancelled, ArchiveMoveStats *stats);
+
+#endif
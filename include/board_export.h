@@ -0,0 +1,33 @@
+#ifndef BOARD_EXPORT_H
+#define BOARD_EXPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A board's threads and posts streamed to one file and back, to back up or move a single board
+// without a whole-instance Redis dump. Posts are written decoded, so a file imports into any
+// board or server whatever its compression settings. Layout, little-endian throughout:
+//   "FCBOARD1" | uint32 version | uint32 flags
+//   then records, inside one zstd stream when flags has BOARD_EXPORT_ZSTD:
+//   uint32 type | uint32 length | payload[length] | uint32 FNV-1a of type, length and payload
+// Types: BORD (the board name), THRD (one thread), END (thread and post counts, so a cut-short
+// file is caught). A THRD payload is
+//   uint64 id | uint32 count | uint32 post_count | uint32 title length | title |
+//   uint32 status length | status | post_count x (uint32 length | post JSON)
+
+#define BOARD_EXPORT_ZSTD 1u
+
+typedef struct {
+    char board[64];          // Board named in the file; for import, where it was exported from
+    uint64_t threads;
+    uint64_t posts;
+    uint64_t post_bytes;     // Post JSON, decoded
+    uint64_t file_bytes;
+    unsigned round_trips;
+} BoardExportStats;
+
+int board_export(const char *board, const char *path, unsigned flags, int scan_count, int batch, const int *cancelled,
+                 BoardExportStats *stats);
+int board_import(const char *board, const char *path, int batch, const int *cancelled, BoardExportStats *stats);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef BOARD_INDEX_H
+#define BOARD_INDEX_H
+
+#include <stddef.h>
+#include "redis_operations.h"
+
+// Sorted indexes of a board's threads, kept in Redis next to the thread keys, so a list
+// sorted by ID, post count or status is read a page at a time with ZRANGE instead of walking
+// the whole board with SCAN. Every key shares the {<board>_index} hash tag, so on a cluster
+// they live on one node and a page costs two round trips there:
+//   {<board>_index}_id       sorted set, thread ID scored by the ID
+//   {<board>_index}_count    sorted set, thread ID scored by the post count
+//   {<board>_index}_status   sorted set, thread ID scored by the status (see board_index_status_score)
+//   {<board>_index}_threads  hash, thread ID -> "<count>\t<status>\t<title>", the row shown for it
+
+typedef enum {
+    BOARD_INDEX_BY_ID,
+    BOARD_INDEX_BY_COUNT,
+    BOARD_INDEX_BY_STATUS,
+} BoardIndexOrder;
+
+typedef struct {
+    size_t threads;
+    unsigned round_trips;
+} BoardIndexStats;
+
+void format_board_index_key(char *buf, size_t size, const char *board, const char *name);
+const char *board_index_order_name(BoardIndexOrder order);
+int parse_board_index_order(const char *name, BoardIndexOrder *order);
+double board_index_status_score(const char *status);
+void deliver_index_rows(char (*ids)[THREAD_ID_MAX], size_t n, const redisReply *rows, thread_record_fn fn, void *user_data);
+
+int board_index_refresh(const char *board, const char *const *ids, size_t n);
+int board_index_refresh_all(const char *board, int batch);
+int board_index_rebuild(const char *board, int scan_count, int batch, const int *cancelled, BoardIndexStats *stats);
+int fetch_board_index_page(const char *board, BoardIndexOrder order, int descending, long start, long count,
+                           thread_record_fn fn, void *user_data, long long *total);
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef CLI_H
+#define CLI_H
+
+// Headless entry point: runs one command against the data layer and exits; argv[0] is ignored
+int cli_main(int argc, char *argv[]);
+
+#endif
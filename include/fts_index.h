@@ -0,0 +1,38 @@
+#ifndef FTS_INDEX_H
+#define FTS_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Full-text index over post text, kept on disk as immutable segments in one directory per board
+
+typedef struct FtsIndex FtsIndex;
+
+typedef struct {
+    uint64_t thread_id;
+    uint64_t post_no;         // Best-scoring post of the thread
+    double score;
+    unsigned matching_posts;
+} FtsHit;
+
+typedef struct {
+    size_t segments;
+    size_t threads;
+    size_t posts;
+    size_t terms;             // Summed over segments
+    size_t bytes;             // Segment files on disk
+    size_t pending_posts;     // Added but not committed yet
+} FtsIndexStats;
+
+FtsIndex *fts_index_open(const char *dir);
+void fts_index_close(FtsIndex *index);
+int fts_index_add_thread(FtsIndex *index, uint64_t thread_id, const char *const *posts, const size_t *lengths, size_t n);
+int fts_index_remove_thread(FtsIndex *index, uint64_t thread_id);
+int fts_index_commit(FtsIndex *index);
+int fts_index_clear(FtsIndex *index);
+size_t fts_index_search(FtsIndex *index, const char *query, FtsHit *hits, size_t max, size_t *total);
+void fts_index_stats(FtsIndex *index, FtsIndexStats *stats);
+
+int fts_index_add_from_redis(FtsIndex *index, const char *board, const char *const *thread_ids, size_t n);
+
+#endif
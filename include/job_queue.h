@@ -0,0 +1,66 @@
+#ifndef JOB_QUEUE_H
+#define JOB_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define JOB_NAME_MAX 32
+#define JOB_BOARD_MAX 64
+#define JOB_THREAD_MAX 32
+
+typedef enum {
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_SUCCEEDED,
+    JOB_FAILED,
+    JOB_CANCELLED,
+    JOB_SKIPPED   // The job's check said there was nothing to do
+} JobState;
+
+// Copy of a job's public state, safe to keep after the queue lock is released
+typedef struct {
+    unsigned id;
+    JobState state;
+    char name[JOB_NAME_MAX];
+    char board[JOB_BOARD_MAX];
+    char thread_id[JOB_THREAD_MAX];  // Empty for board-wide jobs
+    int exit_code;                   // Valid once the command has run, -1 if it was killed
+    int used_runner;                 // Run by the job's run hook rather than as a new process
+    int64_t queued_at_ms;            // Monotonic times; started/finished are 0 until reached
+    int64_t started_at_ms;
+    int64_t finished_at_ms;
+} JobInfo;
+
+// All callbacks run on a worker thread
+typedef void (*job_output_fn)(unsigned job_id, const char *line, void *user_data);
+typedef void (*job_done_fn)(const JobInfo *job, void *user_data);
+typedef int (*job_check_fn)(const char *board, const char *thread_id, void *user_data);  // Nonzero skips the job
+typedef void (*job_change_fn)(void *user_data);
+
+// Optional replacement for executing argv; *cancelled becomes nonzero when the job is cancelled.
+// Returns the exit code, or JOB_RUN_UNAVAILABLE to have argv executed as usual.
+#define JOB_RUN_UNAVAILABLE (-2)
+typedef int (*job_run_fn)(unsigned job_id, char *const *argv, const int *cancelled, void *user_data);
+
+typedef struct {
+    const char *name;        // Command name; with board, thread_id and argv, the deduplication key
+    const char *board;
+    const char *thread_id;   // NULL for board-wide jobs
+    char *const *argv;       // NULL-terminated, copied by job_queue_submit
+    job_run_fn run;          // Optional
+    job_check_fn check;      // Optional
+    job_done_fn on_done;     // Optional
+    void *user_data;
+} JobSpec;
+
+int job_queue_init(int workers, job_output_fn on_output, job_change_fn on_change, void *user_data);
+void job_queue_shutdown();
+unsigned job_queue_submit(const JobSpec *spec);
+int job_queue_cancel(unsigned job_id);
+size_t job_queue_list(JobInfo *out, size_t max);
+void job_queue_clear_finished();
+void job_queue_output(unsigned job_id, const char *line);
+const char *job_state_name(JobState state);
+int64_t job_now_ms();
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef JSON_SCAN_H
+#define JSON_SCAN_H
+
+#include <stddef.h>
+
+// Growable, NUL-terminated output buffer
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} JsonBuffer;
+
+int json_append(JsonBuffer *buffer, const char *text, size_t length);
+int json_append_string(JsonBuffer *buffer, const char *text);
+
+const char *json_skip_space(const char *p);
+const char *json_parse_string(const char *p, char *out, size_t size);
+const char *json_skip_value(const char *p);
+const char *json_object_find(const char *object, const char *key);
+
+#endif
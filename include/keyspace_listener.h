@@ -0,0 +1,14 @@
+#ifndef KEYSPACE_LISTENER_H
+#define KEYSPACE_LISTENER_H
+
+#include <stddef.h>
+
+// Called on the listener thread for every keyspace event on a board's _title/_count/_status keys
+typedef void (*keyspace_event_fn)(const char *key, const char *event, void *user_data);
+
+int keyspace_listener_start(const char *endpoints, const char *const *boards, size_t board_count,
+                            keyspace_event_fn on_event, void *user_data);
+void keyspace_listener_stop();
+int keyspace_listener_is_active();
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_LINE_MAX 512  // Longer lines are truncated, keeping their newline
+
+typedef struct {
+    uint64_t written;  // Lines accepted since start
+    uint64_t dropped;  // Lines rejected because the ring was full
+    uint64_t drained;  // Lines handed to the consumer
+} LogRingStats;
+
+int log_ring_init(size_t capacity);
+int log_ring_write(const char *line, size_t len);
+int log_ring_is_empty();
+size_t log_ring_drain(char *dest, size_t dest_size);
+void log_ring_stats(LogRingStats *stats);
+
+#endif
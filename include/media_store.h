@@ -0,0 +1,32 @@
+#ifndef MEDIA_STORE_H
+#define MEDIA_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Disk tier of the media cache. Downloads are stored once per content under
+// <dir>/objects/<first two hex digits>/<content hash>, and <dir>/urls/<URL hash> names the
+// content a URL returned. Both count against a byte cap and are trimmed beyond it, least
+// recently used first; a URL entry goes with the object it names.
+
+typedef struct {
+    unsigned char *data;
+    size_t length;
+    int from_disk;   // Served by the disk cache rather than downloaded
+} MediaBlob;
+
+typedef struct {
+    uint64_t disk_hits;
+    uint64_t downloads;
+    uint64_t failures;
+    uint64_t trimmed;      // Objects deleted to stay under the cap
+    uint64_t disk_bytes;
+} MediaStoreStats;
+
+int media_store_init(const char *dir, size_t max_bytes);
+int media_store_fetch(const char *url, MediaBlob *blob);
+void media_blob_free(MediaBlob *blob);
+void media_store_stats(MediaStoreStats *stats);
+void format_thumbnail_url(char *buf, size_t size, const char *board, const char *tim);
+
+#endif
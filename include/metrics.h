@@ -0,0 +1,62 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Latency histograms for the operations that make up a refresh. Recording is off unless
+// metrics_enabled is set; then each timed section costs two clock reads and a few atomic adds.
+
+typedef enum {
+    METRIC_REDIS_COMMAND,    // Blocking command on a pooled connection, send to reply
+    METRIC_REDIS_PIPELINE,   // Wait for one reply of a pipelined batch
+    METRIC_REDIS_ASYNC,      // Main-loop command, send to reply callback
+    METRIC_SCRAPER_EXEC,     // Scraper process started for one job (docker exec), start to exit
+    METRIC_SCRAPER_RPC,      // Request to the persistent scraper worker, send to result
+    METRIC_SCRAPER_BACKEND,  // Python run time of that request, as reported by the worker
+    METRIC_LIST_REBUILD,     // Thread list model refilter or sync
+    METRIC_OUTPUT_DRAIN,     // Output pane drain, once per frame
+    METRIC_UPDATE_FLUSH,     // Keyspace-event update flush
+    METRIC_MEDIA_FETCH,      // Thumbnail download, disk cache misses only
+    METRIC_THUMBNAIL_DECODE, // Thumbnail decode and scale on a decode worker
+    METRIC_POST_DECODE,      // Decompression of one stored post
+    METRIC_THREAD_LISTING,   // Board listing, start to the end of the SCAN or the first index page
+    METRIC_COUNT
+} MetricId;
+
+typedef struct {
+    const char *name;   // Prometheus-style, e.g. "redis_command"
+    const char *label;  // For the Stats dialog
+    uint64_t count;
+    double sum_ms;
+    double max_ms;
+    double p50_ms;
+    double p90_ms;
+    double p99_ms;
+    double p999_ms;
+} MetricSummary;
+
+extern int metrics_enabled;  // From settings; may be flipped at runtime
+
+uint64_t metrics_now_ns();
+void metrics_record_ns(MetricId id, uint64_t elapsed_ns);
+
+// Start a timed section; 0 when recording is off, which metrics_end ignores
+static inline uint64_t metrics_begin() {
+    return __atomic_load_n(&metrics_enabled, __ATOMIC_RELAXED) ? metrics_now_ns() : 0;
+}
+
+static inline void metrics_end(MetricId id, uint64_t started_ns) {
+    if (started_ns) metrics_record_ns(id, metrics_now_ns() - started_ns);
+}
+
+void metrics_summarize(MetricId id, MetricSummary *summary);
+void metrics_reset();
+void metrics_write_prometheus(FILE *out);
+
+// Write the Prometheus text every interval_s seconds to a file (replaced atomically), or
+// serve it to each client of a local socket given as "unix:/path"
+int metrics_export_start(const char *target, int interval_s);
+void metrics_export_stop();
+
+#endif
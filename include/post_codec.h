@@ -0,0 +1,65 @@
+#ifndef POST_CODEC_H
+#define POST_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "redis_operations.h"
+
+// Optional zstd compression of the entries of <board><id>_posts lists. A compressed entry is
+// POST_CODEC_MAGIC followed by one zstd frame; anything else is an entry stored as-is. The
+// magic byte doubles as the format version and can never start a plain entry, which is UTF-8
+// JSON. Frames are compressed with the board's trained dictionary, whose ID each frame
+// carries, so entries written under an older dictionary still decode after a retrain.
+//   {<board>_zstd}_dicts  hash: "<dictionary ID>" -> dictionary, "current" -> ID used for writes
+// Only native ingest and board import encode as they write. The scraper, run through the
+// worker or docker exec for adds and update_stored_threads, always writes plain entries;
+// post_codec_recompress converts them later.
+
+#define POST_CODEC_MAGIC 0xFC
+
+// Per board, since this process started
+typedef struct {
+    char board[64];
+    uint32_t dictionary_id;      // Used for writes; 0 without a trained dictionary
+    uint64_t encoded;            // Entries compressed
+    uint64_t encoded_in_bytes;
+    uint64_t encoded_out_bytes;
+    uint64_t decoded;            // Compressed entries read back
+    uint64_t decoded_in_bytes;
+    uint64_t decoded_out_bytes;
+    uint64_t decode_ns;
+} PostCodecStats;
+
+typedef struct {
+    size_t threads;
+    size_t rewritten;            // Threads whose list was written back
+    uint64_t posts;
+    uint64_t bytes_before;       // Of every list read, as stored
+    uint64_t bytes_after;
+    uint32_t dictionary_id;
+    unsigned round_trips;
+} PostRecompressStats;
+
+void format_post_dict_key(char *buf, size_t size, const char *board);
+int post_codec_is_compressed(const char *value, size_t length);
+
+int post_codec_encode(const char *board, const char *text, size_t length, char **out, size_t *out_length);
+int post_codec_decode(const char *board, const char *value, size_t length, char **out, size_t *out_length);
+int post_codec_decode_all(const char *board, const char **posts, size_t *lengths, size_t n, char ***decoded);
+void post_codec_free_decoded(char **decoded, size_t n);
+int post_codec_decode_page(const char *board, ThreadPostPage *page);
+
+// For callers that can't block on Redis: a dictionary the page needs and that isn't loaded
+// yet (0 for none), and a way to hand it over once fetched
+uint32_t post_codec_missing_dictionary(const char *board, const ThreadPostPage *page);
+int post_codec_add_dictionary(const char *board, uint32_t id, const char *data, size_t length);
+
+int post_codec_recompress(const char *board, int retrain, int scan_count, int batch, const int *cancelled,
+                          PostRecompressStats *stats);
+void post_codec_reload_current(const char *board);  // Re-read "current" before the next write
+
+size_t post_codec_stats(PostCodecStats *stats, size_t max);
+void post_codec_format_stats(const PostCodecStats *stats, char *out, size_t size);
+void post_codec_shutdown();
+
+#endif
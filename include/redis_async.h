@@ -0,0 +1,45 @@
+#ifndef REDIS_ASYNC_H
+#define REDIS_ASYNC_H
+
+#include <stddef.h>
+#include <hiredis/async.h>
+#include "redis_operations.h"
+#include "board_index.h"
+
+// Non-blocking connections to one server or cluster, driven by the GTK main loop
+typedef struct RedisAsync RedisAsync;
+
+// Called on the main loop whenever the connection (re)connects
+typedef void (*redis_async_connected_fn)(RedisAsync *connection, void *user_data);
+
+RedisAsync *redis_async_new(const char *endpoints, int timeout_ms, int read_replicas,
+                            redis_async_connected_fn on_connected, void *user_data);
+void redis_async_free(RedisAsync *connection);
+int redis_async_is_connected(RedisAsync *connection);
+int redis_async_command(RedisAsync *connection, const char *key, RedisRoute route, redisCallbackFn *fn, void *privdata,
+                        const char *format, ...);
+int redis_async_command_argv(RedisAsync *connection, const char *key, RedisRoute route, redisCallbackFn *fn, void *privdata,
+                             int argc, const char **argv, const size_t *argvlen);
+typedef struct RedisThreadListing RedisThreadListing;
+typedef void (*listing_done_fn)(int complete, unsigned threads, unsigned round_trips, void *user_data);
+
+RedisThreadListing *redis_async_list_threads(RedisAsync *connection, const char *board, int scan_count, int batch,
+                                             thread_record_fn on_record, listing_done_fn on_done, void *user_data);
+void redis_async_cancel_listing(RedisThreadListing *listing);
+int redis_async_fetch_threads(RedisAsync *connection, const char *board, char (*ids)[THREAD_ID_MAX], size_t n,
+                              thread_record_fn on_record, void *user_data);
+typedef struct RedisIndexPage RedisIndexPage;
+typedef void (*index_page_fn)(int ok, long long total, size_t count, void *user_data);
+
+RedisIndexPage *redis_async_fetch_index_page(RedisAsync *connection, const char *board, BoardIndexOrder order, int descending,
+                                             long start, long count, thread_record_fn on_record, index_page_fn on_done,
+                                             void *user_data);
+void redis_async_cancel_index_page(RedisIndexPage *page);
+typedef void (*post_page_fn)(int ok, ThreadPostPage *page, void *user_data);
+
+int redis_async_fetch_posts(RedisAsync *connection, const char *board, const char *thread_id, long start, long count,
+                            post_page_fn fn, void *user_data);
+void redis_async_start_stall_probe();
+double redis_async_take_max_stall_ms();
+
+#endif
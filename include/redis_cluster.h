@@ -0,0 +1,55 @@
+#ifndef REDIS_CLUSTER_H
+#define REDIS_CLUSTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <hiredis/hiredis.h>
+
+// Where commands go. A single server is one primary, optionally with read replicas listed
+// after it; a Redis Cluster spreads the keys over 16384 hash slots, each served by a primary
+// and its replicas. Shared by the worker pool and the main loop's connections.
+
+#define REDIS_CLUSTER_SLOTS 16384
+#define REDIS_NODES_MAX 64
+
+typedef enum {
+    REDIS_ROUTE_PRIMARY,  // Writes, and reads that must see them
+    REDIS_ROUTE_READ,     // Reads that may lag behind; served by a replica when read_from_replicas is on
+} RedisRoute;
+
+typedef struct {
+    char host[256];
+    int port;
+} RedisEndpoint;
+
+typedef struct {
+    RedisEndpoint endpoint;
+    int primary;  // Node index of the replica's primary, -1 for primaries
+} RedisNode;
+
+typedef struct {
+    int refs;
+    int cluster;          // 0 for a single server: node 0 is the primary, every other node a replica of it
+    int read_replicas;    // Route REDIS_ROUTE_READ to replicas
+    size_t node_count;
+    RedisNode nodes[REDIS_NODES_MAX];
+    uint16_t slot_primary[REDIS_CLUSTER_SLOTS];  // Cluster only: node index serving each slot
+} RedisTopology;
+
+unsigned redis_key_slot(const char *key, size_t length);
+size_t redis_parse_endpoints(const char *list, RedisEndpoint *endpoints, size_t max);
+int redis_endpoint_equal(const RedisEndpoint *a, const RedisEndpoint *b);
+int redis_parse_redirect(const char *error, int *ask, RedisEndpoint *target);
+
+// Topologies are shared read-only once built; whoever replaces one drops its reference
+RedisTopology *redis_topology_standalone(const RedisEndpoint *endpoints, size_t count, int read_replicas);
+RedisTopology *redis_topology_from_slots(const redisReply *reply, const char *queried_host, int read_replicas);
+RedisTopology *redis_topology_discover(const RedisEndpoint *seeds, size_t count, int timeout_ms, int read_replicas);
+RedisTopology *redis_topology_ref(RedisTopology *topology);
+void redis_topology_unref(RedisTopology *topology);
+
+int redis_topology_find(const RedisTopology *topology, const RedisEndpoint *endpoint);
+int redis_topology_route(const RedisTopology *topology, unsigned slot, RedisRoute route);
+size_t redis_topology_scan_nodes(const RedisTopology *topology, RedisRoute route, unsigned spread, int *nodes, size_t max);
+
+#endif
@@ -1,13 +1,83 @@
 #ifndef REDIS_OPERATIONS_H
 #define REDIS_OPERATIONS_H
 
+#include <stddef.h>
 #include <hiredis/hiredis.h>
+#include "thread_snapshot.h"
+#include "redis_cluster.h"
 
-void redis_connect();  // Updated function name
-void fetch_thread_list();
-void fetch_thread_details(const char *thread_id);
-void update_thread_title(const char *thread_id, const char *new_title);
-void delete_thread(const char *thread_id);
-void delete_message(const char *thread_id, const char *message_id);
+#define THREAD_ID_MAX 32
+
+// Receives one thread's fields; title is NULL when the thread no longer exists
+typedef void (*thread_record_fn)(const char *thread_id, const char *title, int count, const char *status, void *user_data);
+
+// Connection pool shared by every thread that needs synchronous Redis access. endpoints is
+// "host:port[,host:port...]": the seeds of a cluster, or a server followed by its replicas.
+int redis_pool_init(const char *endpoints, int size, int timeout_ms, int read_replicas);
+void redis_pool_shutdown();
+redisContext *redis_pool_acquire();
+redisContext *redis_pool_acquire_for_key(const char *key, RedisRoute route);
+redisContext *redis_pool_acquire_endpoint(const RedisEndpoint *endpoint);
+size_t redis_pool_scan_nodes(RedisRoute route, RedisEndpoint *endpoints, size_t max);
+int redis_pool_is_cluster();
+void redis_pool_topology_changed();
+void redis_pool_release(redisContext *context);
+
+// Commands for any number of keys, sent as one pipeline per node that owns them; MOVED and
+// ASK redirects are followed. Replies stay owned by the batch and come back in append order.
+typedef struct RedisBatch RedisBatch;
+
+RedisBatch *redis_batch_new(RedisRoute route);
+void redis_batch_free(RedisBatch *batch);
+void redis_batch_clear(RedisBatch *batch);
+size_t redis_batch_append(RedisBatch *batch, const char *key, const char *format, ...);
+size_t redis_batch_append_argv(RedisBatch *batch, const char *key, int argc, const char **argv, const size_t *argvlen);
+size_t redis_batch_append_keys(RedisBatch *batch, const char *command, const char *const *keys, size_t n);
+size_t redis_batch_count(const RedisBatch *batch);
+int redis_batch_is_cluster(const RedisBatch *batch);
+int redis_batch_execute(RedisBatch *batch);
+unsigned redis_batch_round_trips(const RedisBatch *batch);
+redisReply *redis_batch_reply(const RedisBatch *batch, size_t index);
+
+// Timed wrappers around hiredis's blocking calls; use these for every command on a pooled connection
+redisReply *redis_command(redisContext *context, const char *format, ...);
+redisReply *redis_command_argv(redisContext *context, int argc, const char **argv, const size_t *argvlen);
+int redis_get_reply(redisContext *context, redisReply **reply);
+
+// Key layout used by the scraper: <board><thread_id>_<field>
+void format_thread_key(char *buf, size_t size, const char *board, const char *thread_id, const char *field);
+void format_title_pattern(char *buf, size_t size, const char *board);
+int extract_thread_id(const char *key, char *thread_id, size_t size);
+int build_thread_fields_argv(const char *board, char (*ids)[THREAD_ID_MAX], size_t n, const char ***argv);
+void free_thread_fields_argv(const char **argv, int argc);
+void deliver_thread_values(const char *const *values, char (*ids)[THREAD_ID_MAX], size_t n, thread_record_fn fn, void *user_data);
+void deliver_thread_fields(redisReply *reply, char (*ids)[THREAD_ID_MAX], size_t n, thread_record_fn fn, void *user_data);
+size_t redis_batch_append_thread_fields(RedisBatch *batch, const char *board, char (*ids)[THREAD_ID_MAX], size_t n);
+const redisReply *redis_batch_thread_field(const RedisBatch *batch, size_t first, size_t n, size_t thread, int field);
+void redis_batch_deliver_thread_fields(const RedisBatch *batch, size_t first, char (*ids)[THREAD_ID_MAX], size_t n,
+                                       thread_record_fn fn, void *user_data);
+
+// Posts [start, start + count) of a thread's <board><id>_posts list, each the JSON of one post
+typedef struct {
+    long long total;   // Posts in the list when the page was read; 0 if the thread has none in Redis
+    long start;
+    size_t count;
+    char **posts;
+    size_t *lengths;
+} ThreadPostPage;
+
+int thread_post_page_from_replies(const redisReply *llen, const redisReply *lrange, long start, ThreadPostPage *page);
+int thread_posts_are_string(const redisReply *llen);
+int thread_post_page_from_string(const redisReply *get, long start, ThreadPostPage *page);
+void thread_post_page_free(ThreadPostPage *page);
+
+// One SCAN step on a node; NULL (with the reason printed) if it failed
+redisReply *redis_scan_step(const RedisEndpoint *node, const char *cursor, const char *pattern, int count);
+ThreadSnapshot *fetch_thread_list(const char *board, int scan_count, int batch);
+int fetch_thread_record(const char *board, const char *thread_id, thread_record_fn fn, void *user_data);
+int fetch_thread_details(const char *board, const char *thread_id, long start, long count, ThreadPostPage *page);
+int update_thread_title(const char *board, const char *thread_id, const char *new_title);
+int delete_thread(const char *board, const char *thread_id);
+int delete_message(const char *board, const char *thread_id, const char *post_no);
 
 #endif
@@ -0,0 +1,37 @@
+#ifndef SCRAPER_JOBS_H
+#define SCRAPER_JOBS_H
+
+#include <stddef.h>
+#include "job_queue.h"
+#include "fts_index.h"
+
+// The commands the archiver queues, shared by the window and the headless CLI.
+// Each submit returns the job ID (an existing one for a duplicate), 0 on failure.
+
+#define SCRAPER_ARGV "/usr/bin/docker", "exec", "4chan_scraper-scraper-1", "python", "FourChanScraper.py"
+
+void scraper_jobs_start_worker();  // Long-lived scraper backend chosen by the scraper_worker setting
+
+unsigned submit_add_thread(const char *board, const char *thread_id, job_done_fn on_done, void *user_data);
+unsigned submit_delete_thread(const char *board, const char *thread_id, job_done_fn on_done, void *user_data);
+unsigned submit_set_title(const char *board, const char *thread_id, const char *title, job_done_fn on_done, void *user_data);
+unsigned submit_update_threads(const char *board, job_done_fn on_done, void *user_data);
+unsigned submit_generate_audio(const char *board, const char *thread_id, job_check_fn check, job_done_fn on_done, void *user_data);
+unsigned submit_archive_move(const char *board, const char *thread_id, const char *const *ids, size_t n,
+                             job_done_fn on_done, void *user_data);
+unsigned submit_index_rebuild(const char *board, job_done_fn on_done, void *user_data);
+unsigned submit_index_threads(const char *board, const char *const *ids, size_t n, job_done_fn on_done, void *user_data);
+unsigned submit_board_index_rebuild(const char *board, job_done_fn on_done, void *user_data);
+unsigned submit_post_recompress(const char *board, int retrain, job_done_fn on_done, void *user_data);
+unsigned submit_board_export(const char *board, const char *path, int compress, job_done_fn on_done, void *user_data);
+unsigned submit_board_import(const char *board, const char *path, job_done_fn on_done, void *user_data);
+
+// How a finished job ran: "native ingest", "scraper worker", "docker exec" or "built-in"
+const char *job_transport(const JobInfo *job);
+int format_job_timing(const JobInfo *job, char *out, size_t size);  // 0 when there is nothing to report
+
+FtsIndex *board_search_index(const char *board);  // Opened on first use, kept until exit
+void update_search_index(const JobInfo *job);    // Follows a finished add, delete, update or import
+void update_board_index(const JobInfo *job);     // Follows a finished add, delete, title change or update
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef SCRAPER_RPC_H
+#define SCRAPER_RPC_H
+
+#include <stdint.h>
+
+#define SCRAPER_RPC_UNAVAILABLE (-2)  // No worker to take the call; run the command another way
+
+typedef void (*rpc_output_fn)(const char *line, void *user_data);  // Called on the supervisor thread
+
+typedef struct {
+    uint64_t calls;        // Calls answered by the worker
+    uint64_t failures;     // Calls lost to a crash or cancelled
+    uint64_t restarts;     // Worker processes started after the first one
+    double total_ms;       // Round-trip time of answered calls, as seen by the archiver
+    double max_ms;
+    double backend_ms;     // Time spent inside the scraper, as reported by the worker
+} ScraperRpcStats;
+
+int scraper_rpc_start(char *const *argv);
+void scraper_rpc_stop();
+int scraper_rpc_is_ready();
+int scraper_rpc_call(const char *command, char *const *args, const int *cancelled,
+                     rpc_output_fn on_output, void *user_data, double *elapsed_ms);
+void scraper_rpc_stats(ScraperRpcStats *stats);
+
+#endif
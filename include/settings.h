@@ -1,12 +1,41 @@
 #ifndef SETTINGS_H
 #define SETTINGS_H
 
+#include <stddef.h>
+
 extern char redis_host[256];
 extern int redis_port;
+extern char redis_endpoints[256];
+extern int read_from_replicas;
 extern char board[256];
+extern char boards[256];
+extern int scan_count;
+extern int fetch_batch;
+extern int list_page_size;
+extern int redis_pool_size;
+extern int connect_timeout_ms;
+extern int output_scrollback_lines;
+extern int job_workers;
+extern char scraper_worker[16];
+extern char scraper_worker_script[256];
+extern int native_ingest;
+extern char ingest_base_url[256];
+extern char archive_dir[256];
+extern char index_dir[256];
+extern char thumbnail_base_url[256];
+extern char media_dir[256];
+extern int media_disk_mb;
+extern int thumbnail_memory_mb;
+extern int decode_workers;
+extern int compress_posts;
+extern int compress_level;
+extern int metrics_enabled;
+extern char metrics_export[256];
+extern int metrics_export_interval_s;
 
 void load_settings();
 void save_settings(const char *host, int port, const char *board);
 void save_settings_callback();
+void format_redis_endpoints(char *buf, size_t size);
 
 #endif
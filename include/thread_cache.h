@@ -0,0 +1,22 @@
+#ifndef THREAD_CACHE_H
+#define THREAD_CACHE_H
+
+#include <stddef.h>
+#include "thread_snapshot.h"
+
+// One board's cached thread list; each instance is used from a single thread
+typedef struct ThreadCache ThreadCache;
+
+ThreadCache *thread_cache_new();
+void thread_cache_free(ThreadCache *cache);
+void thread_cache_clear(ThreadCache *cache);
+const ThreadSnapshotRecord *thread_cache_add(ThreadCache *cache, const char *id, const char *title, int count, const char *status);
+const ThreadSnapshotRecord *thread_cache_find(ThreadCache *cache, const char *id);
+int thread_cache_remove(ThreadCache *cache, const char *id);
+ThreadSnapshot *thread_cache_snapshot(ThreadCache *cache);
+ThreadSnapshot *thread_cache_share(ThreadCache *cache);
+int thread_cache_is_valid(const ThreadCache *cache);
+void thread_cache_set_valid(ThreadCache *cache, int valid);
+int thread_record_matches(const ThreadSnapshot *snapshot, const ThreadSnapshotRecord *record, const char *filter);
+
+#endif
@@ -0,0 +1,22 @@
+#ifndef THREAD_INGEST_H
+#define THREAD_INGEST_H
+
+#include <stddef.h>
+#include "redis_operations.h"
+
+typedef struct {
+    char thread_id[THREAD_ID_MAX];
+    unsigned posts;
+    size_t bytes;           // JSON bytes read from the source
+    size_t stored_bytes;    // Bytes of the post list entries written, compressed or not
+    unsigned round_trips;   // Waits for Redis replies
+    double elapsed_ms;
+    size_t peak_buffered_bytes;  // Most post data held at once, the pending batch plus the post being read
+} IngestStats;
+
+int thread_ingest(const char *board, const char *source, const int *cancelled, IngestStats *stats);
+int thread_ingest_from_api(const char *board, const char *base_url, const char *thread_id, const int *cancelled, IngestStats *stats);
+void html_to_text(char *text);
+void thread_ingest_report(const IngestStats *stats, char *out, size_t size);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef THREAD_LIST_MODEL_H
+#define THREAD_LIST_MODEL_H
+
+#include <gtk/gtk.h>
+#include "thread_snapshot.h"
+
+enum {
+    THREAD_LIST_COLUMN_ID,
+    THREAD_LIST_COLUMN_TITLE,
+    THREAD_LIST_COLUMN_COUNT,
+    THREAD_LIST_COLUMN_STATUS,
+    THREAD_LIST_N_COLUMNS
+};
+
+// Match rule applied when (re)building the visible rows
+typedef gboolean (*ThreadListFilterFunc)(const ThreadSnapshot *snapshot, const ThreadSnapshotRecord *record, gpointer user_data);
+
+// Relevance of a visible row; while no column is sorted, rows are shown best first
+typedef double (*ThreadListRankFunc)(const ThreadSnapshot *snapshot, const ThreadSnapshotRecord *record, gpointer user_data);
+
+#define THREAD_TYPE_LIST_MODEL (thread_list_model_get_type())
+G_DECLARE_FINAL_TYPE(ThreadListModel, thread_list_model, THREAD, LIST_MODEL, GObject)
+
+ThreadListModel *thread_list_model_new(void);
+void thread_list_model_set_filter_func(ThreadListModel *model, ThreadListFilterFunc func, gpointer user_data);
+void thread_list_model_set_rank_func(ThreadListModel *model, ThreadListRankFunc func, gpointer user_data);
+void thread_list_model_refilter(ThreadListModel *model, const ThreadSnapshot *snapshot);
+void thread_list_model_sync(ThreadListModel *model, const ThreadSnapshot *snapshot);
+gboolean thread_list_model_record_changed(ThreadListModel *model, const ThreadSnapshot *snapshot, guint record_index);
+guint thread_list_model_get_n_rows(ThreadListModel *model);
+guint thread_list_model_get_record_index(ThreadListModel *model, GtkTreeIter *iter);
+
+#endif
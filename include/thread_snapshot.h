@@ -0,0 +1,45 @@
+#ifndef THREAD_SNAPSHOT_H
+#define THREAD_SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define THREAD_RECORD_DELETED 0x1
+
+// Fixed-layout thread record; strings live in the snapshot's arena and are referenced by offset
+typedef struct {
+    uint64_t id;
+    uint32_t title_offset;
+    uint32_t status_offset;
+    int32_t count;
+    uint32_t flags;
+} ThreadSnapshotRecord;
+
+// A board's thread list as two contiguous blocks: the record array and a string arena.
+// Reference counted; once shared it must be treated as read-only.
+typedef struct {
+    ThreadSnapshotRecord *records;
+    size_t count;
+    size_t capacity;
+    char *arena;
+    size_t arena_used;
+    size_t arena_capacity;
+    size_t allocations;  // malloc/realloc calls made while building, for reporting
+    int refcount;        // Accessed atomically
+} ThreadSnapshot;
+
+ThreadSnapshot *thread_snapshot_new(size_t expected_threads);
+ThreadSnapshot *thread_snapshot_ref(ThreadSnapshot *snapshot);
+void thread_snapshot_unref(ThreadSnapshot *snapshot);
+ThreadSnapshot *thread_snapshot_copy(const ThreadSnapshot *snapshot);
+int thread_snapshot_is_shared(ThreadSnapshot *snapshot);
+
+long thread_snapshot_append(ThreadSnapshot *snapshot, uint64_t id, const char *title, int count, const char *status);
+int thread_snapshot_update(ThreadSnapshot *snapshot, size_t index, const char *title, int count, const char *status);
+
+const char *thread_snapshot_title(const ThreadSnapshot *snapshot, const ThreadSnapshotRecord *record);
+const char *thread_snapshot_status(const ThreadSnapshot *snapshot, const ThreadSnapshotRecord *record);
+void thread_snapshot_report(const ThreadSnapshot *snapshot, FILE *out);
+
+#endif
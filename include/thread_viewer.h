@@ -0,0 +1,12 @@
+#ifndef THREAD_VIEWER_H
+#define THREAD_VIEWER_H
+
+#include "redis_async.h"
+
+// Window listing one thread's posts, read from Redis a page at a time as it is scrolled, or
+// from the board's archive. connection may be NULL to read the archive only.
+void thread_viewer_open(RedisAsync *connection, const char *board, const char *thread_id, const char *title);
+void thread_viewer_invalidate(const char *board, const char *thread_id);
+void thread_viewer_detach(RedisAsync *connection);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef THUMBNAIL_CACHE_H
+#define THUMBNAIL_CACHE_H
+
+#include <gtk/gtk.h>
+
+// Memory tier of the media cache: decoded thumbnails, least recently used dropped beyond a
+// byte cap, over the disk tier in media_store.h. Misses are fetched and decoded on a pool of
+// worker threads, and requests for a URL already being fetched wait on that fetch. Main
+// thread only.
+
+// pixbuf is NULL if the thumbnail couldn't be fetched or decoded; ref it to keep it
+typedef void (*thumbnail_ready_fn)(GdkPixbuf *pixbuf, gpointer owner, gpointer user_data);
+
+typedef struct {
+    guint64 memory_hits;
+    guint64 misses;
+    guint64 coalesced;    // Requests that joined a fetch already in flight
+    guint cached;
+    gsize cached_bytes;
+} ThumbnailCacheStats;
+
+void thumbnail_cache_init(gsize memory_bytes, int workers);
+void thumbnail_cache_shutdown();
+gboolean thumbnail_cache_request(const char *url, gpointer owner, thumbnail_ready_fn fn, gpointer user_data);
+void thumbnail_cache_cancel(gpointer owner);
+void thumbnail_cache_stats(ThumbnailCacheStats *stats);
+
+#endif
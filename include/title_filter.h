@@ -0,0 +1,36 @@
+#ifndef TITLE_FILTER_H
+#define TITLE_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "thread_snapshot.h"
+
+// Ranked title filter for the thread list. A TitleIndex keeps a packed, lower-cased copy of
+// a snapshot's titles and IDs that is scanned with SIMD and split across threads; a TitleQuery
+// is the compiled search text. Matching ignores ASCII case. Scores are positive for matches and
+// higher for better ones.
+
+typedef enum {
+    TITLE_MATCH_SUBSTRING,  // The whole query, anywhere in the title or ID
+    TITLE_MATCH_WORDS,      // Every word or "quoted phrase", anywhere in the title or ID
+    TITLE_MATCH_FUZZY,      // The query's characters in order with gaps; tight, word-aligned matches rank first
+    TITLE_MATCH_REGEX,      // POSIX extended regular expression, against the title or the ID
+} TitleMatchMode;
+
+typedef struct TitleQuery TitleQuery;
+typedef struct TitleIndex TitleIndex;
+
+// NULL for an empty query, or for a bad regex with the reason in error
+TitleQuery *title_query_new(const char *text, TitleMatchMode mode, char *error, size_t error_size);
+void title_query_free(TitleQuery *query);
+float title_query_score(const TitleQuery *query, const char *title, uint64_t id);  // 0 if no match
+
+TitleIndex *title_index_new();
+void title_index_free(TitleIndex *index);
+void title_index_update(TitleIndex *index, const ThreadSnapshot *snapshot);
+
+// Score every record of the snapshot into scores[0 .. snapshot->count); deleted records get 0.
+// Picks up changes since the last update itself. Returns the number of matches.
+size_t title_index_search(TitleIndex *index, const ThreadSnapshot *snapshot, const TitleQuery *query, float *scores);
+
+#endif
@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""Long-lived FourChanScraper backend for FourChanArchiver.
+
+Speaks JSON lines on stdin/stdout so the archiver can keep one warm interpreter
+instead of starting `python FourChanScraper.py <command>` for every action.
+
+Requests:   {"id": 7, "type": "call", "command": "scrape_thread", "args": ["g", "123"]}
+            {"id": 7, "type": "cancel"}
+Responses:  {"type": "ready", "pid": 42, "load_ms": 812.5}
+            {"id": 7, "type": "output", "line": "Scraping thread 123"}
+            {"id": 7, "type": "done", "exit_code": 0, "elapsed_ms": 95.1}
+
+Each request runs in a child forked from the warm interpreter, so it still skips
+the imports but has an interpreter to itself: requests never share sys.argv or
+module state, and cancelling a running request kills its child's process group.
+Up to --concurrency children run at once. Anything a request prints is routed
+back as "output" messages carrying its id; other output goes to stderr.
+"""
+
+import argparse
+import json
+import os
+import runpy
+import signal
+import sys
+import threading
+import time
+import traceback
+import warnings
+from concurrent.futures import ThreadPoolExecutor
+
+protocol_out = sys.stdout
+write_lock = threading.Lock()
+children_lock = threading.Lock()
+children = {}          # Request id -> pid of the child running it
+cancelled_ids = set()  # Cancelled after their thread picked them up but before the fork
+
+# The child only runs one command and exits, so forking from the pool's threads is safe here
+warnings.filterwarnings("ignore", category=DeprecationWarning, message=".*fork.*")
+
+
+def send(message):
+    line = json.dumps(message) + "\n"
+    with write_lock:
+        protocol_out.write(line)
+        protocol_out.flush()
+
+
+def run_command(scraper, script, command, args):
+    """Call the scraper's function for command if it has one, else run the script as __main__."""
+    function = scraper.get(command)
+    if callable(function):
+        result = function(*args)
+        return result if isinstance(result, int) else 0
+
+    sys.argv = [script, command, *args]  # The child's own copy
+    runpy.run_path(script, run_name="__main__")
+    return 0
+
+
+def run_child(scraper, script, request, output_fd):
+    """Body of the forked child: run the command with its output on output_fd, then exit."""
+    exit_code = 1
+    try:
+        os.setpgid(0, 0)  # Its own group, so a cancel also reaches anything it starts
+        signal.signal(signal.SIGTERM, signal.SIG_DFL)
+        null_fd = os.open(os.devnull, os.O_RDONLY)
+        os.dup2(null_fd, 0)  # Never read the request stream
+        os.dup2(output_fd, 1)
+        os.dup2(output_fd, 2)
+        sys.stdout = sys.stderr = open(1, "w", buffering=1, closefd=False)
+        exit_code = run_command(scraper, script, request["command"], [str(a) for a in request.get("args", [])])
+    except SystemExit as error:
+        exit_code = error.code if isinstance(error.code, int) else (0 if error.code is None else 1)
+    except BaseException:
+        traceback.print_exc()
+    finally:
+        try:
+            sys.stdout.flush()
+        finally:
+            os._exit(exit_code & 0xFF)
+
+
+def handle(scraper, script, request):
+    request_id = request["id"]
+    started = time.monotonic()
+    # Pipe and fork under the lock, so no other child inherits this write end and holds it open
+    with children_lock:
+        if request_id in cancelled_ids:
+            cancelled_ids.discard(request_id)
+            send({"id": request_id, "type": "done", "exit_code": -1, "elapsed_ms": 0.0, "cancelled": True})
+            return
+        read_fd, write_fd = os.pipe()
+        pid = os.fork()
+        if pid == 0:
+            os.close(read_fd)
+            run_child(scraper, script, request, write_fd)
+        os.close(write_fd)
+        children[request_id] = pid
+
+    with os.fdopen(read_fd, "r", errors="replace") as output:
+        for line in output:
+            send({"id": request_id, "type": "output", "line": line.rstrip("\n")})
+    _, status = os.waitpid(pid, 0)
+    with children_lock:
+        children.pop(request_id, None)
+        was_cancelled = request_id in cancelled_ids
+        cancelled_ids.discard(request_id)
+    exit_code = os.waitstatus_to_exitcode(status)  # Negative signal number when killed
+    send({"id": request_id, "type": "done", "exit_code": -1 if was_cancelled else exit_code,
+          "elapsed_ms": (time.monotonic() - started) * 1000.0, "cancelled": was_cancelled})
+
+
+def cancel(request_id, future):
+    """Drop a request that hasn't started, or kill the child running it."""
+    if future.cancel():
+        send({"id": request_id, "type": "done", "exit_code": -1, "elapsed_ms": 0.0, "cancelled": True})
+        return
+    with children_lock:
+        cancelled_ids.add(request_id)
+        pid = children.get(request_id)
+        if pid is not None:
+            try:
+                os.killpg(pid, signal.SIGTERM)
+            except ProcessLookupError:
+                pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--scraper", default="FourChanScraper.py", help="path of FourChanScraper.py")
+    parser.add_argument("--concurrency", type=int, default=2, help="requests run at the same time")
+    options = parser.parse_args()
+
+    started = time.monotonic()
+    script = os.path.abspath(options.scraper)
+    sys.path.insert(0, os.path.dirname(script))
+    sys.stdout = sys.stderr  # Stray prints while loading must not corrupt the protocol
+    scraper = runpy.run_path(script, run_name="scraper_worker")  # Imports stay loaded for every fork
+    send({"type": "ready", "pid": os.getpid(), "load_ms": (time.monotonic() - started) * 1000.0})
+
+    pool = ThreadPoolExecutor(max_workers=max(1, options.concurrency))
+    futures = {}
+    for raw in sys.stdin:
+        try:
+            request = json.loads(raw)
+        except ValueError:
+            sys.stderr.write("scraper_worker: ignoring malformed request\n")
+            continue
+
+        request_id = request.get("id")
+        if request.get("type") == "cancel":
+            future = futures.pop(request_id, None)
+            if future is not None:
+                cancel(request_id, future)
+        elif request.get("type") == "call":
+            futures[request_id] = pool.submit(handle, scraper, script, request)
+            futures[request_id].add_done_callback(lambda _, rid=request_id: futures.pop(rid, None))
+
+    pool.shutdown(wait=True)  # stdin closed: finish what is running, then exit
+
+
+if __name__ == "__main__":
+    main()
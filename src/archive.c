@@ -0,0 +1,691 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../include/archive.h"
+#include "../include/board_index.h"
+#include "../include/post_codec.h"
+
+// File layout (host byte order; archives are not meant to move between architectures):
+//   ArchiveFileHeader, then records back to back, each 8-byte aligned:
+//   ArchiveRecordHeader | title NUL | pad to 4 | uint32 post_ends[post_count] | posts, each NUL-terminated | pad to 8
+// post_ends[i] is the offset just past post i's NUL, relative to the first post.
+// A thread archived twice has two records; the index points at the newer one.
+
+#define ARCHIVE_MAGIC "FCARCHV1"
+#define ARCHIVE_INDEX_MAGIC "FCINDEX1"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_RECORD_MAGIC 0x52435446u  // "FTCR"
+#define ARCHIVE_STATUS_MAX 16
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+} ArchiveFileHeader;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t length;        // Whole record, header and padding included
+    uint64_t id;
+    int64_t archived_at;
+    uint32_t post_count;
+    uint32_t title_length;  // Without the NUL
+    char status[ARCHIVE_STATUS_MAX];
+    uint32_t checksum;      // FNV-1a of everything after the header
+    uint32_t reserved;
+} ArchiveRecordHeader;
+
+typedef struct {
+    char magic[8];
+    uint64_t data_length;   // Bytes of the data file the index covers
+    uint64_t count;
+} ArchiveIndexHeader;
+
+typedef struct {
+    uint64_t id;
+    uint64_t offset;
+} ArchiveIndexEntry;
+
+struct Archive {
+    const char *data;
+    size_t length;
+    const ArchiveIndexEntry *entries;
+    size_t count;
+    void *index_map;            // Mapping of <path>.idx when it covers the whole file
+    size_t index_length;
+    ArchiveIndexEntry *owned;   // Index rebuilt in memory when <path>.idx is missing or stale
+};
+
+typedef struct WriterLock WriterLock;
+
+struct ArchiveWriter {
+    int fd;
+    WriterLock *lock;
+    char *path;
+    size_t end;
+    ArchiveIndexEntry *entries;
+    size_t count;
+    size_t capacity;
+    int dirty;
+};
+
+static uint32_t fnv1a(const char *data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static size_t align_up(size_t value, size_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+// Length of the valid record at offset, or 0 if it is damaged or cut short
+static size_t check_record(const char *data, size_t length, size_t offset) {
+    if (offset + sizeof(ArchiveRecordHeader) > length) return 0;
+    const ArchiveRecordHeader *header = (const ArchiveRecordHeader *)(data + offset);
+    if (header->magic != ARCHIVE_RECORD_MAGIC || header->length % 8 != 0 || header->length < sizeof(*header) ||
+        header->length > length - offset || header->status[ARCHIVE_STATUS_MAX - 1] != '\0') {
+        return 0;
+    }
+
+    size_t payload = header->length - sizeof(*header);
+    size_t posts_at = align_up((size_t)header->title_length + 1, 4) + (size_t)header->post_count * 4;
+    if (posts_at > payload) return 0;
+
+    const char *body = data + offset + sizeof(*header);
+    if (body[header->title_length] != '\0') return 0;
+    const uint32_t *ends = (const uint32_t *)(body + align_up((size_t)header->title_length + 1, 4));
+    uint32_t previous = 0;
+    for (uint32_t i = 0; i < header->post_count; i++) {
+        if (ends[i] <= previous || ends[i] > payload - posts_at || body[posts_at + ends[i] - 1] != '\0') return 0;
+        previous = ends[i];
+    }
+    return fnv1a(body, payload) == header->checksum ? header->length : 0;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const ArchiveIndexEntry *x = a, *y = b;
+    if (x->id != y->id) return x->id < y->id ? -1 : 1;
+    return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+// Sort by id and keep only the newest record of each thread
+static size_t sort_entries(ArchiveIndexEntry *entries, size_t count) {
+    qsort(entries, count, sizeof(*entries), compare_entries);
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (kept > 0 && entries[kept - 1].id == entries[i].id) kept--;
+        entries[kept++] = entries[i];
+    }
+    return kept;
+}
+
+static int push_entry(ArchiveIndexEntry **entries, size_t *count, size_t *capacity, uint64_t id, uint64_t offset) {
+    if (*count == *capacity) {
+        size_t grown = *capacity ? *capacity * 2 : 1024;
+        ArchiveIndexEntry *resized = realloc(*entries, grown * sizeof(**entries));
+        if (resized == NULL) return -1;
+        *entries = resized;
+        *capacity = grown;
+    }
+    (*entries)[(*count)++] = (ArchiveIndexEntry){ id, offset };
+    return 0;
+}
+
+// Add entries for the records from offset on; returns where the valid records end
+static size_t scan_records(const char *data, size_t length, size_t offset,
+                           ArchiveIndexEntry **entries, size_t *count, size_t *capacity) {
+    size_t record_length;
+    while ((record_length = check_record(data, length, offset)) > 0) {
+        const ArchiveRecordHeader *header = (const ArchiveRecordHeader *)(data + offset);
+        if (push_entry(entries, count, capacity, header->id, offset) != 0) break;
+        offset += record_length;
+    }
+    return offset;
+}
+
+// Map <path>.idx if it matches this data file; NULL if missing or unusable
+static const ArchiveIndexHeader *map_index(const char *path, size_t data_length, size_t *map_length) {
+    char index_path[1024];
+    snprintf(index_path, sizeof(index_path), "%s.idx", path);
+    int fd = open(index_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ArchiveIndexHeader)) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    const ArchiveIndexHeader *header = map;
+    if (memcmp(header->magic, ARCHIVE_INDEX_MAGIC, 8) != 0 ||
+        header->count != (st.st_size - sizeof(*header)) / sizeof(ArchiveIndexEntry) ||
+        header->data_length < sizeof(ArchiveFileHeader) || header->data_length > data_length) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    *map_length = st.st_size;
+    return header;
+}
+
+// Index entries for data: the mapped index as-is when it is current, otherwise a private
+// copy extended by scanning the records appended since it was written
+static int load_index(Archive *archive, const char *path, size_t *valid_end) {
+    size_t capacity = 0, from = sizeof(ArchiveFileHeader);
+    const ArchiveIndexHeader *header = map_index(path, archive->length, &archive->index_length);
+
+    if (header) {
+        const ArchiveIndexEntry *mapped = (const ArchiveIndexEntry *)(header + 1);
+        if (header->data_length == archive->length) {
+            archive->index_map = (void *)header;
+            archive->entries = mapped;
+            archive->count = header->count;
+            *valid_end = archive->length;
+            return 0;
+        }
+        capacity = header->count + 1024;
+        archive->owned = malloc(capacity * sizeof(ArchiveIndexEntry));
+        if (archive->owned) memcpy(archive->owned, mapped, header->count * sizeof(ArchiveIndexEntry));
+        archive->count = archive->owned ? header->count : 0;
+        from = header->data_length;
+        munmap((void *)header, archive->index_length);
+        if (archive->owned == NULL) return -1;
+    }
+
+    *valid_end = scan_records(archive->data, archive->length, from, &archive->owned, &archive->count, &capacity);
+    archive->count = sort_entries(archive->owned, archive->count);
+    archive->entries = archive->owned;
+    return 0;
+}
+
+static Archive *map_archive(int fd, const char *path, size_t *valid_end) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ArchiveFileHeader)) return NULL;
+
+    Archive *archive = calloc(1, sizeof(Archive));
+    if (archive == NULL) return NULL;
+    archive->length = st.st_size;
+    void *map = mmap(NULL, archive->length, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+        free(archive);
+        return NULL;
+    }
+    archive->data = map;
+
+    const ArchiveFileHeader *header = map;
+    if (memcmp(header->magic, ARCHIVE_MAGIC, 8) != 0 || header->version != ARCHIVE_VERSION) {
+        fprintf(stderr, "%s is not an archive this version can read\n", path);
+        archive_close(archive);
+        return NULL;
+    }
+    if (load_index(archive, path, valid_end) != 0) {
+        archive_close(archive);
+        return NULL;
+    }
+    return archive;
+}
+
+// --- Reading ----------------------------------------------------------------------------------
+
+// Open an archive read-only; NULL if it does not exist or is not an archive
+Archive *archive_open(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    size_t valid_end;
+    Archive *archive = map_archive(fd, path, &valid_end);
+    close(fd);  // The mapping stays valid
+    return archive;
+}
+
+void archive_close(Archive *archive) {
+    if (archive == NULL) return;
+    if (archive->index_map) munmap(archive->index_map, archive->index_length);
+    free(archive->owned);
+    munmap((void *)archive->data, archive->length);
+    free(archive);
+}
+
+size_t archive_thread_count(const Archive *archive) {
+    return archive ? archive->count : 0;
+}
+
+static void fill_thread(const Archive *archive, uint64_t offset, ArchiveThread *thread) {
+    const ArchiveRecordHeader *header = (const ArchiveRecordHeader *)(archive->data + offset);
+    const char *body = (const char *)(header + 1);
+    thread->id = header->id;
+    thread->title = body;
+    thread->status = header->status;
+    thread->post_count = header->post_count;
+    thread->archived_at = header->archived_at;
+    thread->post_ends = (const uint32_t *)(body + align_up((size_t)header->title_length + 1, 4));
+    thread->posts = (const char *)(thread->post_ends + header->post_count);
+}
+
+int archive_thread_at(const Archive *archive, size_t index, ArchiveThread *thread) {
+    if (archive == NULL || index >= archive->count) return -1;
+    fill_thread(archive, archive->entries[index].offset, thread);
+    return 0;
+}
+
+// Binary search of the index; 0 if found
+int archive_find(const Archive *archive, uint64_t id, ArchiveThread *thread) {
+    size_t low = 0, high = archive ? archive->count : 0;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (archive->entries[middle].id < id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (archive && low < archive->count && archive->entries[low].id == id) {
+        fill_thread(archive, archive->entries[low].offset, thread);
+        return 0;
+    }
+    return -1;
+}
+
+const char *archive_thread_post(const ArchiveThread *thread, uint32_t index, size_t *length) {
+    if (index >= thread->post_count) return NULL;
+    uint32_t start = index ? thread->post_ends[index - 1] : 0;
+    if (length) *length = thread->post_ends[index] - start - 1;
+    return thread->posts + start;
+}
+
+// --- Writing ----------------------------------------------------------------------------------
+
+static int write_all(int fd, const void *data, size_t length, off_t offset) {
+    const char *p = data;
+    while (length > 0) {
+        ssize_t written = pwrite(fd, p, length, offset);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += written;
+        offset += written;
+        length -= written;
+    }
+    return 0;
+}
+
+// One per archive file with a writer in this process, found by device and inode so every
+// path to the file shares it. Writers queue on its mutex before taking the flock(): flock is
+// per open file, but on NFS it is emulated with POSIX locks, which are per process.
+struct WriterLock {
+    dev_t dev;
+    ino_t ino;
+    unsigned users;
+    pthread_mutex_t mutex;
+    WriterLock *next;
+};
+
+static pthread_mutex_t writer_locks_lock = PTHREAD_MUTEX_INITIALIZER;
+static WriterLock *writer_locks = NULL;
+
+static WriterLock *writer_lock_acquire(const struct stat *st) {
+    pthread_mutex_lock(&writer_locks_lock);
+    WriterLock *lock = writer_locks;
+    while (lock && (lock->dev != st->st_dev || lock->ino != st->st_ino)) lock = lock->next;
+    if (lock == NULL && (lock = calloc(1, sizeof(WriterLock))) != NULL) {
+        lock->dev = st->st_dev;
+        lock->ino = st->st_ino;
+        pthread_mutex_init(&lock->mutex, NULL);
+        lock->next = writer_locks;
+        writer_locks = lock;
+    }
+    if (lock) lock->users++;
+    pthread_mutex_unlock(&writer_locks_lock);
+
+    if (lock) pthread_mutex_lock(&lock->mutex);
+    return lock;
+}
+
+static void writer_lock_release(WriterLock *lock) {
+    pthread_mutex_unlock(&lock->mutex);
+    pthread_mutex_lock(&writer_locks_lock);
+    if (--lock->users == 0) {
+        WriterLock **link = &writer_locks;
+        while (*link != lock) link = &(*link)->next;
+        *link = lock->next;
+        pthread_mutex_destroy(&lock->mutex);
+        free(lock);
+    }
+    pthread_mutex_unlock(&writer_locks_lock);
+}
+
+// Open for appending, creating the file if needed. Blocks while another writer, in this
+// process or another, holds it. A record left half-written by a crash is cut off here.
+ArchiveWriter *archive_writer_open(const char *path) {
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to open archive %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    ArchiveWriter *writer = calloc(1, sizeof(ArchiveWriter));
+    struct stat st;
+    if (writer == NULL || (writer->path = strdup(path)) == NULL || fstat(fd, &st) != 0 ||
+        (writer->lock = writer_lock_acquire(&st)) == NULL) {
+        if (writer) free(writer->path);
+        free(writer);
+        close(fd);
+        return NULL;
+    }
+    writer->fd = fd;
+    while (flock(fd, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "Failed to lock archive %s: %s\n", path, strerror(errno));
+            archive_writer_close(writer);
+            return NULL;
+        }
+    }
+
+    fstat(fd, &st);  // Size as the previous writer left it
+    if (st.st_size == 0) {
+        ArchiveFileHeader header = { .version = ARCHIVE_VERSION };
+        memcpy(header.magic, ARCHIVE_MAGIC, 8);
+        if (write_all(fd, &header, sizeof(header), 0) != 0) {
+            archive_writer_close(writer);
+            return NULL;
+        }
+        writer->end = sizeof(header);
+        writer->dirty = 1;
+        return writer;
+    }
+
+    size_t valid_end;
+    Archive *archive = map_archive(fd, path, &valid_end);
+    if (archive == NULL) {
+        archive_writer_close(writer);
+        return NULL;
+    }
+    writer->capacity = archive->count + 256;
+    writer->entries = malloc(writer->capacity * sizeof(ArchiveIndexEntry));
+    if (writer->entries) memcpy(writer->entries, archive->entries, archive->count * sizeof(ArchiveIndexEntry));
+    writer->count = archive->count;
+    archive_close(archive);
+    if (writer->entries == NULL) {
+        archive_writer_close(writer);
+        return NULL;
+    }
+
+    writer->end = valid_end;
+    if (valid_end < (size_t)st.st_size) {
+        fprintf(stderr, "Archive %s: dropping %zu bytes of an incomplete record\n", path, (size_t)st.st_size - valid_end);
+        if (ftruncate(fd, valid_end) != 0) {
+            archive_writer_close(writer);
+            return NULL;
+        }
+        writer->dirty = 1;
+    }
+    return writer;
+}
+
+int archive_writer_add(ArchiveWriter *writer, uint64_t id, const char *title, const char *status,
+                       const char *const *posts, const size_t *lengths, uint32_t post_count) {
+    size_t title_length = strlen(title);
+    size_t posts_at = align_up(title_length + 1, 4) + (size_t)post_count * 4;
+    size_t payload = posts_at;
+    for (uint32_t i = 0; i < post_count; i++) payload += lengths[i] + 1;
+    size_t record_length = align_up(sizeof(ArchiveRecordHeader) + payload, 8);
+    if (record_length > UINT32_MAX) {
+        fprintf(stderr, "Thread %llu is too large to archive\n", (unsigned long long)id);
+        return -1;
+    }
+
+    char *record = calloc(1, record_length);
+    if (record == NULL) return -1;
+    ArchiveRecordHeader *header = (ArchiveRecordHeader *)record;
+    char *body = record + sizeof(*header);
+    memcpy(body, title, title_length);
+
+    uint32_t *ends = (uint32_t *)(body + align_up(title_length + 1, 4));
+    size_t end = 0;
+    for (uint32_t i = 0; i < post_count; i++) {
+        memcpy(body + posts_at + end, posts[i], lengths[i]);
+        end += lengths[i] + 1;  // calloc supplied the NUL
+        ends[i] = (uint32_t)end;
+    }
+
+    header->magic = ARCHIVE_RECORD_MAGIC;
+    header->length = (uint32_t)record_length;
+    header->id = id;
+    header->archived_at = time(NULL);
+    header->post_count = post_count;
+    header->title_length = (uint32_t)title_length;
+    snprintf(header->status, sizeof(header->status), "%s", status ? status : "");
+    header->checksum = fnv1a(body, record_length - sizeof(*header));
+
+    int result = write_all(writer->fd, record, record_length, writer->end);
+    free(record);
+    if (result != 0 || push_entry(&writer->entries, &writer->count, &writer->capacity, id, writer->end) != 0) {
+        fprintf(stderr, "Failed to append to archive %s: %s\n", writer->path, strerror(errno));
+        return -1;
+    }
+    writer->end += record_length;
+    writer->dirty = 1;
+    return 0;
+}
+
+// Flush the appended records, then replace <path>.idx in one rename
+int archive_writer_commit(ArchiveWriter *writer) {
+    if (!writer->dirty) return 0;
+    if (fdatasync(writer->fd) != 0) return -1;
+
+    writer->count = sort_entries(writer->entries, writer->count);
+    char index_path[1024], temp_path[1040];
+    snprintf(index_path, sizeof(index_path), "%s.idx", writer->path);
+    snprintf(temp_path, sizeof(temp_path), "%s.XXXXXX", index_path);  // Never shared with another writer
+
+    int fd = mkstemp(temp_path);
+    if (fd < 0) {
+        fprintf(stderr, "Failed to create archive index %s: %s\n", temp_path, strerror(errno));
+        return -1;
+    }
+    fchmod(fd, 0644);
+    ArchiveIndexHeader header = { .data_length = writer->end, .count = writer->count };
+    memcpy(header.magic, ARCHIVE_INDEX_MAGIC, 8);
+    int result = write_all(fd, &header, sizeof(header), 0);
+    if (result == 0) result = write_all(fd, writer->entries, writer->count * sizeof(ArchiveIndexEntry), sizeof(header));
+    if (result == 0) result = fsync(fd);
+    close(fd);
+    if (result == 0) result = rename(temp_path, index_path);
+    if (result != 0) {
+        fprintf(stderr, "Failed to write archive index %s: %s\n", index_path, strerror(errno));
+        unlink(temp_path);
+        return -1;  // Readers rebuild the missing part of the index from the records
+    }
+    writer->dirty = 0;
+    return 0;
+}
+
+void archive_writer_close(ArchiveWriter *writer) {
+    if (writer == NULL) return;
+    close(writer->fd);  // Releases the flock
+    writer_lock_release(writer->lock);
+    free(writer->entries);
+    free(writer->path);
+    free(writer);
+}
+
+// --- Moving threads out of Redis --------------------------------------------------------------
+
+#define ARCHIVE_MOVE_BATCH 16  // Threads read per pipelined round-trip and committed together
+
+void format_archive_path(char *buf, size_t size, const char *dir, const char *board) {
+    snprintf(buf, size, "%s/%s.archive", dir, board);
+}
+
+// Post list of a thread: a list of post JSON, or a single string holding the whole thread
+static uint32_t reply_posts(redisReply *reply, const char ***posts, size_t **lengths) {
+    if (reply->type == REDIS_REPLY_STRING) {
+        *posts = malloc(sizeof(char *));
+        *lengths = malloc(sizeof(size_t));
+        if (*posts == NULL || *lengths == NULL) return 0;
+        (*posts)[0] = reply->str;
+        (*lengths)[0] = reply->len;
+        return 1;
+    }
+    if (reply->type != REDIS_REPLY_ARRAY || reply->elements == 0) return 0;
+
+    *posts = malloc(reply->elements * sizeof(char *));
+    *lengths = malloc(reply->elements * sizeof(size_t));
+    if (*posts == NULL || *lengths == NULL) return 0;
+    uint32_t n = 0;
+    for (size_t i = 0; i < reply->elements; i++) {
+        if (reply->element[i]->type != REDIS_REPLY_STRING) continue;
+        (*posts)[n] = reply->element[i]->str;
+        (*lengths)[n++] = reply->element[i]->len;
+    }
+    return n;
+}
+
+// Read a committed record back from the file and check that it is whole and holds the thread
+// that was written, before its keys are deleted from Redis
+static int verify_record(const ArchiveWriter *writer, uint64_t offset, uint64_t id, uint32_t post_count) {
+    ArchiveRecordHeader header;
+    if (pread(writer->fd, &header, sizeof(header), offset) != (ssize_t)sizeof(header) || header.magic != ARCHIVE_RECORD_MAGIC ||
+        header.id != id || header.post_count != post_count || header.length < sizeof(header) || offset + header.length > writer->end) {
+        return -1;
+    }
+    char *record = malloc(header.length);
+    if (record == NULL) return -1;
+    int valid = pread(writer->fd, record, header.length, offset) == (ssize_t)header.length &&
+                check_record(record, header.length, 0) == header.length;
+    free(record);
+    return valid ? 0 : -1;
+}
+
+// Copy n threads and their posts into the archive at path, then delete them from Redis.
+// Nothing is deleted before the batch holding it is committed to disk and read back. Returns -1 on failure;
+// threads already moved stay moved.
+int archive_move_threads(const char *board, const char *path, char (*ids)[THREAD_ID_MAX], size_t n,
+                         const int *cancelled, ArchiveMoveStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    ArchiveWriter *writer = archive_writer_open(path);
+    if (writer == NULL) return -1;
+    RedisBatch *reads = redis_batch_new(REDIS_ROUTE_PRIMARY);  // The primary: what is read is what gets deleted
+    RedisBatch *unlinks = reads ? redis_batch_new(REDIS_ROUTE_PRIMARY) : NULL;
+    if (unlinks == NULL) {
+        redis_batch_free(reads);
+        archive_writer_close(writer);
+        return -1;
+    }
+
+    int result = 0;
+    size_t unverified = 0;
+    for (size_t first = 0; first < n && result == 0; first += ARCHIVE_MOVE_BATCH) {
+        if (cancelled && __atomic_load_n(cancelled, __ATOMIC_RELAXED)) {
+            result = -1;
+            break;
+        }
+        size_t batch = n - first < ARCHIVE_MOVE_BATCH ? n - first : ARCHIVE_MOVE_BATCH;
+        char (*batch_ids)[THREAD_ID_MAX] = ids + first;
+
+        // Title, count and status for the batch, then the posts of each thread
+        redis_batch_clear(reads);
+        size_t fields = redis_batch_append_thread_fields(reads, board, batch_ids, batch);
+        size_t posts_replies[ARCHIVE_MOVE_BATCH];
+        for (size_t i = 0; i < batch; i++) {
+            char key[320];
+            format_thread_key(key, sizeof(key), board, batch_ids[i], "posts");
+            posts_replies[i] = redis_batch_append(reads, key, "LRANGE %s 0 -1", key);
+            redis_batch_append(reads, key, "GET %s", key);  // Whichever matches the key's type succeeds
+        }
+        result = redis_batch_execute(reads);
+
+        int present[ARCHIVE_MOVE_BATCH] = { 0 };
+        uint64_t offsets[ARCHIVE_MOVE_BATCH];
+        uint32_t post_counts[ARCHIVE_MOVE_BATCH];
+        for (size_t i = 0; i < batch && result == 0; i++) {
+            const redisReply *title = redis_batch_thread_field(reads, fields, batch, i, 0);
+            const redisReply *status = redis_batch_thread_field(reads, fields, batch, i, 2);
+            if (title == NULL) {
+                result = -1;
+                break;
+            }
+            if (title->type != REDIS_REPLY_STRING) {
+                stats->missing++;
+                continue;
+            }
+            const char **posts = NULL;
+            size_t *lengths = NULL;
+            redisReply *list = redis_batch_reply(reads, posts_replies[i]);
+            int is_list = list->type == REDIS_REPLY_ARRAY;
+            uint32_t post_count = reply_posts(is_list ? list : redis_batch_reply(reads, posts_replies[i] + 1), &posts, &lengths);
+
+            // The archive holds the text, whatever the compression in Redis
+            size_t before = writer->end;
+            char **decoded = NULL;
+            result = post_codec_decode_all(board, posts, lengths, post_count, &decoded);
+            if (result == 0) {
+                result = archive_writer_add(writer, strtoull(batch_ids[i], NULL, 10), title->str,
+                                            status && status->type == REDIS_REPLY_STRING ? status->str : "", posts, lengths, post_count);
+            }
+            post_codec_free_decoded(decoded, post_count);
+            free(posts);
+            free(lengths);
+            if (result == 0) {
+                present[i] = 1;
+                offsets[i] = before;
+                post_counts[i] = post_count;
+                stats->posts += post_count;
+                stats->bytes += writer->end - before;
+            }
+        }
+        if (result == 0) result = archive_writer_commit(writer);
+        for (size_t i = 0; i < batch && result == 0; i++) {
+            if (present[i] && verify_record(writer, offsets[i], strtoull(batch_ids[i], NULL, 10), post_counts[i]) != 0) {
+                fprintf(stderr, "Archive %s: thread %s did not read back intact; leaving it in Redis\n", path, batch_ids[i]);
+                present[i] = 0;
+                unverified++;
+            }
+        }
+
+        // Durable now; free the server memory. Only the keys the archiver reads are dropped.
+        redis_batch_clear(unlinks);
+        size_t unlinked = 0;
+        for (size_t i = 0; i < batch && result == 0; i++) {
+            if (!present[i]) continue;
+            static const char *fields_to_drop[] = { "title", "count", "status", "posts" };
+            char keys[4][320];
+            const char *key_list[4];
+            for (int f = 0; f < 4; f++) {
+                format_thread_key(keys[f], sizeof(keys[f]), board, batch_ids[i], fields_to_drop[f]);
+                key_list[f] = keys[f];
+            }
+            redis_batch_append_keys(unlinks, "UNLINK", key_list, 4);
+            unlinked++;
+        }
+        if (unlinked && result == 0) result = redis_batch_execute(unlinks);
+        if (result == 0) stats->moved += unlinked;
+
+        // Moved threads leave the sorted index; a failure here leaves stale rows, not lost threads
+        const char *moved_ids[ARCHIVE_MOVE_BATCH];
+        size_t moved = 0;
+        for (size_t i = 0; i < batch && result == 0; i++) {
+            if (present[i]) moved_ids[moved++] = batch_ids[i];
+        }
+        if (moved) board_index_refresh(board, moved_ids, moved);
+    }
+
+    redis_batch_free(reads);
+    redis_batch_free(unlinks);
+    archive_writer_close(writer);
+    return result == 0 && unverified == 0 ? 0 : -1;
+}
@@ -0,0 +1,601 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <zstd.h>
+#include "../include/board_export.h"
+#include "../include/board_index.h"
+#include "../include/json_scan.h"
+#include "../include/post_codec.h"
+#include "../include/redis_operations.h"
+#include "../include/settings.h"
+
+// Both directions stream: export holds at most EXPORT_POSTS posts read at a time, import one
+// batch of writes, so memory stays the same however large the board is. The file goes through a 1 MiB
+// stdio buffer and, when compressed, zstd's streaming API.
+
+#define EXPORT_MAGIC "FCBOARD1"
+#define EXPORT_VERSION 1
+#define EXPORT_HEADER_SIZE 16
+#define RECORD_BOARD 0x44524f42u   // "BORD"
+#define RECORD_THREAD 0x44524854u  // "THRD"
+#define RECORD_END 0x20444e45u     // "END "
+#define RECORD_MAX (1u << 30)      // Anything longer is taken for damage, not allocated
+#define FILE_BUFFER (1 << 20)
+#define EXPORT_POSTS 16384                // Posts read per pipeline, at least one thread's worth
+#define IMPORT_PUSH 512                   // Posts per RPUSH
+#define IMPORT_BATCH_BYTES (8u << 20)     // Flush writes once this much post data is queued
+#define FNV_OFFSET 2166136261u
+
+static uint32_t fnv1a(uint32_t hash, const char *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void put_u32(char *p, uint32_t value) {
+    for (int i = 0; i < 4; i++) p[i] = (char)(value >> (8 * i));
+}
+
+static uint32_t get_u32(const char *p) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++) value |= (uint32_t)(unsigned char)p[i] << (8 * i);
+    return value;
+}
+
+static uint64_t get_u64(const char *p) {
+    return get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+static int append_u32(JsonBuffer *buffer, uint32_t value) {
+    char bytes[4];
+    put_u32(bytes, value);
+    return json_append(buffer, bytes, 4);
+}
+
+static int append_u64(JsonBuffer *buffer, uint64_t value) {
+    return append_u32(buffer, (uint32_t)value) | append_u32(buffer, (uint32_t)(value >> 32));
+}
+
+static int append_field(JsonBuffer *buffer, const char *data, size_t length) {
+    return append_u32(buffer, (uint32_t)length) | json_append(buffer, data, length);
+}
+
+// --- Export ----------------------------------------------------------------------------------
+
+typedef struct {
+    FILE *file;
+    ZSTD_CCtx *cctx;     // NULL for an uncompressed file
+    char *out;
+    size_t out_size;
+    uint64_t bytes;      // Written to the file
+} ExportWriter;
+
+static int write_file(ExportWriter *writer, const void *data, size_t length) {
+    if (length && fwrite(data, 1, length, writer->file) != length) {
+        fprintf(stderr, "Writing the export failed: %s\n", strerror(errno));
+        return -1;
+    }
+    writer->bytes += length;
+    return 0;
+}
+
+// Pass data on to the file, through the zstd stream if there is one; ZSTD_e_end closes the stream
+static int write_stream(ExportWriter *writer, const void *data, size_t length, ZSTD_EndDirective mode) {
+    if (writer->cctx == NULL) return write_file(writer, data, length);
+    ZSTD_inBuffer in = { data, length, 0 };
+    size_t remaining;
+    do {
+        ZSTD_outBuffer out = { writer->out, writer->out_size, 0 };
+        remaining = ZSTD_compressStream2(writer->cctx, &out, &in, mode);
+        if (ZSTD_isError(remaining)) {
+            fprintf(stderr, "Compressing the export failed: %s\n", ZSTD_getErrorName(remaining));
+            return -1;
+        }
+        if (write_file(writer, writer->out, out.pos) != 0) return -1;
+    } while (mode == ZSTD_e_end ? remaining != 0 : in.pos < in.size);
+    return 0;
+}
+
+static void start_record(JsonBuffer *record, uint32_t type) {
+    record->length = 0;
+    append_u32(record, type);
+    append_u32(record, 0);  // Length, filled in by finish_record
+}
+
+static int finish_record(ExportWriter *writer, JsonBuffer *record) {
+    if (record->data == NULL || record->length - 8 > RECORD_MAX) return -1;
+    put_u32(record->data + 4, (uint32_t)(record->length - 8));
+    if (append_u32(record, fnv1a(FNV_OFFSET, record->data, record->length)) != 0) return -1;
+    return write_stream(writer, record->data, record->length, ZSTD_e_continue);
+}
+
+// Replies from string_posts on are LLENs, where WRONGTYPE only means the posts are one string
+static int check_replies(const RedisBatch *batch, const char *board, size_t string_posts) {
+    for (size_t i = 0; i < redis_batch_count(batch); i++) {
+        if (i >= string_posts && thread_posts_are_string(redis_batch_reply(batch, i))) continue;
+        if (redis_batch_reply(batch, i)->type == REDIS_REPLY_ERROR) {
+            fprintf(stderr, "Reading threads of /%s/ failed: %s\n", board, redis_batch_reply(batch, i)->str);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Posts in a thread's _posts key going by its LLEN reply: a string-typed key holds one
+static long long stored_posts(const redisReply *length) {
+    return length->type == REDIS_REPLY_INTEGER ? length->integer : thread_posts_are_string(length) ? 1 : 0;
+}
+
+// One THRD record from a thread's field replies and the LRANGE of its posts, or the GET of
+// posts stored as one string, which becomes a single post as in the archive. Posts are written decoded.
+static int write_thread(ExportWriter *writer, JsonBuffer *record, const char *board, const char *thread_id, const redisReply *title,
+                        const redisReply *count, const redisReply *state, const redisReply *list, BoardExportStats *stats) {
+    size_t n = 0, elements = list->type == REDIS_REPLY_ARRAY ? list->elements : 0;
+    const char **posts = malloc((elements + 1) * sizeof(char *));
+    size_t *lengths = malloc((elements + 1) * sizeof(size_t));
+    char **decoded = NULL;
+    int status = posts && lengths ? 0 : -1;
+    for (size_t i = 0; status == 0 && i < elements; i++) {
+        if (list->element[i]->type != REDIS_REPLY_STRING) continue;
+        posts[n] = list->element[i]->str;
+        lengths[n++] = list->element[i]->len;
+    }
+    if (status == 0 && list->type == REDIS_REPLY_STRING) {
+        posts[n] = list->str;
+        lengths[n++] = list->len;
+    }
+    if (status == 0) status = post_codec_decode_all(board, posts, lengths, n, &decoded);
+
+    if (status == 0) {
+        const char *status_text = state && state->type == REDIS_REPLY_STRING ? state->str : "Unknown";
+        start_record(record, RECORD_THREAD);
+        status |= append_u64(record, strtoull(thread_id, NULL, 10));
+        status |= append_u32(record, count && count->type == REDIS_REPLY_STRING ? (uint32_t)atoi(count->str) : 0);
+        status |= append_u32(record, (uint32_t)n);
+        status |= append_field(record, title->str, title->len);
+        status |= append_field(record, status_text, strlen(status_text));
+        for (size_t i = 0; status == 0 && i < n; i++) {
+            status = append_field(record, posts[i], lengths[i]);
+            stats->post_bytes += lengths[i];
+        }
+        if (status == 0) status = finish_record(writer, record);
+        stats->threads++;
+        stats->posts += n;
+    }
+
+    post_codec_free_decoded(decoded, n);
+    free(posts);
+    free(lengths);
+    return status;
+}
+
+// Write a record for each of n threads that still exists; one deleted since the SCAN saw it is
+// left out. Their fields and list lengths come in one pipeline, then their posts in pipelines
+// of up to EXPORT_POSTS posts, so a batch of long threads doesn't have to fit in memory at once.
+static int export_threads(ExportWriter *writer, JsonBuffer *record, RedisBatch *reads, RedisBatch *lists, const char *board,
+                          char (*ids)[THREAD_ID_MAX], size_t n, BoardExportStats *stats) {
+    redis_batch_clear(reads);
+    size_t first = redis_batch_append_thread_fields(reads, board, ids, n);
+    size_t lengths = redis_batch_count(reads);
+    for (size_t i = 0; i < n; i++) {
+        char key[320];
+        format_thread_key(key, sizeof(key), board, ids[i], "posts");
+        redis_batch_append(reads, key, "LLEN %s", key);
+    }
+    int status = redis_batch_execute(reads) == 0 ? check_replies(reads, board, lengths) : -1;
+    stats->round_trips++;
+
+    // Threads without posts, or gone, need no LRANGE; posts stored as one string are read with GET
+    static const redisReply no_posts = { .type = REDIS_REPLY_ARRAY };
+    for (size_t group = 0; status == 0 && group < n;) {
+        size_t end = group, posts = 0;
+        redis_batch_clear(lists);
+        for (; end < n && (posts == 0 || posts + stored_posts(redis_batch_reply(reads, lengths + end)) <= EXPORT_POSTS); end++) {
+            const redisReply *title = redis_batch_thread_field(reads, first, n, end, 0);
+            const redisReply *length = redis_batch_reply(reads, lengths + end);
+            if (title == NULL || title->type != REDIS_REPLY_STRING || stored_posts(length) == 0) continue;
+            char key[320];
+            format_thread_key(key, sizeof(key), board, ids[end], "posts");
+            if (length->type == REDIS_REPLY_INTEGER) redis_batch_append(lists, key, "LRANGE %s 0 -1", key);
+            else redis_batch_append(lists, key, "GET %s", key);
+            posts += stored_posts(length);
+        }
+        if (redis_batch_count(lists) > 0) {
+            status = redis_batch_execute(lists) == 0 ? check_replies(lists, board, SIZE_MAX) : -1;
+            stats->round_trips++;
+        }
+
+        for (size_t i = group, list = 0; status == 0 && i < end; i++) {
+            const redisReply *title = redis_batch_thread_field(reads, first, n, i, 0);
+            if (title == NULL || title->type != REDIS_REPLY_STRING) continue;
+            const redisReply *posts_reply = stored_posts(redis_batch_reply(reads, lengths + i)) > 0 ? redis_batch_reply(lists, list++) : &no_posts;
+            status = write_thread(writer, record, board, ids[i], title, redis_batch_thread_field(reads, first, n, i, 1),
+                                  redis_batch_thread_field(reads, first, n, i, 2), posts_reply, stats);
+        }
+        group = end;
+    }
+    return status;
+}
+
+// Write every thread of the board to path, found with SCAN (every primary, or a replica of it,
+// on a cluster) and read batch threads per pipeline. The file is written under <path>.tmp and
+// renamed into place once complete, so a failed or cancelled export leaves no partial file.
+// flags is 0 or BOARD_EXPORT_ZSTD, which compresses at compress_level.
+int board_export(const char *board, const char *path, unsigned flags, int scan_count, int batch, const int *cancelled,
+                 BoardExportStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    snprintf(stats->board, sizeof(stats->board), "%s", board);
+    size_t chunk = batch > 0 ? (size_t)batch : 1;
+    RedisEndpoint nodes[REDIS_NODES_MAX];
+    size_t node_count = redis_pool_scan_nodes(REDIS_ROUTE_READ, nodes, REDIS_NODES_MAX);
+
+    char temp_path[1040];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    ExportWriter writer = { fopen(temp_path, "wb") };
+    if (writer.file == NULL) {
+        fprintf(stderr, "Failed to create %s: %s\n", temp_path, strerror(errno));
+        return -1;
+    }
+    setvbuf(writer.file, NULL, _IOFBF, FILE_BUFFER);
+    char (*ids)[THREAD_ID_MAX] = malloc(sizeof(*ids) * chunk);
+    RedisBatch *reads = redis_batch_new(REDIS_ROUTE_READ);
+    RedisBatch *lists = redis_batch_new(REDIS_ROUTE_READ);
+    JsonBuffer record = { 0 };
+    int status = ids && reads && lists && node_count > 0 ? 0 : -1;
+
+    if (status == 0 && (flags & BOARD_EXPORT_ZSTD)) {
+        writer.cctx = ZSTD_createCCtx();
+        writer.out_size = ZSTD_CStreamOutSize();
+        writer.out = malloc(writer.out_size);
+        if (writer.cctx == NULL || writer.out == NULL) status = -1;
+        else if (ZSTD_isError(ZSTD_CCtx_setParameter(writer.cctx, ZSTD_c_compressionLevel, compress_level)) ||
+                 ZSTD_isError(ZSTD_CCtx_setParameter(writer.cctx, ZSTD_c_checksumFlag, 1))) {
+            status = -1;
+        }
+    }
+    if (status == 0) {
+        char header[EXPORT_HEADER_SIZE];
+        memcpy(header, EXPORT_MAGIC, 8);
+        put_u32(header + 8, EXPORT_VERSION);
+        put_u32(header + 12, flags & BOARD_EXPORT_ZSTD);
+        status = write_file(&writer, header, sizeof(header));
+    }
+    if (status == 0) {
+        start_record(&record, RECORD_BOARD);
+        status = json_append(&record, board, strlen(board)) == 0 ? finish_record(&writer, &record) : -1;
+    }
+
+    char pattern[300];
+    format_title_pattern(pattern, sizeof(pattern), board);
+    for (size_t node = 0; node < node_count && status == 0; node++) {
+        char cursor[32] = "0";
+        do {
+            if (cancelled && __atomic_load_n(cancelled, __ATOMIC_RELAXED)) {
+                status = -1;
+                break;
+            }
+            redisReply *reply = redis_scan_step(&nodes[node], cursor, pattern, scan_count);
+            stats->round_trips++;
+            if (reply == NULL) {
+                status = -1;
+                break;
+            }
+            snprintf(cursor, sizeof(cursor), "%s", reply->element[0]->str);
+
+            redisReply *keys = reply->element[1];
+            size_t n = 0;
+            for (size_t i = 0; i < keys->elements && status == 0; i++) {
+                if (extract_thread_id(keys->element[i]->str, ids[n], THREAD_ID_MAX)) n++;
+                if (n == chunk || (i + 1 == keys->elements && n > 0)) {
+                    status = export_threads(&writer, &record, reads, lists, board, ids, n, stats);
+                    n = 0;
+                }
+            }
+            freeReplyObject(reply);
+        } while (status == 0 && strcmp(cursor, "0") != 0);
+    }
+
+    if (status == 0) {
+        start_record(&record, RECORD_END);
+        status = append_u64(&record, stats->threads) | append_u64(&record, stats->posts);
+        if (status == 0) status = finish_record(&writer, &record);
+    }
+    if (status == 0 && writer.cctx) status = write_stream(&writer, NULL, 0, ZSTD_e_end);
+    if (status == 0 && (fflush(writer.file) != 0 || fsync(fileno(writer.file)) != 0)) {
+        fprintf(stderr, "Writing %s failed: %s\n", temp_path, strerror(errno));
+        status = -1;
+    }
+    if (fclose(writer.file) != 0) status = -1;
+    if (status == 0 && rename(temp_path, path) != 0) {
+        fprintf(stderr, "Failed to rename %s to %s: %s\n", temp_path, path, strerror(errno));
+        status = -1;
+    }
+    if (status != 0) unlink(temp_path);
+    stats->file_bytes = writer.bytes;
+
+    free(record.data);
+    free(writer.out);
+    ZSTD_freeCCtx(writer.cctx);
+    redis_batch_free(lists);
+    redis_batch_free(reads);
+    free(ids);
+    return status;
+}
+
+// --- Import ----------------------------------------------------------------------------------
+
+typedef struct {
+    FILE *file;
+    ZSTD_DCtx *dctx;     // NULL for an uncompressed file
+    char *in_data;
+    size_t in_capacity;
+    ZSTD_inBuffer in;
+    uint64_t bytes;      // Read from the file
+} ImportReader;
+
+// Exactly length bytes of the record stream; -1 if the file ends first or can't be decompressed
+static int read_stream(ImportReader *reader, void *data, size_t length) {
+    if (reader->dctx == NULL) {
+        size_t read = fread(data, 1, length, reader->file);
+        reader->bytes += read;
+        return read == length ? 0 : -1;
+    }
+    ZSTD_outBuffer out = { data, length, 0 };
+    while (out.pos < out.size) {
+        if (reader->in.pos == reader->in.size) {
+            size_t read = fread(reader->in_data, 1, reader->in_capacity, reader->file);
+            if (read == 0) return -1;
+            reader->bytes += read;
+            reader->in = (ZSTD_inBuffer){ reader->in_data, read, 0 };
+        }
+        size_t result = ZSTD_decompressStream(reader->dctx, &out, &reader->in);
+        if (ZSTD_isError(result)) {
+            fprintf(stderr, "Decompressing the import failed: %s\n", ZSTD_getErrorName(result));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// The next record's payload into payload; -1 if the file ends early or the record is damaged
+static int read_record(ImportReader *reader, JsonBuffer *payload, uint32_t *type) {
+    char header[8], trailer[4];
+    if (read_stream(reader, header, sizeof(header)) != 0) return -1;
+    *type = get_u32(header);
+    uint32_t length = get_u32(header + 4);
+    if (length > RECORD_MAX) return -1;
+    if (payload->capacity < (size_t)length + 1) {
+        char *data = realloc(payload->data, (size_t)length + 1);
+        if (data == NULL) return -1;
+        payload->data = data;
+        payload->capacity = (size_t)length + 1;
+    }
+    if (read_stream(reader, payload->data, length) != 0 || read_stream(reader, trailer, sizeof(trailer)) != 0) return -1;
+    payload->length = length;
+    payload->data[length] = '\0';
+    return fnv1a(fnv1a(FNV_OFFSET, header, sizeof(header)), payload->data, length) == get_u32(trailer) ? 0 : -1;
+}
+
+// Writes of the threads read since the last flush
+typedef struct {
+    RedisBatch *writes;
+    char (*ids)[THREAD_ID_MAX];
+    const char **id_list;      // Points into ids, for board_index_refresh
+    size_t threads;
+    size_t bytes;
+    const char *argv[IMPORT_PUSH + 2];
+    size_t argvlen[IMPORT_PUSH + 2];
+    char *encoded[IMPORT_PUSH];
+} ImportBatch;
+
+// Consume length bytes of a record; NULL if it has fewer left
+static const char *take(const char **at, const char *end, size_t length) {
+    if ((size_t)(end - *at) < length) return NULL;
+    const char *taken = *at;
+    *at += length;
+    return taken;
+}
+
+static const char *take_field(const char **at, const char *end, uint32_t *length) {
+    const char *prefix = take(at, end, 4);
+    if (prefix == NULL) return NULL;
+    *length = get_u32(prefix);
+    return take(at, end, *length);
+}
+
+// One RPUSH of the n posts queued in argv; a command that can't be built fails the batch's execute
+static void push_posts(ImportBatch *pending, const char *staging, size_t n) {
+    redis_batch_append_argv(pending->writes, staging, (int)n + 2, pending->argv, pending->argvlen);
+    for (size_t i = 0; i < n; i++) {
+        free(pending->encoded[i]);
+        pending->encoded[i] = NULL;
+    }
+}
+
+// Queue the writes that replace one thread with a THRD record. The posts go to a staging list
+// in the same hash slot, renamed over the thread's list, as a native ingest does; they are
+// compressed first when compress_posts is set. -1 if the record doesn't parse.
+static int import_thread(ImportBatch *pending, const char *board, const char *payload, size_t length, BoardExportStats *stats) {
+    const char *at = payload, *end = payload + length;
+    const char *fixed = take(&at, end, 16);
+    uint32_t title_length, status_length;
+    const char *title = fixed ? take_field(&at, end, &title_length) : NULL;
+    const char *status_text = title ? take_field(&at, end, &status_length) : NULL;
+    if (status_text == NULL) return -1;
+    uint32_t count = get_u32(fixed + 8), post_count = get_u32(fixed + 12);
+
+    char *thread_id = pending->ids[pending->threads];
+    snprintf(thread_id, THREAD_ID_MAX, "%" PRIu64, get_u64(fixed));
+    char key[320], staging[340];
+    format_thread_key(key, sizeof(key), board, thread_id, "posts");
+    snprintf(staging, sizeof(staging), "{%s}_import", key);
+    if (post_count > 0) redis_batch_append(pending->writes, staging, "DEL %s", staging);
+
+    pending->argv[0] = "RPUSH";
+    pending->argvlen[0] = 5;
+    pending->argv[1] = staging;
+    pending->argvlen[1] = strlen(staging);
+    size_t queued = 0;
+    int status = 0;
+    for (uint32_t i = 0; i < post_count; i++) {
+        uint32_t post_length;
+        const char *post = take_field(&at, end, &post_length);
+        if (post == NULL || post_codec_is_compressed(post, post_length)) {
+            status = -1;
+            break;
+        }
+        char *encoded;
+        size_t encoded_length;
+        if (post_codec_encode(board, post, post_length, &encoded, &encoded_length) != 0) {
+            status = -1;
+            break;
+        }
+        pending->encoded[queued] = encoded;
+        pending->argv[2 + queued] = encoded ? encoded : post;
+        pending->argvlen[2 + queued] = encoded ? encoded_length : post_length;
+        pending->bytes += pending->argvlen[2 + queued];
+        stats->post_bytes += post_length;
+        if (++queued == IMPORT_PUSH || i + 1 == post_count) {
+            push_posts(pending, staging, queued);
+            queued = 0;
+        }
+    }
+    for (size_t i = 0; i < queued; i++) {
+        free(pending->encoded[i]);
+        pending->encoded[i] = NULL;
+    }
+    if (status != 0 || at != end) return -1;
+
+    if (post_count > 0) redis_batch_append(pending->writes, staging, "RENAME %s %s", staging, key);
+    else redis_batch_append(pending->writes, key, "DEL %s", key);
+    // One MSET on a single server; on a cluster the three keys hash to different slots
+    char keys[3][320], count_text[16];
+    format_thread_key(keys[0], sizeof(keys[0]), board, thread_id, "title");
+    format_thread_key(keys[1], sizeof(keys[1]), board, thread_id, "count");
+    format_thread_key(keys[2], sizeof(keys[2]), board, thread_id, "status");
+    snprintf(count_text, sizeof(count_text), "%" PRIu32, count);
+    const char *values[3] = { title, count_text, status_text };
+    size_t value_lengths[3] = { title_length, strlen(count_text), status_length };
+    if (redis_batch_is_cluster(pending->writes)) {
+        for (int f = 0; f < 3; f++) redis_batch_append(pending->writes, keys[f], "SET %s %b", keys[f], values[f], value_lengths[f]);
+    } else {
+        const char *argv[7] = { "MSET" };
+        size_t argvlen[7] = { 4 };
+        for (int f = 0; f < 3; f++) {
+            argv[1 + f * 2] = keys[f];
+            argvlen[1 + f * 2] = strlen(keys[f]);
+            argv[2 + f * 2] = values[f];
+            argvlen[2 + f * 2] = value_lengths[f];
+        }
+        redis_batch_append_argv(pending->writes, keys[0], 7, argv, argvlen);
+    }
+
+    pending->id_list[pending->threads++] = thread_id;
+    stats->threads++;
+    stats->posts += post_count;
+    return 0;
+}
+
+// Send the queued writes as one pipeline per node, then bring the board's sorted index up to date
+static int flush_import(ImportBatch *pending, const char *board, BoardExportStats *stats) {
+    if (pending->threads == 0) return 0;
+    int status = redis_batch_execute(pending->writes);
+    for (size_t i = 0; status == 0 && i < redis_batch_count(pending->writes); i++) {
+        const redisReply *reply = redis_batch_reply(pending->writes, i);
+        if (reply->type == REDIS_REPLY_ERROR) {
+            fprintf(stderr, "Importing threads into /%s/ failed: %s\n", board, reply->str);
+            status = -1;
+        }
+    }
+    stats->round_trips++;
+    if (status == 0) status = board_index_refresh(board, pending->id_list, pending->threads);
+    redis_batch_clear(pending->writes);
+    pending->threads = 0;
+    pending->bytes = 0;
+    return status;
+}
+
+// Load an export into board, which need not be the board it came from, in pipelines of batch
+// threads (fewer when their posts pass IMPORT_BATCH_BYTES). Threads in the file replace those
+// with the same ID; other threads of the board are kept. Every thread written is complete, but
+// an import that fails part-way leaves the threads before the failure in place.
+int board_import(const char *board, const char *path, int batch, const int *cancelled, BoardExportStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    size_t chunk = batch > 0 ? (size_t)batch : 1;
+    ImportReader reader = { fopen(path, "rb") };
+    if (reader.file == NULL) {
+        fprintf(stderr, "Failed to open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    setvbuf(reader.file, NULL, _IOFBF, FILE_BUFFER);
+    ImportBatch *pending = calloc(1, sizeof(ImportBatch));
+    if (pending) {
+        pending->writes = redis_batch_new(REDIS_ROUTE_PRIMARY);
+        pending->ids = malloc(sizeof(*pending->ids) * chunk);
+        pending->id_list = malloc(sizeof(char *) * chunk);
+    }
+    JsonBuffer payload = { 0 };
+    int status = pending && pending->writes && pending->ids && pending->id_list ? 0 : -1;
+
+    char header[EXPORT_HEADER_SIZE];
+    if (status == 0 && (fread(header, 1, sizeof(header), reader.file) != sizeof(header) || memcmp(header, EXPORT_MAGIC, 8) != 0 ||
+                        get_u32(header + 8) != EXPORT_VERSION)) {
+        fprintf(stderr, "%s is not a board export this version can read\n", path);
+        status = -1;
+    }
+    reader.bytes = sizeof(header);
+    if (status == 0 && (get_u32(header + 12) & BOARD_EXPORT_ZSTD)) {
+        reader.dctx = ZSTD_createDCtx();
+        reader.in_capacity = ZSTD_DStreamInSize();
+        reader.in_data = malloc(reader.in_capacity);
+        if (reader.dctx == NULL || reader.in_data == NULL) status = -1;
+    }
+
+    int ended = 0;
+    while (status == 0 && !ended) {
+        uint32_t type;
+        if (read_record(&reader, &payload, &type) != 0) {
+            fprintf(stderr, "%s is damaged or cut short after %" PRIu64 " threads\n", path, stats->threads);
+            status = -1;
+        } else if (type == RECORD_BOARD) {
+            snprintf(stats->board, sizeof(stats->board), "%s", payload.data);
+        } else if (type == RECORD_THREAD) {
+            if (import_thread(pending, board, payload.data, payload.length, stats) != 0) {
+                fprintf(stderr, "%s has a damaged thread record after %" PRIu64 " threads\n", path, stats->threads);
+                status = -1;
+            } else if (pending->threads == chunk || pending->bytes >= IMPORT_BATCH_BYTES) {
+                if (cancelled && __atomic_load_n(cancelled, __ATOMIC_RELAXED)) status = -1;
+                else status = flush_import(pending, board, stats);
+            }
+        } else if (type == RECORD_END) {
+            ended = 1;
+            if (payload.length != 16 || get_u64(payload.data) != stats->threads || get_u64(payload.data + 8) != stats->posts) {
+                fprintf(stderr, "%s holds %" PRIu64 " threads, %" PRIu64 " posts; its end record disagrees\n", path, stats->threads,
+                        stats->posts);
+                status = -1;
+            }
+        }
+        // Records of other types come from a newer writer and are skipped
+    }
+    if (status == 0) status = flush_import(pending, board, stats);
+    stats->file_bytes = reader.bytes;
+
+    if (pending) {
+        redis_batch_free(pending->writes);
+        free(pending->ids);
+        free(pending->id_list);
+        free(pending);
+    }
+    free(payload.data);
+    free(reader.in_data);
+    ZSTD_freeDCtx(reader.dctx);
+    fclose(reader.file);
+    return status;
+}
@@ -0,0 +1,471 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+#include "../include/board_index.h"
+
+// The indexes follow the archiver's own writes: finished add, delete, title and update jobs
+// and archive moves refresh the threads they touched, reading the thread keys and rewriting
+// their index entries, and so do the keyspace events for changes the external scraper makes
+// while the window is open. Nothing is written for a board whose index was never built, so a
+// board only switches to paged listing once it is complete.
+//
+// A rebuild lists the board once and renames its result over the live keys at the end, so a
+// refresh in between would be lost. It holds {<board>_index}_lock while it runs; a refresh that
+// sees the lock also adds its IDs to {<board>_index}_pending, and the rebuild refreshes those
+// again after the rename, before it lets go of the lock.
+
+enum { INDEX_ID, INDEX_COUNT, INDEX_STATUS, INDEX_THREADS, INDEX_KEYS };
+
+static const char *index_names[INDEX_KEYS] = { "id", "count", "status", "threads" };
+
+#define INDEX_STAGING "_rebuild"  // Suffix of the keys a rebuild fills before renaming them over the live ones
+#define INDEX_LOCK_MS 60000       // Lifetime of the rebuild lock; renewed with every pipeline, so it only
+                                  // runs out when the rebuilding process died
+
+void format_board_index_key(char *buf, size_t size, const char *board, const char *name) {
+    snprintf(buf, size, "{%s_index}_%s", board, name);
+}
+
+static void index_key(char *buf, size_t size, const char *board, int index, const char *suffix) {
+    char name[64];
+    snprintf(name, sizeof(name), "%s%s", index_names[index], suffix);
+    format_board_index_key(buf, size, board, name);
+}
+
+const char *board_index_order_name(BoardIndexOrder order) {
+    return index_names[order == BOARD_INDEX_BY_COUNT ? INDEX_COUNT : order == BOARD_INDEX_BY_STATUS ? INDEX_STATUS : INDEX_ID];
+}
+
+int parse_board_index_order(const char *name, BoardIndexOrder *order) {
+    if (strcmp(name, "id") == 0) *order = BOARD_INDEX_BY_ID;
+    else if (strcmp(name, "count") == 0) *order = BOARD_INDEX_BY_COUNT;
+    else if (strcmp(name, "status") == 0) *order = BOARD_INDEX_BY_STATUS;
+    else return -1;
+    return 0;
+}
+
+// A score that orders statuses like their first six bytes do; a double holds those 48 bits
+// exactly. "active", "archived", "closed" and "dead" all differ within six bytes. Threads
+// with the same status come out in member order, which for IDs of equal length is ID order.
+double board_index_status_score(const char *status) {
+    uint64_t value = 0;
+    for (int i = 0; i < 6; i++) {
+        value = value << 8 | (status && *status ? (unsigned char)*status : 0);
+        if (status && *status) status++;
+    }
+    return (double)value;
+}
+
+// --- Rows ------------------------------------------------------------------------------------
+
+static char *format_row(const char *title, int count, const char *status) {
+    size_t size = strlen(title) + strlen(status) + 16;
+    char *row = malloc(size);
+    if (row) snprintf(row, size, "%d\t%s\t%s", count, status, title);
+    return row;
+}
+
+// Hand each thread of an HMGET reply on the rows hash to fn, in the order of ids. Threads
+// without a row are skipped: the sorted sets and the hash are written together, so a missing
+// row only means the thread was removed between the two reads.
+void deliver_index_rows(char (*ids)[THREAD_ID_MAX], size_t n, const redisReply *rows, thread_record_fn fn, void *user_data) {
+    if (rows == NULL || rows->type != REDIS_REPLY_ARRAY || rows->elements != n) return;
+    for (size_t i = 0; i < n; i++) {
+        const redisReply *row = rows->element[i];
+        if (row->type != REDIS_REPLY_STRING) continue;
+        const char *status = strchr(row->str, '\t');
+        const char *title = status ? strchr(status + 1, '\t') : NULL;
+        if (title == NULL) continue;
+
+        char status_text[64];
+        snprintf(status_text, sizeof(status_text), "%.*s", (int)(title - status - 1), status + 1);
+        fn(ids[i], title + 1, atoi(row->str), status_text, user_data);
+    }
+}
+
+// --- Writes ----------------------------------------------------------------------------------
+
+// One thread's index entry; a NULL title removes it
+typedef struct {
+    const char *id;
+    const char *title;
+    int count;
+    const char *status;
+} IndexEntry;
+
+// Queue the writes for n entries: one ZADD per sorted set and one HSET for the threads that
+// exist, one ZREM per sorted set and one HDEL for those that are gone. All go to the index's
+// node as a single pipeline. suffix picks the live keys ("") or a rebuild's staging keys.
+static void append_index_writes(RedisBatch *batch, const char *board, const IndexEntry *entries, size_t n, const char *suffix) {
+    const char **argv = malloc(sizeof(char *) * (2 + 2 * n));
+    char (*scores)[32] = malloc(sizeof(*scores) * (n ? n : 1));
+    char **rows = calloc(n ? n : 1, sizeof(char *));
+    if (argv == NULL || scores == NULL || rows == NULL) {
+        free(argv);
+        free(scores);
+        free(rows);
+        return;
+    }
+
+    char key[320];
+    for (int index = 0; index < INDEX_KEYS; index++) {
+        index_key(key, sizeof(key), board, index, suffix);
+        int argc = 2;
+        argv[0] = index == INDEX_THREADS ? "HSET" : "ZADD";
+        argv[1] = key;
+        for (size_t i = 0; i < n; i++) {
+            const IndexEntry *entry = &entries[i];
+            if (entry->title == NULL) continue;
+            if (index == INDEX_THREADS) {
+                if (rows[i] == NULL && (rows[i] = format_row(entry->title, entry->count, entry->status)) == NULL) continue;
+                argv[argc++] = entry->id;
+                argv[argc++] = rows[i];
+                continue;
+            }
+            if (index == INDEX_ID) snprintf(scores[i], sizeof(scores[i]), "%s", entry->id);
+            else if (index == INDEX_COUNT) snprintf(scores[i], sizeof(scores[i]), "%d", entry->count);
+            else snprintf(scores[i], sizeof(scores[i]), "%.0f", board_index_status_score(entry->status));
+            argv[argc++] = scores[i];
+            argv[argc++] = entry->id;
+        }
+        if (argc > 2) redis_batch_append_argv(batch, key, argc, argv, NULL);
+
+        argc = 2;
+        argv[0] = index == INDEX_THREADS ? "HDEL" : "ZREM";
+        for (size_t i = 0; i < n; i++) {
+            if (entries[i].title == NULL) argv[argc++] = entries[i].id;
+        }
+        if (argc > 2) redis_batch_append_argv(batch, key, argc, argv, NULL);
+    }
+
+    for (size_t i = 0; i < n; i++) free(rows[i]);
+    free(rows);
+    free(scores);
+    free(argv);
+}
+
+// 0 if every reply from index first on is a success, else -1 with the first error printed
+static int check_replies(const RedisBatch *batch, size_t first, const char *what) {
+    for (size_t i = first; i < redis_batch_count(batch); i++) {
+        const redisReply *reply = redis_batch_reply(batch, i);
+        if (reply == NULL || reply->type == REDIS_REPLY_ERROR) {
+            fprintf(stderr, "%s failed: %s\n", what, reply ? reply->str : "no reply");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    IndexEntry *entries;
+    size_t n;
+} EntryList;
+
+static void collect_entry(const char *thread_id, const char *title, int count, const char *status, void *user_data) {
+    EntryList *list = user_data;
+    list->entries[list->n++] = (IndexEntry){ thread_id, title, count, status };
+}
+
+// track_pending: note the IDs for a running rebuild, off for the rebuild's own catch-up
+static int refresh_threads(const char *board, const char *const *ids, size_t n, int track_pending) {
+    if (n == 0) return 0;
+    char (*copies)[THREAD_ID_MAX] = malloc(sizeof(*copies) * n);
+    IndexEntry *entries = malloc(sizeof(IndexEntry) * n);
+    RedisBatch *reads = copies && entries ? redis_batch_new(REDIS_ROUTE_PRIMARY) : NULL;
+    RedisBatch *writes = reads ? redis_batch_new(REDIS_ROUTE_PRIMARY) : NULL;
+    int status = writes ? 0 : -1;
+
+    if (status == 0) {
+        for (size_t i = 0; i < n; i++) snprintf(copies[i], THREAD_ID_MAX, "%s", ids[i]);
+        char key[320], lock_key[320];
+        index_key(key, sizeof(key), board, INDEX_ID, "");
+        format_board_index_key(lock_key, sizeof(lock_key), board, "lock");
+        size_t exists = redis_batch_append(reads, key, "EXISTS %s", key);
+        redis_batch_append(reads, lock_key, "EXISTS %s", lock_key);
+        size_t first = redis_batch_append_thread_fields(reads, board, copies, n);
+        status = redis_batch_execute(reads) == 0 ? check_replies(reads, 0, "Reading threads for the sorted index") : -1;
+
+        // Recorded even while the board has no index yet, so the first build picks them up too
+        if (status == 0 && track_pending && redis_batch_reply(reads, exists + 1)->integer > 0) {
+            char pending_key[320];
+            format_board_index_key(pending_key, sizeof(pending_key), board, "pending");
+            const char **argv = malloc(sizeof(char *) * (2 + 2 * n));
+            if (argv == NULL) status = -1;
+            for (size_t i = 0; argv && i < n; i++) {
+                argv[2 + 2 * i] = "0";
+                argv[3 + 2 * i] = copies[i];
+            }
+            if (argv) {
+                argv[0] = "ZADD";
+                argv[1] = pending_key;
+                redis_batch_append_argv(writes, pending_key, (int)(2 + 2 * n), argv, NULL);
+                free(argv);
+            }
+        }
+        // The strings in entries point into the read replies, which live until the batch is freed
+        if (status == 0 && redis_batch_reply(reads, exists)->integer > 0) {
+            EntryList list = { entries, 0 };
+            redis_batch_deliver_thread_fields(reads, first, copies, n, collect_entry, &list);
+            append_index_writes(writes, board, entries, list.n, "");
+        }
+        if (status == 0 && redis_batch_count(writes) > 0) {
+            status = redis_batch_execute(writes) == 0 ? check_replies(writes, 0, "Updating the sorted index") : -1;
+        }
+    }
+
+    redis_batch_free(writes);
+    redis_batch_free(reads);
+    free(entries);
+    free(copies);
+    return status;
+}
+
+// Re-read n threads from their primaries and rewrite their index entries, removing those that
+// no longer exist. Two round trips; does nothing if the board has no index. Returns -1 if Redis failed.
+int board_index_refresh(const char *board, const char *const *ids, size_t n) {
+    return refresh_threads(board, ids, n, 1);
+}
+
+// Refresh every indexed thread, batch at a time in ID order, after a job that may have changed
+// any of them. Returns -1 if Redis failed.
+int board_index_refresh_all(const char *board, int batch) {
+    RedisBatch *ranges = redis_batch_new(REDIS_ROUTE_PRIMARY);
+    const char **ids = malloc(sizeof(char *) * (batch > 0 ? batch : 1));
+    int status = ranges && ids ? 0 : -1;
+    char key[320];
+    index_key(key, sizeof(key), board, INDEX_ID, "");
+
+    // Ranges by score, after the last ID seen, so threads removed meanwhile don't shift the window
+    char after[THREAD_ID_MAX + 1] = "-inf";
+    while (status == 0) {
+        redis_batch_clear(ranges);
+        size_t range = redis_batch_append(ranges, key, "ZRANGEBYSCORE %s %s +inf LIMIT 0 %d", key, after, batch);
+        status = redis_batch_execute(ranges) == 0 ? check_replies(ranges, 0, "Reading the sorted index") : -1;
+        const redisReply *reply = status == 0 ? redis_batch_reply(ranges, range) : NULL;
+        if (reply == NULL || reply->type != REDIS_REPLY_ARRAY || reply->elements == 0) break;
+
+        for (size_t i = 0; i < reply->elements; i++) ids[i] = reply->element[i]->str;
+        status = board_index_refresh(board, ids, reply->elements);
+        snprintf(after, sizeof(after), "(%s", reply->element[reply->elements - 1]->str);
+        if (reply->elements < (size_t)batch) break;
+    }
+
+    free(ids);
+    redis_batch_free(ranges);
+    return status;
+}
+
+// Take the board's rebuild lock; 0 when it is ours, 1 when another rebuild holds it
+static int lock_rebuild(RedisBatch *batch, const char *lock_key, const char *token) {
+    redis_batch_clear(batch);
+    size_t set = redis_batch_append(batch, lock_key, "SET %s %s NX PX %d", lock_key, token, INDEX_LOCK_MS);
+    if (redis_batch_execute(batch) != 0 || check_replies(batch, 0, "Locking the sorted index") != 0) return -1;
+    return redis_batch_reply(batch, set)->type == REDIS_REPLY_NIL ? 1 : 0;
+}
+
+// Release the lock unless it expired and another rebuild took it meanwhile
+static void unlock_rebuild(RedisBatch *batch, const char *lock_key, const char *token) {
+    redis_batch_clear(batch);
+    size_t get = redis_batch_append(batch, lock_key, "GET %s", lock_key);
+    if (redis_batch_execute(batch) != 0) return;
+    const redisReply *holder = redis_batch_reply(batch, get);
+    if (holder->type != REDIS_REPLY_STRING || strcmp(holder->str, token) != 0) return;
+    redis_batch_clear(batch);
+    redis_batch_append(batch, lock_key, "DEL %s", lock_key);
+    redis_batch_execute(batch);
+}
+
+// Refresh the threads refreshes noted while the rebuild ran, batch at a time, with the lock
+// still held so none are added behind the last read
+static int refresh_pending(RedisBatch *ranges, const char *board, const char *pending_key, int batch, BoardIndexStats *stats) {
+    const char **ids = malloc(sizeof(char *) * (batch > 0 ? batch : 1));
+    int status = ids ? 0 : -1;
+    while (status == 0) {
+        redis_batch_clear(ranges);
+        size_t range = redis_batch_append(ranges, pending_key, "ZRANGE %s 0 %d", pending_key, batch - 1);
+        status = redis_batch_execute(ranges) == 0 ? check_replies(ranges, 0, "Reading the pending index updates") : -1;
+        const redisReply *reply = status == 0 ? redis_batch_reply(ranges, range) : NULL;
+        if (reply == NULL || reply->type != REDIS_REPLY_ARRAY || reply->elements == 0) break;
+
+        for (size_t i = 0; i < reply->elements; i++) ids[i] = reply->element[i]->str;
+        status = refresh_threads(board, ids, reply->elements, 0);
+        stats->round_trips += 2;
+        if (status == 0) {
+            RedisBatch *removal = redis_batch_new(REDIS_ROUTE_PRIMARY);
+            const char **argv = malloc(sizeof(char *) * (2 + reply->elements));
+            if (removal && argv) {
+                argv[0] = "ZREM";
+                argv[1] = pending_key;
+                memcpy(argv + 2, ids, sizeof(char *) * reply->elements);
+                redis_batch_append_argv(removal, pending_key, (int)(2 + reply->elements), argv, NULL);
+                status = redis_batch_execute(removal) == 0 ? check_replies(removal, 0, "Clearing the pending index updates") : -1;
+                stats->round_trips++;
+            } else {
+                status = -1;
+            }
+            free(argv);
+            redis_batch_free(removal);
+        }
+    }
+    free(ids);
+    return status;
+}
+
+// Build the board's index from scratch: list the board with SCAN, fill staging keys in
+// batch-sized pipelines, then rename them over the live keys, so readers see the old index
+// until the new one is complete. Also the migration for boards that never had one. Holds the
+// board's rebuild lock throughout; returns -1 at once if another rebuild holds it.
+int board_index_rebuild(const char *board, int scan_count, int batch, const int *cancelled, BoardIndexStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    char lock_key[320], pending_key[320], token[64];
+    format_board_index_key(lock_key, sizeof(lock_key), board, "lock");
+    format_board_index_key(pending_key, sizeof(pending_key), board, "pending");
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    snprintf(token, sizeof(token), "%ld:%lld.%09ld", (long)getpid(), (long long)now.tv_sec, (long)now.tv_nsec);
+
+    RedisBatch *writes = redis_batch_new(REDIS_ROUTE_PRIMARY);
+    int locked = writes ? lock_rebuild(writes, lock_key, token) : -1;
+    if (locked == 1) fprintf(stderr, "The sorted index of /%s/ is already being rebuilt\n", board);
+    if (locked != 0) {
+        redis_batch_free(writes);
+        return -1;
+    }
+    stats->round_trips++;
+    // A rebuild that died left these behind; what they named is in the listing below. Cleared
+    // before listing, so anything noted from here on is newer than the listing.
+    redis_batch_clear(writes);
+    redis_batch_append(writes, pending_key, "DEL %s", pending_key);
+    redis_batch_execute(writes);
+
+    ThreadSnapshot *snapshot = fetch_thread_list(board, scan_count, batch);
+    size_t chunk = batch > 0 ? (size_t)batch : 1;
+    char (*ids)[THREAD_ID_MAX] = malloc(sizeof(*ids) * chunk);
+    IndexEntry *entries = malloc(sizeof(IndexEntry) * chunk);
+    int status = snapshot && ids && entries ? 0 : -1;
+
+    char staging[INDEX_KEYS][320], live[INDEX_KEYS][320];
+    const char *staging_keys[INDEX_KEYS];
+    for (int index = 0; index < INDEX_KEYS; index++) {
+        index_key(staging[index], sizeof(staging[index]), board, index, INDEX_STAGING);
+        index_key(live[index], sizeof(live[index]), board, index, "");
+        staging_keys[index] = staging[index];
+    }
+
+    // Left over from a rebuild that was interrupted
+    if (status == 0) {
+        redis_batch_clear(writes);
+        redis_batch_append_keys(writes, "DEL", staging_keys, INDEX_KEYS);
+        status = redis_batch_execute(writes) == 0 ? check_replies(writes, 0, "Clearing the sorted index") : -1;
+        stats->round_trips++;
+    }
+
+    for (size_t first = 0; status == 0 && first < snapshot->count; first += chunk) {
+        if (cancelled && __atomic_load_n(cancelled, __ATOMIC_RELAXED)) {
+            status = -1;
+            break;
+        }
+        size_t n = 0;
+        for (size_t i = first; i < snapshot->count && i < first + chunk; i++) {
+            const ThreadSnapshotRecord *record = &snapshot->records[i];
+            if (record->flags & THREAD_RECORD_DELETED) continue;
+            snprintf(ids[n], THREAD_ID_MAX, "%" PRIu64, record->id);
+            entries[n] = (IndexEntry){ ids[n], thread_snapshot_title(snapshot, record), record->count,
+                                       thread_snapshot_status(snapshot, record) };
+            n++;
+        }
+        redis_batch_clear(writes);
+        append_index_writes(writes, board, entries, n, INDEX_STAGING);
+        if (redis_batch_count(writes) == 0) continue;
+        redis_batch_append(writes, lock_key, "PEXPIRE %s %d", lock_key, INDEX_LOCK_MS);
+        status = redis_batch_execute(writes) == 0 ? check_replies(writes, 0, "Writing the sorted index") : -1;
+        stats->threads += n;
+        stats->round_trips++;
+    }
+
+    // An empty board has no staging keys to rename; its index is simply dropped
+    if (status == 0) {
+        redis_batch_clear(writes);
+        if (stats->threads == 0) {
+            const char *live_keys[INDEX_KEYS] = { live[0], live[1], live[2], live[3] };
+            redis_batch_append_keys(writes, "DEL", live_keys, INDEX_KEYS);
+        } else {
+            for (int index = 0; index < INDEX_KEYS; index++) {
+                redis_batch_append(writes, staging[index], "RENAME %s %s", staging[index], live[index]);
+            }
+        }
+        status = redis_batch_execute(writes) == 0 ? check_replies(writes, 0, "Replacing the sorted index") : -1;
+        stats->round_trips++;
+    } else {
+        redis_batch_clear(writes);
+        redis_batch_append_keys(writes, "DEL", staging_keys, INDEX_KEYS);
+        redis_batch_execute(writes);
+    }
+    // Also after a failure: those threads are refreshed in the old index, which is still live
+    if (refresh_pending(writes, board, pending_key, (int)chunk, stats) != 0) status = -1;
+
+    unlock_rebuild(writes, lock_key, token);
+    free(entries);
+    free(ids);
+    redis_batch_free(writes);
+    if (snapshot) thread_snapshot_unref(snapshot);
+    return status;
+}
+
+// --- Reads -----------------------------------------------------------------------------------
+
+// Threads [start, start + count) of the board in the given order, and how many are indexed:
+// ZCARD and ZRANGE pipelined, then one HMGET of their rows, all on the index's node. *total
+// is 0 if the board has no index. Returns -1 if Redis failed.
+int fetch_board_index_page(const char *board, BoardIndexOrder order, int descending, long start, long count,
+                           thread_record_fn fn, void *user_data, long long *total) {
+    *total = 0;
+    RedisBatch *ranges = redis_batch_new(REDIS_ROUTE_READ);
+    RedisBatch *rows = ranges ? redis_batch_new(REDIS_ROUTE_READ) : NULL;
+    if (rows == NULL) {
+        redis_batch_free(ranges);
+        return -1;
+    }
+
+    char key[320], rows_key[320];
+    format_board_index_key(key, sizeof(key), board, board_index_order_name(order));
+    index_key(rows_key, sizeof(rows_key), board, INDEX_THREADS, "");
+    size_t card = redis_batch_append(ranges, key, "ZCARD %s", key);
+    redis_batch_append(ranges, key, "%s %s %ld %ld", descending ? "ZREVRANGE" : "ZRANGE", key, start, start + count - 1);
+    int status = redis_batch_execute(ranges) == 0 ? check_replies(ranges, 0, "Reading the sorted index") : -1;
+
+    const redisReply *range = status == 0 ? redis_batch_reply(ranges, card + 1) : NULL;
+    if (range && range->type == REDIS_REPLY_ARRAY && range->elements > 0) {
+        *total = redis_batch_reply(ranges, card)->integer;
+        size_t n = range->elements;
+        char (*ids)[THREAD_ID_MAX] = malloc(sizeof(*ids) * n);
+        const char **argv = malloc(sizeof(char *) * (n + 2));
+        if (ids && argv) {
+            argv[0] = "HMGET";
+            argv[1] = rows_key;
+            for (size_t i = 0; i < n; i++) {
+                snprintf(ids[i], THREAD_ID_MAX, "%s", range->element[i]->str);
+                argv[2 + i] = ids[i];
+            }
+            size_t hmget = redis_batch_append_argv(rows, rows_key, (int)n + 2, argv, NULL);
+            status = redis_batch_execute(rows) == 0 ? check_replies(rows, 0, "Reading the sorted index") : -1;
+            if (status == 0) deliver_index_rows(ids, n, redis_batch_reply(rows, hmget), fn, user_data);
+        } else {
+            status = -1;
+        }
+        free(argv);
+        free(ids);
+    } else if (status == 0) {
+        *total = redis_batch_reply(ranges, card)->integer;
+    }
+
+    redis_batch_free(rows);
+    redis_batch_free(ranges);
+    return status;
+}
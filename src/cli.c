@@ -0,0 +1,661 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include "../include/cli.h"
+#include "../include/settings.h"
+#include "../include/redis_operations.h"
+#include "../include/job_queue.h"
+#include "../include/scraper_jobs.h"
+#include "../include/scraper_rpc.h"
+#include "../include/json_scan.h"
+#include "../include/thread_ingest.h"
+#include "../include/metrics.h"
+#include "../include/board_index.h"
+#include "../include/post_codec.h"
+
+// Records go to stdout, one per line: tab-separated by default, JSON objects with --json.
+// Progress and job output go to stderr, and so does the closing summary in text mode.
+
+static int json_output = 0;
+static int show_stats = 0;  // --stats: listing timing and a latency summary at exit
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;  // Workers print concurrently
+
+static void usage() {
+    fprintf(stderr,
+            "usage: FourChanArchiver --headless [--json] [--stats] [--board NAME] [--host HOST] [--port PORT] COMMAND [ARGS]\n"
+            "  list                 every thread of the board: id, title, post count, status\n"
+            "  list --by id|count|status [--desc] [--offset N] [--limit N]\n"
+            "                       a page of the board's sorted index\n"
+            "  posts ID             a thread's posts in order: number and text\n"
+            "  add ID...|-          scrape threads, or import them when native_ingest is set\n"
+            "  delete ID...|-       delete threads\n"
+            "  title ID TITLE|-     set a thread title; '-' reads \"ID<TAB>TITLE\" lines\n"
+            "  update               refresh every stored thread\n"
+            "  audio ID...|-        generate audio summaries\n"
+            "  archive ID...|-      move threads from Redis to the archive file\n"
+            "  search [--limit N] QUERY   ranked post search\n"
+            "  reindex              rebuild the post search index\n"
+            "  sortindex            rebuild the board's sorted index\n"
+            "  compress [--retrain] compress the board's posts, training a dictionary if it has none\n"
+            "  export [--compress] FILE   write the board's threads and posts to FILE\n"
+            "  import FILE          load threads and posts exported to FILE into the board\n"
+            "'-' reads thread IDs from stdin, separated by whitespace or commas.\n");
+}
+
+// --- Output ----------------------------------------------------------------------------------
+
+// One output record under construction; fields are appended as "key", value pairs
+typedef struct {
+    JsonBuffer buffer;
+    int fields;
+} Record;
+
+static void record_key(Record *record, const char *key) {
+    if (json_output) {
+        json_append(&record->buffer, record->fields ? "," : "{", 1);
+        json_append_string(&record->buffer, key);
+        json_append(&record->buffer, ":", 1);
+    } else if (record->fields) {
+        json_append(&record->buffer, "\t", 1);
+    }
+    record->fields++;
+}
+
+static void record_string(Record *record, const char *key, const char *value) {
+    record_key(record, key);
+    if (json_output) {
+        json_append_string(&record->buffer, value ? value : "");
+        return;
+    }
+    // Tabs and newlines would split the row
+    for (const char *p = value ? value : ""; *p; p++) {
+        char c = (*p == '\t' || *p == '\n' || *p == '\r') ? ' ' : *p;
+        json_append(&record->buffer, &c, 1);
+    }
+}
+
+static void record_number(Record *record, const char *key, double value) {
+    char text[64];
+    if (value == (double)(int64_t)value) snprintf(text, sizeof(text), "%" PRId64, (int64_t)value);
+    else snprintf(text, sizeof(text), "%.3f", value);
+    record_key(record, key);
+    json_append(&record->buffer, text, strlen(text));
+}
+
+static void record_emit(Record *record, FILE *out) {
+    if (json_output) json_append(&record->buffer, record->fields ? "}" : "{}", record->fields ? 1 : 2);
+    pthread_mutex_lock(&output_lock);
+    fprintf(out, "%s\n", record->buffer.data ? record->buffer.data : "");
+    fflush(out);
+    pthread_mutex_unlock(&output_lock);
+    free(record->buffer.data);
+}
+
+static void on_job_output(unsigned job_id, const char *line, void *user_data) {
+    size_t length = strlen(line);
+    pthread_mutex_lock(&output_lock);
+    fprintf(stderr, "[#%u] %s%s", job_id, line, length && line[length - 1] == '\n' ? "" : "\n");
+    pthread_mutex_unlock(&output_lock);
+}
+
+// --- Job batches -----------------------------------------------------------------------------
+
+typedef struct {
+    const char *command;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    unsigned submitted;
+    unsigned finished;
+    unsigned succeeded;
+    unsigned failed;
+    unsigned skipped;
+    unsigned duplicates;   // Already queued by this batch
+    unsigned invalid;      // Input that is not a thread ID
+    unsigned highest_id;   // Job IDs only grow, so an older ID back from submit is a duplicate
+    int ids_listed;        // Jobs named by the user's ID list: a duplicate is reported by the job it joined
+    int64_t started_at_ms;
+} Batch;
+
+// Runs on a job worker: one record per finished job
+static void on_batch_job_done(const JobInfo *job, void *user_data) {
+    Batch *batch = user_data;
+    update_search_index(job);
+    update_board_index(job);
+
+    Record record = { 0 };
+    record_string(&record, "state", job_state_name(job->state));
+    record_string(&record, "command", job->name);
+    record_string(&record, "thread", job->thread_id);
+    record_number(&record, "job", job->id);
+    record_number(&record, "exit_code", job->exit_code);
+    record_number(&record, "wait_ms", job->started_at_ms ? job->started_at_ms - job->queued_at_ms : 0);
+    record_number(&record, "run_ms", job->started_at_ms ? job->finished_at_ms - job->started_at_ms : 0);
+    record_string(&record, "via", job->started_at_ms ? job_transport(job) : "");
+    record_emit(&record, stdout);
+
+    pthread_mutex_lock(&batch->lock);
+    batch->finished++;
+    if (job->state == JOB_SUCCEEDED) batch->succeeded++;
+    else if (job->state == JOB_SKIPPED) batch->skipped++;
+    else batch->failed++;
+    pthread_cond_signal(&batch->done);
+    pthread_mutex_unlock(&batch->lock);
+}
+
+static void batch_note_submitted(Batch *batch, unsigned job_id) {
+    pthread_mutex_lock(&batch->lock);
+    if (job_id == 0) {
+        batch->failed++;
+    } else if (job_id <= batch->highest_id) {
+        // Folded into an earlier job of this batch, whose own result covers it
+        if (batch->ids_listed) fprintf(stderr, "Submission folded into job #%u\n", job_id);
+        batch->duplicates++;
+    } else {
+        batch->highest_id = job_id;
+        batch->submitted++;
+    }
+    pthread_mutex_unlock(&batch->lock);
+}
+
+// Wait for every job of the batch, then report totals; the exit status is 1 if any job failed
+static int batch_finish(Batch *batch) {
+    pthread_mutex_lock(&batch->lock);
+    while (batch->finished < batch->submitted) pthread_cond_wait(&batch->done, &batch->lock);
+    pthread_mutex_unlock(&batch->lock);
+
+    int64_t elapsed = job_now_ms() - batch->started_at_ms;
+    double rate = elapsed > 0 ? batch->submitted * 1000.0 / elapsed : 0;
+    if (!json_output) {
+        fprintf(stderr, "%s: %u jobs, %u succeeded, %u failed, %u skipped, %u duplicates, %u invalid in %" PRId64 " ms (%.1f jobs/s)\n",
+                batch->command, batch->submitted, batch->succeeded, batch->failed, batch->skipped, batch->duplicates, batch->invalid,
+                elapsed, rate);
+        return batch->failed || batch->invalid ? 1 : 0;
+    }
+
+    Record record = { 0 };
+    record_string(&record, "summary", batch->command);
+    record_number(&record, "jobs", batch->submitted);
+    record_number(&record, "succeeded", batch->succeeded);
+    record_number(&record, "failed", batch->failed);
+    record_number(&record, "skipped", batch->skipped);
+    record_number(&record, "duplicates", batch->duplicates);
+    record_number(&record, "invalid", batch->invalid);
+    record_number(&record, "elapsed_ms", elapsed);
+    record_number(&record, "jobs_per_s", rate);
+    record_emit(&record, stdout);
+    return batch->failed || batch->invalid ? 1 : 0;
+}
+
+typedef unsigned (*submit_thread_fn)(const char *board, const char *thread_id, job_done_fn on_done, void *user_data);
+typedef void (*thread_id_fn)(Batch *batch, const char *thread_id, void *context);
+
+static unsigned submit_audio(const char *board, const char *thread_id, job_done_fn on_done, void *user_data) {
+    return submit_generate_audio(board, thread_id, NULL, on_done, user_data);
+}
+
+static unsigned submit_compress(const char *board, job_done_fn on_done, void *user_data) {
+    return submit_post_recompress(board, 0, on_done, user_data);
+}
+
+static unsigned submit_compress_retrain(const char *board, job_done_fn on_done, void *user_data) {
+    return submit_post_recompress(board, 1, on_done, user_data);
+}
+
+static int valid_thread_id(const char *id) {
+    if (*id == '\0' || strlen(id) >= THREAD_ID_MAX) return 0;
+    for (const char *p = id; *p; p++) {
+        if (!isdigit((unsigned char)*p)) return 0;
+    }
+    return 1;
+}
+
+static void take_thread_id(Batch *batch, const char *thread_id, thread_id_fn fn, void *context) {
+    if (!valid_thread_id(thread_id)) {
+        fprintf(stderr, "Skipping invalid thread ID '%s'\n", thread_id);
+        batch->invalid++;
+        return;
+    }
+    fn(batch, thread_id, context);
+}
+
+// Hand over each ID as it is read, so jobs start while stdin is still being consumed
+static void read_thread_ids(Batch *batch, FILE *in, thread_id_fn fn, void *context) {
+    char token[THREAD_ID_MAX + 1];
+    size_t length = 0;
+    int overlong = 0;
+    int c;
+    do {
+        c = getc(in);
+        if (c == EOF || isspace(c) || c == ',') {
+            token[length] = '\0';
+            if (overlong) take_thread_id(batch, "(too long)", fn, context);
+            else if (length) take_thread_id(batch, token, fn, context);
+            length = 0;
+            overlong = 0;
+        } else if (length < THREAD_ID_MAX) {
+            token[length++] = (char)c;
+        } else {
+            overlong = 1;
+        }
+    } while (c != EOF);
+}
+
+// IDs from the command line, with "-" standing for stdin
+static void for_each_thread_id(Batch *batch, int argc, char **argv, thread_id_fn fn, void *context) {
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-") == 0) read_thread_ids(batch, stdin, fn, context);
+        else take_thread_id(batch, argv[i], fn, context);
+    }
+}
+
+static void submit_one(Batch *batch, const char *thread_id, void *context) {
+    submit_thread_fn submit = *(submit_thread_fn *)context;
+    batch_note_submitted(batch, submit(board, thread_id, on_batch_job_done, batch));
+}
+
+// One job per thread
+static int run_thread_batch(const char *command, submit_thread_fn submit, int argc, char **argv) {
+    if (argc == 0) {
+        usage();
+        return 2;
+    }
+    Batch batch = { command, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+    batch.started_at_ms = job_now_ms();
+    batch.ids_listed = 1;
+    for_each_thread_id(&batch, argc, argv, submit_one, &submit);
+    return batch_finish(&batch);
+}
+
+#define ARCHIVE_JOB_THREADS 256  // Threads per archive job; each job commits the file once
+
+typedef struct {
+    char ids[ARCHIVE_JOB_THREADS][THREAD_ID_MAX];
+    const char *pointers[ARCHIVE_JOB_THREADS];
+    size_t count;
+} ArchiveGroup;
+
+static void flush_archive_group(Batch *batch, ArchiveGroup *group) {
+    if (group->count == 0) return;
+    for (size_t i = 0; i < group->count; i++) group->pointers[i] = group->ids[i];
+    // A single thread is named so it deduplicates like the window's "Move to Archive". A group
+    // has no thread ID; its dedup key is its argv, which lists its IDs, so every group that
+    // moves different threads is its own job. Only a group repeating an earlier one is folded
+    // into it, and batch_note_submitted counts that as a duplicate.
+    const char *thread_id = group->count == 1 ? group->ids[0] : NULL;
+    batch_note_submitted(batch, submit_archive_move(board, thread_id, group->pointers, group->count, on_batch_job_done, batch));
+    group->count = 0;
+}
+
+static void add_to_archive_group(Batch *batch, const char *thread_id, void *context) {
+    ArchiveGroup *group = context;
+    snprintf(group->ids[group->count++], THREAD_ID_MAX, "%s", thread_id);
+    if (group->count == ARCHIVE_JOB_THREADS) flush_archive_group(batch, group);
+}
+
+// Archive moves are grouped: one fsync per job instead of one per thread
+static int run_archive(int argc, char **argv) {
+    if (argc == 0) {
+        usage();
+        return 2;
+    }
+    ArchiveGroup *group = calloc(1, sizeof(ArchiveGroup));
+    if (group == NULL) return 1;
+    Batch batch = { "archive", PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+    batch.started_at_ms = job_now_ms();
+    batch.ids_listed = 1;
+    for_each_thread_id(&batch, argc, argv, add_to_archive_group, group);
+    flush_archive_group(&batch, group);
+    free(group);
+    return batch_finish(&batch);
+}
+
+// title ID TITLE, or "ID<TAB>TITLE" lines from stdin
+static int run_titles(int argc, char **argv) {
+    Batch batch = { "title", PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+    batch.started_at_ms = job_now_ms();
+    batch.ids_listed = 1;
+
+    if (argc == 2) {
+        if (valid_thread_id(argv[0])) batch_note_submitted(&batch, submit_set_title(board, argv[0], argv[1], on_batch_job_done, &batch));
+        else batch.invalid++;
+    } else if (argc == 1 && strcmp(argv[0], "-") == 0) {
+        char *line = NULL;
+        size_t capacity = 0;
+        while (getline(&line, &capacity, stdin) > 0) {
+            line[strcspn(line, "\r\n")] = '\0';
+            char *tab = strchr(line, '\t');
+            if (tab == NULL && *line == '\0') continue;
+            if (tab) *tab = '\0';
+            if (tab == NULL || !valid_thread_id(line)) {
+                fprintf(stderr, "Skipping malformed line '%s'\n", line);
+                batch.invalid++;
+                continue;
+            }
+            batch_note_submitted(&batch, submit_set_title(board, line, tab + 1, on_batch_job_done, &batch));
+        }
+        free(line);
+    } else {
+        usage();
+        return 2;
+    }
+    return batch_finish(&batch);
+}
+
+static int run_board_job(const char *command, unsigned (*submit)(const char *, job_done_fn, void *)) {
+    Batch batch = { command, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+    batch.started_at_ms = job_now_ms();
+    batch_note_submitted(&batch, submit(board, on_batch_job_done, &batch));
+    return batch_finish(&batch);
+}
+
+// export [--compress] FILE, import FILE
+static int run_transfer(const char *command, int argc, char **argv) {
+    int compress = argc == 2 && strcmp(argv[0], "--compress") == 0;
+    int is_export = strcmp(command, "export") == 0;
+    if (argc != 1 + compress || (compress && !is_export)) return -1;
+    const char *path = argv[compress];
+
+    Batch batch = { command, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+    batch.started_at_ms = job_now_ms();
+    unsigned job_id = is_export ? submit_board_export(board, path, compress, on_batch_job_done, &batch)
+                                : submit_board_import(board, path, on_batch_job_done, &batch);
+    batch_note_submitted(&batch, job_id);
+    return batch_finish(&batch);
+}
+
+// --- Queries ---------------------------------------------------------------------------------
+
+static void emit_thread_record(const char *thread_id, const char *title, int count, const char *status, void *user_data) {
+    Record record = { 0 };
+    record_string(&record, "id", thread_id);
+    record_string(&record, "title", title);
+    record_number(&record, "count", count);
+    record_string(&record, "status", status);
+    record_emit(&record, stdout);
+    (*(size_t *)user_data)++;
+}
+
+// A page of the sorted index, read with one ZRANGE and one HMGET however large the board is
+static int run_index_page(int argc, char **argv) {
+    BoardIndexOrder order = BOARD_INDEX_BY_ID;
+    int descending = 0, by = 0;
+    long offset = 0, limit = 100;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--by") == 0 && i + 1 < argc && parse_board_index_order(argv[i + 1], &order) == 0) {
+            by = 1;
+            i++;
+        } else if (strcmp(argv[i], "--desc") == 0) {
+            descending = 1;
+        } else if (strcmp(argv[i], "--offset") == 0 && i + 1 < argc) {
+            offset = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--limit") == 0 && i + 1 < argc) {
+            limit = strtol(argv[++i], NULL, 10);
+        } else {
+            by = 0;
+            break;
+        }
+    }
+    if (!by || offset < 0 || limit <= 0) {
+        usage();
+        return 2;
+    }
+
+    int64_t started = job_now_ms();
+    size_t listed = 0;
+    long long total = 0;
+    if (fetch_board_index_page(board, order, descending, offset, limit, emit_thread_record, &listed, &total) != 0) {
+        fprintf(stderr, "Failed to read the sorted index of /%s/ on %s:%d\n", board, redis_host, redis_port);
+        return 1;
+    }
+    if (total == 0) {
+        fprintf(stderr, "/%s/ has no sorted index; run sortindex to build it\n", board);
+        return 1;
+    }
+    fprintf(stderr, "Listed %zu of %lld threads by %s in %" PRId64 " ms\n", listed, total, board_index_order_name(order),
+            job_now_ms() - started);
+    return 0;
+}
+
+static int run_list(int argc, char **argv) {
+    if (argc > 0) return run_index_page(argc, argv);
+
+    int64_t started = job_now_ms();
+    ThreadSnapshot *snapshot = fetch_thread_list(board, scan_count, fetch_batch);
+    if (snapshot == NULL) {
+        fprintf(stderr, "Failed to list /%s/ on %s:%d\n", board, redis_host, redis_port);
+        return 1;
+    }
+
+    size_t listed = 0;
+    for (size_t i = 0; i < snapshot->count; i++) {
+        const ThreadSnapshotRecord *thread = &snapshot->records[i];
+        if (thread->flags & THREAD_RECORD_DELETED) continue;
+        char id[THREAD_ID_MAX];
+        snprintf(id, sizeof(id), "%" PRIu64, thread->id);
+        Record record = { 0 };
+        record_string(&record, "id", id);
+        record_string(&record, "title", thread_snapshot_title(snapshot, thread));
+        record_number(&record, "count", thread->count);
+        record_string(&record, "status", thread_snapshot_status(snapshot, thread));
+        record_emit(&record, stdout);
+        listed++;
+    }
+    if (show_stats) {
+        fprintf(stderr, "Listed %zu threads in %" PRId64 " ms\n", listed, job_now_ms() - started);
+        thread_snapshot_report(snapshot, stderr);
+    }
+    thread_snapshot_unref(snapshot);
+    return 0;
+}
+
+// Read the posts a page at a time, so a long thread never has to fit in one reply
+static int run_posts(int argc, char **argv) {
+    if (argc != 1 || !valid_thread_id(argv[0])) {
+        usage();
+        return 2;
+    }
+
+    int64_t started = job_now_ms();
+    long page_size = fetch_batch > 0 ? fetch_batch : 256;
+    long long total = 0;
+    for (long start = 0; start == 0 || start < total; start += page_size) {
+        ThreadPostPage page;
+        if (fetch_thread_details(board, argv[0], start, page_size, &page) != 0) {
+            fprintf(stderr, "Failed to read the posts of /%s/%s\n", board, argv[0]);
+            return 1;
+        }
+        total = page.total;
+        for (size_t i = 0; i < page.count; i++) {
+            const char *no = json_object_find(page.posts[i], "no");
+            const char *com = json_object_find(page.posts[i], "com");
+            char *text = malloc(page.lengths[i] + 1);
+            if (text == NULL) break;
+            text[0] = '\0';
+            if (com && *com == '"') json_parse_string(com, text, page.lengths[i] + 1);
+            html_to_text(text);
+
+            Record record = { 0 };
+            record_number(&record, "no", no ? (double)strtoull(no, NULL, 10) : 0);
+            record_string(&record, "text", text);
+            record_emit(&record, stdout);
+            free(text);
+        }
+        thread_post_page_free(&page);
+        if (total == 0) break;
+    }
+    fprintf(stderr, "%lld posts in %" PRId64 " ms\n", total, job_now_ms() - started);
+    return total > 0 ? 0 : 1;
+}
+
+static int run_search(int argc, char **argv) {
+    size_t limit = 20;
+    if (argc >= 2 && strcmp(argv[0], "--limit") == 0) {
+        limit = strtoul(argv[1], NULL, 10);
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc != 1 || limit == 0) {
+        usage();
+        return 2;
+    }
+
+    FtsIndex *index = board_search_index(board);
+    FtsHit *hits = calloc(limit, sizeof(FtsHit));
+    if (index == NULL || hits == NULL) {
+        free(hits);
+        return 1;
+    }
+    int64_t started = job_now_ms();
+    size_t total;
+    size_t n = fts_index_search(index, argv[0], hits, limit, &total);
+    for (size_t i = 0; i < n; i++) {
+        char id[THREAD_ID_MAX];
+        snprintf(id, sizeof(id), "%" PRIu64, hits[i].thread_id);
+        Record record = { 0 };
+        record_string(&record, "id", id);
+        record_number(&record, "score", hits[i].score);
+        record_number(&record, "post", (double)hits[i].post_no);
+        record_number(&record, "matching_posts", hits[i].matching_posts);
+        record_emit(&record, stdout);
+    }
+    fprintf(stderr, "%zu threads match, %zu shown (%" PRId64 " ms)\n", total, n, job_now_ms() - started);
+    free(hits);
+    return 0;
+}
+
+// --- Entry point -----------------------------------------------------------------------------
+
+// Latency summary of every operation that ran, for --stats
+static void report_stats() {
+    for (int id = 0; id < METRIC_COUNT; id++) {
+        MetricSummary summary;
+        metrics_summarize(id, &summary);
+        if (summary.count == 0) continue;
+        if (!json_output) {
+            fprintf(stderr, "%-22s %8llu calls  p50 %9.3f ms  p99 %9.3f ms  max %9.3f ms  total %10.1f ms\n", summary.name,
+                    (unsigned long long)summary.count, summary.p50_ms, summary.p99_ms, summary.max_ms, summary.sum_ms);
+            continue;
+        }
+        Record record = { 0 };
+        record_string(&record, "stats", summary.name);
+        record_number(&record, "count", (double)summary.count);
+        record_number(&record, "p50_ms", summary.p50_ms);
+        record_number(&record, "p90_ms", summary.p90_ms);
+        record_number(&record, "p99_ms", summary.p99_ms);
+        record_number(&record, "max_ms", summary.max_ms);
+        record_number(&record, "total_ms", summary.sum_ms);
+        record_emit(&record, stdout);
+    }
+
+    // Post compression, per board touched
+    PostCodecStats boards[64];
+    size_t n = post_codec_stats(boards, sizeof(boards) / sizeof(boards[0]));
+    for (size_t i = 0; i < n; i++) {
+        const PostCodecStats *codec = &boards[i];
+        if (codec->encoded == 0 && codec->decoded == 0) continue;
+        if (!json_output) {
+            char line[320];
+            post_codec_format_stats(codec, line, sizeof(line));
+            fprintf(stderr, "%s\n", line);
+            continue;
+        }
+        Record record = { 0 };
+        record_string(&record, "compression", codec->board);
+        record_number(&record, "dictionary", codec->dictionary_id);
+        record_number(&record, "encoded", (double)codec->encoded);
+        record_number(&record, "encoded_in_bytes", (double)codec->encoded_in_bytes);
+        record_number(&record, "encoded_out_bytes", (double)codec->encoded_out_bytes);
+        record_number(&record, "decoded", (double)codec->decoded);
+        record_number(&record, "decoded_in_bytes", (double)codec->decoded_in_bytes);
+        record_number(&record, "decoded_out_bytes", (double)codec->decoded_out_bytes);
+        record_number(&record, "decode_ms", codec->decode_ns / 1e6);
+        record_emit(&record, stdout);
+    }
+}
+
+static int run_command(const char *command, int argc, char *argv[]) {
+    if (strcmp(command, "list") == 0) return run_list(argc, argv);
+    if (strcmp(command, "posts") == 0) return run_posts(argc, argv);
+    if (strcmp(command, "search") == 0) return run_search(argc, argv);
+
+    static const struct {
+        const char *command;
+        submit_thread_fn submit;
+    } thread_commands[] = {
+        { "add", submit_add_thread },
+        { "delete", submit_delete_thread },
+        { "audio", submit_audio },
+    };
+    int uses_scraper = strcmp(command, "archive") != 0 && strcmp(command, "reindex") != 0 && strcmp(command, "sortindex") != 0 &&
+                       strcmp(command, "compress") != 0 && strcmp(command, "export") != 0 && strcmp(command, "import") != 0;
+
+    job_queue_init(job_workers, on_job_output, NULL, NULL);
+    if (uses_scraper) scraper_jobs_start_worker();
+
+    int status = -1;
+    for (size_t c = 0; c < sizeof(thread_commands) / sizeof(thread_commands[0]); c++) {
+        if (strcmp(command, thread_commands[c].command) == 0) status = run_thread_batch(command, thread_commands[c].submit, argc, argv);
+    }
+    if (strcmp(command, "archive") == 0) status = run_archive(argc, argv);
+    if (strcmp(command, "title") == 0) status = run_titles(argc, argv);
+    if (strcmp(command, "update") == 0) status = run_board_job(command, submit_update_threads);
+    if (strcmp(command, "reindex") == 0) status = run_board_job(command, submit_index_rebuild);
+    if (strcmp(command, "sortindex") == 0) status = run_board_job(command, submit_board_index_rebuild);
+    if (strcmp(command, "compress") == 0 && argc == 0) status = run_board_job(command, submit_compress);
+    if (strcmp(command, "compress") == 0 && argc == 1 && strcmp(argv[0], "--retrain") == 0) {
+        status = run_board_job(command, submit_compress_retrain);
+    }
+    if (strcmp(command, "export") == 0 || strcmp(command, "import") == 0) status = run_transfer(command, argc, argv);
+    if (status == -1) {
+        usage();
+        status = 2;
+    }
+
+    job_queue_shutdown();
+    if (uses_scraper) scraper_rpc_stop();
+    return status;
+}
+
+int cli_main(int argc, char *argv[]) {
+    int i = 1;
+    for (; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json_output = 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            show_stats = 1;
+            metrics_enabled = 1;
+        } else if (strcmp(argv[i], "--board") == 0 && i + 1 < argc) {
+            snprintf(board, sizeof(board), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--host") == 0 && i + 1 < argc) {
+            snprintf(redis_host, sizeof(redis_host), "%s", argv[++i]);
+        } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            redis_port = atoi(argv[++i]);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+    if (i == argc) {
+        usage();
+        return 2;
+    }
+    const char *command = argv[i++];
+    argc -= i;
+    argv += i;
+
+    char endpoints[600];
+    format_redis_endpoints(endpoints, sizeof(endpoints));
+    redis_pool_init(endpoints, redis_pool_size, connect_timeout_ms, read_from_replicas);
+    metrics_export_start(metrics_export, metrics_export_interval_s);
+    int status = run_command(command, argc, argv);
+    if (show_stats) report_stats();
+    metrics_export_stop();
+    post_codec_shutdown();
+    redis_pool_shutdown();
+    return status;
+}
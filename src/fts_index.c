@@ -0,0 +1,1353 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../include/fts_index.h"
+#include "../include/json_scan.h"
+#include "../include/thread_ingest.h"
+#include "../include/redis_operations.h"
+#include "../include/post_codec.h"
+
+// Inverted index over post text. Added threads are buffered in memory and written out on
+// commit as an immutable, memory-mapped segment; segments of similar size are merged in
+// groups of FTS_MERGE_FACTOR, so a thread is rewritten O(log n) times over the life of the index.
+//
+// A thread lives in the newest segment that mentions it. Re-indexing a thread writes it again
+// in a new segment and removing it writes an entry with no posts; either way the older copies
+// stop matching at once and are dropped at the next merge.
+//
+// Several processes (the window and the headless CLI) may share a directory. Every change to
+// it holds flock() on <dir>/LOCK and starts by re-reading MANIFEST, so segments another
+// process committed are kept, never overwritten or removed as leftovers.
+//
+// Segment layout (host byte order):
+//   SegmentHeader | uint64 threads[thread_count], sorted | SegmentDoc docs[doc_count]
+//   | SegmentTerm terms[term_count], sorted by term bytes | term strings | postings
+// Posting list of a term, per document in increasing order:
+//   varint doc delta | varint term frequency | varint byte length of positions | varint position deltas
+
+#define FTS_MAGIC "FCFTS001"
+#define FTS_VERSION 1
+#define FTS_MAX_TERM 32          // Longer tokens are not indexed
+#define FTS_BUFFER_POSTS 100000  // Commit automatically once this many posts are pending
+#define FTS_MERGE_FACTOR 8
+#define FTS_MAX_CLAUSES 16
+#define FTS_MAX_PHRASE 8
+#define FTS_BM25_K1 1.2
+#define FTS_BM25_B 0.75
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t doc_count;
+    uint32_t thread_count;
+    uint32_t term_count;
+    uint64_t total_length;   // Tokens over all documents, for the average document length
+    uint64_t threads_at;
+    uint64_t docs_at;
+    uint64_t terms_at;
+    uint64_t strings_at;
+    uint64_t postings_at;
+    uint64_t file_length;
+} SegmentHeader;
+
+typedef struct {
+    uint32_t thread_index;   // Into the segment's thread array
+    uint32_t length;         // Tokens
+    uint64_t post_no;
+} SegmentDoc;
+
+typedef struct {
+    uint32_t string_offset;
+    uint32_t string_length;
+    uint32_t doc_freq;
+    uint32_t reserved;
+    uint64_t postings_offset;
+    uint64_t postings_length;
+} SegmentTerm;
+
+typedef struct {
+    char name[32];
+    const char *data;
+    size_t length;
+    const SegmentHeader *header;
+    const uint64_t *threads;
+    const SegmentDoc *docs;
+    const SegmentTerm *terms;
+    const char *strings;
+    const uint8_t *postings;
+    uint8_t *superseded;     // Per thread: a newer segment holds this thread
+    size_t live_docs;
+} Segment;
+
+typedef struct {
+    uint8_t *data;
+    size_t length;
+    size_t capacity;
+} Bytes;
+
+// uint64 -> uint32 open-addressing map; the key 0 marks an empty slot, so ids are stored + 1
+typedef struct {
+    uint64_t *keys;
+    uint32_t *values;
+    size_t capacity;
+    size_t count;
+} IdMap;
+
+typedef struct {
+    uint32_t length;
+    uint32_t doc_freq;
+    uint32_t last_doc;
+    Bytes postings;
+    char term[];
+} BuilderTerm;
+
+// Documents and postings not yet written to a segment
+typedef struct {
+    BuilderTerm **slots;
+    size_t slot_capacity;
+    size_t term_count;
+    SegmentDoc *docs;
+    size_t doc_count;
+    size_t doc_capacity;
+    uint64_t *threads;       // In the order added
+    size_t thread_count;
+    size_t thread_capacity;
+    IdMap thread_map;        // Thread id -> index in threads
+    uint64_t total_length;
+} Builder;
+
+struct FtsIndex {
+    pthread_mutex_t lock;
+    int lock_fd;             // <dir>/LOCK, flocked around every change to the directory
+    char *dir;
+    Segment *segments;       // Oldest first
+    size_t segment_count;
+    uint64_t next_segment;
+    Builder pending;
+};
+
+typedef struct {
+    char term[FTS_MAX_TERM + 1];
+    uint32_t length;
+    uint32_t position;
+} Token;
+
+// --- Small containers --------------------------------------------------------------------------
+
+static int bytes_reserve(Bytes *bytes, size_t extra) {
+    if (bytes->length + extra <= bytes->capacity) return 0;
+    size_t capacity = bytes->capacity ? bytes->capacity * 2 : 64;
+    while (capacity < bytes->length + extra) capacity *= 2;
+    uint8_t *data = realloc(bytes->data, capacity);
+    if (data == NULL) return -1;
+    bytes->data = data;
+    bytes->capacity = capacity;
+    return 0;
+}
+
+static int bytes_append(Bytes *bytes, const void *data, size_t length) {
+    if (bytes_reserve(bytes, length) != 0) return -1;
+    memcpy(bytes->data + bytes->length, data, length);
+    bytes->length += length;
+    return 0;
+}
+
+static int put_varint(Bytes *bytes, uint64_t value) {
+    if (bytes_reserve(bytes, 10) != 0) return -1;
+    while (value >= 0x80) {
+        bytes->data[bytes->length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    bytes->data[bytes->length++] = (uint8_t)value;
+    return 0;
+}
+
+static uint64_t get_varint(const uint8_t **p) {
+    uint64_t value = 0;
+    int shift = 0;
+    while (**p & 0x80) {
+        value |= (uint64_t)(*(*p)++ & 0x7F) << shift;
+        shift += 7;
+    }
+    return value | (uint64_t)(*(*p)++) << shift;
+}
+
+static size_t hash_u64(uint64_t id) {
+    id ^= id >> 33;
+    id *= 0xff51afd7ed558ccdULL;
+    id ^= id >> 33;
+    return (size_t)id;
+}
+
+static size_t hash_bytes(const char *data, size_t length) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return (size_t)hash;
+}
+
+static void id_map_free(IdMap *map) {
+    free(map->keys);
+    free(map->values);
+    memset(map, 0, sizeof(*map));
+}
+
+static int id_map_grow(IdMap *map) {
+    IdMap grown = { 0 };
+    grown.capacity = map->capacity ? map->capacity * 2 : 1024;
+    grown.keys = calloc(grown.capacity, sizeof(uint64_t));
+    grown.values = malloc(grown.capacity * sizeof(uint32_t));
+    if (grown.keys == NULL || grown.values == NULL) {
+        id_map_free(&grown);
+        return -1;
+    }
+    for (size_t i = 0; i < map->capacity; i++) {
+        if (map->keys[i] == 0) continue;
+        size_t slot = hash_u64(map->keys[i]) & (grown.capacity - 1);
+        while (grown.keys[slot]) slot = (slot + 1) & (grown.capacity - 1);
+        grown.keys[slot] = map->keys[i];
+        grown.values[slot] = map->values[i];
+    }
+    grown.count = map->count;
+    id_map_free(map);
+    *map = grown;
+    return 0;
+}
+
+// Value stored for id, or UINT32_MAX
+static uint32_t id_map_get(const IdMap *map, uint64_t id) {
+    if (map->capacity == 0) return UINT32_MAX;
+    size_t slot = hash_u64(id + 1) & (map->capacity - 1);
+    while (map->keys[slot]) {
+        if (map->keys[slot] == id + 1) return map->values[slot];
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+    return UINT32_MAX;
+}
+
+static int id_map_put(IdMap *map, uint64_t id, uint32_t value) {
+    if ((map->count + 1) * 2 > map->capacity && id_map_grow(map) != 0) return -1;
+    size_t slot = hash_u64(id + 1) & (map->capacity - 1);
+    while (map->keys[slot] && map->keys[slot] != id + 1) slot = (slot + 1) & (map->capacity - 1);
+    if (map->keys[slot] == 0) map->count++;
+    map->keys[slot] = id + 1;
+    map->values[slot] = value;
+    return 0;
+}
+
+// --- Text ------------------------------------------------------------------------------------
+
+// Words are runs of ASCII letters and digits or of non-ASCII bytes; ASCII is lowercased
+static size_t tokenize(const char *text, Token **tokens, size_t *capacity, uint32_t first_position) {
+    size_t count = 0;
+    uint32_t position = first_position;
+    const unsigned char *p = (const unsigned char *)text;
+
+    while (*p) {
+        while (*p && *p < 0x80 && !((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9'))) p++;
+        if (*p == '\0') break;
+
+        const unsigned char *start = p;
+        while (*p && (*p >= 0x80 || (*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z') || (*p >= '0' && *p <= '9'))) p++;
+        size_t length = p - start;
+        if (length > FTS_MAX_TERM) {
+            position++;  // Too long to be a useful search term, but keeps phrase positions honest
+            continue;
+        }
+
+        if (count == *capacity) {
+            size_t grown = *capacity ? *capacity * 2 : 256;
+            Token *resized = realloc(*tokens, grown * sizeof(Token));
+            if (resized == NULL) break;
+            *tokens = resized;
+            *capacity = grown;
+        }
+        Token *token = &(*tokens)[count++];
+        for (size_t i = 0; i < length; i++) {
+            unsigned char c = start[i];
+            token->term[i] = (c >= 'A' && c <= 'Z') ? c + 32 : c;
+        }
+        token->term[length] = '\0';
+        token->length = (uint32_t)length;
+        token->position = position++;
+    }
+    return count;
+}
+
+// Searchable text of one post: subject and comment of a 4chan API post object with markup
+// removed, or the whole value when it is not JSON. post must be NUL-terminated.
+static char *post_text(const char *post, size_t length, uint64_t *post_no) {
+    char *text = malloc(length + 2);
+    if (text == NULL) return NULL;
+    text[0] = '\0';
+
+    const char *p = json_skip_space(post);
+    if (*p != '{') {
+        memcpy(text, post, length);
+        text[length] = '\0';
+    } else {
+        const char *no = json_object_find(p, "no");
+        if (no) *post_no = strtoull(no, NULL, 10);
+        const char *sub = json_object_find(p, "sub");
+        size_t used = 0;
+        if (sub && *sub == '"') {
+            json_parse_string(sub, text, length + 1);
+            used = strlen(text);
+            text[used++] = ' ';
+        }
+        const char *com = json_object_find(p, "com");
+        if (com && *com == '"') json_parse_string(com, text + used, length + 2 - used);
+        else text[used] = '\0';
+    }
+    html_to_text(text);
+    return text;
+}
+
+static int compare_tokens(const void *a, const void *b) {
+    const Token *x = a, *y = b;
+    int result = strcmp(x->term, y->term);
+    return result ? result : (x->position > y->position) - (x->position < y->position);
+}
+
+// --- Building segments -------------------------------------------------------------------------
+
+static void builder_free(Builder *builder) {
+    for (size_t i = 0; i < builder->slot_capacity; i++) {
+        if (builder->slots[i] == NULL) continue;
+        free(builder->slots[i]->postings.data);
+        free(builder->slots[i]);
+    }
+    free(builder->slots);
+    free(builder->docs);
+    free(builder->threads);
+    id_map_free(&builder->thread_map);
+    memset(builder, 0, sizeof(*builder));
+}
+
+static int builder_grow_terms(Builder *builder) {
+    size_t capacity = builder->slot_capacity ? builder->slot_capacity * 2 : 4096;
+    BuilderTerm **slots = calloc(capacity, sizeof(BuilderTerm *));
+    if (slots == NULL) return -1;
+    for (size_t i = 0; i < builder->slot_capacity; i++) {
+        BuilderTerm *term = builder->slots[i];
+        if (term == NULL) continue;
+        size_t slot = hash_bytes(term->term, term->length) & (capacity - 1);
+        while (slots[slot]) slot = (slot + 1) & (capacity - 1);
+        slots[slot] = term;
+    }
+    free(builder->slots);
+    builder->slots = slots;
+    builder->slot_capacity = capacity;
+    return 0;
+}
+
+static BuilderTerm *builder_term(Builder *builder, const char *text, uint32_t length) {
+    if ((builder->term_count + 1) * 2 > builder->slot_capacity && builder_grow_terms(builder) != 0) return NULL;
+    size_t slot = hash_bytes(text, length) & (builder->slot_capacity - 1);
+    for (BuilderTerm *term; (term = builder->slots[slot]) != NULL; slot = (slot + 1) & (builder->slot_capacity - 1)) {
+        if (term->length == length && memcmp(term->term, text, length) == 0) return term;
+    }
+
+    BuilderTerm *term = calloc(1, sizeof(BuilderTerm) + length + 1);
+    if (term == NULL) return NULL;
+    memcpy(term->term, text, length);
+    term->length = length;
+    builder->slots[slot] = term;
+    builder->term_count++;
+    return term;
+}
+
+static uint32_t builder_thread(Builder *builder, uint64_t thread_id) {
+    uint32_t index = id_map_get(&builder->thread_map, thread_id);
+    if (index != UINT32_MAX) return index;
+
+    if (builder->thread_count == builder->thread_capacity) {
+        size_t capacity = builder->thread_capacity ? builder->thread_capacity * 2 : 256;
+        uint64_t *threads = realloc(builder->threads, capacity * sizeof(uint64_t));
+        if (threads == NULL) return UINT32_MAX;
+        builder->threads = threads;
+        builder->thread_capacity = capacity;
+    }
+    index = (uint32_t)builder->thread_count;
+    if (id_map_put(&builder->thread_map, thread_id, index) != 0) return UINT32_MAX;
+    builder->threads[builder->thread_count++] = thread_id;
+    return index;
+}
+
+static long builder_doc(Builder *builder, uint32_t thread_index, uint64_t post_no, uint32_t length) {
+    if (builder->doc_count == UINT32_MAX - 1) return -1;
+    if (builder->doc_count == builder->doc_capacity) {
+        size_t capacity = builder->doc_capacity ? builder->doc_capacity * 2 : 1024;
+        SegmentDoc *docs = realloc(builder->docs, capacity * sizeof(SegmentDoc));
+        if (docs == NULL) return -1;
+        builder->docs = docs;
+        builder->doc_capacity = capacity;
+    }
+    builder->docs[builder->doc_count] = (SegmentDoc){ thread_index, length, post_no };
+    builder->total_length += length;
+    return (long)builder->doc_count++;
+}
+
+// Append one document to a term's posting list; documents arrive in increasing order
+static int builder_posting(BuilderTerm *term, uint32_t doc, uint32_t frequency, const uint8_t *positions, size_t positions_length) {
+    uint32_t delta = doc - (term->doc_freq ? term->last_doc : 0);
+    if (put_varint(&term->postings, delta) != 0 || put_varint(&term->postings, frequency) != 0 ||
+        put_varint(&term->postings, positions_length) != 0 || bytes_append(&term->postings, positions, positions_length) != 0) {
+        return -1;
+    }
+    term->last_doc = doc;
+    term->doc_freq++;
+    return 0;
+}
+
+// Tokenize one post and add its postings
+static int builder_add_post(Builder *builder, uint32_t thread_index, const char *post, size_t length, uint64_t post_no,
+                            Token **tokens, size_t *token_capacity) {
+    char *text = post_text(post, length, &post_no);
+    if (text == NULL) return -1;
+    size_t count = tokenize(text, tokens, token_capacity, 0);
+    free(text);
+
+    long doc = builder_doc(builder, thread_index, post_no, (uint32_t)count);
+    if (doc < 0) return -1;
+    qsort(*tokens, count, sizeof(Token), compare_tokens);
+
+    Bytes positions = { 0 };
+    int result = 0;
+    for (size_t i = 0; i < count && result == 0;) {
+        size_t end = i;
+        uint32_t previous = 0;
+        positions.length = 0;
+        while (end < count && strcmp((*tokens)[end].term, (*tokens)[i].term) == 0) {
+            put_varint(&positions, (*tokens)[end].position - previous);
+            previous = (*tokens)[end].position;
+            end++;
+        }
+        BuilderTerm *term = builder_term(builder, (*tokens)[i].term, (*tokens)[i].length);
+        result = term ? builder_posting(term, (uint32_t)doc, (uint32_t)(end - i), positions.data, positions.length) : -1;
+        i = end;
+    }
+    free(positions.data);
+    return result;
+}
+
+static int compare_builder_terms(const void *a, const void *b) {
+    const BuilderTerm *x = *(BuilderTerm *const *)a, *y = *(BuilderTerm *const *)b;
+    int result = memcmp(x->term, y->term, x->length < y->length ? x->length : y->length);
+    return result ? result : (x->length > y->length) - (x->length < y->length);
+}
+
+typedef struct {
+    uint64_t id;
+    uint32_t index;
+} ThreadOrder;
+
+static int compare_thread_order(const void *a, const void *b) {
+    const ThreadOrder *x = a, *y = b;
+    return (x->id > y->id) - (x->id < y->id);
+}
+
+static int write_all(FILE *file, const void *data, size_t length) {
+    return length == 0 || fwrite(data, 1, length, file) == length ? 0 : -1;
+}
+
+// Write the builder out as segment file path
+static int builder_write(Builder *builder, const char *path) {
+    ThreadOrder *order = malloc((builder->thread_count + 1) * sizeof(ThreadOrder));
+    uint32_t *remap = malloc((builder->thread_count + 1) * sizeof(uint32_t));
+    uint64_t *threads = malloc((builder->thread_count + 1) * sizeof(uint64_t));
+    BuilderTerm **terms = malloc((builder->term_count + 1) * sizeof(BuilderTerm *));
+    SegmentTerm *entries = malloc((builder->term_count + 1) * sizeof(SegmentTerm));
+    FILE *file = NULL;
+    int result = -1;
+    if (order == NULL || remap == NULL || threads == NULL || terms == NULL || entries == NULL) goto done;
+
+    for (size_t i = 0; i < builder->thread_count; i++) order[i] = (ThreadOrder){ builder->threads[i], (uint32_t)i };
+    qsort(order, builder->thread_count, sizeof(ThreadOrder), compare_thread_order);
+    for (size_t i = 0; i < builder->thread_count; i++) {
+        remap[order[i].index] = (uint32_t)i;
+        threads[i] = order[i].id;
+    }
+    for (size_t i = 0; i < builder->doc_count; i++) builder->docs[i].thread_index = remap[builder->docs[i].thread_index];
+
+    size_t n = 0;
+    for (size_t i = 0; i < builder->slot_capacity; i++) {
+        if (builder->slots[i]) terms[n++] = builder->slots[i];
+    }
+    qsort(terms, n, sizeof(BuilderTerm *), compare_builder_terms);
+
+    SegmentHeader header = { .version = FTS_VERSION };
+    memcpy(header.magic, FTS_MAGIC, 8);
+    header.doc_count = (uint32_t)builder->doc_count;
+    header.thread_count = (uint32_t)builder->thread_count;
+    header.term_count = (uint32_t)n;
+    header.total_length = builder->total_length;
+    header.threads_at = sizeof(header);
+    header.docs_at = header.threads_at + builder->thread_count * sizeof(uint64_t);
+    header.terms_at = header.docs_at + builder->doc_count * sizeof(SegmentDoc);
+    header.strings_at = header.terms_at + n * sizeof(SegmentTerm);
+
+    uint64_t string_offset = 0, postings_offset = 0;
+    for (size_t i = 0; i < n; i++) {
+        entries[i] = (SegmentTerm){ (uint32_t)string_offset, terms[i]->length, terms[i]->doc_freq, 0,
+                                    postings_offset, terms[i]->postings.length };
+        string_offset += terms[i]->length;
+        postings_offset += terms[i]->postings.length;
+    }
+    header.postings_at = (header.strings_at + string_offset + 7) & ~7ULL;
+    header.file_length = header.postings_at + postings_offset;
+
+    char temp_path[1040];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+    file = fopen(temp_path, "wb");
+    if (file == NULL) goto done;
+
+    static const char padding[8] = { 0 };
+    result = write_all(file, &header, sizeof(header));
+    if (result == 0) result = write_all(file, threads, builder->thread_count * sizeof(uint64_t));
+    if (result == 0) result = write_all(file, builder->docs, builder->doc_count * sizeof(SegmentDoc));
+    if (result == 0) result = write_all(file, entries, n * sizeof(SegmentTerm));
+    for (size_t i = 0; i < n && result == 0; i++) result = write_all(file, terms[i]->term, terms[i]->length);
+    if (result == 0) result = write_all(file, padding, header.postings_at - header.strings_at - string_offset);
+    for (size_t i = 0; i < n && result == 0; i++) result = write_all(file, terms[i]->postings.data, terms[i]->postings.length);
+    if (result == 0) result = fflush(file);
+    if (result == 0) result = fsync(fileno(file));
+    if (fclose(file) != 0) result = -1;
+    file = NULL;
+    if (result == 0) result = rename(temp_path, path);
+    if (result != 0) {
+        fprintf(stderr, "Failed to write index segment %s: %s\n", path, strerror(errno));
+        unlink(temp_path);
+    }
+
+done:
+    free(order);
+    free(remap);
+    free(threads);
+    free(terms);
+    free(entries);
+    return result;
+}
+
+// --- Segments ----------------------------------------------------------------------------------
+
+static void segment_path(const FtsIndex *index, const char *name, char *path, size_t size) {
+    snprintf(path, size, "%s/%s", index->dir, name);
+}
+
+static int segment_map(FtsIndex *index, Segment *segment, const char *name) {
+    char path[1024];
+    memset(segment, 0, sizeof(*segment));
+    snprintf(segment->name, sizeof(segment->name), "%s", name);
+    segment_path(index, name, path, sizeof(path));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(SegmentHeader)) {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    const SegmentHeader *header = map;
+    if (memcmp(header->magic, FTS_MAGIC, 8) != 0 || header->version != FTS_VERSION || header->file_length != (uint64_t)st.st_size ||
+        header->docs_at != header->threads_at + (uint64_t)header->thread_count * sizeof(uint64_t) ||
+        header->terms_at != header->docs_at + (uint64_t)header->doc_count * sizeof(SegmentDoc) ||
+        header->strings_at != header->terms_at + (uint64_t)header->term_count * sizeof(SegmentTerm) ||
+        header->postings_at < header->strings_at || header->postings_at > header->file_length) {
+        fprintf(stderr, "Index segment %s is damaged\n", path);
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    segment->data = map;
+    segment->length = st.st_size;
+    segment->header = header;
+    segment->threads = (const uint64_t *)(segment->data + header->threads_at);
+    segment->docs = (const SegmentDoc *)(segment->data + header->docs_at);
+    segment->terms = (const SegmentTerm *)(segment->data + header->terms_at);
+    segment->strings = segment->data + header->strings_at;
+    segment->postings = (const uint8_t *)segment->data + header->postings_at;
+    segment->superseded = calloc(header->thread_count + 1, 1);
+    if (segment->superseded == NULL) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+    return 0;
+}
+
+static void segment_unmap(Segment *segment) {
+    if (segment->data) munmap((void *)segment->data, segment->length);
+    free(segment->superseded);
+    memset(segment, 0, sizeof(*segment));
+}
+
+// Mark every thread that a newer segment also holds
+static void update_liveness(FtsIndex *index) {
+    IdMap seen = { 0 };
+    for (size_t s = index->segment_count; s-- > 0;) {
+        Segment *segment = &index->segments[s];
+        for (uint32_t t = 0; t < segment->header->thread_count; t++) {
+            segment->superseded[t] = id_map_get(&seen, segment->threads[t]) != UINT32_MAX;
+            id_map_put(&seen, segment->threads[t], 0);
+        }
+        segment->live_docs = 0;
+        for (uint32_t d = 0; d < segment->header->doc_count; d++) {
+            if (!segment->superseded[segment->docs[d].thread_index]) segment->live_docs++;
+        }
+    }
+    id_map_free(&seen);
+}
+
+static int write_manifest(FtsIndex *index) {
+    char path[1024], temp_path[1040];
+    snprintf(path, sizeof(path), "%s/MANIFEST", index->dir);
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+    FILE *file = fopen(temp_path, "w");
+    if (file == NULL) return -1;
+    fprintf(file, "next %llu\n", (unsigned long long)index->next_segment);
+    for (size_t i = 0; i < index->segment_count; i++) fprintf(file, "%s\n", index->segments[i].name);
+    int result = fflush(file) == 0 && fsync(fileno(file)) == 0 ? 0 : -1;
+    if (fclose(file) != 0) result = -1;
+    if (result == 0) result = rename(temp_path, path);
+    if (result != 0) fprintf(stderr, "Failed to write %s: %s\n", path, strerror(errno));
+    return result;
+}
+
+static int append_segment(FtsIndex *index, Builder *builder) {
+    char name[32], path[1024];
+    snprintf(name, sizeof(name), "seg_%08llu.fts", (unsigned long long)index->next_segment++);
+    segment_path(index, name, path, sizeof(path));
+    if (builder_write(builder, path) != 0) return -1;
+
+    Segment *segments = realloc(index->segments, (index->segment_count + 1) * sizeof(Segment));
+    if (segments == NULL) return -1;
+    index->segments = segments;
+    if (segment_map(index, &index->segments[index->segment_count], name) != 0) return -1;
+    index->segment_count++;
+    return 0;
+}
+
+// Find term in a segment by binary search over the sorted term table
+static const SegmentTerm *segment_find_term(const Segment *segment, const char *term, size_t length) {
+    size_t low = 0, high = segment->header->term_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        const SegmentTerm *entry = &segment->terms[middle];
+        size_t common = entry->string_length < length ? entry->string_length : length;
+        int result = memcmp(segment->strings + entry->string_offset, term, common);
+        if (result == 0) result = (entry->string_length > length) - (entry->string_length < length);
+        if (result == 0) return entry;
+        if (result < 0) low = middle + 1;
+        else high = middle;
+    }
+    return NULL;
+}
+
+// --- Merging -----------------------------------------------------------------------------------
+
+static int segment_tier(const Segment *segment) {
+    int tier = 0;
+    for (uint64_t docs = segment->header->doc_count; docs >= FTS_MERGE_FACTOR; docs /= FTS_MERGE_FACTOR) tier++;
+    return tier;
+}
+
+static int segment_has_thread(const Segment *segment, uint64_t thread_id) {
+    size_t low = 0, high = segment->header->thread_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (segment->threads[middle] < thread_id) low = middle + 1;
+        else high = middle;
+    }
+    return low < segment->header->thread_count && segment->threads[low] == thread_id;
+}
+
+// A removed thread must stay recorded only while an older copy exists outside the merge
+static int tombstone_needed(const FtsIndex *index, const size_t *chosen, size_t count, uint64_t thread_id) {
+    for (size_t s = 0, c = 0; s < index->segment_count; s++) {
+        if (c < count && chosen[c] == s) {
+            c++;
+        } else if (segment_has_thread(&index->segments[s], thread_id)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Rewrite the live threads of the chosen segments (in segment order) as one new, newest segment
+static int merge_segments(FtsIndex *index, const size_t *chosen, size_t count) {
+    Builder merged = { 0 };
+    int result = 0;
+
+    for (size_t c = 0; c < count && result == 0; c++) {
+        const Segment *segment = &index->segments[chosen[c]];
+        uint32_t *doc_map = malloc((segment->header->doc_count + 1) * sizeof(uint32_t));
+        uint8_t *has_docs = calloc(segment->header->thread_count + 1, 1);
+        if (doc_map == NULL || has_docs == NULL) {
+            free(doc_map);
+            free(has_docs);
+            result = -1;
+            break;
+        }
+
+        for (uint32_t d = 0; d < segment->header->doc_count; d++) has_docs[segment->docs[d].thread_index] = 1;
+        for (uint32_t t = 0; t < segment->header->thread_count && result == 0; t++) {
+            if (segment->superseded[t]) continue;
+            if (!has_docs[t] && !tombstone_needed(index, chosen, count, segment->threads[t])) continue;
+            if (builder_thread(&merged, segment->threads[t]) == UINT32_MAX) result = -1;
+        }
+        free(has_docs);
+        for (uint32_t d = 0; d < segment->header->doc_count && result == 0; d++) {
+            const SegmentDoc *doc = &segment->docs[d];
+            doc_map[d] = UINT32_MAX;
+            if (segment->superseded[doc->thread_index]) continue;
+            long merged_doc = builder_doc(&merged, id_map_get(&merged.thread_map, segment->threads[doc->thread_index]), doc->post_no, doc->length);
+            if (merged_doc < 0) result = -1;
+            else doc_map[d] = (uint32_t)merged_doc;
+        }
+
+        // Documents of later segments get higher numbers, so every list stays in order
+        for (uint32_t i = 0; i < segment->header->term_count && result == 0; i++) {
+            const SegmentTerm *entry = &segment->terms[i];
+            const uint8_t *p = segment->postings + entry->postings_offset;
+            BuilderTerm *term = NULL;
+            uint32_t doc = 0;
+            for (uint32_t j = 0; j < entry->doc_freq && result == 0; j++) {
+                doc += (uint32_t)get_varint(&p);
+                uint32_t frequency = (uint32_t)get_varint(&p);
+                size_t positions_length = get_varint(&p);
+                if (doc_map[doc] != UINT32_MAX) {
+                    if (term == NULL) term = builder_term(&merged, segment->strings + entry->string_offset, entry->string_length);
+                    result = term ? builder_posting(term, doc_map[doc], frequency, p, positions_length) : -1;
+                }
+                p += positions_length;
+            }
+        }
+        free(doc_map);
+    }
+
+    if (result == 0) result = append_segment(index, &merged);
+    builder_free(&merged);
+    if (result != 0) return -1;
+
+    // The merged segment is in place; drop its inputs
+    char removed[FTS_MERGE_FACTOR * 4][32];
+    size_t kept = 0, removed_count = 0;
+    for (size_t s = 0; s < index->segment_count; s++) {
+        int merge_input = 0;
+        for (size_t c = 0; c < count; c++) merge_input |= chosen[c] == s;
+        if (merge_input) {
+            snprintf(removed[removed_count++], sizeof(removed[0]), "%s", index->segments[s].name);
+            segment_unmap(&index->segments[s]);
+        } else {
+            index->segments[kept++] = index->segments[s];
+        }
+    }
+    index->segment_count = kept;
+    update_liveness(index);
+    if (write_manifest(index) != 0) return -1;
+
+    for (size_t i = 0; i < removed_count; i++) {
+        char path[1024];
+        segment_path(index, removed[i], path, sizeof(path));
+        unlink(path);
+    }
+    return 0;
+}
+
+// Merge while any size tier holds FTS_MERGE_FACTOR segments
+static int maybe_merge(FtsIndex *index) {
+    for (;;) {
+        int merged = 0;
+        for (size_t s = 0; s < index->segment_count && !merged; s++) {
+            size_t chosen[FTS_MERGE_FACTOR * 4], count = 0;
+            int tier = segment_tier(&index->segments[s]);
+            for (size_t t = 0; t < index->segment_count && count < FTS_MERGE_FACTOR * 4; t++) {
+                if (segment_tier(&index->segments[t]) == tier) chosen[count++] = t;
+            }
+            if (count < FTS_MERGE_FACTOR) continue;
+            if (merge_segments(index, chosen, count) != 0) return -1;
+            merged = 1;
+        }
+        if (!merged) return 0;
+    }
+}
+
+// --- Directory lock ----------------------------------------------------------------------------
+
+static int lock_directory(FtsIndex *index) {
+    while (flock(index->lock_fd, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "Failed to lock index %s: %s\n", index->dir, strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void unlock_directory(FtsIndex *index) {
+    flock(index->lock_fd, LOCK_UN);
+}
+
+// Make the segment list match MANIFEST, keeping the mappings of segments still listed.
+// Called with the directory lock held; on failure the list is left as it was.
+static int load_manifest(FtsIndex *index) {
+    char path[1024], line[128];
+    snprintf(path, sizeof(path), "%s/MANIFEST", index->dir);
+    FILE *manifest = fopen(path, "r");
+    if (manifest == NULL) return errno == ENOENT ? 0 : -1;
+
+    unsigned long long next = 0;
+    char (*names)[32] = NULL;
+    size_t count = 0;
+    int result = fgets(line, sizeof(line), manifest) && sscanf(line, "next %llu", &next) == 1 ? 0 : -1;
+    while (result == 0 && fgets(line, sizeof(line), manifest)) {
+        line[strcspn(line, "\n")] = '\0';
+        char (*grown)[32] = realloc(names, (count + 1) * sizeof(*names));
+        if (grown == NULL) result = -1;
+        else snprintf((names = grown)[count++], sizeof(*names), "%.31s", line);
+    }
+    fclose(manifest);
+    Segment *segments = result == 0 ? calloc(count + 1, sizeof(Segment)) : NULL;
+    if (segments == NULL) {
+        free(names);
+        return -1;
+    }
+
+    size_t loaded = 0;
+    for (size_t n = 0; n < count; n++) {
+        size_t s = 0;
+        while (s < index->segment_count && strcmp(index->segments[s].name, names[n]) != 0) s++;
+        if (s < index->segment_count) {
+            segments[loaded++] = index->segments[s];
+            index->segments[s].data = NULL;  // Moved to the new list
+            index->segments[s].superseded = NULL;
+        } else if (segment_map(index, &segments[loaded], names[n]) == 0) {
+            loaded++;
+        }
+    }
+    for (size_t s = 0; s < index->segment_count; s++) segment_unmap(&index->segments[s]);
+    free(index->segments);
+    free(names);
+    index->segments = segments;
+    index->segment_count = loaded;
+    if (next > index->next_segment) index->next_segment = next;
+    update_liveness(index);
+    return 0;
+}
+
+// --- Opening -----------------------------------------------------------------------------------
+
+static int make_directories(const char *dir) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s", dir);
+    for (char *p = path + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) return -1;
+        *p = '/';
+    }
+    return mkdir(path, 0755) != 0 && errno != EEXIST ? -1 : 0;
+}
+
+// Remove segment and temporary files a crash left behind; only safe under the directory lock,
+// since another process's segment is unlisted until its MANIFEST is written
+static void remove_unlisted_files(FtsIndex *index) {
+    DIR *directory = opendir(index->dir);
+    if (directory == NULL) return;
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != NULL) {
+        int listed = strcmp(entry->d_name, "MANIFEST") == 0;
+        for (size_t i = 0; i < index->segment_count && !listed; i++) listed = strcmp(entry->d_name, index->segments[i].name) == 0;
+        if (listed || (strncmp(entry->d_name, "seg_", 4) != 0 && strstr(entry->d_name, ".tmp") == NULL)) continue;
+        char path[1024];
+        segment_path(index, entry->d_name, path, sizeof(path));
+        unlink(path);
+    }
+    closedir(directory);
+}
+
+// Open the index in dir, creating it if needed
+FtsIndex *fts_index_open(const char *dir) {
+    if (make_directories(dir) != 0) {
+        fprintf(stderr, "Failed to create index directory %s: %s\n", dir, strerror(errno));
+        return NULL;
+    }
+    FtsIndex *index = calloc(1, sizeof(FtsIndex));
+    if (index == NULL || (index->dir = strdup(dir)) == NULL) {
+        free(index);
+        return NULL;
+    }
+    pthread_mutex_init(&index->lock, NULL);
+    index->next_segment = 1;
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/LOCK", dir);
+    index->lock_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (index->lock_fd < 0 || lock_directory(index) != 0) {
+        fprintf(stderr, "Failed to open index lock %s: %s\n", path, strerror(errno));
+        fts_index_close(index);
+        return NULL;
+    }
+    if (load_manifest(index) != 0) fprintf(stderr, "Failed to read %s/MANIFEST; starting from an empty index\n", dir);
+    remove_unlisted_files(index);
+    unlock_directory(index);
+    return index;
+}
+
+void fts_index_close(FtsIndex *index) {
+    if (index == NULL) return;
+    for (size_t i = 0; i < index->segment_count; i++) segment_unmap(&index->segments[i]);
+    free(index->segments);
+    builder_free(&index->pending);
+    pthread_mutex_destroy(&index->lock);
+    if (index->lock_fd >= 0) close(index->lock_fd);
+    free(index->dir);
+    free(index);
+}
+
+// --- Updating ----------------------------------------------------------------------------------
+
+// Called with index->lock held; takes the directory lock for the write and any merge
+static int commit_locked(FtsIndex *index) {
+    if (index->pending.thread_count == 0) return 0;
+    if (lock_directory(index) != 0) return -1;
+    int result = load_manifest(index);
+    if (result == 0) result = append_segment(index, &index->pending);
+    builder_free(&index->pending);
+    if (result == 0) {
+        update_liveness(index);
+        result = write_manifest(index);
+    }
+    if (result == 0) result = maybe_merge(index);
+    unlock_directory(index);
+    return result;
+}
+
+// Index (or re-index) a thread from its posts, each the JSON of one post NUL-terminated at
+// lengths[i]. The thread becomes searchable at the next commit.
+int fts_index_add_thread(FtsIndex *index, uint64_t thread_id, const char *const *posts, const size_t *lengths, size_t n) {
+    pthread_mutex_lock(&index->lock);
+    int result = 0;
+    if (id_map_get(&index->pending.thread_map, thread_id) != UINT32_MAX || index->pending.doc_count >= FTS_BUFFER_POSTS) {
+        result = commit_locked(index);  // Newer copy of a thread must land in a newer segment
+    }
+
+    uint32_t thread_index = result == 0 ? builder_thread(&index->pending, thread_id) : UINT32_MAX;
+    Token *tokens = NULL;
+    size_t token_capacity = 0;
+    for (size_t i = 0; i < n && thread_index != UINT32_MAX && result == 0; i++) {
+        result = builder_add_post(&index->pending, thread_index, posts[i], lengths[i], i, &tokens, &token_capacity);
+    }
+    free(tokens);
+    pthread_mutex_unlock(&index->lock);
+    return thread_index == UINT32_MAX ? -1 : result;
+}
+
+// Stop a thread from matching; committed like an add
+int fts_index_remove_thread(FtsIndex *index, uint64_t thread_id) {
+    return fts_index_add_thread(index, thread_id, NULL, NULL, 0);
+}
+
+// Write pending threads as a new segment
+int fts_index_commit(FtsIndex *index) {
+    pthread_mutex_lock(&index->lock);
+    int result = commit_locked(index);
+    pthread_mutex_unlock(&index->lock);
+    return result;
+}
+
+// Drop everything, e.g. before a rebuild
+int fts_index_clear(FtsIndex *index) {
+    pthread_mutex_lock(&index->lock);
+    builder_free(&index->pending);
+    int result = lock_directory(index);
+    if (result == 0) {
+        load_manifest(index);  // For the newest next_segment, so names are never reused
+        for (size_t i = 0; i < index->segment_count; i++) segment_unmap(&index->segments[i]);
+        index->segment_count = 0;
+        result = write_manifest(index);
+        remove_unlisted_files(index);
+        unlock_directory(index);
+    }
+    pthread_mutex_unlock(&index->lock);
+    return result;
+}
+
+void fts_index_stats(FtsIndex *index, FtsIndexStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_lock(&index->lock);
+    stats->segments = index->segment_count;
+    for (size_t i = 0; i < index->segment_count; i++) {
+        const Segment *segment = &index->segments[i];
+        for (uint32_t t = 0; t < segment->header->thread_count; t++) stats->threads += !segment->superseded[t];
+        stats->posts += segment->live_docs;
+        stats->terms += segment->header->term_count;
+        stats->bytes += segment->length;
+    }
+    stats->pending_posts = index->pending.doc_count;
+    pthread_mutex_unlock(&index->lock);
+}
+
+// --- Searching ---------------------------------------------------------------------------------
+
+typedef struct {
+    size_t term_count;       // 1 for a word, more for a phrase
+    char terms[FTS_MAX_PHRASE][FTS_MAX_TERM + 1];
+    uint32_t lengths[FTS_MAX_PHRASE];
+    size_t doc_freq;         // Live matching documents over all segments
+} Clause;
+
+typedef struct {
+    uint32_t *docs;
+    uint32_t *frequencies;
+    size_t count;
+} Matches;
+
+typedef struct {
+    uint32_t *docs;
+    uint32_t *frequencies;
+    uint32_t *position_starts;  // Into positions, count + 1 entries
+    uint32_t *positions;
+    size_t count;
+} Postings;
+
+// Words become separate clauses, "quoted text" one phrase clause
+static size_t parse_query(const char *query, Clause *clauses) {
+    size_t count = 0;
+    Token *tokens = NULL;
+    size_t capacity = 0;
+    const char *p = query;
+
+    while (*p && count < FTS_MAX_CLAUSES) {
+        const char *quote = strchr(p, '"');
+        const char *end = quote ? quote : p + strlen(p);
+        char *text = strndup(p, end - p);
+        size_t n = text ? tokenize(text, &tokens, &capacity, 0) : 0;
+        free(text);
+        for (size_t i = 0; i < n && count < FTS_MAX_CLAUSES; i++) {
+            Clause *clause = &clauses[count++];
+            memset(clause, 0, sizeof(*clause));
+            clause->term_count = 1;
+            memcpy(clause->terms[0], tokens[i].term, tokens[i].length + 1);
+            clause->lengths[0] = tokens[i].length;
+        }
+        if (quote == NULL) break;
+
+        const char *closing = strchr(quote + 1, '"');
+        const char *phrase_end = closing ? closing : quote + 1 + strlen(quote + 1);
+        text = strndup(quote + 1, phrase_end - quote - 1);
+        n = text ? tokenize(text, &tokens, &capacity, 0) : 0;
+        free(text);
+        if (n > 0 && count < FTS_MAX_CLAUSES) {
+            Clause *clause = &clauses[count++];
+            memset(clause, 0, sizeof(*clause));
+            clause->term_count = n < FTS_MAX_PHRASE ? n : FTS_MAX_PHRASE;
+            for (size_t i = 0; i < clause->term_count; i++) {
+                memcpy(clause->terms[i], tokens[i].term, tokens[i].length + 1);
+                clause->lengths[i] = tokens[i].length;
+            }
+        }
+        p = closing ? closing + 1 : phrase_end;
+    }
+    free(tokens);
+    return count;
+}
+
+static void postings_free(Postings *postings) {
+    free(postings->docs);
+    free(postings->frequencies);
+    free(postings->position_starts);
+    free(postings->positions);
+    memset(postings, 0, sizeof(*postings));
+}
+
+// Decode a term's live documents; positions only when a phrase needs them
+static int decode_postings(const Segment *segment, const SegmentTerm *entry, int with_positions, Postings *out) {
+    memset(out, 0, sizeof(*out));
+    if (entry == NULL) return 0;
+    out->docs = malloc((entry->doc_freq + 1) * sizeof(uint32_t));
+    out->frequencies = malloc((entry->doc_freq + 1) * sizeof(uint32_t));
+    if (with_positions) out->position_starts = malloc((entry->doc_freq + 1) * sizeof(uint32_t));
+    if (out->docs == NULL || out->frequencies == NULL || (with_positions && out->position_starts == NULL)) {
+        postings_free(out);
+        return -1;
+    }
+
+    size_t positions_capacity = 0, positions_used = 0;
+    const uint8_t *p = segment->postings + entry->postings_offset;
+    uint32_t doc = 0;
+    for (uint32_t i = 0; i < entry->doc_freq; i++) {
+        doc += (uint32_t)get_varint(&p);
+        uint32_t frequency = (uint32_t)get_varint(&p);
+        size_t positions_length = get_varint(&p);
+        const uint8_t *positions_end = p + positions_length;
+        if (segment->superseded[segment->docs[doc].thread_index]) {
+            p = positions_end;
+            continue;
+        }
+
+        if (with_positions) {
+            if (positions_used + frequency > positions_capacity) {
+                positions_capacity = (positions_used + frequency) * 2;
+                uint32_t *positions = realloc(out->positions, positions_capacity * sizeof(uint32_t));
+                if (positions == NULL) {
+                    postings_free(out);
+                    return -1;
+                }
+                out->positions = positions;
+            }
+            out->position_starts[out->count] = (uint32_t)positions_used;
+            uint32_t position = 0;
+            for (uint32_t j = 0; j < frequency; j++) {
+                position += (uint32_t)get_varint(&p);
+                out->positions[positions_used++] = position;
+            }
+        }
+        p = positions_end;
+        out->docs[out->count] = doc;
+        out->frequencies[out->count++] = frequency;
+    }
+    if (with_positions) out->position_starts[out->count] = (uint32_t)positions_used;
+    return 0;
+}
+
+static int contains_position(const uint32_t *positions, size_t count, uint32_t position) {
+    size_t low = 0, high = count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (positions[middle] < position) low = middle + 1;
+        else high = middle;
+    }
+    return low < count && positions[low] == position;
+}
+
+// Documents of one segment matching a clause, with the clause's frequency in each
+static int match_clause(const Segment *segment, const Clause *clause, Matches *out) {
+    memset(out, 0, sizeof(*out));
+    Postings postings[FTS_MAX_PHRASE];
+    int with_positions = clause->term_count > 1;
+    for (size_t i = 0; i < clause->term_count; i++) {
+        if (decode_postings(segment, segment_find_term(segment, clause->terms[i], clause->lengths[i]), with_positions, &postings[i]) != 0) {
+            for (size_t j = 0; j < i; j++) postings_free(&postings[j]);
+            return -1;
+        }
+    }
+
+    if (!with_positions) {
+        out->docs = postings[0].docs;
+        out->frequencies = postings[0].frequencies;
+        out->count = postings[0].count;
+        return 0;
+    }
+
+    // Phrase: documents holding every term, then a run of consecutive positions
+    size_t capacity = postings[0].count;
+    out->docs = malloc((capacity + 1) * sizeof(uint32_t));
+    out->frequencies = malloc((capacity + 1) * sizeof(uint32_t));
+    size_t cursor[FTS_MAX_PHRASE] = { 0 };
+    for (size_t d = 0; d < postings[0].count && out->docs && out->frequencies; d++) {
+        uint32_t doc = postings[0].docs[d];
+        size_t at[FTS_MAX_PHRASE];
+        int present = 1;
+        for (size_t i = 1; i < clause->term_count && present; i++) {
+            while (cursor[i] < postings[i].count && postings[i].docs[cursor[i]] < doc) cursor[i]++;
+            present = cursor[i] < postings[i].count && postings[i].docs[cursor[i]] == doc;
+            at[i] = cursor[i];
+        }
+        if (!present) continue;
+
+        uint32_t frequency = 0;
+        for (uint32_t k = postings[0].position_starts[d]; k < postings[0].position_starts[d + 1]; k++) {
+            uint32_t start = postings[0].positions[k];
+            int run = 1;
+            for (size_t i = 1; i < clause->term_count && run; i++) {
+                const uint32_t *positions = postings[i].positions + postings[i].position_starts[at[i]];
+                size_t n = postings[i].position_starts[at[i] + 1] - postings[i].position_starts[at[i]];
+                run = contains_position(positions, n, start + (uint32_t)i);
+            }
+            frequency += run;
+        }
+        if (frequency > 0) {
+            out->docs[out->count] = doc;
+            out->frequencies[out->count++] = frequency;
+        }
+    }
+    for (size_t i = 0; i < clause->term_count; i++) postings_free(&postings[i]);
+    if (out->docs == NULL || out->frequencies == NULL) {
+        free(out->docs);
+        free(out->frequencies);
+        return -1;
+    }
+    return 0;
+}
+
+static int compare_hits(const void *a, const void *b) {
+    const FtsHit *x = a, *y = b;
+    if (x->score != y->score) return x->score < y->score ? 1 : -1;
+    return (x->thread_id < y->thread_id) - (x->thread_id > y->thread_id);  // Newer threads first
+}
+
+// Threads whose posts match every word and phrase of query, best first. Each post is scored
+// with BM25; a thread scores as its best post plus a bonus that grows with the log of the
+// number of matching posts. Returns the number of hits copied; *total gets all of them.
+size_t fts_index_search(FtsIndex *index, const char *query, FtsHit *hits, size_t max, size_t *total) {
+    Clause clauses[FTS_MAX_CLAUSES];
+    size_t clause_count = parse_query(query, clauses);
+    if (total) *total = 0;
+    if (clause_count == 0) return 0;
+
+    pthread_mutex_lock(&index->lock);
+    size_t segment_count = index->segment_count;
+    Matches *matches = calloc(segment_count * clause_count + 1, sizeof(Matches));
+    double live_docs = 0, total_length = 0, all_docs = 0;
+    int failed = matches == NULL;
+
+    for (size_t s = 0; s < segment_count && !failed; s++) {
+        live_docs += index->segments[s].live_docs;
+        all_docs += index->segments[s].header->doc_count;
+        total_length += index->segments[s].header->total_length;
+        for (size_t c = 0; c < clause_count && !failed; c++) {
+            failed = match_clause(&index->segments[s], &clauses[c], &matches[s * clause_count + c]) != 0;
+            if (!failed) clauses[c].doc_freq += matches[s * clause_count + c].count;
+        }
+    }
+
+    double idf[FTS_MAX_CLAUSES];
+    for (size_t c = 0; c < clause_count; c++) {
+        double df = clauses[c].doc_freq;
+        idf[c] = log(1.0 + (live_docs - df + 0.5) / (df + 0.5));
+    }
+    double average_length = all_docs > 0 ? total_length / all_docs : 1;
+
+    // Intersect the clauses segment by segment and fold matching posts into their threads
+    FtsHit *found = NULL;
+    size_t found_count = 0, found_capacity = 0;
+    IdMap thread_hits = { 0 };
+    for (size_t s = 0; s < segment_count && !failed; s++) {
+        const Segment *segment = &index->segments[s];
+        Matches *row = &matches[s * clause_count];
+        size_t rarest = 0;
+        for (size_t c = 1; c < clause_count; c++) {
+            if (row[c].count < row[rarest].count) rarest = c;
+        }
+
+        size_t cursor[FTS_MAX_CLAUSES] = { 0 };
+        for (size_t d = 0; d < row[rarest].count && !failed; d++) {
+            uint32_t doc = row[rarest].docs[d];
+            const SegmentDoc *entry = &segment->docs[doc];
+            double length_norm = FTS_BM25_K1 * (1 - FTS_BM25_B + FTS_BM25_B * entry->length / average_length);
+            double score = 0;
+            int present = 1;
+            for (size_t c = 0; c < clause_count && present; c++) {
+                while (cursor[c] < row[c].count && row[c].docs[cursor[c]] < doc) cursor[c]++;
+                present = cursor[c] < row[c].count && row[c].docs[cursor[c]] == doc;
+                if (present) {
+                    double frequency = row[c].frequencies[cursor[c]];
+                    score += idf[c] * frequency * (FTS_BM25_K1 + 1) / (frequency + length_norm);
+                }
+            }
+            if (!present) continue;
+
+            uint64_t thread_id = segment->threads[entry->thread_index];
+            uint32_t at = id_map_get(&thread_hits, thread_id);
+            if (at == UINT32_MAX) {
+                if (found_count == found_capacity) {
+                    found_capacity = found_capacity ? found_capacity * 2 : 256;
+                    FtsHit *resized = realloc(found, found_capacity * sizeof(FtsHit));
+                    if (resized == NULL) {
+                        failed = 1;
+                        break;
+                    }
+                    found = resized;
+                }
+                at = (uint32_t)found_count++;
+                found[at] = (FtsHit){ thread_id, entry->post_no, score, 0 };
+                if (id_map_put(&thread_hits, thread_id, at) != 0) failed = 1;
+            } else if (score > found[at].score) {
+                found[at].score = score;
+                found[at].post_no = entry->post_no;
+            }
+            found[at].matching_posts++;
+        }
+    }
+    pthread_mutex_unlock(&index->lock);
+
+    for (size_t i = 0; matches && i < segment_count * clause_count; i++) {
+        free(matches[i].docs);
+        free(matches[i].frequencies);
+    }
+    free(matches);
+    id_map_free(&thread_hits);
+
+    size_t copied = 0;
+    if (!failed) {
+        for (size_t i = 0; i < found_count; i++) found[i].score *= 1.0 + 0.1 * log(found[i].matching_posts);
+        if (found_count) qsort(found, found_count, sizeof(FtsHit), compare_hits);
+        copied = found_count < max ? found_count : max;
+        if (copied) memcpy(hits, found, copied * sizeof(FtsHit));
+        if (total) *total = found_count;
+    }
+    free(found);
+    return copied;
+}
+
+// --- Redis -------------------------------------------------------------------------------------
+
+#define FTS_REDIS_BATCH 32  // Threads whose posts are fetched per pipelined round-trip
+
+// Index the post lists of the given threads as stored in Redis, then commit
+int fts_index_add_from_redis(FtsIndex *index, const char *board, const char *const *thread_ids, size_t n) {
+    RedisBatch *lists = redis_batch_new(REDIS_ROUTE_READ);
+    if (lists == NULL) return -1;
+
+    int result = 0;
+    for (size_t first = 0; first < n && result == 0; first += FTS_REDIS_BATCH) {
+        size_t batch = n - first < FTS_REDIS_BATCH ? n - first : FTS_REDIS_BATCH;
+        redis_batch_clear(lists);
+        for (size_t i = 0; i < batch; i++) {
+            char key[320];
+            format_thread_key(key, sizeof(key), board, thread_ids[first + i], "posts");
+            redis_batch_append(lists, key, "LRANGE %s 0 -1", key);
+        }
+        result = redis_batch_execute(lists);
+        for (size_t i = 0; i < batch && result == 0; i++) {
+            redisReply *reply = redis_batch_reply(lists, i);
+            if (reply->type == REDIS_REPLY_ARRAY) {
+                const char **posts = malloc((reply->elements + 1) * sizeof(char *));
+                size_t *lengths = malloc((reply->elements + 1) * sizeof(size_t));
+                size_t count = 0;
+                for (size_t j = 0; posts && lengths && j < reply->elements; j++) {
+                    if (reply->element[j]->type != REDIS_REPLY_STRING) continue;
+                    posts[count] = reply->element[j]->str;  // hiredis NUL-terminates strings
+                    lengths[count++] = reply->element[j]->len;
+                }
+                char **decoded = NULL;
+                if (posts && lengths) result = post_codec_decode_all(board, posts, lengths, count, &decoded);
+                else result = -1;
+                if (result == 0) result = fts_index_add_thread(index, strtoull(thread_ids[first + i], NULL, 10), posts, lengths, count);
+                post_codec_free_decoded(decoded, count);
+                free(posts);
+                free(lengths);
+            }
+        }
+    }
+    redis_batch_free(lists);
+    return result == 0 ? fts_index_commit(index) : result;
+}
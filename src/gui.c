@@ -1,19 +1,37 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <gtk/gtk.h>
-#include <hiredis/hiredis.h>
 #include <string.h>
 #include <stdio.h>
-#include <pthread.h>
+#include <math.h>
 #include "../include/settings.h"
 #include "../include/gui.h"
 #include "../include/redis_operations.h"
+#include "../include/thread_cache.h"
+#include "../include/thread_list_model.h"
+#include "../include/keyspace_listener.h"
+#include "../include/redis_async.h"
+#include "../include/log_ring.h"
+#include "../include/job_queue.h"
+#include "../include/scraper_rpc.h"
+#include "../include/thread_ingest.h"
+#include "../include/archive.h"
+#include "../include/scraper_jobs.h"
+#include "../include/metrics.h"
+#include "../include/title_filter.h"
+#include "../include/thread_viewer.h"
+#include "../include/media_store.h"
+#include "../include/thumbnail_cache.h"
+#include "../include/post_codec.h"
 
 // Global variables for GUI widgets
-GtkWidget *host_entry, *port_entry, *board_entry;
+GtkWidget *host_entry, *port_entry, *board_entry, *boards_entry, *endpoints_entry, *replicas_check;
 GtkWidget *thread_tree_view;  // TreeView for displaying thread titles
 GtkWidget *search_entry;      // Search bar for filtering threads
 GtkWidget *output_text_view;
-
-static redisContext *redis_context = NULL;
+GtkWidget *output_stats_label;  // Output rate and dropped-line count under the output view
+GtkWidget *jobs_tree_view;      // Queued, running and finished scraper jobs
+GtkWidget *search_mode_combo;   // Search titles or post text
 
 extern char redis_host[256];
 extern int redis_port;
@@ -27,8 +45,22 @@ void delete_thread_from_scraper(const char *board, const char *thread_id);
 void delete_selected_thread();
 void open_settings_dialog();
 void refresh_thread_list_callback();
+void search_changed_callback();
+void refresh_after_mutation(const char *mutated_board);
 void open_add_thread_dialog();
-void create_thread_list_tree_view(GtkWidget *parent_box);
+void create_board_notebook(GtkWidget *parent_box);
+void open_board_tabs();
+void close_board_tabs();
+void show_archived_threads();
+void move_selected_thread_to_archive();
+void archive_dead_threads();
+void rebuild_search_index();
+void rebuild_sorted_index();
+void compress_posts_of_boards();
+void export_board_to_file();
+void import_board_from_file();
+void open_stats_dialog();
+void create_jobs_panel(GtkWidget *parent_box);
 void create_main_window();
 void save_settings_callback();  // Declaration added for save_settings_callback
 void open_set_title_dialog();  // Function to open dialog to set thread title
@@ -36,23 +68,19 @@ void set_thread_title(const char *board, const char *thread_id, const char *titl
 const char *get_selected_thread_id_and_title(char *thread_title_out, size_t title_len);  // Helper function to get ID and title
 void update_stored_threads_from_scraper(); //updates threads and generates Markdown on server.
 void detect_docker_host();//see if there is Docker host to auto-populate redis host ip
-void *update_stored_threads_thread(void *arg);
-void generate_audio_for_thread(); // Function for generating audio in a thread
 void on_generate_audio_button_clicked(GtkWidget *widget, gpointer data);
 void show_context_menu(GtkWidget *widget, GdkEventButton *event, gpointer data);
 void copy_thread_id_callback(GtkWidget *menu_item, gpointer data);
 
-gboolean update_output_text_view_safe(gchar *output);
-gboolean update_output_text_view(gchar *output);
+void append_output(const char *text);
+static const char *selected_board();
 
-// Connect to Redis using stored settings
+// Connect to Redis using stored settings; returns at once, each board's connection completes on the main loop
 void connect_to_redis() {
-    if (redis_context) redisFree(redis_context);
-    redis_context = redisConnect(redis_host, redis_port);
-
-    if (redis_context == NULL || redis_context->err) {
-        fprintf(stderr, "Could not connect to Redis: %s\n", redis_context ? redis_context->errstr : "Unknown error");
-    }
+    char endpoints[600];
+    format_redis_endpoints(endpoints, sizeof(endpoints));
+    redis_pool_init(endpoints, redis_pool_size, connect_timeout_ms, read_from_replicas);  // For worker threads
+    open_board_tabs();
 }
 
 // Helper function to get the selected thread ID from TreeView
@@ -91,121 +119,618 @@ void delete_selected_thread() {
     gtk_widget_destroy(dialog);
 
     if (response == GTK_RESPONSE_YES) {
-        delete_thread_from_scraper(board, thread_id);  // Perform deletion
+        delete_thread_from_scraper(selected_board(), thread_id);  // Perform deletion
     }
 }
 
+// Prefix each output line with its job so concurrent commands stay readable
+static void on_job_output(unsigned job_id, const char *line, void *user_data) {
+    char prefixed[1100];
+    size_t length = strlen(line);
+    g_snprintf(prefixed, sizeof(prefixed), "[#%u] %s%s", job_id, line, length && line[length - 1] == '\n' ? "" : "\n");
+    append_output(prefixed);
+}
+
+// One timing line per finished command, with the running average for its transport
+static void report_job_timing(const JobInfo *job) {
+    char line[256];
+    if (format_job_timing(job, line, sizeof(line))) on_job_output(job->id, line, NULL);
+}
+
+static void on_scraper_job_done(const JobInfo *job, void *user_data) {
+    report_job_timing(job);
+    update_search_index(job);
+    update_board_index(job);
+}
+
+static gboolean refresh_after_mutation_idle(gpointer data) {
+    refresh_after_mutation(data);
+    g_free(data);
+    return G_SOURCE_REMOVE;
+}
+
+// Runs on a job worker; mutations refresh the list from the main thread
+static void on_mutation_job_done(const JobInfo *job, void *user_data) {
+    report_job_timing(job);
+    update_search_index(job);
+    update_board_index(job);
+    if (job->state == JOB_SUCCEEDED || job->state == JOB_FAILED) g_idle_add(refresh_after_mutation_idle, g_strdup(job->board));
+}
+
 // Delete a thread using the scraper script
 void delete_thread_from_scraper(const char *board, const char *thread_id) {
-    char command[512];
-    snprintf(command, sizeof(command), "/usr/bin/docker exec 4chan_scraper-scraper-1 python FourChanScraper.py delete_thread %s %s", board, thread_id);
+    submit_delete_thread(board, thread_id, on_mutation_job_done, NULL);  // Drops the thread from the list when it finishes
+}
 
+// --- Board tabs ------------------------------------------------------------------------------
+
+// Each board has its own tab with its own connection, cache, list model and view, so boards
+// load concurrently and switching tabs only changes which view is on screen. With more than one
+// board, an "All boards" tab shows their threads together.
+
+#define BOARD_TABS_MAX 32
+#define COMBINED_REBUILD_MS 500  // Coalesces changes from busy boards into one rebuild of the combined list
+
+typedef struct BoardTab BoardTab;
+struct BoardTab {
+    char board[256];               // Empty for the combined tab
+    RedisAsync *connection;        // NULL for the combined tab
+    ThreadCache *cache;            // NULL for the combined tab
+    RedisThreadListing *listing;   // Listing still running, NULL if none
+    RedisIndexPage *index_page;    // Page of the sorted index still loading, NULL if none
+    long long index_total;         // Threads in the board's sorted index; -1 when listed with SCAN
+    long index_loaded;             // Index positions requested so far
+    uint64_t listing_started;      // metrics_begin() of the listing, 0 while recording is off
+    gboolean showing_archive;      // List filled from the board's archive file instead of Redis
+    Archive *archive;              // Read-only mapping of the board's archive file
+    ThreadListModel *model;        // Virtual model over the cache snapshot; owned by the view
+    GtkWidget *tree_view;
+    GtkWidget *label;
+    guint model_sync_id;           // Pending merge of newly listed records, 0 if none
+    GHashTable *pending_updates;   // Thread IDs touched by keyspace events since the last flush
+    guint pending_flush_id;
+    gboolean filter_stale;         // The search changed while another tab was shown
+
+    TitleIndex *title_index;       // Packed copy of the cached titles for the title query
+    float *title_scores;           // Per-record score from the last search; NAN once the record changed
+    size_t title_scores_count;
+
+    FtsHit *search_hits;           // Ranked result of the last post search
+    GHashTable *search_hit_index;  // Thread ID -> hit, NULL when searching titles
+
+    ThreadSnapshot *combined;      // Combined tab: every board's live threads, titles prefixed with the board
+    BoardTab **owners;             // Combined tab: board tab of each combined record
+};
+
+static BoardTab *board_tabs[BOARD_TABS_MAX];
+static int board_tab_count = 0;
+static BoardTab *combined_tab = NULL;
+static BoardTab *current_tab = NULL;
+static GtkWidget *board_notebook;
+static guint combined_rebuild_id = 0;
+
+static guint search_debounce_id = 0;     // Pending search filter timeout, 0 if none
+static char *thread_filter = NULL;       // Filter currently applied to the lists, NULL for all threads
+static TitleQuery *title_query = NULL;   // Compiled thread_filter, NULL for all threads
+
+#define SEARCH_DEBOUNCE_MS 150
+
+// Search modes, in combo box order
+enum {
+    SEARCH_TITLES,
+    SEARCH_FUZZY_TITLES,
+    SEARCH_REGEX_TITLES,
+    SEARCH_POSTS,
+};
+
+static ThreadSnapshot *tab_snapshot(BoardTab *tab) {
+    return tab->cache ? thread_cache_snapshot(tab->cache) : tab->combined;
+}
 
-    FILE *fp = popen(command, "r");
-    if (fp == NULL) {
-        fprintf(stderr, "Failed to execute scraper command\n");
+// Tab a combined record came from, or the tab itself
+static BoardTab *record_owner(BoardTab *tab, const ThreadSnapshotRecord *record) {
+    return tab == combined_tab ? tab->owners[record - tab->combined->records] : tab;
+}
+
+// Score of a record under the title query; records added or changed since the last search are scored alone
+static float title_score(BoardTab *tab, const ThreadSnapshot *snapshot, const ThreadSnapshotRecord *record) {
+    if (record->flags & THREAD_RECORD_DELETED) return 0;
+    if (title_query == NULL) return 1;
+    size_t index = record - snapshot->records;
+    if (index < tab->title_scores_count && !isnan(tab->title_scores[index])) return tab->title_scores[index];
+    return title_query_score(title_query, thread_snapshot_title(snapshot, record), record->id);
+}
+
+static gboolean match_thread_filter(const ThreadSnapshot *snapshot, const ThreadSnapshotRecord *record, gpointer data) {
+    BoardTab *owner = record_owner(data, record);
+    if (owner->search_hit_index) return g_hash_table_contains(owner->search_hit_index, &record->id);
+    return title_score(data, snapshot, record) > 0;
+}
+
+static double rank_thread(const ThreadSnapshot *snapshot, const ThreadSnapshotRecord *record, gpointer data) {
+    BoardTab *owner = record_owner(data, record);
+    if (!owner->search_hit_index) return title_query ? title_score(data, snapshot, record) : 0;
+    const FtsHit *hit = g_hash_table_lookup(owner->search_hit_index, &record->id);
+    return hit ? hit->score : 0;
+}
+
+static int search_mode() {
+    return search_mode_combo ? gtk_combo_box_get_active(GTK_COMBO_BOX(search_mode_combo)) : SEARCH_TITLES;
+}
+
+// Set the title filter and compile it for the current search mode; a bad regex filters nothing out
+static void set_thread_filter(const char *filter) {
+    static const TitleMatchMode modes[] = {
+        [SEARCH_TITLES] = TITLE_MATCH_WORDS,
+        [SEARCH_FUZZY_TITLES] = TITLE_MATCH_FUZZY,
+        [SEARCH_REGEX_TITLES] = TITLE_MATCH_REGEX,
+    };
+    g_free(thread_filter);
+    thread_filter = (filter && *filter) ? g_strdup(filter) : NULL;
+    title_query_free(title_query);
+    title_query = NULL;
+    if (thread_filter == NULL || search_mode() == SEARCH_POSTS) return;
+
+    char error[256];
+    title_query = title_query_new(thread_filter, modes[search_mode()], error, sizeof(error));
+    if (title_query == NULL && *error) {
+        char line[320];
+        g_snprintf(line, sizeof(line), "Bad regular expression: %s\n", error);
+        append_output(line);
+    }
+}
+
+// Score the whole list in one pass over the packed titles, ahead of a refilter
+static void search_titles(BoardTab *tab, const ThreadSnapshot *snapshot) {
+    tab->title_scores_count = 0;
+    if (title_query == NULL) return;
+    if (tab->title_index == NULL) tab->title_index = title_index_new();
+    tab->title_scores = g_renew(float, tab->title_scores, snapshot->count ? snapshot->count : 1);
+    title_index_search(tab->title_index, snapshot, title_query, tab->title_scores);
+    tab->title_scores_count = snapshot->count;
+}
+
+// Rebuild a tab's visible rows from its cache; never touches Redis. The view is detached
+// meanwhile so a refilter is one pass over the index vector instead of a signal per row.
+static void show_cached_threads(BoardTab *tab) {
+    if (tab->model_sync_id) {
+        g_source_remove(tab->model_sync_id);
+        tab->model_sync_id = 0;
+    }
+    g_object_ref(tab->model);
+    gtk_tree_view_set_model(GTK_TREE_VIEW(tab->tree_view), NULL);
+    search_titles(tab, tab_snapshot(tab));
+    thread_list_model_refilter(tab->model, tab_snapshot(tab));
+    gtk_tree_view_set_model(GTK_TREE_VIEW(tab->tree_view), GTK_TREE_MODEL(tab->model));
+    g_object_unref(tab->model);
+    tab->filter_stale = FALSE;
+}
+
+// Gather every board's live threads into the combined tab's list
+static void rebuild_combined_list() {
+    size_t total = 0;
+    for (int i = 0; i < board_tab_count; i++) total += thread_cache_snapshot(board_tabs[i]->cache)->count;
+
+    ThreadSnapshot *combined = thread_snapshot_new(total);
+    combined_tab->owners = g_renew(BoardTab *, combined_tab->owners, total ? total : 1);
+    for (int i = 0; i < board_tab_count; i++) {
+        const ThreadSnapshot *snapshot = thread_cache_snapshot(board_tabs[i]->cache);
+        for (size_t r = 0; r < snapshot->count; r++) {
+            const ThreadSnapshotRecord *record = &snapshot->records[r];
+            if (record->flags & THREAD_RECORD_DELETED) continue;
+            char *title = g_strdup_printf("/%s/ %s", board_tabs[i]->board, thread_snapshot_title(snapshot, record));
+            long index = thread_snapshot_append(combined, record->id, title, record->count, thread_snapshot_status(snapshot, record));
+            g_free(title);
+            if (index >= 0) combined_tab->owners[index] = board_tabs[i];
+        }
+    }
+
+    // The model still points at the old snapshot until the refilter below
+    ThreadSnapshot *old = combined_tab->combined;
+    combined_tab->combined = combined;
+    show_cached_threads(combined_tab);
+    thread_snapshot_unref(old);
+}
+
+static gboolean rebuild_combined_timeout(gpointer data) {
+    combined_rebuild_id = 0;
+    rebuild_combined_list();
+    return G_SOURCE_REMOVE;
+}
+
+// A board's list changed: rebuild the combined list soon if it is on screen, else when it is next shown
+static void combined_list_changed() {
+    if (combined_tab == NULL) return;
+    combined_tab->filter_stale = TRUE;
+    if (current_tab == combined_tab && combined_rebuild_id == 0) {
+        combined_rebuild_id = g_timeout_add(COMBINED_REBUILD_MS, rebuild_combined_timeout, NULL);
+    }
+}
+
+// Merge records appended by the listing since the last sync, once per burst of replies
+static gboolean sync_thread_model(gpointer data) {
+    BoardTab *tab = data;
+    tab->model_sync_id = 0;
+    thread_list_model_sync(tab->model, thread_cache_snapshot(tab->cache));
+    return G_SOURCE_REMOVE;
+}
+
+// Record delivered by the data layer: cache it and patch its row; no title means it was deleted
+static void on_thread_record(const char *thread_id, const char *title, int count, const char *status, void *user_data) {
+    BoardTab *tab = user_data;
+    const ThreadSnapshotRecord *record;
+    size_t index;
+
+    if (title) {
+        record = thread_cache_add(tab->cache, thread_id, title, count, status);
+        if (record == NULL) return;
+        index = record - thread_cache_snapshot(tab->cache)->records;
+    } else {
+        record = thread_cache_find(tab->cache, thread_id);
+        if (record == NULL) return;
+        index = record - thread_cache_snapshot(tab->cache)->records;
+        thread_cache_remove(tab->cache, thread_id);  // Tombstone; the record keeps its index
+    }
+    if (index < tab->title_scores_count) tab->title_scores[index] = NAN;
+
+    if (!thread_list_model_record_changed(tab->model, thread_cache_snapshot(tab->cache), index) && tab->model_sync_id == 0) {
+        tab->model_sync_id = g_idle_add(sync_thread_model, tab);
+    }
+    combined_list_changed();
+}
+
+static void set_tab_label(BoardTab *tab) {
+    char text[300];
+    if (tab->listing || (tab->index_page && tab->index_total < 0)) g_snprintf(text, sizeof(text), "/%s/ …", tab->board);
+    else if (tab->index_total >= 0 && !tab->showing_archive) {
+        g_snprintf(text, sizeof(text), "/%s/ %ld of %lld", tab->board, MIN(tab->index_loaded, (long)tab->index_total), tab->index_total);
+    } else g_snprintf(text, sizeof(text), "/%s/%s", tab->board, tab->showing_archive ? " (archive)" : "");
+    gtk_label_set_text(GTK_LABEL(tab->label), text);
+}
+
+// A listing that ran to the end validates the cache
+static void on_listing_done(int complete, unsigned threads, unsigned round_trips, void *user_data) {
+    BoardTab *tab = user_data;
+    tab->listing = NULL;
+    thread_cache_set_valid(tab->cache, complete);
+    set_tab_label(tab);
+    if (!tab->listing_started) return;
+    // Only while metrics are recorded, so a plain session keeps stderr quiet
+    fprintf(stderr, "Listed %u threads of /%s/ in %.1f ms (%u round-trips, worst main-loop stall %.1f ms)\n", threads, tab->board,
+            (metrics_now_ns() - tab->listing_started) / 1e6, round_trips, redis_async_take_max_stall_ms());
+    thread_snapshot_report(thread_cache_snapshot(tab->cache), stderr);
+    metrics_end(METRIC_THREAD_LISTING, tab->listing_started);
+}
+
+static void show_archived_threads_in(BoardTab *tab);
+
+static void start_scan_listing(BoardTab *tab) {
+    tab->index_total = -1;
+    tab->listing_started = metrics_begin();
+    tab->listing = redis_async_list_threads(tab->connection, tab->board, scan_count, fetch_batch, on_thread_record, on_listing_done, tab);
+    set_tab_label(tab);
+}
+
+// Sorted index matching the list's sort column: newest first while unsorted. Titles have none.
+static gboolean tab_index_order(BoardTab *tab, BoardIndexOrder *order, int *descending) {
+    gint column;
+    GtkSortType sort_type;
+    if (!gtk_tree_sortable_get_sort_column_id(GTK_TREE_SORTABLE(tab->model), &column, &sort_type)) {
+        *order = BOARD_INDEX_BY_ID;
+        *descending = 1;
+        return TRUE;
+    }
+    *descending = sort_type == GTK_SORT_DESCENDING;
+    if (column == THREAD_LIST_COLUMN_ID) *order = BOARD_INDEX_BY_ID;
+    else if (column == THREAD_LIST_COLUMN_COUNT) *order = BOARD_INDEX_BY_COUNT;
+    else if (column == THREAD_LIST_COLUMN_STATUS) *order = BOARD_INDEX_BY_STATUS;
+    else return FALSE;
+    return TRUE;
+}
+
+static void request_index_page(BoardTab *tab);
+
+// The first page tells whether the board has an index; without one the board is listed with SCAN
+static void on_index_page(int ok, long long total, size_t count, void *user_data) {
+    BoardTab *tab = user_data;
+    gboolean first = tab->index_total < 0;
+    tab->index_page = NULL;
+    if (first && (!ok || total == 0)) {
+        fprintf(stderr, "No sorted index of /%s/; listing it with SCAN (Rebuild Sorted Index creates one)\n", tab->board);
+        start_scan_listing(tab);
         return;
     }
+    if (ok) tab->index_total = total;
+    else tab->index_loaded -= list_page_size;  // Scrolling to the end asks again
+    thread_cache_set_valid(tab->cache, 1);
+    set_tab_label(tab);
+    if (first && tab->listing_started) {
+        fprintf(stderr, "Listed %zu of %lld threads of /%s/ from its sorted index in %.1f ms\n", count, total, tab->board,
+                (metrics_now_ns() - tab->listing_started) / 1e6);
+        metrics_end(METRIC_THREAD_LISTING, tab->listing_started);
+    }
+}
 
-    // Capture command output and append to text view
-    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(output_text_view));
-    char output[1024];
-    while (fgets(output, sizeof(output), fp) != NULL) {
-        GtkTextIter end;
-        gtk_text_buffer_get_end_iter(buffer, &end);
-        gtk_text_buffer_insert(buffer, &end, output, -1);
+static void request_index_page(BoardTab *tab) {
+    BoardIndexOrder order = BOARD_INDEX_BY_ID;
+    int descending = 1;
+    tab_index_order(tab, &order, &descending);
+    tab->index_page = redis_async_fetch_index_page(tab->connection, tab->board, order, descending, tab->index_loaded, list_page_size,
+                                                   on_thread_record, on_index_page, tab);
+    if (tab->index_page) tab->index_loaded += list_page_size;
+    set_tab_label(tab);
+}
+
+// Load the next page once the list is scrolled to within a screen of its end
+static void on_tab_scrolled(GtkAdjustment *adjustment, gpointer data) {
+    BoardTab *tab = data;
+    if (tab->index_total < 0 || tab->index_page || tab->showing_archive || tab->index_loaded >= tab->index_total) return;
+    double value = gtk_adjustment_get_value(adjustment), page = gtk_adjustment_get_page_size(adjustment);
+    if (value + 2 * page >= gtk_adjustment_get_upper(adjustment)) request_index_page(tab);
+}
+
+// Reload a board's cache from Redis. With list_page_size set, the first page of the board's
+// sorted index is read in the list's sort order and further pages as the list is scrolled;
+// otherwise, or if the board has no index, rows are added in SCAN-sized chunks as replies
+// arrive. A load that is still running is cancelled so only the newest refresh fills the cache.
+static void load_tab_threads(BoardTab *tab) {
+    if (!redis_async_is_connected(tab->connection)) {
+        fprintf(stderr, "Redis connection for /%s/ not established.\n", tab->board);
+        show_archived_threads_in(tab);  // Browse what is on disk until the server is back
+        return;
     }
-    pclose(fp);
 
-    load_thread_titles(NULL);  // Refresh the list to remove the deleted thread
-    
+    redis_async_cancel_listing(tab->listing);
+    tab->listing = NULL;
+    redis_async_cancel_index_page(tab->index_page);
+    tab->index_page = NULL;
+    tab->showing_archive = FALSE;
+    thread_cache_clear(tab->cache);
+    show_cached_threads(tab);
+    combined_list_changed();
+
+    if (list_page_size <= 0) {
+        start_scan_listing(tab);
+        return;
+    }
+    tab->index_total = -1;
+    tab->index_loaded = 0;
+    tab->listing_started = metrics_begin();
+    request_index_page(tab);
+    if (tab->index_page == NULL) start_scan_listing(tab);
+}
+
+// A paged list is reloaded from the index in the new order; loaded rows can't be re-sorted
+// into it. Sorting by title sorts the loaded rows only.
+static void on_tab_sort_changed(GtkTreeSortable *sortable, gpointer data) {
+    BoardTab *tab = data;
+    BoardIndexOrder order;
+    int descending;
+    if (tab->index_total >= 0 && !tab->showing_archive && tab_index_order(tab, &order, &descending)) load_tab_threads(tab);
 }
 
+// Reload the current tab, or every board from the combined tab, and show it with the given filter
 void load_thread_titles(const char *filter) {
-    if (!redis_context) {
-        fprintf(stderr, "Redis connection not established.\n");
-        return;
+    set_thread_filter(search_mode() == SEARCH_POSTS ? NULL : filter);
+    for (int i = 0; i < board_tab_count; i++) {
+        if (current_tab == combined_tab || current_tab == board_tabs[i]) load_tab_threads(board_tabs[i]);
+        else board_tabs[i]->filter_stale = TRUE;
+    }
+}
+
+// Load a board whenever its connection comes (back) up
+static void on_redis_connected(RedisAsync *connection, void *user_data) {
+    BoardTab *tab = user_data;
+    fprintf(stderr, "Connected to Redis at %s:%d for /%s/\n", redis_host, redis_port, tab->board);
+    load_tab_threads(tab);
+}
+
+// Re-read every thread touched since the last flush with one MGET and patch only those rows
+static gboolean flush_pending_updates(gpointer data) {
+    BoardTab *tab = data;
+    tab->pending_flush_id = 0;
+    guint n = g_hash_table_size(tab->pending_updates);
+    if (n == 0) return G_SOURCE_REMOVE;
+
+    uint64_t started = metrics_begin();
+    char (*ids)[THREAD_ID_MAX] = g_malloc0(sizeof(*ids) * n);
+    guint i = 0;
+
+    GHashTableIter iter;
+    gpointer id;
+    g_hash_table_iter_init(&iter, tab->pending_updates);
+    while (g_hash_table_iter_next(&iter, &id, NULL)) {
+        g_strlcpy(ids[i++], id, THREAD_ID_MAX);
     }
+    g_hash_table_remove_all(tab->pending_updates);
+
+    redis_async_fetch_threads(tab->connection, tab->board, ids, n, on_thread_record, tab);
+    // Both indexes are updated on a job worker, since their reads are synchronous; in paged mode
+    // this is how threads the external scraper writes reach the list
+    const char **id_pointers = g_malloc(sizeof(*id_pointers) * n);
+    for (i = 0; i < n; i++) id_pointers[i] = ids[i];
+    submit_index_threads(tab->board, id_pointers, n, NULL, NULL);
+    g_free(id_pointers);
+    g_free(ids);
+    metrics_end(METRIC_UPDATE_FLUSH, started);
+    return G_SOURCE_REMOVE;
+}
 
-    GtkListStore *store = GTK_LIST_STORE(gtk_tree_view_get_model(GTK_TREE_VIEW(thread_tree_view)));
-    gtk_list_store_clear(store);
+// Tab of the board a key belongs to; the board name must be followed by the thread ID,
+// so keys of /gif/ never land in /g/
+static BoardTab *find_key_tab(const char *key) {
+    for (int i = 0; i < board_tab_count; i++) {
+        size_t length = strlen(board_tabs[i]->board);
+        if (strncmp(key, board_tabs[i]->board, length) == 0 && g_ascii_isdigit(key[length])) return board_tabs[i];
+    }
+    return NULL;
+}
 
-    char pattern[256];
-    snprintf(pattern, sizeof(pattern), "%s*_title", board);  // Matches titles of threads for the specified board
-    redisReply *reply = redisCommand(redis_context, "KEYS %s", pattern);
+// Main-thread half of a keyspace event: queue the thread and coalesce the burst
+// of _title/_count/_status events a single scrape produces into one flush.
+static gboolean queue_thread_update(gpointer data) {
+    char *key = data;
+    char thread_id[THREAD_ID_MAX] = "";
+    BoardTab *tab = find_key_tab(key);
+
+    if (tab && !tab->showing_archive && extract_thread_id(key + strlen(tab->board), thread_id, sizeof(thread_id))) {
+        thread_viewer_invalidate(tab->board, thread_id);  // New posts come with a count change
+        if (tab->pending_updates == NULL) tab->pending_updates = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        g_hash_table_add(tab->pending_updates, g_strdup(thread_id));
+        if (tab->pending_flush_id == 0) tab->pending_flush_id = g_idle_add(flush_pending_updates, tab);
+    }
 
-    if (reply->type == REDIS_REPLY_ARRAY) {
-        for (size_t i = 0; i < reply->elements; i++) {
-            const char *title_key = reply->element[i]->str;
-            redisReply *title_reply = redisCommand(redis_context, "GET %s", title_key);
+    g_free(key);
+    return G_SOURCE_REMOVE;
+}
 
-            if (title_reply->type == REDIS_REPLY_STRING) {
-                char thread_id[256];
-                sscanf(title_key, "%*[^0123456789]%[0123456789]", thread_id);  // Extract thread_id
+// Runs on the listener thread; hand the key over to the main loop
+static void on_keyspace_event(const char *key, const char *event, void *user_data) {
+    g_idle_add(queue_thread_update, g_strdup(key));
+}
 
-                // Retrieve the count associated with the thread ID
-                char count_key[256];
-                snprintf(count_key, sizeof(count_key), "%s%s_count", board, thread_id);
-                redisReply *count_reply = redisCommand(redis_context, "GET %s", count_key);
+// Refresh a board after a mutation, unless keyspace events will already patch the changed rows
+void refresh_after_mutation(const char *mutated_board) {
+    BoardTab *tab = NULL;
+    for (int i = 0; i < board_tab_count; i++) {
+        if (strcmp(board_tabs[i]->board, mutated_board) == 0) tab = board_tabs[i];
+    }
+    if (tab == NULL) return;  // Not open as a tab
 
-                int count = (count_reply && count_reply->type == REDIS_REPLY_STRING) ? atoi(count_reply->str) : 0;
+    if (tab->showing_archive) {
+        show_archived_threads_in(tab);
+    } else if (!keyspace_listener_is_active()) {
+        load_tab_threads(tab);
+    }
+}
 
-                // Retrieve the status associated with the thread ID
-                char status_key[256];
-                snprintf(status_key, sizeof(status_key), "%s%s_status", board, thread_id);
-                redisReply *status_reply = redisCommand(redis_context, "GET %s", status_key);
+// Add a thread using the scraper script, or the built-in importer when native_ingest is set
+void add_thread_from_scraper(const char *board, const char *thread_id) {
+    submit_add_thread(board, thread_id, on_mutation_job_done, NULL);  // Shows the new thread in the list when it finishes
+}
 
-                const char *status = (status_reply && status_reply->type == REDIS_REPLY_STRING) ? status_reply->str : "Unknown";
+// --- Archive ---------------------------------------------------------------------------------
 
-                // Apply filter if provided
-                if (filter == NULL || strstr(title_reply->str, filter) != NULL || strstr(thread_id, filter) != NULL) {
-                    GtkTreeIter iter;
-                    gtk_list_store_append(store, &iter);
-                    gtk_list_store_set(store, &iter,
-                                       0, thread_id,
-                                       1, title_reply->str,
-                                       2, count,
-                                       3, status,  // Set the status in the new column
-                                       -1);
-                }
+// Reopen the archive so records appended since the last open become visible
+static Archive *reopen_archive(BoardTab *tab) {
+    char path[512];
+    format_archive_path(path, sizeof(path), archive_dir, tab->board);
+    archive_close(tab->archive);
+    tab->archive = archive_open(path);
+    return tab->archive;
+}
 
-                if (count_reply) freeReplyObject(count_reply);
-                if (status_reply) freeReplyObject(status_reply);
-            }
+// Fill a board's list from its archive file; works without a Redis connection
+static void show_archived_threads_in(BoardTab *tab) {
+    redis_async_cancel_listing(tab->listing);
+    tab->listing = NULL;
+    redis_async_cancel_index_page(tab->index_page);
+    tab->index_page = NULL;
+    tab->index_total = -1;
+    tab->showing_archive = TRUE;
+    thread_cache_clear(tab->cache);
+
+    Archive *archive = reopen_archive(tab);
+    size_t n = archive_thread_count(archive);
+    for (size_t i = 0; i < n; i++) {
+        ArchiveThread thread;
+        char id[THREAD_ID_MAX];
+        archive_thread_at(archive, i, &thread);
+        g_snprintf(id, sizeof(id), "%" G_GUINT64_FORMAT, thread.id);
+        if (thread_cache_add(tab->cache, id, thread.title, (int)thread.post_count, thread.status) == NULL) break;
+    }
+    thread_cache_set_valid(tab->cache, 1);  // Stays invalid if an add failed
+    show_cached_threads(tab);
+    set_tab_label(tab);
+    combined_list_changed();
+
+    char line[640];
+    if (archive) {
+        g_snprintf(line, sizeof(line), "Showing %zu archived threads of /%s/ from %s\n", n, tab->board, archive_dir);
+    } else {
+        g_snprintf(line, sizeof(line), "No archive of /%s/ in %s\n", tab->board, archive_dir);
+    }
+    append_output(line);
+}
 
-            freeReplyObject(title_reply);
-        }
+// Show the archive of the current board, or of every board from the combined tab
+void show_archived_threads() {
+    for (int i = 0; i < board_tab_count; i++) {
+        if (current_tab == combined_tab || current_tab == board_tabs[i]) show_archived_threads_in(board_tabs[i]);
     }
+}
 
-    freeReplyObject(reply);
+// Tab of the selected row: the board's own tab, or in the combined tab the row's board
+static BoardTab *selected_tab() {
+    if (current_tab != combined_tab) return current_tab;
+
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(combined_tab->tree_view));
+    if (!gtk_tree_selection_get_selected(selection, &model, &iter)) return NULL;
+    return combined_tab->owners[thread_list_model_get_record_index(THREAD_LIST_MODEL(model), &iter)];
 }
 
+// Board of the selected row, falling back to the last board tab shown
+static const char *selected_board() {
+    BoardTab *tab = selected_tab();
+    return tab ? tab->board : board;
+}
 
+// Posts of a thread of the selected row's board: paged in from Redis, or read from the
+// archive when the tab shows the archive
+void show_thread_details(const char *thread_id) {
+    BoardTab *tab = selected_tab();
+    if (tab == NULL) return;
 
+    char title[512] = "";
+    get_selected_thread_id_and_title(title, sizeof(title));
+    thread_viewer_open(tab->showing_archive ? NULL : tab->connection, tab->board, thread_id, title);
+}
 
-// Add a thread using the scraper script
-void add_thread_from_scraper(const char *board, const char *thread_id) {
-    char command[512];
-    snprintf(command, sizeof(command), "/usr/bin/docker exec 4chan_scraper-scraper-1 python FourChanScraper.py scrape_thread %s %s", board, thread_id);
+static void on_thread_row_activated(GtkTreeView *tree_view, GtkTreePath *path, GtkTreeViewColumn *column, gpointer data) {
+    const char *thread_id = get_selected_thread_id();
+    if (thread_id) show_thread_details(thread_id);
+}
 
-    FILE *fp = popen(command, "r");
-    if (fp == NULL) {
-        fprintf(stderr, "Failed to execute scraper command\n");
-        return;
+void move_selected_thread_to_archive() {
+    const char *thread_id = get_selected_thread_id();
+    BoardTab *tab = selected_tab();
+    if (thread_id == NULL || tab == NULL || tab->showing_archive) return;
+
+    submit_archive_move(tab->board, thread_id, &thread_id, 1, on_mutation_job_done, NULL);
+}
+
+// Move every thread of a board's list that the scraper marked archived or dead out of Redis
+static void archive_dead_threads_in(BoardTab *tab) {
+    if (tab->showing_archive) return;
+
+    ThreadSnapshot *snapshot = thread_cache_snapshot(tab->cache);
+    GPtrArray *ids = g_ptr_array_new_with_free_func(g_free);
+    for (size_t i = 0; i < snapshot->count; i++) {
+        const ThreadSnapshotRecord *record = &snapshot->records[i];
+        const char *status = thread_snapshot_status(snapshot, record);
+        if (record->flags & THREAD_RECORD_DELETED) continue;
+        if (g_ascii_strcasecmp(status, "archived") != 0 && g_ascii_strcasecmp(status, "dead") != 0) continue;
+        char *id = g_strdup_printf("%" G_GUINT64_FORMAT, (guint64)record->id);
+        g_ptr_array_add(ids, id);
     }
 
-    // Capture command output and append to text view
-    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(output_text_view));
-    char output[1024];
-    while (fgets(output, sizeof(output), fp) != NULL) {
-        GtkTextIter end;
-        gtk_text_buffer_get_end_iter(buffer, &end);
-        gtk_text_buffer_insert(buffer, &end, output, -1);
+    if (ids->len == 0) {
+        char line[300];
+        g_snprintf(line, sizeof(line), "No archived or dead threads of /%s/ to move\n", tab->board);
+        append_output(line);
+    } else {
+        submit_archive_move(tab->board, NULL, (const char *const *)ids->pdata, ids->len, on_mutation_job_done, NULL);
     }
-    pclose(fp);
+    g_ptr_array_free(ids, TRUE);
+}
 
-     load_thread_titles(NULL);  // Refresh the list to include the new thread
-    
+// For the current board, or every board from the combined tab
+void archive_dead_threads() {
+    for (int i = 0; i < board_tab_count; i++) {
+        if (current_tab == combined_tab || current_tab == board_tabs[i]) archive_dead_threads_in(board_tabs[i]);
+    }
 }
 
 // Open dialog to add a new thread
@@ -233,10 +758,16 @@ void open_settings_dialog() {
     host_entry = gtk_entry_new();
     port_entry = gtk_entry_new();
     board_entry = gtk_entry_new();
+    boards_entry = gtk_entry_new();
+    endpoints_entry = gtk_entry_new();
+    replicas_check = gtk_check_button_new_with_label("Read thread lists from replicas");
 
     gtk_entry_set_text(GTK_ENTRY(host_entry), redis_host);
     gtk_entry_set_text(GTK_ENTRY(port_entry), g_strdup_printf("%d", redis_port));
     gtk_entry_set_text(GTK_ENTRY(board_entry), board);
+    gtk_entry_set_text(GTK_ENTRY(boards_entry), boards);
+    gtk_entry_set_text(GTK_ENTRY(endpoints_entry), redis_endpoints);
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(replicas_check), read_from_replicas != 0);
 
     GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(dialog));
     gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Redis Host:"), FALSE, FALSE, 5);
@@ -251,6 +782,11 @@ void open_settings_dialog() {
     gtk_box_pack_start(GTK_BOX(content_area), port_entry, FALSE, FALSE, 5);
     gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Board:"), FALSE, FALSE, 5);
     gtk_box_pack_start(GTK_BOX(content_area), board_entry, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("Boards (comma-separated):"), FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(content_area), boards_entry, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(content_area), gtk_label_new("More endpoints (host:port, comma-separated):"), FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(content_area), endpoints_entry, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(content_area), replicas_check, FALSE, FALSE, 5);
 
     gtk_widget_show_all(dialog);
 
@@ -261,55 +797,674 @@ void open_settings_dialog() {
     gtk_widget_destroy(dialog);
 }
 
-// Create a TreeView with a single column for thread titles
-// Initialize the TreeView and Context Menu
-// Create a TreeView with columns for Thread ID, Title, and Count
-void create_thread_list_tree_view(GtkWidget *parent_box) {
-    thread_tree_view = gtk_tree_view_new();
-    GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+#define OUTPUT_RING_LINES 4096          // Lines queued between two drains before new ones are dropped
+#define OUTPUT_FRAME_MS 16              // Drain at most once per frame
+#define OUTPUT_DRAIN_BYTES (256 * 1024) // Upper bound on text inserted per frame
+
+static int output_drain_scheduled = 0;  // Set by whichever producer schedules the next drain
+static char *output_drain_buffer = NULL;
+
+// Drop the oldest lines beyond output_scrollback_lines
+static void trim_output_scrollback(GtkTextBuffer *buffer) {
+    gint excess = gtk_text_buffer_get_line_count(buffer) - output_scrollback_lines;
+    if (excess <= 0) return;
+
+    GtkTextIter start, cut;
+    gtk_text_buffer_get_start_iter(buffer, &start);
+    gtk_text_buffer_get_iter_at_line(buffer, &cut, excess);
+    gtk_text_buffer_delete(buffer, &start, &cut);
+}
+
+// Move everything queued since the last frame into the output view with a single insert
+static gboolean drain_output(gpointer data) {
+    uint64_t started = metrics_begin();
+    // Clear the flag before reading so a line queued during the drain schedules the next one
+    __atomic_exchange_n(&output_drain_scheduled, 0, __ATOMIC_SEQ_CST);
+
+    size_t used = log_ring_drain(output_drain_buffer, OUTPUT_DRAIN_BYTES);
+    if (used > 0) {
+        GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(output_text_view));
+        GtkTextIter end;
+        gtk_text_buffer_get_end_iter(buffer, &end);
+        gtk_text_buffer_insert(buffer, &end, output_drain_buffer, used);
+        trim_output_scrollback(buffer);
+    }
+    metrics_end(METRIC_OUTPUT_DRAIN, started);
+
+    // More than one frame's worth queued: keep this timer for the next frame
+    if (!log_ring_is_empty() && !__atomic_exchange_n(&output_drain_scheduled, 1, __ATOMIC_SEQ_CST)) {
+        return G_SOURCE_CONTINUE;
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// Queue output from any thread, one ring entry per line; never blocks on the UI
+void append_output(const char *text) {
+    while (*text) {
+        const char *newline = strchr(text, '\n');
+        size_t len = newline ? (size_t)(newline - text) + 1 : strlen(text);
+        log_ring_write(text, len);
+        text += len;
+    }
+
+    if (!__atomic_exchange_n(&output_drain_scheduled, 1, __ATOMIC_SEQ_CST)) {
+        g_timeout_add(OUTPUT_FRAME_MS, drain_output, NULL);
+    }
+}
+
+// Once a second: output rate and lines lost to a full ring
+static gboolean update_output_stats(gpointer data) {
+    static uint64_t last_written = 0;
+    static gint64 last_time = 0;
+
+    LogRingStats stats;
+    log_ring_stats(&stats);
+    gint64 now = g_get_monotonic_time();
+
+    if (last_time != 0) {
+        double rate = (stats.written - last_written) * (double)G_USEC_PER_SEC / (now - last_time);
+        char text[128];
+        g_snprintf(text, sizeof(text), "%.0f lines/s, %" G_GUINT64_FORMAT " dropped", rate, stats.dropped);
+        gtk_label_set_text(GTK_LABEL(output_stats_label), text);
+    }
+    last_written = stats.written;
+    last_time = now;
+    return G_SOURCE_CONTINUE;
+}
+
+enum { JOB_COLUMN_ID, JOB_COLUMN_NAME, JOB_COLUMN_TARGET, JOB_COLUMN_STATE, JOB_COLUMN_DURATION, JOB_N_COLUMNS };
+
+#define JOBS_PANEL_MAX 2048  // Jobs listed in the panel; the queue itself is unbounded
+
+static int jobs_refresh_scheduled = 0;  // Set while a panel refresh is pending
+static JobInfo *jobs_snapshot = NULL;
+
+// Time spent waiting for queued jobs, running so far for running ones, run time once finished
+static void format_job_duration(const JobInfo *job, int64_t now, char *out, size_t size) {
+    if (job->state == JOB_QUEUED) {
+        g_snprintf(out, size, "%.1f s waiting", (now - job->queued_at_ms) / 1000.0);
+    } else if (job->started_at_ms == 0) {
+        g_snprintf(out, size, "-");  // Cancelled before it started
+    } else {
+        int64_t end = job->state == JOB_RUNNING ? now : job->finished_at_ms;
+        g_snprintf(out, size, "%.1f s", (end - job->started_at_ms) / 1000.0);
+    }
+}
+
+// Bring the panel in line with the queue, updating rows in place so the selection survives
+static gboolean refresh_jobs_panel(gpointer data) {
+    __atomic_exchange_n(&jobs_refresh_scheduled, 0, __ATOMIC_SEQ_CST);
+
+    size_t n = job_queue_list(jobs_snapshot, JOBS_PANEL_MAX);
+    int64_t now = job_now_ms();
+    GtkListStore *store = GTK_LIST_STORE(gtk_tree_view_get_model(GTK_TREE_VIEW(jobs_tree_view)));
+    GtkTreeIter iter;
+
+    // Rows and jobs are both in submission order: walk them together, dropping rows of forgotten jobs
+    gboolean valid = gtk_tree_model_get_iter_first(GTK_TREE_MODEL(store), &iter);
+    size_t i = 0;
+    while (i < n || valid) {
+        if (valid) {
+            guint row_id;
+            gtk_tree_model_get(GTK_TREE_MODEL(store), &iter, JOB_COLUMN_ID, &row_id, -1);
+            if (i == n || row_id != jobs_snapshot[i].id) {
+                valid = gtk_list_store_remove(store, &iter);
+                continue;
+            }
+        }
+
+        const JobInfo *job = &jobs_snapshot[i++];
+        char target[JOB_BOARD_MAX + JOB_THREAD_MAX + 2], duration[64];
+        g_snprintf(target, sizeof(target), "%s%s%s", job->board, job->thread_id[0] ? "/" : "", job->thread_id);
+        format_job_duration(job, now, duration, sizeof(duration));
+
+        gboolean appended = !valid;
+        if (appended) gtk_list_store_append(store, &iter);
+        gtk_list_store_set(store, &iter,
+                           JOB_COLUMN_ID, job->id,
+                           JOB_COLUMN_NAME, job->name,
+                           JOB_COLUMN_TARGET, target,
+                           JOB_COLUMN_STATE, job_state_name(job->state),
+                           JOB_COLUMN_DURATION, duration,
+                           -1);
+        valid = appended ? FALSE : gtk_tree_model_iter_next(GTK_TREE_MODEL(store), &iter);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// Runs on a job worker: coalesce state changes into one panel refresh on the main loop
+static void on_jobs_changed(void *user_data) {
+    if (!__atomic_exchange_n(&jobs_refresh_scheduled, 1, __ATOMIC_SEQ_CST)) {
+        g_idle_add(refresh_jobs_panel, NULL);
+    }
+}
 
-    // Model with four columns: Thread_ID, Title, Count, and Status
-    GtkListStore *store = gtk_list_store_new(4, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT, G_TYPE_STRING);
-    gtk_tree_view_set_model(GTK_TREE_VIEW(thread_tree_view), GTK_TREE_MODEL(store));
+// Keep the durations of waiting and running jobs ticking
+static gboolean tick_jobs_panel(gpointer data) {
+    refresh_jobs_panel(NULL);
+    return G_SOURCE_CONTINUE;
+}
+
+static void cancel_selected_job(GtkWidget *widget, gpointer data) {
+    GtkTreeSelection *selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(jobs_tree_view));
+    GtkTreeModel *model;
+    GtkTreeIter iter;
+
+    if (gtk_tree_selection_get_selected(selection, &model, &iter)) {
+        guint job_id;
+        gtk_tree_model_get(model, &iter, JOB_COLUMN_ID, &job_id, -1);
+        job_queue_cancel(job_id);
+    }
+}
+
+static void clear_finished_jobs(GtkWidget *widget, gpointer data) {
+    job_queue_clear_finished();
+}
+
+// Collapsible list of scraper jobs with their state and duration
+void create_jobs_panel(GtkWidget *parent_box) {
+    jobs_snapshot = g_new(JobInfo, JOBS_PANEL_MAX);
+
+    GtkListStore *store = gtk_list_store_new(JOB_N_COLUMNS, G_TYPE_UINT, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+    jobs_tree_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
     g_object_unref(store);
 
+    const char *titles[] = { "#", "Job", "Target", "State", "Duration" };
+    for (int column = 0; column < JOB_N_COLUMNS; column++) {
+        GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+        gtk_tree_view_append_column(GTK_TREE_VIEW(jobs_tree_view),
+                                    gtk_tree_view_column_new_with_attributes(titles[column], renderer, "text", column, NULL));
+    }
+
+    GtkWidget *scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_widget_set_size_request(scrolled_window, -1, 120);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), jobs_tree_view);
+
+    GtkWidget *cancel_button = gtk_button_new_with_label("Cancel Job");
+    g_signal_connect(cancel_button, "clicked", G_CALLBACK(cancel_selected_job), NULL);
+    GtkWidget *clear_button = gtk_button_new_with_label("Clear Finished");
+    g_signal_connect(clear_button, "clicked", G_CALLBACK(clear_finished_jobs), NULL);
+
+    GtkWidget *button_row = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
+    gtk_box_pack_start(GTK_BOX(button_row), cancel_button, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(button_row), clear_button, FALSE, FALSE, 5);
+
+    GtkWidget *panel_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_box_pack_start(GTK_BOX(panel_box), scrolled_window, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(panel_box), button_row, FALSE, FALSE, 0);
+
+    GtkWidget *expander = gtk_expander_new("Jobs");
+    gtk_container_add(GTK_CONTAINER(expander), panel_box);
+    gtk_box_pack_start(GTK_BOX(parent_box), expander, FALSE, FALSE, 5);
+
+    g_timeout_add_seconds(1, tick_jobs_panel, NULL);
+}
+
+// --- Stats dialog ----------------------------------------------------------------------------
+
+enum { STATS_LABEL, STATS_COUNT, STATS_P50, STATS_P90, STATS_P99, STATS_P999, STATS_MAX, STATS_MEAN, STATS_N_COLUMNS };
+
+static GtkWidget *stats_dialog = NULL;
+static GtkListStore *stats_store = NULL;
+static GtkWidget *stats_media_label = NULL;
+static GtkWidget *stats_compression_label = NULL;
+static guint stats_refresh_id = 0;
+
+static void format_ms(char *out, size_t size, double ms, uint64_t count) {
+    if (count == 0) g_strlcpy(out, "-", size);
+    else if (ms < 1) snprintf(out, size, "%.0f µs", ms * 1000);
+    else snprintf(out, size, "%.1f ms", ms);
+}
+
+// Once a second while the dialog is open
+static gboolean refresh_stats_dialog(gpointer data) {
+    GtkTreeIter iter;
+    gboolean valid = gtk_tree_model_get_iter_first(GTK_TREE_MODEL(stats_store), &iter);
+    for (int id = 0; id < METRIC_COUNT; id++) {
+        MetricSummary summary;
+        metrics_summarize(id, &summary);
+        if (!valid) gtk_list_store_append(stats_store, &iter);
+
+        char count[32], p50[32], p90[32], p99[32], p999[32], max[32], mean[32];
+        snprintf(count, sizeof(count), "%llu", (unsigned long long)summary.count);
+        format_ms(p50, sizeof(p50), summary.p50_ms, summary.count);
+        format_ms(p90, sizeof(p90), summary.p90_ms, summary.count);
+        format_ms(p99, sizeof(p99), summary.p99_ms, summary.count);
+        format_ms(p999, sizeof(p999), summary.p999_ms, summary.count);
+        format_ms(max, sizeof(max), summary.max_ms, summary.count);
+        format_ms(mean, sizeof(mean), summary.count ? summary.sum_ms / summary.count : 0, summary.count);
+        gtk_list_store_set(stats_store, &iter, STATS_LABEL, summary.label, STATS_COUNT, count, STATS_P50, p50, STATS_P90, p90,
+                           STATS_P99, p99, STATS_P999, p999, STATS_MAX, max, STATS_MEAN, mean, -1);
+        valid = valid && gtk_tree_model_iter_next(GTK_TREE_MODEL(stats_store), &iter);
+    }
+
+    ThumbnailCacheStats thumbnails;
+    MediaStoreStats media;
+    thumbnail_cache_stats(&thumbnails);
+    media_store_stats(&media);
+    char text[256];
+    g_snprintf(text, sizeof(text),
+               "Thumbnails: %u in memory (%.1f MB), %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses, %" G_GUINT64_FORMAT " coalesced; "
+               "disk %.1f MB, %llu disk hits, %llu downloads, %llu failed",
+               thumbnails.cached, thumbnails.cached_bytes / 1048576.0, thumbnails.memory_hits, thumbnails.misses, thumbnails.coalesced,
+               media.disk_bytes / 1048576.0, (unsigned long long)media.disk_hits, (unsigned long long)media.downloads,
+               (unsigned long long)media.failures);
+    gtk_label_set_text(GTK_LABEL(stats_media_label), text);
+
+    PostCodecStats codecs[BOARD_TABS_MAX];
+    size_t codec_count = post_codec_stats(codecs, BOARD_TABS_MAX);
+    GString *compression = g_string_new(NULL);
+    for (size_t i = 0; i < codec_count; i++) {
+        char line[320];
+        post_codec_format_stats(&codecs[i], line, sizeof(line));
+        g_string_append_printf(compression, "%sPosts %s", compression->len ? "\n" : "", line);
+    }
+    gtk_label_set_text(GTK_LABEL(stats_compression_label), compression->len ? compression->str : "Posts: none compressed or decompressed");
+    g_string_free(compression, TRUE);
+    return G_SOURCE_CONTINUE;
+}
+
+static void on_record_timings_toggled(GtkToggleButton *button, gpointer data) {
+    __atomic_store_n(&metrics_enabled, gtk_toggle_button_get_active(button) ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+static void on_stats_response(GtkDialog *dialog, gint response, gpointer data) {
+    if (response == GTK_RESPONSE_REJECT) {
+        metrics_reset();
+        refresh_stats_dialog(NULL);
+        return;
+    }
+    gtk_widget_destroy(GTK_WIDGET(dialog));
+}
+
+static void on_stats_destroyed(GtkWidget *widget, gpointer data) {
+    g_source_remove(stats_refresh_id);
+    stats_refresh_id = 0;
+    stats_dialog = NULL;
+    stats_store = NULL;
+    stats_media_label = NULL;
+    stats_compression_label = NULL;
+}
+
+// Latency percentiles per operation, so a slow refresh can be traced to Redis, the scraper or the list
+void open_stats_dialog() {
+    if (stats_dialog) {
+        gtk_window_present(GTK_WINDOW(stats_dialog));
+        return;
+    }
+
+    stats_dialog = gtk_dialog_new_with_buttons("Stats", NULL, 0, "_Reset", GTK_RESPONSE_REJECT, "_Close", GTK_RESPONSE_CLOSE, NULL);
+    gtk_window_set_default_size(GTK_WINDOW(stats_dialog), 720, 320);
+    GtkWidget *content_area = gtk_dialog_get_content_area(GTK_DIALOG(stats_dialog));
+
+    stats_store = gtk_list_store_new(STATS_N_COLUMNS, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING,
+                                     G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
+    GtkWidget *tree_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(stats_store));
+    g_object_unref(stats_store);  // Owned by the view from here on
+
+    const char *titles[] = { "Operation", "Count", "p50", "p90", "p99", "p99.9", "Max", "Mean" };
+    for (int column = 0; column < STATS_N_COLUMNS; column++) {
+        GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+        if (column > STATS_LABEL) g_object_set(renderer, "xalign", 1.0, NULL);
+        gtk_tree_view_append_column(GTK_TREE_VIEW(tree_view),
+                                    gtk_tree_view_column_new_with_attributes(titles[column], renderer, "text", column, NULL));
+    }
+
+    GtkWidget *record_check = gtk_check_button_new_with_label("Record timings");
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(record_check), metrics_enabled != 0);
+    g_signal_connect(record_check, "toggled", G_CALLBACK(on_record_timings_toggled), NULL);
+
+    stats_media_label = gtk_label_new(NULL);
+    gtk_widget_set_halign(stats_media_label, GTK_ALIGN_START);
+    stats_compression_label = gtk_label_new(NULL);
+    gtk_widget_set_halign(stats_compression_label, GTK_ALIGN_START);
+
+    gtk_box_pack_start(GTK_BOX(content_area), tree_view, TRUE, TRUE, 5);
+    gtk_box_pack_start(GTK_BOX(content_area), stats_media_label, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(content_area), stats_compression_label, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(content_area), record_check, FALSE, FALSE, 5);
+    g_signal_connect(stats_dialog, "response", G_CALLBACK(on_stats_response), NULL);
+    g_signal_connect(stats_dialog, "destroy", G_CALLBACK(on_stats_destroyed), NULL);
+
+    refresh_stats_dialog(NULL);
+    stats_refresh_id = g_timeout_add_seconds(1, refresh_stats_dialog, NULL);
+    gtk_widget_show_all(stats_dialog);
+}
+
+// Create a tab's TreeView with columns for Thread ID, Title, Count and Status, and its context menu
+static GtkWidget *create_thread_list_tree_view(BoardTab *tab) {
+    GtkWidget *thread_tree_view = gtk_tree_view_new();
+    GtkCellRenderer *renderer = gtk_cell_renderer_text_new();
+    tab->tree_view = thread_tree_view;
+
+    // Virtual model with four columns: Thread_ID, Title, Count, and Status, read from the tab's cache
+    tab->model = thread_list_model_new();
+    thread_list_model_set_filter_func(tab->model, match_thread_filter, tab);
+    thread_list_model_set_rank_func(tab->model, rank_thread, tab);
+    thread_list_model_refilter(tab->model, tab_snapshot(tab));
+    gtk_tree_view_set_model(GTK_TREE_VIEW(thread_tree_view), GTK_TREE_MODEL(tab->model));
+    g_object_unref(tab->model);  // The view holds the only reference
+
     // Create Thread ID column
-    GtkTreeViewColumn *id_column = gtk_tree_view_column_new_with_attributes("Thread ID", renderer, "text", 0, NULL);
-    gtk_tree_view_column_set_sort_column_id(id_column, 0); // Enable sorting by Thread ID
+    GtkTreeViewColumn *id_column = gtk_tree_view_column_new_with_attributes("Thread ID", renderer, "text", THREAD_LIST_COLUMN_ID, NULL);
+    gtk_tree_view_column_set_sort_column_id(id_column, THREAD_LIST_COLUMN_ID); // Enable sorting by Thread ID
+    gtk_tree_view_column_set_sizing(id_column, GTK_TREE_VIEW_COLUMN_FIXED);
+    gtk_tree_view_column_set_fixed_width(id_column, 110);
+    gtk_tree_view_column_set_resizable(id_column, TRUE);
     gtk_tree_view_append_column(GTK_TREE_VIEW(thread_tree_view), id_column);
 
     // Create Title column
-    GtkTreeViewColumn *title_column = gtk_tree_view_column_new_with_attributes("Title", renderer, "text", 1, NULL);
-    gtk_tree_view_column_set_sort_column_id(title_column, 1); // Enable sorting by Title
+    GtkTreeViewColumn *title_column = gtk_tree_view_column_new_with_attributes("Title", renderer, "text", THREAD_LIST_COLUMN_TITLE, NULL);
+    gtk_tree_view_column_set_sort_column_id(title_column, THREAD_LIST_COLUMN_TITLE); // Enable sorting by Title
+    gtk_tree_view_column_set_sizing(title_column, GTK_TREE_VIEW_COLUMN_FIXED);
+    gtk_tree_view_column_set_fixed_width(title_column, 400);
+    gtk_tree_view_column_set_resizable(title_column, TRUE);
+    gtk_tree_view_column_set_expand(title_column, TRUE);
     gtk_tree_view_append_column(GTK_TREE_VIEW(thread_tree_view), title_column);
 
     // Create Count column
-    GtkTreeViewColumn *count_column = gtk_tree_view_column_new_with_attributes("Count", renderer, "text", 2, NULL);
-    gtk_tree_view_column_set_sort_column_id(count_column, 2); // Enable sorting by Count
+    GtkTreeViewColumn *count_column = gtk_tree_view_column_new_with_attributes("Count", renderer, "text", THREAD_LIST_COLUMN_COUNT, NULL);
+    gtk_tree_view_column_set_sort_column_id(count_column, THREAD_LIST_COLUMN_COUNT); // Enable sorting by Count
+    gtk_tree_view_column_set_sizing(count_column, GTK_TREE_VIEW_COLUMN_FIXED);
+    gtk_tree_view_column_set_fixed_width(count_column, 70);
+    gtk_tree_view_column_set_resizable(count_column, TRUE);
     gtk_tree_view_append_column(GTK_TREE_VIEW(thread_tree_view), count_column);
 
     // Create Status column
-    GtkTreeViewColumn *status_column = gtk_tree_view_column_new_with_attributes("Status", renderer, "text", 3, NULL);
-    gtk_tree_view_column_set_sort_column_id(status_column, 3); // Enable sorting by Status
+    GtkTreeViewColumn *status_column = gtk_tree_view_column_new_with_attributes("Status", renderer, "text", THREAD_LIST_COLUMN_STATUS, NULL);
+    gtk_tree_view_column_set_sort_column_id(status_column, THREAD_LIST_COLUMN_STATUS); // Enable sorting by Status
+    gtk_tree_view_column_set_sizing(status_column, GTK_TREE_VIEW_COLUMN_FIXED);
+    gtk_tree_view_column_set_fixed_width(status_column, 90);
+    gtk_tree_view_column_set_resizable(status_column, TRUE);
     gtk_tree_view_append_column(GTK_TREE_VIEW(thread_tree_view), status_column);
 
+    // Fixed-height rows let the view lay out only what is on screen, however long the list
+    gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(thread_tree_view), TRUE);
+
     // Enable right-click event for context menu
     g_signal_connect(thread_tree_view, "button-press-event", G_CALLBACK(show_context_menu), NULL);
+    g_signal_connect(thread_tree_view, "row-activated", G_CALLBACK(on_thread_row_activated), NULL);
 
     // Add the TreeView to a scrollable container
     GtkWidget *scrolled_window = gtk_scrolled_window_new(NULL, NULL);
     gtk_container_add(GTK_CONTAINER(scrolled_window), thread_tree_view);
-    gtk_box_pack_start(GTK_BOX(parent_box), scrolled_window, TRUE, TRUE, 5);
+    if (tab->cache) {
+        g_signal_connect(tab->model, "sort-column-changed", G_CALLBACK(on_tab_sort_changed), tab);
+        g_signal_connect(gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(scrolled_window)), "value-changed",
+                         G_CALLBACK(on_tab_scrolled), tab);
+    }
+    return scrolled_window;
+}
+
+static BoardTab *add_board_tab(const char *tab_board) {
+    BoardTab *tab = g_new0(BoardTab, 1);
+    tab->index_total = -1;
+    if (tab_board) {
+        g_strlcpy(tab->board, tab_board, sizeof(tab->board));
+        tab->cache = thread_cache_new();
+    } else {
+        tab->combined = thread_snapshot_new(0);
+    }
+
+    GtkWidget *page = create_thread_list_tree_view(tab);
+    tab->label = gtk_label_new(tab_board ? "" : "All boards");
+    if (tab_board) set_tab_label(tab);
+    g_object_set_data(G_OBJECT(page), "board-tab", tab);
+    gtk_notebook_append_page(GTK_NOTEBOOK(board_notebook), page, tab->label);
+    gtk_widget_show_all(page);
+    return tab;
+}
+
+static void free_board_tab(BoardTab *tab) {
+    redis_async_cancel_listing(tab->listing);
+    redis_async_cancel_index_page(tab->index_page);
+    thread_viewer_detach(tab->connection);
+    redis_async_free(tab->connection);
+    if (tab->model_sync_id) g_source_remove(tab->model_sync_id);
+    if (tab->pending_flush_id) g_source_remove(tab->pending_flush_id);
+    if (tab->pending_updates) g_hash_table_destroy(tab->pending_updates);
+    if (tab->search_hit_index) g_hash_table_destroy(tab->search_hit_index);
+    g_free(tab->search_hits);
+    title_index_free(tab->title_index);
+    g_free(tab->title_scores);
+    archive_close(tab->archive);
+    thread_cache_free(tab->cache);
+    thread_snapshot_unref(tab->combined);
+    g_free(tab->owners);
+    g_free(tab);
+}
+
+static void apply_search_to_tab(BoardTab *tab);
+
+// Switching only swaps the view on screen; the list is re-filtered if the search changed meanwhile
+static void on_board_tab_switched(GtkNotebook *notebook, GtkWidget *page, guint page_num, gpointer data) {
+    BoardTab *tab = g_object_get_data(G_OBJECT(page), "board-tab");
+    if (tab == NULL) return;
+    current_tab = tab;
+    thread_tree_view = tab->tree_view;
+    if (tab != combined_tab) g_strlcpy(board, tab->board, sizeof(board));
+    if (tab->filter_stale) apply_search_to_tab(tab);
+}
+
+// One tab per board in the boards setting, plus the board setting itself, each with its own
+// connection. They are shown from the archive until their connection comes up.
+void open_board_tabs() {
+    close_board_tabs();
+
+    char initial[256];  // Adding the first tab selects it, which replaces board
+    g_strlcpy(initial, board, sizeof(initial));
+    char **names = g_strsplit(boards[0] ? boards : initial, ",", -1);
+    const char *listened[BOARD_TABS_MAX];
+    BoardTab *selected = NULL;
+    for (int i = 0; names[i] && board_tab_count < BOARD_TABS_MAX; i++) {
+        char *name = g_strstrip(names[i]);
+        gboolean duplicate = FALSE;
+        for (int t = 0; t < board_tab_count; t++) duplicate |= strcmp(board_tabs[t]->board, name) == 0;
+        if (*name == '\0' || duplicate) continue;
+
+        BoardTab *tab = add_board_tab(name);
+        listened[board_tab_count] = tab->board;
+        board_tabs[board_tab_count++] = tab;
+        if (strcmp(name, initial) == 0) selected = tab;
+    }
+    g_strfreev(names);
+    if (selected == NULL && board_tab_count < BOARD_TABS_MAX) {
+        selected = add_board_tab(initial);
+        listened[board_tab_count] = selected->board;
+        board_tabs[board_tab_count++] = selected;
+    }
+    if (board_tab_count > 1) combined_tab = add_board_tab(NULL);
+
+    int page = selected ? gtk_notebook_page_num(GTK_NOTEBOOK(board_notebook), gtk_widget_get_parent(selected->tree_view)) : 0;
+    gtk_notebook_set_current_page(GTK_NOTEBOOK(board_notebook), page);
+    on_board_tab_switched(GTK_NOTEBOOK(board_notebook), gtk_notebook_get_nth_page(GTK_NOTEBOOK(board_notebook), page), page, NULL);
+
+    char endpoints[600];
+    format_redis_endpoints(endpoints, sizeof(endpoints));
+    for (int i = 0; i < board_tab_count; i++) {
+        show_archived_threads_in(board_tabs[i]);  // Replaced by the Redis listing once connected
+        board_tabs[i]->connection = redis_async_new(endpoints, connect_timeout_ms, read_from_replicas, on_redis_connected, board_tabs[i]);
+    }
+    keyspace_listener_start(endpoints, listened, board_tab_count, on_keyspace_event, NULL);
+}
+
+// Drop every tab with its connection and cache, e.g. before switching servers
+void close_board_tabs() {
+    keyspace_listener_stop();
+    if (combined_rebuild_id) g_source_remove(combined_rebuild_id);
+    combined_rebuild_id = 0;
+
+    current_tab = NULL;
+    thread_tree_view = NULL;
+    g_signal_handlers_block_by_func(board_notebook, on_board_tab_switched, NULL);
+    while (gtk_notebook_get_n_pages(GTK_NOTEBOOK(board_notebook)) > 0) {
+        gtk_notebook_remove_page(GTK_NOTEBOOK(board_notebook), -1);
+    }
+    g_signal_handlers_unblock_by_func(board_notebook, on_board_tab_switched, NULL);
+    for (int i = 0; i < board_tab_count; i++) free_board_tab(board_tabs[i]);
+    if (combined_tab) free_board_tab(combined_tab);
+    board_tab_count = 0;
+    combined_tab = NULL;
+}
+
+void create_board_notebook(GtkWidget *parent_box) {
+    board_notebook = gtk_notebook_new();
+    gtk_notebook_set_scrollable(GTK_NOTEBOOK(board_notebook), TRUE);
+    g_signal_connect(board_notebook, "switch-page", G_CALLBACK(on_board_tab_switched), NULL);
+    gtk_box_pack_start(GTK_BOX(parent_box), board_notebook, TRUE, TRUE, 5);
 }
 
 
 
-// Refresh the thread list based on the search filter
+// Refresh the thread cache from Redis and show it with the current search filter
 void refresh_thread_list_callback() {
     const char *filter_text = gtk_entry_get_text(GTK_ENTRY(search_entry));
     load_thread_titles(filter_text);
 }
 
+// --- Post search -------------------------------------------------------------------------------
+
+#define SEARCH_MAX_HITS 5000
+
+static void clear_post_search(BoardTab *tab) {
+    if (tab->search_hit_index) g_hash_table_destroy(tab->search_hit_index);
+    tab->search_hit_index = NULL;
+    g_free(tab->search_hits);
+    tab->search_hits = NULL;
+}
+
+// Run the search text against a board's post index and keep the ranked threads for its list
+static void run_post_search(BoardTab *tab, const char *query) {
+    clear_post_search(tab);
+    FtsIndex *index = board_search_index(tab->board);
+    if (index == NULL || *query == '\0') return;
+
+    gint64 started = g_get_monotonic_time();
+    size_t total;
+    tab->search_hits = g_new(FtsHit, SEARCH_MAX_HITS);
+    size_t n = fts_index_search(index, query, tab->search_hits, SEARCH_MAX_HITS, &total);
+    tab->search_hit_index = g_hash_table_new(g_int64_hash, g_int64_equal);
+    for (size_t i = 0; i < n; i++) g_hash_table_insert(tab->search_hit_index, &tab->search_hits[i].thread_id, &tab->search_hits[i]);
+
+    char line[512];
+    g_snprintf(line, sizeof(line), "%zu threads of /%s/ with matching posts%s (%.1f ms)\n", total, tab->board,
+               total > n ? ", best shown" : "", (g_get_monotonic_time() - started) / 1000.0);
+    append_output(line);
+}
+
+static gboolean searching_posts() {
+    return search_mode() == SEARCH_POSTS;
+}
+
+static void on_search_mode_changed(GtkComboBox *combo, gpointer data) {
+    // Every mode ranks its matches; clicking a column header sorts by that column instead
+    for (int i = 0; i <= board_tab_count; i++) {
+        BoardTab *tab = i < board_tab_count ? board_tabs[i] : combined_tab;
+        if (tab) gtk_tree_sortable_set_sort_column_id(GTK_TREE_SORTABLE(tab->model), GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID, GTK_SORT_ASCENDING);
+    }
+    search_changed_callback();
+}
+
+// For the current board, or every board from the combined tab
+void rebuild_search_index() {
+    for (int i = 0; i < board_tab_count; i++) {
+        if (current_tab == combined_tab || current_tab == board_tabs[i]) submit_index_rebuild(board_tabs[i]->board, on_scraper_job_done, NULL);
+    }
+}
+
+// For the current board, or every board from the combined tab; paged lists reload once it is built
+void rebuild_sorted_index() {
+    for (int i = 0; i < board_tab_count; i++) {
+        if (current_tab == combined_tab || current_tab == board_tabs[i]) {
+            submit_board_index_rebuild(board_tabs[i]->board, on_mutation_job_done, NULL);
+        }
+    }
+}
+
+// Compress the current board's posts, or every board's from the combined tab, in the background
+void compress_posts_of_boards() {
+    for (int i = 0; i < board_tab_count; i++) {
+        if (current_tab == combined_tab || current_tab == board_tabs[i]) {
+            submit_post_recompress(board_tabs[i]->board, 0, on_scraper_job_done, NULL);
+        }
+    }
+}
+
+// Stream the selected row's board, or the current board, to a file chosen in a save dialog
+void export_board_to_file() {
+    char title[128];
+    g_snprintf(title, sizeof(title), "Export /%s/", selected_board());
+    GtkWidget *dialog = gtk_file_chooser_dialog_new(title, NULL, GTK_FILE_CHOOSER_ACTION_SAVE, "_Cancel", GTK_RESPONSE_CANCEL,
+                                                    "_Export", GTK_RESPONSE_ACCEPT, NULL);
+    gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(dialog), TRUE);
+    char name[96];
+    g_snprintf(name, sizeof(name), "%s.fcboard", selected_board());
+    gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dialog), name);
+    GtkWidget *compress_check = gtk_check_button_new_with_label("Compress with zstd");
+    gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(compress_check), TRUE);
+    gtk_file_chooser_set_extra_widget(GTK_FILE_CHOOSER(dialog), compress_check);
+
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+        char *path = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+        int compress = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(compress_check));
+        if (path) submit_board_export(selected_board(), path, compress, on_scraper_job_done, NULL);
+        g_free(path);
+    }
+    gtk_widget_destroy(dialog);
+}
+
+// Load an export into the selected row's board, or the current board; the list reloads once it is in
+void import_board_from_file() {
+    char title[128];
+    g_snprintf(title, sizeof(title), "Import into /%s/", selected_board());
+    GtkWidget *dialog = gtk_file_chooser_dialog_new(title, NULL, GTK_FILE_CHOOSER_ACTION_OPEN, "_Cancel", GTK_RESPONSE_CANCEL,
+                                                    "_Import", GTK_RESPONSE_ACCEPT, NULL);
+    if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
+        char *path = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dialog));
+        if (path) submit_board_import(selected_board(), path, on_mutation_job_done, NULL);
+        g_free(path);
+    }
+    gtk_widget_destroy(dialog);
+}
+
+// Bring a tab's list in line with the search text: post hits or title scores, then a refilter.
+// The combined tab searches every board and regathers their threads.
+static void apply_search_to_tab(BoardTab *tab) {
+    const char *filter_text = gtk_entry_get_text(GTK_ENTRY(search_entry));
+    for (int i = 0; i < board_tab_count; i++) {
+        if (tab != combined_tab && tab != board_tabs[i]) continue;
+        if (searching_posts()) run_post_search(board_tabs[i], filter_text);
+        else clear_post_search(board_tabs[i]);
+    }
+
+    if (tab == combined_tab) {
+        rebuild_combined_list();
+    } else if (thread_cache_is_valid(tab->cache) || tab->listing != NULL || tab->index_page != NULL) {
+        show_cached_threads(tab);
+    } else {
+        load_tab_threads(tab);  // Nothing cached yet (or it was invalidated)
+    }
+}
+
+// Apply the search text once typing has paused; filters the caches only. Tabs that are not
+// on screen catch up when they are next shown.
+static gboolean apply_search_filter(gpointer data) {
+    search_debounce_id = 0;
+
+    const char *filter_text = gtk_entry_get_text(GTK_ENTRY(search_entry));
+    set_thread_filter(searching_posts() ? NULL : filter_text);
+    for (int i = 0; i < board_tab_count; i++) board_tabs[i]->filter_stale = TRUE;
+    if (combined_tab) combined_tab->filter_stale = TRUE;
+    if (current_tab) apply_search_to_tab(current_tab);
+    return G_SOURCE_REMOVE;
+}
+
+// Restart the debounce timer on every keystroke
+void search_changed_callback() {
+    if (search_debounce_id != 0) g_source_remove(search_debounce_id);
+    search_debounce_id = g_timeout_add(SEARCH_DEBOUNCE_MS, apply_search_filter, NULL);
+}
+
 void create_main_window() {
     // Create the main window
     GtkWidget *window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
@@ -336,6 +1491,24 @@ void create_main_window() {
     GtkWidget *update_stored_threads_button = gtk_button_new_with_label("Update Stored Threads");
     g_signal_connect(update_stored_threads_button, "clicked", G_CALLBACK(update_stored_threads_from_scraper), NULL);
 
+    GtkWidget *show_archive_button = gtk_button_new_with_label("Show Archive");
+    g_signal_connect(show_archive_button, "clicked", G_CALLBACK(show_archived_threads), NULL);
+
+    GtkWidget *archive_dead_button = gtk_button_new_with_label("Archive Dead Threads");
+    g_signal_connect(archive_dead_button, "clicked", G_CALLBACK(archive_dead_threads), NULL);
+
+    GtkWidget *compress_button = gtk_button_new_with_label("Compress Posts");
+    g_signal_connect(compress_button, "clicked", G_CALLBACK(compress_posts_of_boards), NULL);
+
+    GtkWidget *export_button = gtk_button_new_with_label("Export Board");
+    g_signal_connect(export_button, "clicked", G_CALLBACK(export_board_to_file), NULL);
+
+    GtkWidget *import_button = gtk_button_new_with_label("Import Board");
+    g_signal_connect(import_button, "clicked", G_CALLBACK(import_board_from_file), NULL);
+
+    GtkWidget *stats_button = gtk_button_new_with_label("Stats");
+    g_signal_connect(stats_button, "clicked", G_CALLBACK(open_stats_dialog), NULL);
+
     // Top bar with buttons
     GtkWidget *top_bar = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
     gtk_box_pack_start(GTK_BOX(top_bar), settings_button, FALSE, FALSE, 5);
@@ -344,6 +1517,12 @@ void create_main_window() {
     gtk_box_pack_start(GTK_BOX(top_bar), delete_thread_button, FALSE, FALSE, 5);
     gtk_box_pack_start(GTK_BOX(top_bar), set_title_button, FALSE, FALSE, 5);
     gtk_box_pack_start(GTK_BOX(top_bar), update_stored_threads_button, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(top_bar), show_archive_button, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(top_bar), archive_dead_button, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(top_bar), compress_button, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(top_bar), export_button, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(top_bar), import_button, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(top_bar), stats_button, FALSE, FALSE, 5);
 
     // Audio button row
     GtkWidget *audio_button = gtk_button_new_with_label("Generate Audio for Selected Thread");
@@ -355,10 +1534,27 @@ void create_main_window() {
     // Create search bar and add it below the audio button row
     search_entry = gtk_entry_new();
     gtk_entry_set_placeholder_text(GTK_ENTRY(search_entry), "Search by ID or title...");
-    g_signal_connect(search_entry, "changed", G_CALLBACK(refresh_thread_list_callback), NULL);
+    g_signal_connect(search_entry, "changed", G_CALLBACK(search_changed_callback), NULL);
+
+    search_mode_combo = gtk_combo_box_text_new();
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(search_mode_combo), "Titles");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(search_mode_combo), "Fuzzy titles");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(search_mode_combo), "Regex titles");
+    gtk_combo_box_text_append_text(GTK_COMBO_BOX_TEXT(search_mode_combo), "Posts");
+    gtk_combo_box_set_active(GTK_COMBO_BOX(search_mode_combo), 0);
+    g_signal_connect(search_mode_combo, "changed", G_CALLBACK(on_search_mode_changed), NULL);
+
+    GtkWidget *rebuild_index_button = gtk_button_new_with_label("Rebuild Search Index");
+    g_signal_connect(rebuild_index_button, "clicked", G_CALLBACK(rebuild_search_index), NULL);
+
+    GtkWidget *rebuild_sorted_button = gtk_button_new_with_label("Rebuild Sorted Index");
+    g_signal_connect(rebuild_sorted_button, "clicked", G_CALLBACK(rebuild_sorted_index), NULL);
 
     GtkWidget *search_bar_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 5);
     gtk_box_pack_start(GTK_BOX(search_bar_box), search_entry, TRUE, TRUE, 5);
+    gtk_box_pack_start(GTK_BOX(search_bar_box), search_mode_combo, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(search_bar_box), rebuild_index_button, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(search_bar_box), rebuild_sorted_button, FALSE, FALSE, 5);
 
     // Label for the title section
     GtkWidget *title_label = gtk_label_new("Stored Thread Titles:");
@@ -370,6 +1566,11 @@ void create_main_window() {
     GtkWidget *output_scrolled_window = gtk_scrolled_window_new(NULL, NULL);
     gtk_widget_set_size_request(output_scrolled_window, -1, 100);  // Fixed height for terminal view
     gtk_container_add(GTK_CONTAINER(output_scrolled_window), output_text_view);
+    log_ring_init(OUTPUT_RING_LINES);
+    output_drain_buffer = g_malloc(OUTPUT_DRAIN_BYTES);
+    output_stats_label = gtk_label_new("");
+    gtk_widget_set_halign(output_stats_label, GTK_ALIGN_START);
+    g_timeout_add_seconds(1, update_output_stats, NULL);
 
     // Main vertical box to hold all components
     GtkWidget *main_box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 10);
@@ -378,11 +1579,13 @@ void create_main_window() {
     gtk_box_pack_start(GTK_BOX(main_box), search_bar_box, FALSE, FALSE, 5);
     gtk_box_pack_start(GTK_BOX(main_box), title_label, FALSE, FALSE, 5);
 
-    // Add the thread list TreeView
-    create_thread_list_tree_view(main_box);
+    // Add the board tabs, one thread list each
+    create_board_notebook(main_box);
 
     // Add the output text view below the thread list
     gtk_box_pack_start(GTK_BOX(main_box), output_scrolled_window, FALSE, FALSE, 5);
+    gtk_box_pack_start(GTK_BOX(main_box), output_stats_label, FALSE, FALSE, 0);
+    create_jobs_panel(main_box);
 
     // Add main box to the window
     gtk_container_add(GTK_CONTAINER(window), main_box);
@@ -394,15 +1597,29 @@ void create_main_window() {
 // Initialize GTK and start the main GUI loop
 void initialize_gui(int argc, char *argv[]) {
     gtk_init(&argc, &argv);
-    connect_to_redis();
     create_main_window();
+    job_queue_init(job_workers, on_job_output, on_jobs_changed, NULL);
+    scraper_jobs_start_worker();
+    redis_async_start_stall_probe();
+    media_store_init(media_dir, (size_t)media_disk_mb * 1024 * 1024);
+    thumbnail_cache_init((gsize)thumbnail_memory_mb * 1024 * 1024, decode_workers);
+    connect_to_redis();  // Opens the board tabs, which show their archives until the listings arrive
+    metrics_export_start(metrics_export, metrics_export_interval_s);
     gtk_main();
+    job_queue_shutdown();  // Terminates commands still running
+    thumbnail_cache_shutdown();
+    post_codec_shutdown();
+    scraper_rpc_stop();
+    metrics_export_stop();
 }
 
 void save_settings_callback() {
     const char *new_host = gtk_entry_get_text(GTK_ENTRY(host_entry));
     int new_port = atoi(gtk_entry_get_text(GTK_ENTRY(port_entry)));
     const char *new_board = gtk_entry_get_text(GTK_ENTRY(board_entry));
+    g_strlcpy(boards, gtk_entry_get_text(GTK_ENTRY(boards_entry)), sizeof(boards));
+    g_strlcpy(redis_endpoints, gtk_entry_get_text(GTK_ENTRY(endpoints_entry)), sizeof(redis_endpoints));
+    read_from_replicas = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(replicas_check));
 
     // Assuming save_settings is a function that saves the settings
     save_settings(new_host, new_port, new_board);  
@@ -410,7 +1627,7 @@ void save_settings_callback() {
     redis_port = new_port;
     strncpy(board, new_board, sizeof(board) - 1);
 
-    connect_to_redis();  // Reconnect to Redis with new settings
+    connect_to_redis();  // Reopens the tabs for the new server and boards; each list reloads once connected
 }
 
 const char *get_selected_thread_id_and_title(char *thread_title_out, size_t title_len) {
@@ -434,7 +1651,10 @@ const char *get_selected_thread_id_and_title(char *thread_title_out, size_t titl
             // Get the title from the appropriate column, ensure it fits in the buffer
             gchar *title;
             gtk_tree_model_get(model, &iter, 1, &title, -1);  // Assuming title is in column 1
-            strncpy(thread_title_out, title, title_len - 1);
+            // The combined tab prefixes titles with "/board/ "
+            BoardTab *owner = selected_tab();
+            size_t prefix = current_tab == combined_tab && owner ? strlen(owner->board) + 3 : 0;
+            strncpy(thread_title_out, strlen(title) >= prefix ? title + prefix : title, title_len - 1);
             thread_title_out[title_len - 1] = '\0';
             g_free(title);
 
@@ -478,7 +1698,7 @@ void open_set_title_dialog() {
     if (gtk_dialog_run(GTK_DIALOG(dialog)) == GTK_RESPONSE_ACCEPT) {
         const char *new_title = gtk_entry_get_text(GTK_ENTRY(title_entry));
         printf("DEBUG: Setting new title: %s for thread ID: %s\n", new_title, thread_id);  // Debug print
-        set_thread_title(board, thread_id, new_title);  // Call function to set the new title
+        set_thread_title(selected_board(), thread_id, new_title);  // Call function to set the new title
     }
 
     gtk_widget_destroy(dialog);
@@ -489,38 +1709,13 @@ void open_set_title_dialog() {
 
 
 void set_thread_title(const char *board, const char *thread_id, const char *title) {
-    printf("DEBUG: Executing set_thread_title with board: %s, thread ID: %s, title: %s\n", board, thread_id, title);
-
-    char command[1024];
-    snprintf(command, sizeof(command), "/usr/bin/docker exec 4chan_scraper-scraper-1 python FourChanScraper.py set_title %s %s \"%s\"", board, thread_id, title);
-
-    FILE *fp = popen(command, "r");
-    if (fp == NULL) {
-        fprintf(stderr, "Failed to execute set_title command\n");
-        return;
-    }
-
-    // Capture command output and append to text view
-    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(output_text_view));
-    char output[1024];
-    while (fgets(output, sizeof(output), fp) != NULL) {
-        GtkTextIter end;
-        gtk_text_buffer_get_end_iter(buffer, &end);
-        gtk_text_buffer_insert(buffer, &end, output, -1);
-    }
-    pclose(fp);
-    
-    printf("DEBUG: Title updated successfully.\n");
-
-    load_thread_titles(NULL);  // Refresh the list to include the updated thread title
+    submit_set_title(board, thread_id, title, on_mutation_job_done, NULL);  // Shows the updated thread title when it finishes
 }
 
+// For the current board, or every board from the combined tab
 void update_stored_threads_from_scraper() {
-    pthread_t thread_id;
-    if (pthread_create(&thread_id, NULL, update_stored_threads_thread, NULL) != 0) {
-        fprintf(stderr, "Failed to create thread for updating stored threads\n");
-    } else {
-        pthread_detach(thread_id);  // Automatically free resources when thread finishes
+    for (int i = 0; i < board_tab_count; i++) {
+        if (current_tab == combined_tab || current_tab == board_tabs[i]) submit_update_threads(board_tabs[i]->board, on_scraper_job_done, NULL);
     }
 }
 
@@ -543,62 +1738,21 @@ void detect_docker_host() {
     pclose(fp);
 }
 
-// Function that will run in a separate thread to perform the update
-void *update_stored_threads_thread(void *arg) {
-    
-    char command[512];
-    snprintf(command, sizeof(command), "/usr/bin/docker exec 4chan_scraper-scraper-1 python FourChanScraper.py update_stored_threads %s", board);
-    
-    FILE *fp = popen(command, "r");
-    if (fp == NULL) {
-        fprintf(stderr, "Failed to execute scraper command\n");
-        return NULL;
-    }
-
-    // Read the command output and update the output text view
-    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(output_text_view));
-    char output[1024];
-
-    // While reading the output, periodically update the UI
-    while (fgets(output, sizeof(output), fp) != NULL) {
-        g_idle_add((GSourceFunc)update_output_text_view, g_strdup(output));
-    }
-
-    pclose(fp);
-    return NULL;
-}
-
-// Function to update the output text view from the main thread
-gboolean update_output_text_view(gchar *output) {
-    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(output_text_view));
-    GtkTextIter end;
-    gtk_text_buffer_get_end_iter(buffer, &end);
-    gtk_text_buffer_insert(buffer, &end, output, -1);
-    g_free(output);  // Free the output string after updating
-    return FALSE;    // Return FALSE to indicate one-time execution
+// Worker-thread check through the connection pool: does the thread still have a title?
+static void note_thread_exists(const char *thread_id, const char *title, int count, const char *status, void *user_data) {
+    *(int *)user_data = (title != NULL);
 }
 
-// Function to be used in a worker thread, updated for g_idle_add use
-void *generate_audio_thread_function(void *arg) {
-    const char *thread_id = (const char *)arg;
-
-    // Command to call the Python script for audio generation
-    char command[512];
-    snprintf(command, sizeof(command), "/usr/bin/docker exec 4chan_scraper-scraper-1 python3 FourChanScraper.py generate_audio %s %s", board, thread_id);
-
-    FILE *fp = popen(command, "r");
-    if (fp == NULL) {
-        fprintf(stderr, "Failed to execute generate_audio command\n");
-        return NULL;
+// Job check: don't start a long audio job for a thread that was deleted after it was selected
+static int check_thread_exists(const char *board, const char *thread_id, void *user_data) {
+    int exists = 1;
+    if (fetch_thread_record(board, thread_id, note_thread_exists, &exists) == 0 && !exists) {
+        char message[THREAD_ID_MAX + 32];
+        g_snprintf(message, sizeof(message), "Thread %s no longer exists\n", thread_id);
+        append_output(message);
+        return 1;
     }
-
-    char output[1024];
-    while (fgets(output, sizeof(output), fp) != NULL) {
-        // Schedule the output to be inserted on the main thread
-        g_idle_add((GSourceFunc)update_output_text_view_safe, g_strdup(output));
-    }
-    pclose(fp);
-    return NULL;
+    return 0;
 }
 
 // Function called when "Generate Audio" button is clicked
@@ -612,15 +1766,8 @@ void on_generate_audio_button_clicked(GtkWidget *widget, gpointer data) {
         return;
     }
 
-    // Create a new thread for audio generation
-    pthread_t audio_thread;
-    if (pthread_create(&audio_thread, NULL, generate_audio_thread_function, (void *)thread_id) != 0) {
-        fprintf(stderr, "Failed to create audio generation thread\n");
-        return;
-    }
-
-    // Detach the thread to allow it to run independently
-    pthread_detach(audio_thread);
+    // Queue audio generation; the job copies the ID out of get_selected_thread_id()'s shared buffer
+    submit_generate_audio(selected_board(), thread_id, check_thread_exists, on_scraper_job_done, NULL);
 }
 
 // Function to create and show the context menu
@@ -642,6 +1789,11 @@ void show_context_menu(GtkWidget *widget, GdkEventButton *event, gpointer data)
 
             g_signal_connect(copy_menu_item, "activate", G_CALLBACK(copy_thread_id_callback), widget);
             gtk_menu_shell_append(GTK_MENU_SHELL(menu), copy_menu_item);
+
+            GtkWidget *archive_menu_item = gtk_menu_item_new_with_label("Move to Archive");
+            gtk_widget_set_sensitive(archive_menu_item, selected_tab() && !selected_tab()->showing_archive);
+            g_signal_connect(archive_menu_item, "activate", G_CALLBACK(move_selected_thread_to_archive), NULL);
+            gtk_menu_shell_append(GTK_MENU_SHELL(menu), archive_menu_item);
             gtk_widget_show_all(menu);
             
             gtk_menu_popup_at_pointer(GTK_MENU(menu), (GdkEvent *)event);
@@ -667,15 +1819,3 @@ void copy_thread_id_callback(GtkWidget *menu_item, gpointer data) {
         printf("Thread ID copied to clipboard.\n"); // Optional: For debugging or feedback
     }
 }
-
-
-
-// Wrapper function to safely add text to GtkTextView from any thread
-gboolean update_output_text_view_safe(gchar *output) {
-    GtkTextBuffer *buffer = gtk_text_view_get_buffer(GTK_TEXT_VIEW(output_text_view));
-    GtkTextIter end;
-    gtk_text_buffer_get_end_iter(buffer, &end);
-    gtk_text_buffer_insert(buffer, &end, output, -1);
-    g_free(output);  // Free the output string after updating
-    return FALSE;    // Return FALSE to indicate one-time execution
-}
\ No newline at end of file
@@ -0,0 +1,393 @@
+#define _GNU_SOURCE  // pipe2
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "../include/job_queue.h"
+#include "../include/metrics.h"
+
+// Scraper commands run here instead of on the GTK thread: a FIFO of jobs served by a fixed
+// set of worker threads. Each command is forked into its own process group so cancelling
+// a running job can signal the whole command; a queued job is simply dropped.
+
+#define JOB_WORKERS_MAX 16
+#define JOB_HISTORY_MAX 200  // Finished jobs kept for the jobs panel
+
+typedef struct Job {
+    JobInfo info;
+    char **argv;
+    job_run_fn run;
+    job_check_fn check;
+    job_done_fn on_done;
+    void *user_data;
+    pid_t pid;            // Process group of the running command, 0 when none
+    int cancel_requested;
+    struct Job *prev, *next;
+} Job;
+
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static Job *jobs_head = NULL;  // Every job, in submission order
+static Job *jobs_tail = NULL;
+static size_t finished_count = 0;
+static unsigned next_job_id = 1;
+static int stopping = 0;
+
+static pthread_t worker_threads[JOB_WORKERS_MAX];
+static int worker_count = 0;
+static job_output_fn output_callback = NULL;
+static job_change_fn change_callback = NULL;
+static void *callback_data = NULL;
+
+int64_t job_now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+const char *job_state_name(JobState state) {
+    switch (state) {
+    case JOB_QUEUED: return "queued";
+    case JOB_RUNNING: return "running";
+    case JOB_SUCCEEDED: return "done";
+    case JOB_FAILED: return "failed";
+    case JOB_CANCELLED: return "cancelled";
+    case JOB_SKIPPED: return "skipped";
+    }
+    return "?";
+}
+
+static int is_finished(const Job *job) {
+    return job->info.state != JOB_QUEUED && job->info.state != JOB_RUNNING;
+}
+
+static void notify_change() {
+    if (change_callback) change_callback(callback_data);
+}
+
+static void free_job(Job *job) {
+    if (job->argv) {
+        for (char **arg = job->argv; *arg; arg++) free(*arg);
+        free(job->argv);
+    }
+    free(job);
+}
+
+static void unlink_job(Job *job) {
+    if (job->prev) job->prev->next = job->next; else jobs_head = job->next;
+    if (job->next) job->next->prev = job->prev; else jobs_tail = job->prev;
+}
+
+// Forget the oldest finished jobs beyond the history limit; called with the lock held
+static void trim_history() {
+    Job *job = jobs_head;
+    while (job && finished_count > JOB_HISTORY_MAX) {
+        Job *next = job->next;
+        if (is_finished(job)) {
+            unlink_job(job);
+            free_job(job);
+            finished_count--;
+        }
+        job = next;
+    }
+}
+
+static void finish_job(Job *job, JobState state) {
+    job->info.state = state;
+    job->info.finished_at_ms = job_now_ms();
+    finished_count++;
+}
+
+// Fork and exec the job's command, forwarding its combined stdout/stderr line by line.
+// Returns the exit code, -1 if it was killed by a signal, or 127 if it couldn't be started.
+static int run_command(Job *job) {
+    int fds[2];
+    // Close-on-exec from the start, so another worker's child never inherits these ends
+    if (pipe2(fds, O_CLOEXEC) != 0) {
+        fprintf(stderr, "Failed to create pipe for job %u: %s\n", job->info.id, strerror(errno));
+        return 127;
+    }
+
+    uint64_t started = metrics_begin();
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "Failed to fork job %u: %s\n", job->info.id, strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return 127;
+    }
+    if (pid == 0) {
+        setpgid(0, 0);
+        dup2(fds[1], STDOUT_FILENO);
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execvp(job->argv[0], job->argv);
+        const char *message = "Failed to execute scraper command\n";  // Only async-signal-safe calls after fork
+        if (write(STDERR_FILENO, message, strlen(message)) < 0) _exit(127);
+        _exit(127);
+    }
+
+    // Set the group from both sides so a cancel right after fork can't miss the child
+    setpgid(pid, pid);
+    close(fds[1]);
+    pthread_mutex_lock(&queue_lock);
+    job->pid = pid;
+    if (job->cancel_requested) kill(-pid, SIGTERM);
+    pthread_mutex_unlock(&queue_lock);
+
+    FILE *output = fdopen(fds[0], "r");
+    if (output) {
+        char line[1024];
+        while (fgets(line, sizeof(line), output) != NULL) {
+            job_queue_output(job->info.id, line);
+        }
+        fclose(output);
+    } else {
+        close(fds[0]);
+    }
+
+    // Wait without reaping first, so the pid can't be reused while cancel may still signal it
+    siginfo_t info;
+    while (waitid(P_PID, pid, &info, WEXITED | WNOWAIT) != 0 && errno == EINTR) {}
+    pthread_mutex_lock(&queue_lock);
+    job->pid = 0;
+    pthread_mutex_unlock(&queue_lock);
+
+    // status stays unset if the child was already reaped elsewhere (ECHILD); count that as killed
+    int status = 0;
+    pid_t reaped;
+    while ((reaped = waitpid(pid, &status, 0)) < 0 && errno == EINTR) {}
+    metrics_end(METRIC_SCRAPER_EXEC, started);
+    return reaped == pid && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+// Forward a line of job output to the queue's output callback; for run hooks as well
+void job_queue_output(unsigned job_id, const char *line) {
+    if (output_callback) output_callback(job_id, line, callback_data);
+}
+
+static Job *first_queued() {
+    for (Job *job = jobs_head; job; job = job->next) {
+        if (job->info.state == JOB_QUEUED) return job;
+    }
+    return NULL;
+}
+
+static void *worker_main(void *arg) {
+    for (;;) {
+        pthread_mutex_lock(&queue_lock);
+        Job *job;
+        while (!stopping && (job = first_queued()) == NULL) pthread_cond_wait(&queue_cond, &queue_lock);
+        if (stopping) {
+            pthread_mutex_unlock(&queue_lock);
+            return NULL;
+        }
+        job->info.state = JOB_RUNNING;
+        job->info.started_at_ms = job_now_ms();
+        pthread_mutex_unlock(&queue_lock);
+        notify_change();
+
+        int skip = job->check && job->check(job->info.board, job->info.thread_id[0] ? job->info.thread_id : NULL, job->user_data) != 0;
+        int exit_code = -1;
+
+        pthread_mutex_lock(&queue_lock);
+        int cancelled = job->cancel_requested;  // Cancelled while the check ran
+        pthread_mutex_unlock(&queue_lock);
+        int used_runner = 0;
+        if (!skip && !cancelled) {
+            exit_code = job->run ? job->run(job->info.id, job->argv, &job->cancel_requested, job->user_data) : JOB_RUN_UNAVAILABLE;
+            used_runner = exit_code != JOB_RUN_UNAVAILABLE;
+            if (!used_runner) exit_code = run_command(job);
+        }
+
+        pthread_mutex_lock(&queue_lock);
+        job->info.exit_code = exit_code;
+        job->info.used_runner = used_runner;
+        finish_job(job, job->cancel_requested ? JOB_CANCELLED : skip ? JOB_SKIPPED : exit_code == 0 ? JOB_SUCCEEDED : JOB_FAILED);
+        JobInfo info = job->info;
+        job_done_fn on_done = job->on_done;
+        void *user_data = job->user_data;
+        trim_history();  // May free job
+        pthread_mutex_unlock(&queue_lock);
+
+        if (on_done) on_done(&info, user_data);
+        notify_change();
+    }
+}
+
+// Start the worker threads; on_output and on_change may be NULL
+int job_queue_init(int workers, job_output_fn on_output, job_change_fn on_change, void *user_data) {
+    if (worker_count > 0) return 0;
+
+    output_callback = on_output;
+    change_callback = on_change;
+    callback_data = user_data;
+    stopping = 0;
+
+    if (workers < 1) workers = 1;
+    if (workers > JOB_WORKERS_MAX) workers = JOB_WORKERS_MAX;
+    for (int i = 0; i < workers; i++) {
+        if (pthread_create(&worker_threads[i], NULL, worker_main, NULL) != 0) {
+            fprintf(stderr, "Failed to start job worker %d\n", i);
+            break;
+        }
+        worker_count++;
+    }
+    return worker_count > 0 ? 0 : -1;
+}
+
+// Cancel everything, wait for the workers and free all jobs
+void job_queue_shutdown() {
+    pthread_mutex_lock(&queue_lock);
+    stopping = 1;
+    for (Job *job = jobs_head; job; job = job->next) {
+        __atomic_store_n(&job->cancel_requested, 1, __ATOMIC_RELAXED);
+        if (job->pid > 0) kill(-job->pid, SIGTERM);
+    }
+    pthread_cond_broadcast(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+
+    for (int i = 0; i < worker_count; i++) pthread_join(worker_threads[i], NULL);
+    worker_count = 0;
+
+    pthread_mutex_lock(&queue_lock);
+    while (jobs_head) {
+        Job *job = jobs_head;
+        unlink_job(job);
+        free_job(job);
+    }
+    finished_count = 0;
+    pthread_mutex_unlock(&queue_lock);
+}
+
+// Same command on the same target: name, board, thread and every argument must match, so two
+// board-wide jobs with different arguments (another path, another set of IDs) both run
+static int same_target(const Job *job, const JobSpec *spec) {
+    if (strcmp(job->info.name, spec->name) != 0 ||
+        strcmp(job->info.board, spec->board ? spec->board : "") != 0 ||
+        strcmp(job->info.thread_id, spec->thread_id ? spec->thread_id : "") != 0) {
+        return 0;
+    }
+    size_t i = 0;
+    for (; job->argv[i] && spec->argv[i]; i++) {
+        if (strcmp(job->argv[i], spec->argv[i]) != 0) return 0;
+    }
+    return job->argv[i] == NULL && spec->argv[i] == NULL;
+}
+
+// Queue a command. A job with the same name, board, thread and arguments that is still queued
+// or running absorbs the request: its id is returned and nothing new is started.
+// Returns 0 if the job couldn't be queued.
+unsigned job_queue_submit(const JobSpec *spec) {
+    Job *job = calloc(1, sizeof(Job));
+    size_t argc = 0;
+    while (spec->argv[argc]) argc++;
+    if (job) job->argv = calloc(argc + 1, sizeof(char *));
+    size_t copied = 0;
+    while (job && job->argv && copied < argc && (job->argv[copied] = strdup(spec->argv[copied])) != NULL) copied++;
+    if (job == NULL || job->argv == NULL || copied < argc) {
+        fprintf(stderr, "Failed to allocate job %s\n", spec->name);
+        if (job) free_job(job);
+        return 0;
+    }
+
+    snprintf(job->info.name, sizeof(job->info.name), "%s", spec->name);
+    snprintf(job->info.board, sizeof(job->info.board), "%s", spec->board ? spec->board : "");
+    snprintf(job->info.thread_id, sizeof(job->info.thread_id), "%s", spec->thread_id ? spec->thread_id : "");
+    job->info.state = JOB_QUEUED;
+    job->info.exit_code = -1;
+    job->run = spec->run;
+    job->check = spec->check;
+    job->on_done = spec->on_done;
+    job->user_data = spec->user_data;
+
+    // The duplicate check and the insert share one hold of the lock, so two identical
+    // submissions from different threads can't both get in
+    pthread_mutex_lock(&queue_lock);
+    for (Job *other = jobs_head; other; other = other->next) {
+        if (!is_finished(other) && !other->cancel_requested && same_target(other, spec)) {
+            unsigned id = other->info.id;
+            pthread_mutex_unlock(&queue_lock);
+            free_job(job);
+            return id;
+        }
+    }
+    job->info.id = next_job_id++;
+    job->info.queued_at_ms = job_now_ms();
+    job->prev = jobs_tail;
+    if (jobs_tail) jobs_tail->next = job; else jobs_head = job;
+    jobs_tail = job;
+    unsigned id = job->info.id;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+
+    notify_change();
+    return id;
+}
+
+// Drop a queued job or terminate the process group of a running one.
+// Returns -1 if the job is unknown or already finished.
+int job_queue_cancel(unsigned job_id) {
+    int result = -1;
+    Job *cancelled = NULL;
+    JobInfo info;
+
+    pthread_mutex_lock(&queue_lock);
+    for (Job *job = jobs_head; job; job = job->next) {
+        if (job->info.id != job_id) continue;
+        if (job->info.state == JOB_QUEUED) {
+            __atomic_store_n(&job->cancel_requested, 1, __ATOMIC_RELAXED);
+            finish_job(job, JOB_CANCELLED);
+            cancelled = job;
+            info = job->info;
+            result = 0;
+        } else if (job->info.state == JOB_RUNNING) {
+            __atomic_store_n(&job->cancel_requested, 1, __ATOMIC_RELAXED);
+            if (job->pid > 0) kill(-job->pid, SIGTERM);
+            result = 0;
+        }
+        break;
+    }
+    job_done_fn on_done = cancelled ? cancelled->on_done : NULL;
+    void *user_data = cancelled ? cancelled->user_data : NULL;
+    if (cancelled) trim_history();
+    pthread_mutex_unlock(&queue_lock);
+
+    if (on_done) on_done(&info, user_data);
+    if (result == 0) notify_change();
+    return result;
+}
+
+// Copy up to max jobs, oldest first; returns how many were copied
+size_t job_queue_list(JobInfo *out, size_t max) {
+    size_t n = 0;
+    pthread_mutex_lock(&queue_lock);
+    for (Job *job = jobs_head; job && n < max; job = job->next) out[n++] = job->info;
+    pthread_mutex_unlock(&queue_lock);
+    return n;
+}
+
+void job_queue_clear_finished() {
+    pthread_mutex_lock(&queue_lock);
+    Job *job = jobs_head;
+    while (job) {
+        Job *next = job->next;
+        if (is_finished(job)) {
+            unlink_job(job);
+            free_job(job);
+        }
+        job = next;
+    }
+    finished_count = 0;
+    pthread_mutex_unlock(&queue_lock);
+    notify_change();
+}
@@ -0,0 +1,163 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/json_scan.h"
+
+// Just enough JSON for the archiver's own protocols and the 4chan API: an encoder for
+// strings and a scanner that walks objects in place, decoding only the values asked for.
+
+int json_append(JsonBuffer *buffer, const char *text, size_t length) {
+    if (buffer->length + length + 1 > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : 256;
+        while (capacity < buffer->length + length + 1) capacity *= 2;
+        char *data = realloc(buffer->data, capacity);
+        if (data == NULL) return -1;
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->length, text, length);
+    buffer->length += length;
+    buffer->data[buffer->length] = '\0';
+    return 0;
+}
+
+int json_append_string(JsonBuffer *buffer, const char *text) {
+    int result = json_append(buffer, "\"", 1);
+    for (const unsigned char *p = (const unsigned char *)text; *p && result == 0; p++) {
+        char escaped[8];
+        if (*p == '"' || *p == '\\') {
+            escaped[0] = '\\';
+            escaped[1] = *p;
+            result = json_append(buffer, escaped, 2);
+        } else if (*p < 0x20) {
+            snprintf(escaped, sizeof(escaped), "\\u%04x", *p);
+            result = json_append(buffer, escaped, 6);
+        } else {
+            result = json_append(buffer, (const char *)p, 1);
+        }
+    }
+    return result == 0 ? json_append(buffer, "\"", 1) : result;
+}
+
+const char *json_skip_space(const char *p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') p++;
+    return p;
+}
+
+static size_t put_utf8(char *out, unsigned code) {
+    if (code < 0x80) { out[0] = code; return 1; }
+    if (code < 0x800) { out[0] = 0xC0 | (code >> 6); out[1] = 0x80 | (code & 0x3F); return 2; }
+    if (code < 0x10000) { out[0] = 0xE0 | (code >> 12); out[1] = 0x80 | ((code >> 6) & 0x3F); out[2] = 0x80 | (code & 0x3F); return 3; }
+    out[0] = 0xF0 | (code >> 18); out[1] = 0x80 | ((code >> 12) & 0x3F); out[2] = 0x80 | ((code >> 6) & 0x3F); out[3] = 0x80 | (code & 0x3F);
+    return 4;
+}
+
+static unsigned parse_hex4(const char *p) {
+    unsigned value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') value |= c - '0';
+        else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+        else return 0xFFFD;
+    }
+    return value;
+}
+
+// Decode the string starting at the opening quote into out (NULL to skip); returns the
+// position after the closing quote, or NULL if the string is malformed
+const char *json_parse_string(const char *p, char *out, size_t size) {
+    size_t used = 0;
+    if (*p++ != '"') return NULL;
+
+    while (*p && *p != '"') {
+        char decoded[4];
+        size_t length = 1;
+
+        if (*p == '\\') {
+            p++;
+            switch (*p) {
+            case 'n': decoded[0] = '\n'; break;
+            case 't': decoded[0] = '\t'; break;
+            case 'r': decoded[0] = '\r'; break;
+            case 'b': decoded[0] = '\b'; break;
+            case 'f': decoded[0] = '\f'; break;
+            case 'u': {
+                if (strnlen(p + 1, 4) < 4) return NULL;
+                unsigned code = parse_hex4(p + 1);
+                p += 4;
+                if (code >= 0xD800 && code < 0xDC00 && p[1] == '\\' && p[2] == 'u' && strnlen(p + 3, 4) == 4) {
+                    unsigned low = parse_hex4(p + 3);
+                    if (low >= 0xDC00 && low < 0xE000) {
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        p += 6;
+                    }
+                }
+                length = put_utf8(decoded, code);
+                break;
+            }
+            case '\0': return NULL;
+            default: decoded[0] = *p; break;  // \" \\ \/
+            }
+            p++;
+        } else {
+            decoded[0] = *p++;
+        }
+
+        if (out && used + length < size) {
+            memcpy(out + used, decoded, length);
+            used += length;
+        }
+    }
+    if (out && size) out[used] = '\0';
+    return *p == '"' ? p + 1 : NULL;
+}
+
+// Skip a value we don't need; nested containers are skipped by depth
+const char *json_skip_value(const char *p) {
+    if (*p == '"') return json_parse_string(p, NULL, 0);
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        while (*p) {
+            if (*p == '"') {
+                p = json_parse_string(p, NULL, 0);
+                if (p == NULL) return NULL;
+                continue;
+            }
+            if (*p == '{' || *p == '[') depth++;
+            if (*p == '}' || *p == ']') {
+                if (--depth == 0) return p + 1;
+            }
+            p++;
+        }
+        return NULL;
+    }
+    while (*p && *p != ',' && *p != '}') p++;  // Number or literal
+    return p;
+}
+
+// Value of key in the object starting at object (top level only), or NULL if absent
+const char *json_object_find(const char *object, const char *key) {
+    const char *p = json_skip_space(object);
+    if (*p++ != '{') return NULL;
+
+    for (;;) {
+        char name[64];
+        p = json_skip_space(p);
+        if (*p != '"') return NULL;
+        p = json_parse_string(p, name, sizeof(name));
+        if (p == NULL) return NULL;
+        p = json_skip_space(p);
+        if (*p++ != ':') return NULL;
+        p = json_skip_space(p);
+        if (strcmp(name, key) == 0) return p;
+
+        p = json_skip_value(p);
+        if (p == NULL) return NULL;
+        p = json_skip_space(p);
+        if (*p++ != ',') return NULL;
+    }
+}
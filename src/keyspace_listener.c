@@ -0,0 +1,264 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <hiredis/hiredis.h>
+#include "../include/keyspace_listener.h"
+#include "../include/redis_operations.h"
+#include "../include/settings.h"
+
+#define RECONNECT_MIN_MS 250
+#define RECONNECT_MAX_MS 30000
+
+// One subscriber thread with its own connections; a subscribed context can't run normal
+// commands, so it is never shared with the listing code. Keyspace events are only published
+// by the node that holds the key, so on a cluster every primary is subscribed to. The thread
+// owns this state and frees it on exit, so stopping never has to wait for a connect or a read.
+typedef struct {
+    pthread_mutex_t lock;      // Guards contexts and stopping against keyspace_listener_stop()
+    redisContext *contexts[REDIS_NODES_MAX];
+    size_t context_count;
+    int stopping;
+    RedisEndpoint seeds[REDIS_NODES_MAX];
+    size_t seed_count;
+    char (*boards)[256];       // One PSUBSCRIBE per board and field
+    size_t board_count;
+    keyspace_event_fn on_event;
+    void *user_data;
+} KeyspaceListener;
+
+static KeyspaceListener *current_listener = NULL;
+static volatile int listener_active = 0;  // Set once every node of the current listener confirmed PSUBSCRIBE
+
+static int is_stopping(KeyspaceListener *listener) {
+    pthread_mutex_lock(&listener->lock);
+    int stopping = listener->stopping;
+    pthread_mutex_unlock(&listener->lock);
+    return stopping;
+}
+
+// Sleep in short slices so a stop request is noticed quickly
+static void backoff_sleep(KeyspaceListener *listener, int delay_ms) {
+    for (int slept = 0; slept < delay_ms && !is_stopping(listener); slept += 50) {
+        struct timespec slice = { 0, 50 * 1000000L };
+        nanosleep(&slice, NULL);
+    }
+}
+
+// Keyspace events for string commands (set, append...) and generic ones (del, expire, rename).
+// Flags the operator set for other consumers are kept: only a missing K, $ or g is added.
+static int enable_notifications(redisContext *context, const RedisEndpoint *endpoint) {
+    redisReply *reply = redis_command(context, "CONFIG GET notify-keyspace-events");
+    if (reply == NULL || reply->type != REDIS_REPLY_ARRAY || reply->elements != 2 || reply->element[1]->str == NULL) {
+        if (reply && reply->type == REDIS_REPLY_ERROR) {
+            fprintf(stderr, "CONFIG is disabled on %s:%d (%s); set notify-keyspace-events to include K$g there for live updates\n",
+                    endpoint->host, endpoint->port, reply->str);
+        }
+        if (reply) freeReplyObject(reply);
+        return context->err ? -1 : 0;
+    }
+
+    char flags[64];
+    snprintf(flags, sizeof(flags), "%s", reply->element[1]->str);
+    freeReplyObject(reply);
+    int all = strchr(flags, 'A') != NULL;  // A stands for every event class, $ and g included
+    size_t length = strlen(flags), added = 0;
+    for (const char *flag = all ? "K" : "K$g"; *flag; flag++) {
+        if (strchr(flags, *flag) == NULL && length + 1 < sizeof(flags)) {
+            flags[length++] = *flag;
+            flags[length] = '\0';
+            added++;
+        }
+    }
+    if (added == 0) return 0;
+
+    reply = redis_command(context, "CONFIG SET notify-keyspace-events %s", flags);
+    if (reply == NULL || reply->type == REDIS_REPLY_ERROR) {
+        fprintf(stderr, "Could not enable keyspace notifications on %s:%d (%s); set notify-keyspace-events to %s there\n",
+                endpoint->host, endpoint->port, reply ? reply->str : context->errstr, flags);
+    }
+    if (reply) freeReplyObject(reply);
+    return context->err ? -1 : 0;
+}
+
+// Queue one node's subscriptions; 0 once they are sent
+static int subscribe(KeyspaceListener *listener, redisContext *context) {
+    // Only the connect is bounded; once subscribed, reads block until an event or a stop
+    struct timeval no_timeout = { 0, 0 };
+    redisSetTimeout(context, no_timeout);
+
+    const char *fields[] = { "title", "count", "status" };
+    for (size_t b = 0; b < listener->board_count; b++) {
+        for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+            redisAppendCommand(context, "PSUBSCRIBE __keyspace@*__:%s*_%s", listener->boards[b], fields[i]);
+        }
+    }
+    int done = 0;
+    while (!done) {
+        if (redisBufferWrite(context, &done) != REDIS_OK) return -1;
+    }
+    return 0;
+}
+
+// Deliver events from every node until one of them drops or the listener is stopped
+static void run_subscriptions(KeyspaceListener *listener, redisContext **contexts, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (subscribe(listener, contexts[i]) != 0) {
+            fprintf(stderr, "Keyspace listener could not subscribe: %s\n", contexts[i]->errstr);
+            return;
+        }
+    }
+
+    struct pollfd fds[REDIS_NODES_MAX];
+    int subscribed[REDIS_NODES_MAX] = { 0 };
+    size_t subscribed_count = 0;
+    for (size_t i = 0; i < count; i++) fds[i] = (struct pollfd){ .fd = contexts[i]->fd, .events = POLLIN };
+
+    redisContext *failed = NULL;
+    while (failed == NULL && !is_stopping(listener)) {
+        if (poll(fds, count, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (size_t i = 0; i < count && failed == NULL; i++) {
+            if (fds[i].revents == 0) continue;
+            if (redisBufferRead(contexts[i]) != REDIS_OK) {
+                failed = contexts[i];
+                break;
+            }
+
+            redisReply *reply;
+            while (redisGetReplyFromReader(contexts[i], (void **)&reply) == REDIS_OK && reply) {
+                if (reply->type == REDIS_REPLY_ARRAY && reply->elements >= 3 && reply->element[0]->str) {
+                    const char *kind = reply->element[0]->str;
+                    if (strcmp(kind, "psubscribe") == 0) {
+                        if (!subscribed[i]) subscribed_count++;
+                        subscribed[i] = 1;
+                        if (subscribed_count == count) listener_active = 1;
+                    } else if (strcmp(kind, "pmessage") == 0 && reply->elements == 4 && !is_stopping(listener)) {
+                        // element[2] is "__keyspace@<db>__:<key>", element[3] the event name
+                        const char *key = strchr(reply->element[2]->str, ':');
+                        if (key) listener->on_event(key + 1, reply->element[3]->str, listener->user_data);
+                    }
+                }
+                freeReplyObject(reply);
+            }
+        }
+    }
+
+    if (!is_stopping(listener)) {
+        fprintf(stderr, "Keyspace listener disconnected: %s\n", failed ? failed->errstr : strerror(errno));
+        listener_active = 0;
+    }
+}
+
+// Finds the nodes and connects on this thread (never the caller's) with a timeout, and starts
+// over with backoff whenever a node drops
+static void *keyspace_listener_thread(void *arg) {
+    KeyspaceListener *listener = arg;
+    int delay_ms = RECONNECT_MIN_MS;
+
+    while (!is_stopping(listener)) {
+        RedisTopology *topology = redis_topology_discover(listener->seeds, listener->seed_count, connect_timeout_ms, 0);
+        int nodes[REDIS_NODES_MAX];
+        size_t count = topology ? redis_topology_scan_nodes(topology, REDIS_ROUTE_PRIMARY, 0, nodes, REDIS_NODES_MAX) : 0;
+        redisContext *contexts[REDIS_NODES_MAX];
+        size_t connected = 0;
+
+        struct timeval timeout = { connect_timeout_ms / 1000, (connect_timeout_ms % 1000) * 1000 };
+        for (; connected < count; connected++) {
+            const RedisEndpoint *endpoint = &topology->nodes[nodes[connected]].endpoint;
+            redisContext *context = redisConnectWithTimeout(endpoint->host, endpoint->port, timeout);
+            if (context == NULL || context->err || enable_notifications(context, endpoint) != 0) {
+                fprintf(stderr, "Could not connect keyspace listener to %s:%d: %s\n", endpoint->host, endpoint->port,
+                        context ? context->errstr : "Unknown error");
+                if (context) redisFree(context);
+                break;
+            }
+            contexts[connected] = context;
+        }
+        redis_topology_unref(topology);
+
+        if (count > 0 && connected == count) {
+            pthread_mutex_lock(&listener->lock);
+            if (!listener->stopping) {
+                memcpy(listener->contexts, contexts, sizeof(redisContext *) * count);
+                listener->context_count = count;
+            }
+            pthread_mutex_unlock(&listener->lock);
+
+            delay_ms = RECONNECT_MIN_MS;
+            if (listener->context_count) run_subscriptions(listener, contexts, count);
+
+            pthread_mutex_lock(&listener->lock);
+            listener->context_count = 0;
+            pthread_mutex_unlock(&listener->lock);
+        }
+        for (size_t i = 0; i < connected; i++) redisFree(contexts[i]);
+
+        backoff_sleep(listener, delay_ms);
+        delay_ms = delay_ms * 2 < RECONNECT_MAX_MS ? delay_ms * 2 : RECONNECT_MAX_MS;
+    }
+
+    pthread_mutex_destroy(&listener->lock);
+    free(listener->boards);
+    free(listener);
+    return NULL;
+}
+
+// Start listening for changes to the thread keys of some boards on separate connections.
+// endpoints is "host:port[,host:port...]" as for redis_pool_init(). Returns without touching
+// the network; the thread connects and retries on its own.
+int keyspace_listener_start(const char *endpoints, const char *const *boards, size_t board_count,
+                            keyspace_event_fn on_event, void *user_data) {
+    keyspace_listener_stop();
+
+    KeyspaceListener *listener = calloc(1, sizeof(KeyspaceListener));
+    if (listener == NULL) return -1;
+    listener->boards = calloc(board_count ? board_count : 1, sizeof(*listener->boards));
+    if (listener->boards == NULL) {
+        free(listener);
+        return -1;
+    }
+    pthread_mutex_init(&listener->lock, NULL);
+    listener->seed_count = redis_parse_endpoints(endpoints, listener->seeds, REDIS_NODES_MAX);
+    for (size_t b = 0; b < board_count; b++) snprintf(listener->boards[b], sizeof(listener->boards[b]), "%s", boards[b]);
+    listener->board_count = board_count;
+    listener->on_event = on_event;
+    listener->user_data = user_data;
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, keyspace_listener_thread, listener) != 0) {
+        fprintf(stderr, "Failed to create keyspace listener thread\n");
+        pthread_mutex_destroy(&listener->lock);
+        free(listener->boards);
+        free(listener);
+        return -1;
+    }
+    pthread_detach(thread);
+    current_listener = listener;
+    return 0;
+}
+
+// Ask the current listener to exit; it wakes from poll() when its sockets are shut down
+void keyspace_listener_stop() {
+    if (current_listener == NULL) return;
+
+    pthread_mutex_lock(&current_listener->lock);
+    current_listener->stopping = 1;
+    for (size_t i = 0; i < current_listener->context_count; i++) shutdown(current_listener->contexts[i]->fd, SHUT_RDWR);
+    pthread_mutex_unlock(&current_listener->lock);
+
+    current_listener = NULL;
+    listener_active = 0;
+}
+
+int keyspace_listener_is_active() {
+    return listener_active;
+}
@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/log_ring.h"
+
+// Bounded multi-producer, single-consumer line queue (Vyukov-style sequence numbers per slot).
+// Writers never block or take a lock: when the ring is full the line is dropped and counted,
+// so a chatty scraper can't stall the threads feeding it or the UI draining it.
+
+typedef struct {
+    size_t sequence;  // == position when free for the writer at position, position + 1 once filled
+    size_t length;
+    char text[LOG_LINE_MAX];
+} LogSlot;
+
+static LogSlot *slots = NULL;
+static size_t slot_mask = 0;
+static size_t write_position = 0;  // Claimed by producers with CAS
+static size_t read_position = 0;   // Owned by the single consumer
+static uint64_t lines_written = 0;
+static uint64_t lines_dropped = 0;
+static uint64_t lines_drained = 0;
+
+// Allocate the ring once, before any producer starts; capacity is rounded up to a power of two
+int log_ring_init(size_t capacity) {
+    if (slots) return 0;
+
+    size_t size = 1;
+    while (size < capacity) size <<= 1;
+
+    slots = calloc(size, sizeof(LogSlot));
+    if (slots == NULL) {
+        fprintf(stderr, "Failed to allocate the output log ring\n");
+        return -1;
+    }
+    for (size_t i = 0; i < size; i++) slots[i].sequence = i;
+    slot_mask = size - 1;
+    return 0;
+}
+
+// Queue one line from any thread; returns -1 if it was dropped
+int log_ring_write(const char *line, size_t len) {
+    if (slots == NULL) return -1;
+
+    size_t position = __atomic_load_n(&write_position, __ATOMIC_RELAXED);
+    LogSlot *slot;
+    for (;;) {
+        slot = &slots[position & slot_mask];
+        size_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)position;
+
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&write_position, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if (diff < 0) {
+            __atomic_add_fetch(&lines_dropped, 1, __ATOMIC_RELAXED);  // Consumer hasn't freed this slot yet: full
+            return -1;
+        } else {
+            position = __atomic_load_n(&write_position, __ATOMIC_RELAXED);  // Another writer took it
+        }
+    }
+
+    slot->length = len < LOG_LINE_MAX ? len : LOG_LINE_MAX;
+    memcpy(slot->text, line, slot->length);
+    if (len > LOG_LINE_MAX && line[len - 1] == '\n') slot->text[LOG_LINE_MAX - 1] = '\n';  // Truncated, still a whole line
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&lines_written, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+int log_ring_is_empty() {
+    if (slots == NULL) return 1;
+    LogSlot *slot = &slots[read_position & slot_mask];
+    return __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != read_position + 1;
+}
+
+// Consumer side: copy as many complete lines as fit into dest and return the byte count.
+// Lines that don't fit stay queued for the next call.
+size_t log_ring_drain(char *dest, size_t dest_size) {
+    size_t used = 0, lines = 0;
+
+    while (!log_ring_is_empty()) {
+        LogSlot *slot = &slots[read_position & slot_mask];
+        if (used + slot->length > dest_size) break;
+
+        memcpy(dest + used, slot->text, slot->length);
+        used += slot->length;
+        lines++;
+        __atomic_store_n(&slot->sequence, read_position + slot_mask + 1, __ATOMIC_RELEASE);
+        read_position++;
+    }
+
+    __atomic_add_fetch(&lines_drained, lines, __ATOMIC_RELAXED);
+    return used;
+}
+
+void log_ring_stats(LogRingStats *stats) {
+    stats->written = __atomic_load_n(&lines_written, __ATOMIC_RELAXED);
+    stats->dropped = __atomic_load_n(&lines_dropped, __ATOMIC_RELAXED);
+    stats->drained = __atomic_load_n(&lines_drained, __ATOMIC_RELAXED);
+}
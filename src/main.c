@@ -1,11 +1,20 @@
-#include <gtk/gtk.h>
-#include "../include/gui.h"
+#include <stdio.h>
+#include <string.h>
+#include "../include/cli.h"
 #include "../include/settings.h"
+#ifndef HEADLESS
+#include "../include/gui.h"
+#endif
 
 
 int main(int argc, char *argv[]) {
-    fprintf(stderr, "Starting 4CHARK:");
     load_settings();  // Load settings at program start
+    if (argc > 1 && strcmp(argv[1], "--headless") == 0) return cli_main(argc - 1, argv + 1);
+#ifdef HEADLESS
+    return cli_main(argc, argv);  // Built without GTK: every invocation is a CLI command
+#else
+    fprintf(stderr, "Starting 4CHARK:");
     initialize_gui(argc, argv);  // Start GUI
     return 0;
+#endif
 }
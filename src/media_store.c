@@ -0,0 +1,342 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <curl/curl.h>
+#include "../include/media_store.h"
+#include "../include/settings.h"
+#include "../include/metrics.h"
+
+// Safe to call from any number of threads: files are written under a temporary name and
+// renamed into place, so a reader sees a whole object or none. Two threads storing the same
+// content write the same bytes to the same name.
+
+#define MEDIA_DOWNLOAD_MAX (8 * 1024 * 1024)  // Larger responses are not thumbnails
+#define MEDIA_TRIM_TO 0.9                     // Trim down to this share of the cap
+
+static char store_dir[256] = "";
+static size_t store_max_bytes = 0;
+static pthread_mutex_t store_lock = PTHREAD_MUTEX_INITIALIZER;  // Guards disk_bytes and trimming
+static uint64_t disk_bytes = 0;
+static uint64_t disk_hits = 0, downloads = 0, failures = 0, trimmed = 0;
+
+// --- Names -----------------------------------------------------------------------------------
+
+// FNV-1a, 128 bits wide so distinct thumbnails never share a name in practice
+static void hash_hex(const void *data, size_t length, char hex[33]) {
+    unsigned __int128 hash = ((unsigned __int128)0x6c62272e07bb0142ULL << 64) | 0x62b821756295c58dULL;
+    const unsigned __int128 prime = ((unsigned __int128)1 << 88) | 0x13b;
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < length; i++) hash = (hash ^ bytes[i]) * prime;
+    snprintf(hex, 33, "%016llx%016llx", (unsigned long long)(hash >> 64), (unsigned long long)hash);
+}
+
+static void object_path(char *buf, size_t size, const char *hex) {
+    snprintf(buf, size, "%s/objects/%.2s/%s", store_dir, hex, hex);
+}
+
+static void url_path(char *buf, size_t size, const char *url) {
+    char hex[33];
+    hash_hex(url, strlen(url), hex);
+    snprintf(buf, size, "%s/urls/%s", store_dir, hex);
+}
+
+// <base>/<board>/<tim>s.jpg: the thumbnail 4chan serves for a post's file
+void format_thumbnail_url(char *buf, size_t size, const char *board, const char *tim) {
+    snprintf(buf, size, "%s/%s/%ss.jpg", thumbnail_base_url, board, tim);
+}
+
+// --- Files -----------------------------------------------------------------------------------
+
+static int make_dir(const char *path) {
+    return mkdir(path, 0755) != 0 && errno != EEXIST ? -1 : 0;
+}
+
+static int read_whole_file(const char *path, unsigned char **data, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return -1;
+    struct stat st;
+    if (fstat(fileno(file), &st) != 0 || st.st_size > MEDIA_DOWNLOAD_MAX) {
+        fclose(file);
+        return -1;
+    }
+    *data = malloc((size_t)st.st_size + 1);
+    *length = *data ? fread(*data, 1, (size_t)st.st_size, file) : 0;
+    fclose(file);
+    if (*data == NULL || *length != (size_t)st.st_size) {
+        free(*data);
+        *data = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+// Write to <path>.<thread>.tmp, then rename over path
+static int write_whole_file(const char *path, const void *data, size_t length) {
+    char temp_path[600];
+    snprintf(temp_path, sizeof(temp_path), "%s.%lx.tmp", path, (unsigned long)pthread_self());
+    FILE *file = fopen(temp_path, "wb");
+    if (file == NULL) return -1;
+    int result = fwrite(data, 1, length, file) == length ? 0 : -1;
+    if (fclose(file) != 0) result = -1;
+    if (result == 0) result = rename(temp_path, path);
+    if (result != 0) unlink(temp_path);
+    return result;
+}
+
+typedef struct {
+    char path[600];
+    time_t used_at;
+    off_t size;
+    int is_url;      // An entry of urls/ rather than an object
+} ObjectFile;
+
+static int compare_used_at(const void *a, const void *b) {
+    const ObjectFile *x = a, *y = b;
+    return (x->used_at > y->used_at) - (x->used_at < y->used_at);
+}
+
+// Add the files of dir_path to the list
+static void list_dir(const char *dir_path, int is_url, ObjectFile **files, size_t *count, size_t *capacity, uint64_t *total) {
+    DIR *dir = opendir(dir_path);
+    struct dirent *entry;
+    while (dir && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') continue;
+        if (*count == *capacity) {
+            size_t grown_capacity = *capacity ? *capacity * 2 : 256;
+            ObjectFile *grown = realloc(*files, grown_capacity * sizeof(ObjectFile));
+            if (grown == NULL) break;
+            *files = grown;
+            *capacity = grown_capacity;
+        }
+        ObjectFile *file = &(*files)[*count];
+        snprintf(file->path, sizeof(file->path), "%s/%.40s", dir_path, entry->d_name);
+        struct stat st;
+        if (stat(file->path, &st) != 0) continue;
+        file->used_at = st.st_mtime;
+        file->size = st.st_size;
+        file->is_url = is_url;
+        *total += (uint64_t)st.st_size;
+        (*count)++;
+    }
+    if (dir) closedir(dir);
+}
+
+// Every object and URL entry with its size and last use, for trimming; the total goes to *total
+static ObjectFile *list_objects(size_t *count, uint64_t *total) {
+    char objects[300];
+    snprintf(objects, sizeof(objects), "%s/objects", store_dir);
+    *count = 0;
+    *total = 0;
+    size_t capacity = 0;
+    ObjectFile *files = NULL;
+
+    DIR *top = opendir(objects);
+    struct dirent *prefix;
+    while (top && (prefix = readdir(top)) != NULL) {
+        if (prefix->d_name[0] == '.') continue;
+        char sub[320];
+        snprintf(sub, sizeof(sub), "%s/%.2s", objects, prefix->d_name);
+        list_dir(sub, 0, &files, count, &capacity, total);
+    }
+    if (top) closedir(top);
+    char urls[300];
+    snprintf(urls, sizeof(urls), "%s/urls", store_dir);
+    list_dir(urls, 1, &files, count, &capacity, total);
+    return files;
+}
+
+// The object a URL entry names still exists
+static int url_entry_live(const char *path) {
+    char hex[64] = "", object[600];
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return 0;
+    int named = fscanf(file, "%32s", hex) == 1;
+    fclose(file);
+    if (!named) return 0;
+    object_path(object, sizeof(object), hex);
+    struct stat st;
+    return stat(object, &st) == 0;
+}
+
+// Delete the least recently used objects and URL entries until the store is back under
+// MEDIA_TRIM_TO of the cap, then the URL entries whose object is gone
+static void trim_locked() {
+    size_t count;
+    uint64_t total;
+    ObjectFile *files = list_objects(&count, &total);
+    qsort(files, count, sizeof(ObjectFile), compare_used_at);
+    uint64_t target = (uint64_t)(store_max_bytes * MEDIA_TRIM_TO);
+    size_t i = 0;
+    for (; i < count && total > target; i++) {
+        if (unlink(files[i].path) != 0) continue;
+        total -= (uint64_t)files[i].size;
+        if (!files[i].is_url) trimmed++;
+    }
+    for (; i < count; i++) {
+        if (files[i].is_url && !url_entry_live(files[i].path) && unlink(files[i].path) == 0) total -= (uint64_t)files[i].size;
+    }
+    disk_bytes = total;
+    free(files);
+}
+
+// Create the directories and measure what is already stored. Returns -1 if the store
+// can't be used; fetches then go straight to the network.
+int media_store_init(const char *dir, size_t max_bytes) {
+    snprintf(store_dir, sizeof(store_dir), "%s", dir);
+    store_max_bytes = max_bytes;
+
+    char path[300];
+    if (make_dir(store_dir) != 0) {
+        fprintf(stderr, "Failed to create %s: %s\n", store_dir, strerror(errno));
+        store_dir[0] = '\0';
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/objects", store_dir);
+    int result = make_dir(path);
+    snprintf(path, sizeof(path), "%s/urls", store_dir);
+    if (result == 0) result = make_dir(path);
+    for (int i = 0; i < 256 && result == 0; i++) {
+        snprintf(path, sizeof(path), "%s/objects/%02x", store_dir, i);
+        result = make_dir(path);
+    }
+    if (result != 0) {
+        fprintf(stderr, "Failed to create the media cache in %s: %s\n", store_dir, strerror(errno));
+        store_dir[0] = '\0';
+        return -1;
+    }
+
+    pthread_mutex_lock(&store_lock);
+    size_t count;
+    free(list_objects(&count, &disk_bytes));
+    if (store_max_bytes && disk_bytes > store_max_bytes) trim_locked();
+    pthread_mutex_unlock(&store_lock);
+    return 0;
+}
+
+// --- Fetching --------------------------------------------------------------------------------
+
+static int read_cached(const char *url, MediaBlob *blob) {
+    char path[600], hex[64] = "";
+    url_path(path, sizeof(path), url);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return -1;
+    int named = fscanf(file, "%32s", hex) == 1;
+    fclose(file);
+    if (!named) return -1;
+
+    char entry_path[600];
+    snprintf(entry_path, sizeof(entry_path), "%s", path);
+    object_path(path, sizeof(path), hex);
+    if (read_whole_file(path, &blob->data, &blob->length) != 0) return -1;
+    utimensat(AT_FDCWD, path, NULL, 0);  // Mark both used for trimming
+    utimensat(AT_FDCWD, entry_path, NULL, 0);
+    blob->from_disk = 1;
+    return 0;
+}
+
+static void store(const char *url, const MediaBlob *blob) {
+    char hex[33], path[600];
+    hash_hex(blob->data, blob->length, hex);
+    object_path(path, sizeof(path), hex);
+
+    struct stat st;
+    int exists = stat(path, &st) == 0;
+    if (!exists && write_whole_file(path, blob->data, blob->length) != 0) return;
+    url_path(path, sizeof(path), url);
+    int entry_exists = stat(path, &st) == 0;
+    int entry_written = write_whole_file(path, hex, strlen(hex)) == 0 && !entry_exists;
+    if (exists && !entry_written) return;
+
+    pthread_mutex_lock(&store_lock);
+    disk_bytes += (exists ? 0 : blob->length) + (entry_written ? strlen(hex) : 0);
+    if (store_max_bytes && disk_bytes > store_max_bytes) trim_locked();
+    pthread_mutex_unlock(&store_lock);
+}
+
+static size_t on_media_data(char *data, size_t size, size_t count, void *user_data) {
+    MediaBlob *blob = user_data;
+    size_t length = size * count;
+    if (blob->length + length > MEDIA_DOWNLOAD_MAX) return 0;  // Aborts the transfer
+    unsigned char *grown = realloc(blob->data, blob->length + length + 1);
+    if (grown == NULL) return 0;
+    blob->data = grown;
+    memcpy(blob->data + blob->length, data, length);
+    blob->length += length;
+    return length;
+}
+
+static pthread_once_t curl_once = PTHREAD_ONCE_INIT;
+
+static void init_curl() {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+}
+
+static int download(const char *url, MediaBlob *blob) {
+    pthread_once(&curl_once, init_curl);
+    CURL *curl = curl_easy_init();
+    if (curl == NULL) return -1;
+
+    char error[CURL_ERROR_SIZE] = "";
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, on_media_data);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, blob);
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "FourChanArchiver");
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, 10000L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);  // Called from worker threads
+
+    uint64_t started = metrics_begin();
+    CURLcode result = curl_easy_perform(curl);
+    metrics_end(METRIC_MEDIA_FETCH, started);
+    curl_easy_cleanup(curl);
+    if (result != CURLE_OK) {
+        fprintf(stderr, "Failed to fetch %s: %s\n", url, error[0] ? error : curl_easy_strerror(result));
+        media_blob_free(blob);
+        return -1;
+    }
+    return 0;
+}
+
+// The bytes behind url: from the disk cache, or downloaded and stored there. Blocks; call it
+// from a worker thread. Returns -1 if the download failed.
+int media_store_fetch(const char *url, MediaBlob *blob) {
+    memset(blob, 0, sizeof(*blob));
+    if (store_dir[0] && read_cached(url, blob) == 0) {
+        __atomic_add_fetch(&disk_hits, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    if (download(url, blob) != 0 || blob->length == 0) {
+        media_blob_free(blob);
+        __atomic_add_fetch(&failures, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    __atomic_add_fetch(&downloads, 1, __ATOMIC_RELAXED);
+    if (store_dir[0]) store(url, blob);
+    return 0;
+}
+
+void media_blob_free(MediaBlob *blob) {
+    free(blob->data);
+    memset(blob, 0, sizeof(*blob));
+}
+
+void media_store_stats(MediaStoreStats *stats) {
+    stats->disk_hits = __atomic_load_n(&disk_hits, __ATOMIC_RELAXED);
+    stats->downloads = __atomic_load_n(&downloads, __ATOMIC_RELAXED);
+    stats->failures = __atomic_load_n(&failures, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&store_lock);
+    stats->trimmed = trimmed;
+    stats->disk_bytes = disk_bytes;
+    pthread_mutex_unlock(&store_lock);
+}
@@ -0,0 +1,274 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../include/metrics.h"
+
+// --- Histograms ------------------------------------------------------------------------------
+
+// Log-linear buckets in nanoseconds, as in HDR histograms: values below 64 ns get a bucket
+// each, above that every power of two is split into 32 buckets, so any recorded value is
+// within about 3% of its bucket's bounds. The top bucket covers everything from ~9 hours.
+#define SUB_BUCKET_BITS 5
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define MAX_SHIFT 40
+#define BUCKETS ((MAX_SHIFT + 2) * SUB_BUCKETS)
+
+typedef struct {
+    uint64_t buckets[BUCKETS];
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+} Histogram;
+
+static Histogram histograms[METRIC_COUNT];
+
+static const struct {
+    const char *name;
+    const char *label;
+} metric_names[METRIC_COUNT] = {
+    [METRIC_REDIS_COMMAND] = { "redis_command", "Redis command (worker)" },
+    [METRIC_REDIS_PIPELINE] = { "redis_pipeline_reply", "Redis pipelined reply wait" },
+    [METRIC_REDIS_ASYNC] = { "redis_async_command", "Redis command (main loop)" },
+    [METRIC_SCRAPER_EXEC] = { "scraper_exec", "Scraper process (docker exec)" },
+    [METRIC_SCRAPER_RPC] = { "scraper_rpc", "Scraper worker request" },
+    [METRIC_SCRAPER_BACKEND] = { "scraper_backend", "Scraper Python run time" },
+    [METRIC_LIST_REBUILD] = { "list_rebuild", "Thread list rebuild" },
+    [METRIC_OUTPUT_DRAIN] = { "output_drain", "Output pane drain" },
+    [METRIC_UPDATE_FLUSH] = { "update_flush", "Keyspace update flush" },
+    [METRIC_MEDIA_FETCH] = { "media_fetch", "Thumbnail download" },
+    [METRIC_THUMBNAIL_DECODE] = { "thumbnail_decode", "Thumbnail decode" },
+    [METRIC_POST_DECODE] = { "post_decode", "Post decompress" },
+    [METRIC_THREAD_LISTING] = { "thread_listing", "Board listing" },
+};
+
+uint64_t metrics_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static unsigned bucket_index(uint64_t value) {
+    if (value < 2 * SUB_BUCKETS) return (unsigned)value;
+    unsigned shift = 63 - __builtin_clzll(value) - SUB_BUCKET_BITS;
+    if (shift > MAX_SHIFT) return BUCKETS - 1;
+    return (shift + 1) * SUB_BUCKETS + (unsigned)(value >> shift) - SUB_BUCKETS;
+}
+
+// Largest value that lands in the bucket
+static uint64_t bucket_upper_bound(unsigned index) {
+    if (index < 2 * SUB_BUCKETS) return index;
+    unsigned shift = index / SUB_BUCKETS - 1;
+    uint64_t top = index % SUB_BUCKETS + SUB_BUCKETS;
+    return ((top + 1) << shift) - 1;
+}
+
+void metrics_record_ns(MetricId id, uint64_t elapsed_ns) {
+    Histogram *histogram = &histograms[id];
+    __atomic_fetch_add(&histogram->buckets[bucket_index(elapsed_ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->count, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->sum_ns, elapsed_ns, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&histogram->max_ns, __ATOMIC_RELAXED);
+    while (elapsed_ns > max &&
+           !__atomic_compare_exchange_n(&histogram->max_ns, &max, elapsed_ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {}
+}
+
+// Reads race with recording; a summary may be a few samples behind, which is fine for display
+void metrics_summarize(MetricId id, MetricSummary *summary) {
+    const Histogram *histogram = &histograms[id];
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    double *targets[] = { &summary->p50_ms, &summary->p90_ms, &summary->p99_ms, &summary->p999_ms };
+
+    memset(summary, 0, sizeof(*summary));
+    summary->name = metric_names[id].name;
+    summary->label = metric_names[id].label;
+
+    uint64_t counts[BUCKETS];
+    uint64_t total = 0;
+    for (unsigned i = 0; i < BUCKETS; i++) {
+        counts[i] = __atomic_load_n(&histogram->buckets[i], __ATOMIC_RELAXED);
+        total += counts[i];
+    }
+    if (total == 0) return;
+
+    uint64_t max_ns = __atomic_load_n(&histogram->max_ns, __ATOMIC_RELAXED);
+    summary->count = total;
+    summary->sum_ms = __atomic_load_n(&histogram->sum_ns, __ATOMIC_RELAXED) / 1e6;
+    summary->max_ms = max_ns / 1e6;
+
+    uint64_t seen = 0;
+    unsigned q = 0;
+    for (unsigned i = 0; i < BUCKETS && q < 4; i++) {
+        seen += counts[i];
+        while (q < 4 && seen >= (uint64_t)(quantiles[q] * total + 0.5) && seen > 0) {
+            uint64_t bound = bucket_upper_bound(i);
+            *targets[q++] = (bound < max_ns ? bound : max_ns) / 1e6;
+        }
+    }
+}
+
+void metrics_reset() {
+    for (int id = 0; id < METRIC_COUNT; id++) {
+        Histogram *histogram = &histograms[id];
+        for (unsigned i = 0; i < BUCKETS; i++) __atomic_store_n(&histogram->buckets[i], 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&histogram->count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&histogram->sum_ns, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&histogram->max_ns, 0, __ATOMIC_RELAXED);
+    }
+}
+
+// --- Prometheus export -----------------------------------------------------------------------
+
+// One summary per operation, in seconds
+void metrics_write_prometheus(FILE *out) {
+    for (int id = 0; id < METRIC_COUNT; id++) {
+        MetricSummary summary;
+        metrics_summarize(id, &summary);
+        const char *name = summary.name;
+        fprintf(out, "# HELP fourchan_archiver_%s_seconds %s\n", name, summary.label);
+        fprintf(out, "# TYPE fourchan_archiver_%s_seconds summary\n", name);
+        fprintf(out, "fourchan_archiver_%s_seconds{quantile=\"0.5\"} %.9f\n", name, summary.p50_ms / 1000);
+        fprintf(out, "fourchan_archiver_%s_seconds{quantile=\"0.9\"} %.9f\n", name, summary.p90_ms / 1000);
+        fprintf(out, "fourchan_archiver_%s_seconds{quantile=\"0.99\"} %.9f\n", name, summary.p99_ms / 1000);
+        fprintf(out, "fourchan_archiver_%s_seconds{quantile=\"0.999\"} %.9f\n", name, summary.p999_ms / 1000);
+        fprintf(out, "fourchan_archiver_%s_seconds_sum %.9f\n", name, summary.sum_ms / 1000);
+        fprintf(out, "fourchan_archiver_%s_seconds_count %llu\n", name, (unsigned long long)summary.count);
+    }
+}
+
+static pthread_t export_thread;
+static int export_running = 0;
+static int export_stopping = 0;
+static pthread_mutex_t export_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t export_wake = PTHREAD_COND_INITIALIZER;
+static char export_path[256];
+static int export_interval_s = 10;
+static int export_socket = -1;  // Listening socket in unix: mode
+
+// Write to a temporary file and rename it, so a scraper never reads a half-written file
+static void export_file() {
+    char temporary[300];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", export_path);
+    FILE *out = fopen(temporary, "w");
+    if (out == NULL) {
+        fprintf(stderr, "Cannot write metrics to %s: %s\n", temporary, strerror(errno));
+        return;
+    }
+    metrics_write_prometheus(out);
+    if (fclose(out) != 0 || rename(temporary, export_path) != 0) {
+        fprintf(stderr, "Cannot write metrics to %s: %s\n", export_path, strerror(errno));
+    }
+}
+
+static void serve_client(int fd) {
+    char *text = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&text, &length);
+    if (out) {
+        metrics_write_prometheus(out);
+        fclose(out);
+        for (size_t written = 0; written < length;) {
+            ssize_t n = write(fd, text + written, length - written);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            written += (size_t)n;
+        }
+        free(text);
+    }
+    close(fd);
+}
+
+static void *export_main(void *arg) {
+    pthread_mutex_lock(&export_lock);
+    while (!export_stopping) {
+        if (export_socket >= 0) {
+            pthread_mutex_unlock(&export_lock);
+            struct pollfd pfd = { export_socket, POLLIN, 0 };
+            if (poll(&pfd, 1, 500) > 0) {
+                int fd = accept(export_socket, NULL, NULL);
+                if (fd >= 0) serve_client(fd);
+            }
+            pthread_mutex_lock(&export_lock);
+            continue;
+        }
+
+        pthread_mutex_unlock(&export_lock);
+        export_file();
+        pthread_mutex_lock(&export_lock);
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += export_interval_s;
+        while (!export_stopping && pthread_cond_timedwait(&export_wake, &export_lock, &deadline) != ETIMEDOUT) {}
+    }
+    pthread_mutex_unlock(&export_lock);
+    return NULL;
+}
+
+static int open_export_socket(const char *path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Metrics socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    unlink(path);  // A socket left behind by a previous run
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(fd, 4) != 0) {
+        fprintf(stderr, "Cannot listen for metrics on %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int metrics_export_start(const char *target, int interval_s) {
+    if (target == NULL || *target == '\0' || export_running) return 0;
+
+    int is_socket = strncmp(target, "unix:", 5) == 0;
+    snprintf(export_path, sizeof(export_path), "%s", is_socket ? target + 5 : target);
+    export_interval_s = interval_s > 0 ? interval_s : 10;
+    export_socket = is_socket ? open_export_socket(export_path) : -1;
+    if (is_socket && export_socket < 0) return -1;
+
+    export_stopping = 0;
+    if (pthread_create(&export_thread, NULL, export_main, NULL) != 0) {
+        if (export_socket >= 0) close(export_socket);
+        export_socket = -1;
+        return -1;
+    }
+    export_running = 1;
+    return 0;
+}
+
+// Stops the exporter; a file target gets one final write
+void metrics_export_stop() {
+    if (!export_running) return;
+    pthread_mutex_lock(&export_lock);
+    export_stopping = 1;
+    pthread_cond_signal(&export_wake);
+    pthread_mutex_unlock(&export_lock);
+    pthread_join(export_thread, NULL);
+    export_running = 0;
+
+    if (export_socket >= 0) {
+        close(export_socket);
+        unlink(export_path);
+        export_socket = -1;
+    } else {
+        export_file();
+    }
+}
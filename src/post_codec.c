@@ -0,0 +1,716 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
+#include <zstd.h>
+#include <zdict.h>
+#include "../include/post_codec.h"
+#include "../include/settings.h"
+#include "../include/metrics.h"
+
+// Dictionaries are loaded from Redis on first use and kept until exit; each is immutable once
+// stored, so a frame naming an ID always decodes with the same bytes. Compression contexts
+// are expensive to set up, so idle ones are pooled rather than made per entry.
+
+#define DICTIONARY_SIZE (112 * 1024)           // zstd's recommended size for small records
+#define TRAINING_BYTES (8 * 1024 * 1024)       // Posts sampled to train a dictionary
+#define TRAINING_MIN_SAMPLES 100               // Fewer posts than this train nothing useful
+#define RECOMPRESS_BATCH 32                    // Threads whose posts are read per pipelined round-trip
+#define RECOMPRESS_PUSH 512                    // Entries per RPUSH when a list is written back
+#define DECODED_MAX (64u * 1024 * 1024)        // Larger frame content sizes are treated as corrupt
+#define CONTEXTS_IDLE_MAX 16
+
+typedef struct {
+    uint32_t id;
+    ZSTD_DDict *ddict;
+} Dictionary;
+
+typedef struct BoardCodec {
+    PostCodecStats stats;       // stats.board names the board, stats.dictionary_id the current dictionary
+    int current_loaded;         // "current" has been read from Redis
+    ZSTD_CDict *cdict;          // For stats.dictionary_id; NULL without one
+    ZSTD_CDict **retired;       // Replaced by a retrain; another thread may still be using them
+    size_t retired_count;
+    Dictionary *dictionaries;
+    size_t dictionary_count;
+    struct BoardCodec *next;
+} BoardCodec;
+
+static pthread_mutex_t codecs_lock = PTHREAD_MUTEX_INITIALIZER;
+static BoardCodec *codecs = NULL;
+static ZSTD_CCtx *idle_cctx[CONTEXTS_IDLE_MAX];
+static ZSTD_DCtx *idle_dctx[CONTEXTS_IDLE_MAX];
+static size_t idle_cctx_count = 0, idle_dctx_count = 0;
+
+void format_post_dict_key(char *buf, size_t size, const char *board) {
+    snprintf(buf, size, "{%s_zstd}_dicts", board);
+}
+
+int post_codec_is_compressed(const char *value, size_t length) {
+    return length > 1 && (unsigned char)value[0] == POST_CODEC_MAGIC;
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// --- Contexts --------------------------------------------------------------------------------
+
+static ZSTD_CCtx *acquire_cctx() {
+    ZSTD_CCtx *cctx = NULL;
+    pthread_mutex_lock(&codecs_lock);
+    if (idle_cctx_count > 0) cctx = idle_cctx[--idle_cctx_count];
+    pthread_mutex_unlock(&codecs_lock);
+    return cctx ? cctx : ZSTD_createCCtx();
+}
+
+static void release_cctx(ZSTD_CCtx *cctx) {
+    pthread_mutex_lock(&codecs_lock);
+    if (idle_cctx_count < CONTEXTS_IDLE_MAX) {
+        idle_cctx[idle_cctx_count++] = cctx;
+        cctx = NULL;
+    }
+    pthread_mutex_unlock(&codecs_lock);
+    ZSTD_freeCCtx(cctx);
+}
+
+static ZSTD_DCtx *acquire_dctx() {
+    ZSTD_DCtx *dctx = NULL;
+    pthread_mutex_lock(&codecs_lock);
+    if (idle_dctx_count > 0) dctx = idle_dctx[--idle_dctx_count];
+    pthread_mutex_unlock(&codecs_lock);
+    return dctx ? dctx : ZSTD_createDCtx();
+}
+
+static void release_dctx(ZSTD_DCtx *dctx) {
+    pthread_mutex_lock(&codecs_lock);
+    if (idle_dctx_count < CONTEXTS_IDLE_MAX) {
+        idle_dctx[idle_dctx_count++] = dctx;
+        dctx = NULL;
+    }
+    pthread_mutex_unlock(&codecs_lock);
+    ZSTD_freeDCtx(dctx);
+}
+
+// --- Dictionaries ----------------------------------------------------------------------------
+
+// The board's entry, created on first use; called with codecs_lock held
+static BoardCodec *find_codec(const char *board) {
+    BoardCodec *codec = codecs;
+    while (codec && strcmp(codec->stats.board, board) != 0) codec = codec->next;
+    if (codec == NULL && (codec = calloc(1, sizeof(BoardCodec))) != NULL) {
+        snprintf(codec->stats.board, sizeof(codec->stats.board), "%s", board);
+        codec->next = codecs;
+        codecs = codec;
+    }
+    return codec;
+}
+
+// Called with codecs_lock held
+static ZSTD_DDict *find_dictionary(const BoardCodec *codec, uint32_t id) {
+    for (size_t i = 0; i < codec->dictionary_count; i++) {
+        if (codec->dictionaries[i].id == id) return codec->dictionaries[i].ddict;
+    }
+    return NULL;
+}
+
+int post_codec_add_dictionary(const char *board, uint32_t id, const char *data, size_t length) {
+    if (id == 0 || ZSTD_getDictID_fromDict(data, length) != id) {
+        fprintf(stderr, "Dictionary %" PRIu32 " of /%s/ is damaged\n", id, board);
+        return -1;
+    }
+    ZSTD_DDict *ddict = ZSTD_createDDict(data, length);
+    if (ddict == NULL) return -1;
+
+    pthread_mutex_lock(&codecs_lock);
+    BoardCodec *codec = find_codec(board);
+    Dictionary *grown = codec && find_dictionary(codec, id) == NULL
+                            ? realloc(codec->dictionaries, (codec->dictionary_count + 1) * sizeof(Dictionary))
+                            : NULL;
+    if (grown) {
+        codec->dictionaries = grown;
+        codec->dictionaries[codec->dictionary_count++] = (Dictionary){ id, ddict };
+        ddict = NULL;
+    }
+    pthread_mutex_unlock(&codecs_lock);
+    ZSTD_freeDDict(ddict);  // Already loaded by another thread
+    return codec ? 0 : -1;
+}
+
+// Read one field of the board's dictionary hash; NULL if it is missing or Redis failed
+static char *read_dict_field(const char *board, const char *field, size_t *length) {
+    RedisBatch *batch = redis_batch_new(REDIS_ROUTE_PRIMARY);
+    if (batch == NULL) return NULL;
+    char key[320];
+    format_post_dict_key(key, sizeof(key), board);
+    size_t index = redis_batch_append(batch, key, "HMGET %s %s", key, field);
+    char *value = NULL;
+    if (redis_batch_execute(batch) == 0) {
+        const redisReply *reply = redis_batch_reply(batch, index);
+        if (reply->type == REDIS_REPLY_ARRAY && reply->elements == 1 && reply->element[0]->type == REDIS_REPLY_STRING &&
+            (value = malloc(reply->element[0]->len + 1)) != NULL) {
+            memcpy(value, reply->element[0]->str, reply->element[0]->len + 1);
+            *length = reply->element[0]->len;
+        }
+    }
+    redis_batch_free(batch);
+    return value;
+}
+
+// The board's entry; entries live until post_codec_shutdown, so the pointer can be kept
+static BoardCodec *codec_for(const char *board) {
+    pthread_mutex_lock(&codecs_lock);
+    BoardCodec *codec = find_codec(board);
+    pthread_mutex_unlock(&codecs_lock);
+    return codec;
+}
+
+static ZSTD_DDict *loaded_dictionary(BoardCodec *codec, uint32_t id) {
+    pthread_mutex_lock(&codecs_lock);
+    ZSTD_DDict *ddict = find_dictionary(codec, id);
+    pthread_mutex_unlock(&codecs_lock);
+    return ddict;
+}
+
+// The decoder dictionary for id, read from Redis if it isn't loaded yet
+static ZSTD_DDict *load_dictionary(BoardCodec *codec, uint32_t id) {
+    const char *board = codec->stats.board;
+    ZSTD_DDict *ddict = loaded_dictionary(codec, id);
+    if (ddict) return ddict;
+
+    char field[16];
+    size_t length = 0;
+    snprintf(field, sizeof(field), "%" PRIu32, id);
+    char *data = read_dict_field(board, field, &length);
+    if (data == NULL) {
+        fprintf(stderr, "Dictionary %" PRIu32 " of /%s/ is missing; its posts can't be read\n", id, board);
+        return NULL;
+    }
+    post_codec_add_dictionary(board, id, data, length);
+    free(data);
+    return loaded_dictionary(codec, id);
+}
+
+// Make id the dictionary new entries are written with; 0 writes plain zstd frames
+static void set_current(const char *board, uint32_t id, const char *data, size_t length) {
+    ZSTD_CDict *cdict = id ? ZSTD_createCDict(data, length, compress_level) : NULL;
+    pthread_mutex_lock(&codecs_lock);
+    BoardCodec *codec = find_codec(board);
+    ZSTD_CDict **retired = codec && codec->cdict ? realloc(codec->retired, (codec->retired_count + 1) * sizeof(ZSTD_CDict *)) : NULL;
+    if (retired) {
+        codec->retired = retired;
+        codec->retired[codec->retired_count++] = codec->cdict;
+    }
+    if (codec && (codec->cdict == NULL || retired)) {
+        codec->cdict = cdict;
+        codec->stats.dictionary_id = cdict ? id : 0;
+        __atomic_store_n(&codec->current_loaded, 1, __ATOMIC_RELEASE);
+        cdict = NULL;
+    }
+    pthread_mutex_unlock(&codecs_lock);
+    ZSTD_freeCDict(cdict);
+}
+
+// The board's codec with its current dictionary loaded; NULL if memory ran out
+static BoardCodec *current_codec(const char *board) {
+    BoardCodec *codec = codec_for(board);
+    if (codec == NULL || __atomic_load_n(&codec->current_loaded, __ATOMIC_ACQUIRE)) return codec;
+
+    size_t length = 0;
+    char *current = read_dict_field(board, "current", &length);
+    uint32_t id = current ? (uint32_t)strtoul(current, NULL, 10) : 0;
+    free(current);
+    if (id != 0 && id == __atomic_load_n(&codec->stats.dictionary_id, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&codec->current_loaded, 1, __ATOMIC_RELEASE);  // Reloaded and unchanged
+        return codec;
+    }
+    char field[16];
+    snprintf(field, sizeof(field), "%" PRIu32, id);
+    char *data = id ? read_dict_field(board, field, &length) : NULL;
+    if (data) post_codec_add_dictionary(board, id, data, length);
+    set_current(board, data ? id : 0, data, length);
+    free(data);
+    return codec;
+}
+
+// "current" is cached once read; a retrain elsewhere changes it in Redis only. The dictionaries
+// already loaded stay, since entries name their own.
+void post_codec_reload_current(const char *board) {
+    pthread_mutex_lock(&codecs_lock);
+    BoardCodec *codec = find_codec(board);
+    if (codec) __atomic_store_n(&codec->current_loaded, 0, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&codecs_lock);
+}
+
+// --- Encoding and decoding -------------------------------------------------------------------
+
+// Compress with the board's current dictionary. Entries that don't get smaller are left as they
+// are: *out stays NULL and the caller stores text.
+static int encode_value(BoardCodec *codec, const char *text, size_t length, char **out, size_t *out_length) {
+    *out = NULL;
+    size_t capacity = 1 + ZSTD_compressBound(length);
+    char *buffer = malloc(capacity);
+    ZSTD_CCtx *cctx = buffer ? acquire_cctx() : NULL;
+    if (cctx == NULL) {
+        free(buffer);
+        return -1;
+    }
+
+    pthread_mutex_lock(&codecs_lock);
+    const ZSTD_CDict *cdict = codec->cdict;  // Kept alive after a retrain, see set_current
+    pthread_mutex_unlock(&codecs_lock);
+    buffer[0] = (char)POST_CODEC_MAGIC;
+    size_t written = cdict ? ZSTD_compress_usingCDict(cctx, buffer + 1, capacity - 1, text, length, cdict)
+                           : ZSTD_compressCCtx(cctx, buffer + 1, capacity - 1, text, length, compress_level);
+    release_cctx(cctx);
+    if (ZSTD_isError(written)) {
+        fprintf(stderr, "Compressing a post of /%s/ failed: %s\n", codec->stats.board, ZSTD_getErrorName(written));
+        free(buffer);
+        return -1;
+    }
+
+    __atomic_add_fetch(&codec->stats.encoded, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&codec->stats.encoded_in_bytes, length, __ATOMIC_RELAXED);
+    if (written + 1 >= length) {
+        __atomic_add_fetch(&codec->stats.encoded_out_bytes, length, __ATOMIC_RELAXED);
+        free(buffer);
+        return 0;
+    }
+    __atomic_add_fetch(&codec->stats.encoded_out_bytes, written + 1, __ATOMIC_RELAXED);
+    *out = buffer;
+    *out_length = written + 1;
+    return 0;
+}
+
+// With compress_posts off this is a no-op: *out stays NULL and the caller stores text as is
+int post_codec_encode(const char *board, const char *text, size_t length, char **out, size_t *out_length) {
+    *out = NULL;
+    if (!compress_posts) return 0;
+    BoardCodec *codec = current_codec(board);
+    return codec ? encode_value(codec, text, length, out, out_length) : -1;
+}
+
+static int decode_frame(BoardCodec *codec, const char *value, size_t length, char **out, size_t *out_length, int may_load) {
+    const char *board = codec->stats.board;
+    const char *frame = value + 1;
+    size_t frame_length = length - 1;
+    unsigned long long size = ZSTD_getFrameContentSize(frame, frame_length);
+    if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN || size > DECODED_MAX) {
+        fprintf(stderr, "A post of /%s/ is not a valid compressed entry\n", board);
+        return -1;
+    }
+
+    uint32_t id = ZSTD_getDictID_fromFrame(frame, frame_length);
+    ZSTD_DDict *ddict = NULL;
+    if (id && (ddict = may_load ? load_dictionary(codec, id) : loaded_dictionary(codec, id)) == NULL) return -1;
+
+    char *text = malloc(size + 1);
+    ZSTD_DCtx *dctx = text ? acquire_dctx() : NULL;
+    if (dctx == NULL) {
+        free(text);
+        return -1;
+    }
+    uint64_t started = now_ns(), timed = metrics_begin();
+    size_t decoded = ddict ? ZSTD_decompress_usingDDict(dctx, text, size, frame, frame_length, ddict)
+                           : ZSTD_decompressDCtx(dctx, text, size, frame, frame_length);
+    metrics_end(METRIC_POST_DECODE, timed);
+    uint64_t elapsed = now_ns() - started;
+    release_dctx(dctx);
+    if (ZSTD_isError(decoded) || decoded != size) {
+        fprintf(stderr, "Decompressing a post of /%s/ failed: %s\n", board, ZSTD_isError(decoded) ? ZSTD_getErrorName(decoded) : "short frame");
+        free(text);
+        return -1;
+    }
+    text[size] = '\0';  // Readers treat posts as strings, as hiredis hands them out
+    *out = text;
+    *out_length = size;
+
+    __atomic_add_fetch(&codec->stats.decoded, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&codec->stats.decoded_in_bytes, length, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&codec->stats.decoded_out_bytes, size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&codec->stats.decode_ns, elapsed, __ATOMIC_RELAXED);
+    return 0;
+}
+
+// Decode a stored entry. A plain entry is left alone and *out set to NULL; otherwise *out is
+// the text, NUL-terminated, for the caller to free. -1 if it can't be decoded.
+int post_codec_decode(const char *board, const char *value, size_t length, char **out, size_t *out_length) {
+    *out = NULL;
+    if (!post_codec_is_compressed(value, length)) return 0;
+    BoardCodec *codec = codec_for(board);
+    return codec ? decode_frame(codec, value, length, out, out_length, 1) : -1;
+}
+
+// Point each compressed entry of posts at its decoded text. *decoded owns those buffers and is
+// NULL when no entry was compressed; free it with post_codec_free_decoded.
+int post_codec_decode_all(const char *board, const char **posts, size_t *lengths, size_t n, char ***decoded) {
+    *decoded = NULL;
+    BoardCodec *codec = NULL;
+    for (size_t i = 0; i < n; i++) {
+        if (!post_codec_is_compressed(posts[i], lengths[i])) continue;
+        if (*decoded == NULL && (*decoded = calloc(n, sizeof(char *))) == NULL) return -1;
+        if (codec == NULL && (codec = codec_for(board)) == NULL) return -1;
+        if (decode_frame(codec, posts[i], lengths[i], &(*decoded)[i], &lengths[i], 1) != 0) {
+            post_codec_free_decoded(*decoded, n);
+            *decoded = NULL;
+            return -1;
+        }
+        posts[i] = (*decoded)[i];
+    }
+    return 0;
+}
+
+void post_codec_free_decoded(char **decoded, size_t n) {
+    for (size_t i = 0; decoded && i < n; i++) free(decoded[i]);
+    free(decoded);
+}
+
+static int decode_page(const char *board, ThreadPostPage *page, int may_load) {
+    BoardCodec *codec = NULL;
+    for (size_t i = 0; i < page->count; i++) {
+        char *text;
+        size_t length;
+        if (!post_codec_is_compressed(page->posts[i], page->lengths[i])) continue;
+        if (codec == NULL && (codec = codec_for(board)) == NULL) return -1;
+        if (decode_frame(codec, page->posts[i], page->lengths[i], &text, &length, may_load) != 0) return -1;
+        free(page->posts[i]);
+        page->posts[i] = text;
+        page->lengths[i] = length;
+    }
+    return 0;
+}
+
+// Replace the page's compressed entries by their text, loading dictionaries as needed
+int post_codec_decode_page(const char *board, ThreadPostPage *page) {
+    return decode_page(board, page, 1);
+}
+
+uint32_t post_codec_missing_dictionary(const char *board, const ThreadPostPage *page) {
+    uint32_t missing = 0;
+    pthread_mutex_lock(&codecs_lock);
+    BoardCodec *codec = find_codec(board);
+    for (size_t i = 0; codec && i < page->count && missing == 0; i++) {
+        if (!post_codec_is_compressed(page->posts[i], page->lengths[i])) continue;
+        uint32_t id = ZSTD_getDictID_fromFrame(page->posts[i] + 1, page->lengths[i] - 1);
+        if (id && find_dictionary(codec, id) == NULL) missing = id;
+    }
+    pthread_mutex_unlock(&codecs_lock);
+    return missing;
+}
+
+// --- Recompression ---------------------------------------------------------------------------
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+    size_t *sizes;
+    size_t count;
+    size_t size_capacity;
+} Samples;
+
+static int add_sample(Samples *samples, const char *post, size_t length) {
+    if (samples->length + length > TRAINING_BYTES) return 0;
+    if (samples->count == samples->size_capacity) {
+        size_t capacity = samples->size_capacity ? samples->size_capacity * 2 : 4096;
+        size_t *sizes = realloc(samples->sizes, capacity * sizeof(size_t));
+        if (sizes == NULL) return 0;
+        samples->sizes = sizes;
+        samples->size_capacity = capacity;
+    }
+    memcpy(samples->data + samples->length, post, length);
+    samples->length += length;
+    samples->sizes[samples->count++] = length;
+    return 1;
+}
+
+// The posts of each thread of ids, one LRANGE per thread in one pipeline
+static int read_lists(RedisBatch *reads, const char *board, char (*ids)[THREAD_ID_MAX], size_t n) {
+    redis_batch_clear(reads);
+    for (size_t i = 0; i < n; i++) {
+        char key[320];
+        format_thread_key(key, sizeof(key), board, ids[i], "posts");
+        redis_batch_append(reads, key, "LRANGE %s 0 -1", key);
+    }
+    return redis_batch_execute(reads);
+}
+
+// Copy a list reply's entries into posts and lengths, which hold reply->elements; returns the count
+static size_t list_entries(const redisReply *list, const char **posts, size_t *lengths) {
+    size_t n = 0;
+    for (size_t i = 0; list->type == REDIS_REPLY_ARRAY && i < list->elements; i++) {
+        if (list->element[i]->type != REDIS_REPLY_STRING) continue;
+        posts[n] = list->element[i]->str;
+        lengths[n++] = list->element[i]->len;
+    }
+    return n;
+}
+
+// Train a dictionary on posts sampled from the first threads of ids, store it and make it
+// current. 0 with *id left at 0 if there were too few posts to train on.
+static int train_dictionary(const char *board, char (*ids)[THREAD_ID_MAX], size_t n, const int *cancelled, uint32_t *id,
+                            unsigned *round_trips) {
+    *id = 0;
+    Samples samples = { malloc(TRAINING_BYTES) };
+    RedisBatch *reads = samples.data ? redis_batch_new(REDIS_ROUTE_READ) : NULL;
+    int status = reads ? 0 : -1;
+    int full = 0;
+
+    for (size_t first = 0; status == 0 && !full && first < n; first += RECOMPRESS_BATCH) {
+        if (cancelled && __atomic_load_n(cancelled, __ATOMIC_RELAXED)) status = -1;
+        size_t batch = n - first < RECOMPRESS_BATCH ? n - first : RECOMPRESS_BATCH;
+        if (status == 0) status = read_lists(reads, board, ids + first, batch);
+        (*round_trips)++;
+        for (size_t i = 0; status == 0 && i < batch && !full; i++) {
+            const redisReply *list = redis_batch_reply(reads, i);
+            size_t count = list->type == REDIS_REPLY_ARRAY ? list->elements : 0;
+            const char **posts = malloc((count + 1) * sizeof(char *));
+            size_t *lengths = malloc((count + 1) * sizeof(size_t));
+            char **decoded = NULL;
+            if (posts == NULL || lengths == NULL) status = -1;
+            else count = list_entries(list, posts, lengths);
+            if (status == 0) status = post_codec_decode_all(board, posts, lengths, count, &decoded);
+            for (size_t j = 0; status == 0 && j < count && !full; j++) full = !add_sample(&samples, posts[j], lengths[j]);
+            post_codec_free_decoded(decoded, count);
+            free(posts);
+            free(lengths);
+        }
+    }
+
+    if (status == 0 && samples.count < TRAINING_MIN_SAMPLES) {
+        fprintf(stderr, "/%s/ has %zu posts, too few to train a dictionary; compressing without one\n", board, samples.count);
+    } else if (status == 0) {
+        char *dictionary = malloc(DICTIONARY_SIZE);
+        size_t size = dictionary ? ZDICT_trainFromBuffer(dictionary, DICTIONARY_SIZE, samples.data, samples.sizes, (unsigned)samples.count) : 0;
+        if (dictionary == NULL) {
+            status = -1;
+        } else if (ZDICT_isError(size)) {
+            fprintf(stderr, "Training a dictionary for /%s/ failed: %s; compressing without one\n", board, ZDICT_getErrorName(size));
+        } else {
+            *id = ZSTD_getDictID_fromDict(dictionary, size);
+            char key[320], field[16];
+            format_post_dict_key(key, sizeof(key), board);
+            snprintf(field, sizeof(field), "%" PRIu32, *id);
+            const char *argv[] = { "HSET", key, field, dictionary, "current", field };
+            size_t argvlen[] = { 4, strlen(key), strlen(field), size, 7, strlen(field) };
+            RedisBatch *writes = redis_batch_new(REDIS_ROUTE_PRIMARY);
+            size_t index = writes ? redis_batch_append_argv(writes, key, 6, argv, argvlen) : 0;
+            if (writes == NULL || redis_batch_execute(writes) != 0 || redis_batch_reply(writes, index)->type == REDIS_REPLY_ERROR) {
+                fprintf(stderr, "Storing the dictionary of /%s/ failed\n", board);
+                status = -1;
+            } else {
+                post_codec_add_dictionary(board, *id, dictionary, size);
+                set_current(board, *id, dictionary, size);
+            }
+            (*round_trips)++;
+            redis_batch_free(writes);
+        }
+        free(dictionary);
+    }
+
+    redis_batch_free(reads);
+    free(samples.sizes);
+    free(samples.data);
+    return status;
+}
+
+// Append the commands that replace the list at key with posts: they go to a staging list that
+// shares the key's hash slot, which is then renamed over it
+static int append_list_rewrite(RedisBatch *writes, const char *key, const char **posts, const size_t *lengths, size_t n) {
+    char staging[340];
+    snprintf(staging, sizeof(staging), "{%s}_recompress", key);
+    redis_batch_append(writes, staging, "DEL %s", staging);
+
+    const char **argv = malloc((RECOMPRESS_PUSH + 2) * sizeof(char *));
+    size_t *argvlen = malloc((RECOMPRESS_PUSH + 2) * sizeof(size_t));
+    if (argv == NULL || argvlen == NULL) {
+        free(argv);
+        free(argvlen);
+        return -1;
+    }
+    argv[0] = "RPUSH";
+    argvlen[0] = 5;
+    argv[1] = staging;
+    argvlen[1] = strlen(staging);
+    for (size_t first = 0; first < n; first += RECOMPRESS_PUSH) {
+        size_t chunk = n - first < RECOMPRESS_PUSH ? n - first : RECOMPRESS_PUSH;
+        memcpy(argv + 2, posts + first, chunk * sizeof(char *));
+        memcpy(argvlen + 2, lengths + first, chunk * sizeof(size_t));
+        redis_batch_append_argv(writes, staging, (int)chunk + 2, argv, argvlen);
+    }
+    free(argv);
+    free(argvlen);
+    redis_batch_append(writes, staging, "RENAME %s %s", staging, key);
+    return 0;
+}
+
+// Whether every entry is already compressed with the current dictionary
+static int list_is_current(const char **posts, const size_t *lengths, size_t n, uint32_t id) {
+    for (size_t i = 0; i < n; i++) {
+        if (!post_codec_is_compressed(posts[i], lengths[i])) return 0;
+        if (ZSTD_getDictID_fromFrame(posts[i] + 1, lengths[i] - 1) != id) return 0;
+    }
+    return 1;
+}
+
+// Recompress one thread's entries and queue the rewrite, unless every entry comes out as it
+// was stored (posts too short to shrink stay plain); adds to stats->bytes_after. 1 if rewritten.
+static int recompress_list(RedisBatch *writes, BoardCodec *codec, const char *key, const char **posts, size_t *lengths,
+                           size_t n, PostRecompressStats *stats) {
+    char **decoded = NULL, **encoded = calloc(n + 1, sizeof(char *));
+    const char **stored = malloc((n + 1) * sizeof(char *));
+    size_t *stored_lengths = malloc((n + 1) * sizeof(size_t));
+    int status = encoded && stored && stored_lengths ? 0 : -1;
+    if (status == 0) {
+        memcpy(stored, posts, n * sizeof(char *));
+        memcpy(stored_lengths, lengths, n * sizeof(size_t));
+        status = post_codec_decode_all(codec->stats.board, posts, lengths, n, &decoded);
+    }
+
+    int changed = 0;
+    for (size_t i = 0; status == 0 && i < n; i++) {
+        size_t length;
+        status = encode_value(codec, posts[i], lengths[i], &encoded[i], &length);
+        if (status == 0 && encoded[i]) {
+            posts[i] = encoded[i];
+            lengths[i] = length;
+        }
+        changed = changed || lengths[i] != stored_lengths[i] || memcmp(posts[i], stored[i], lengths[i]) != 0;
+        stats->bytes_after += lengths[i];
+    }
+    if (status == 0 && changed) status = append_list_rewrite(writes, key, posts, lengths, n);
+    post_codec_free_decoded(encoded, n);
+    post_codec_free_decoded(decoded, n);
+    free(stored);
+    free(stored_lengths);
+    return status == 0 ? changed : -1;
+}
+
+// Train a dictionary for the board if it has none (or retrain is set), then rewrite every post
+// list that has entries stored plain or under an older dictionary. Lists are read in
+// pipelines of RECOMPRESS_BATCH threads and each is replaced by a rename, so readers never
+// see one half-written. Posts added to a thread while its list is being rewritten are lost,
+// so run it while no scrape of the board is in progress.
+int post_codec_recompress(const char *board, int retrain, int scan_count, int batch, const int *cancelled,
+                          PostRecompressStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    ThreadSnapshot *snapshot = fetch_thread_list(board, scan_count, batch);
+    BoardCodec *codec = snapshot ? current_codec(board) : NULL;
+    char (*ids)[THREAD_ID_MAX] = snapshot ? malloc(sizeof(*ids) * (snapshot->count + 1)) : NULL;
+    RedisBatch *reads = redis_batch_new(REDIS_ROUTE_PRIMARY);
+    RedisBatch *writes = redis_batch_new(REDIS_ROUTE_PRIMARY);
+    int status = codec && ids && reads && writes ? 0 : -1;
+
+    size_t n = 0;
+    for (size_t i = 0; status == 0 && i < snapshot->count; i++) {
+        if (snapshot->records[i].flags & THREAD_RECORD_DELETED) continue;
+        snprintf(ids[n++], THREAD_ID_MAX, "%" PRIu64, snapshot->records[i].id);
+    }
+    if (status == 0 && (retrain || codec->stats.dictionary_id == 0)) {
+        status = train_dictionary(board, ids, n, cancelled, &stats->dictionary_id, &stats->round_trips);
+    }
+    if (status == 0) stats->dictionary_id = codec->stats.dictionary_id;
+
+    for (size_t first = 0; status == 0 && first < n; first += RECOMPRESS_BATCH) {
+        if (cancelled && __atomic_load_n(cancelled, __ATOMIC_RELAXED)) {
+            status = -1;
+            break;
+        }
+        size_t count = n - first < RECOMPRESS_BATCH ? n - first : RECOMPRESS_BATCH;
+        status = read_lists(reads, board, ids + first, count);
+        stats->round_trips++;
+        redis_batch_clear(writes);
+
+        for (size_t i = 0; status == 0 && i < count; i++) {
+            const redisReply *list = redis_batch_reply(reads, i);
+            if (list->type != REDIS_REPLY_ARRAY) continue;  // No posts, or not a list
+            const char **posts = malloc((list->elements + 1) * sizeof(char *));
+            size_t *lengths = malloc((list->elements + 1) * sizeof(size_t));
+            size_t entries = posts && lengths ? list_entries(list, posts, lengths) : 0;
+            if (posts == NULL || lengths == NULL) status = -1;
+
+            stats->threads++;
+            stats->posts += entries;
+            size_t before = 0;
+            for (size_t j = 0; j < entries; j++) before += lengths[j];
+            stats->bytes_before += before;
+            if (status == 0 && list_is_current(posts, lengths, entries, stats->dictionary_id)) {
+                stats->bytes_after += before;
+            } else if (status == 0) {
+                char key[320];
+                format_thread_key(key, sizeof(key), board, ids[first + i], "posts");
+                int rewritten = recompress_list(writes, codec, key, posts, lengths, entries, stats);
+                if (rewritten > 0) stats->rewritten++;
+                status = rewritten < 0 ? -1 : 0;
+            }
+            free(posts);
+            free(lengths);
+        }
+
+        if (status == 0 && redis_batch_count(writes) > 0) {
+            status = redis_batch_execute(writes);
+            for (size_t i = 0; status == 0 && i < redis_batch_count(writes); i++) {
+                const redisReply *reply = redis_batch_reply(writes, i);
+                if (reply->type == REDIS_REPLY_ERROR) {
+                    fprintf(stderr, "Rewriting the posts of /%s/ failed: %s\n", board, reply->str);
+                    status = -1;
+                }
+            }
+            stats->round_trips++;
+        }
+    }
+
+    redis_batch_free(writes);
+    redis_batch_free(reads);
+    free(ids);
+    if (snapshot) thread_snapshot_unref(snapshot);
+    return status;
+}
+
+// --- Stats -----------------------------------------------------------------------------------
+
+// Copy the stats of up to max boards; returns how many were copied
+size_t post_codec_stats(PostCodecStats *stats, size_t max) {
+    size_t n = 0;
+    pthread_mutex_lock(&codecs_lock);
+    for (BoardCodec *codec = codecs; codec && n < max; codec = codec->next) {
+        stats[n] = codec->stats;  // Counters may be mid-update; each is read whole
+        n++;
+    }
+    pthread_mutex_unlock(&codecs_lock);
+    return n;
+}
+
+// One line: compression ratio of what was written and read back, and decode throughput
+void post_codec_format_stats(const PostCodecStats *stats, char *out, size_t size) {
+    double decode_s = stats->decode_ns / 1e9;
+    snprintf(out, size,
+             "/%s/ dictionary %" PRIu32 ": %" PRIu64 " posts compressed %.2fx, %" PRIu64 " decoded %.2fx at %.1f MiB/s",
+             stats->board, stats->dictionary_id, stats->encoded,
+             stats->encoded_out_bytes ? (double)stats->encoded_in_bytes / stats->encoded_out_bytes : 1.0, stats->decoded,
+             stats->decoded_in_bytes ? (double)stats->decoded_out_bytes / stats->decoded_in_bytes : 1.0,
+             decode_s > 0 ? stats->decoded_out_bytes / 1048576.0 / decode_s : 0.0);
+}
+
+void post_codec_shutdown() {
+    pthread_mutex_lock(&codecs_lock);
+    while (codecs) {
+        BoardCodec *codec = codecs;
+        codecs = codec->next;
+        for (size_t i = 0; i < codec->dictionary_count; i++) ZSTD_freeDDict(codec->dictionaries[i].ddict);
+        for (size_t i = 0; i < codec->retired_count; i++) ZSTD_freeCDict(codec->retired[i]);
+        ZSTD_freeCDict(codec->cdict);
+        free(codec->dictionaries);
+        free(codec->retired);
+        free(codec);
+    }
+    while (idle_cctx_count > 0) ZSTD_freeCCtx(idle_cctx[--idle_cctx_count]);
+    while (idle_dctx_count > 0) ZSTD_freeDCtx(idle_dctx[--idle_dctx_count]);
+    pthread_mutex_unlock(&codecs_lock);
+}
@@ -0,0 +1,947 @@
+#include <gtk/gtk.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <hiredis/hiredis.h>
+#include <hiredis/async.h>
+#include <hiredis/adapters/glib.h>
+#include "../include/redis_async.h"
+#include "../include/redis_operations.h"
+#include "../include/metrics.h"
+#include "../include/post_codec.h"
+
+// Non-blocking Redis connections for the GTK thread. Commands are written and their replies
+// read from a GSource on the default main context, so no call here ever waits on the network.
+// Each board tab has its own connection, so one board's listing never queues behind another's.
+
+#define RECONNECT_MIN_MS 250
+#define RECONNECT_MAX_MS 30000
+#define STALL_PROBE_MS 50
+#define REDIRECTS_MAX 5
+
+// One connection to one server. A client has a control node that asks its seeds for the
+// cluster layout, plus one node per primary (and per replica when reads go to replicas).
+typedef struct {
+    RedisAsync *client;
+    RedisEndpoint endpoint;
+    int control;           // Discovers the topology rather than serving commands
+    int readonly;          // A cluster replica: READONLY goes first on every connection
+    int lost;              // Dropped since it last connected; the client reports the reconnect
+    redisAsyncContext *context;
+    GSource *source;
+    gboolean connected;
+    guint connect_timeout_id;
+    guint reconnect_id;
+    guint reconnect_delay_ms;
+} AsyncNode;
+
+struct RedisAsync {
+    RedisEndpoint seeds[REDIS_NODES_MAX];
+    size_t seed_count;
+    size_t next_seed;      // Seed the control node tries next
+    int timeout_ms;
+    int read_replicas;
+    AsyncNode control;
+    RedisTopology *topology;               // NULL until the first discovery
+    AsyncNode *nodes[REDIS_NODES_MAX];     // Indexed like topology->nodes; NULL for unused replicas
+    unsigned scan_spread;
+    redis_async_connected_fn connected_callback;
+    void *user_data;
+};
+
+static gint64 probe_expected_at = 0;
+static gint64 max_stall_us = 0;
+
+static void start_connect(AsyncNode *node);
+static void request_topology(RedisAsync *client);
+
+// The adapter only removes its poll fd on cleanup; the source itself is ours to destroy.
+// Deferred to an idle so it never happens inside the source's own dispatch.
+static gboolean destroy_source_idle(gpointer data) {
+    GSource *source = data;
+    g_source_destroy(source);
+    g_source_unref(source);
+    return G_SOURCE_REMOVE;
+}
+
+static void drop_context(AsyncNode *node) {
+    if (node->source) g_idle_add(destroy_source_idle, node->source);
+    if (node->context) node->context->data = NULL;
+    node->source = NULL;
+    node->context = NULL;
+    node->connected = FALSE;
+}
+
+// Close a node's connection and cancel its timers; pending callbacks run with a NULL reply
+static void close_node(AsyncNode *node) {
+    if (node->reconnect_id != 0) g_source_remove(node->reconnect_id);
+    if (node->connect_timeout_id != 0) g_source_remove(node->connect_timeout_id);
+    node->reconnect_id = 0;
+    node->connect_timeout_id = 0;
+
+    if (node->context) {
+        redisAsyncContext *ac = node->context;
+        drop_context(node);
+        redisAsyncFree(ac);
+    }
+}
+
+static gboolean reconnect_timeout(gpointer data) {
+    AsyncNode *node = data;
+    node->reconnect_id = 0;
+    start_connect(node);
+    return G_SOURCE_REMOVE;
+}
+
+// Try again later, doubling the delay each time up to RECONNECT_MAX_MS. The control node
+// moves on to the next seed, so one dead seed doesn't keep the client from its cluster.
+static void schedule_reconnect(AsyncNode *node) {
+    if (node->reconnect_id != 0) return;
+    if (node->control) {
+        RedisAsync *client = node->client;
+        client->next_seed = (client->next_seed + 1) % client->seed_count;
+        node->endpoint = client->seeds[client->next_seed];
+    }
+    fprintf(stderr, "Reconnecting to Redis at %s:%d in %u ms\n", node->endpoint.host, node->endpoint.port, node->reconnect_delay_ms);
+    node->reconnect_id = g_timeout_add(node->reconnect_delay_ms, reconnect_timeout, node);
+    node->reconnect_delay_ms = MIN(node->reconnect_delay_ms * 2, RECONNECT_MAX_MS);
+}
+
+static void on_connect(const redisAsyncContext *ac, int status) {
+    AsyncNode *node = ac->data;
+    if (node == NULL) return;  // A context we already gave up on
+
+    if (node->connect_timeout_id != 0) {
+        g_source_remove(node->connect_timeout_id);
+        node->connect_timeout_id = 0;
+    }
+
+    if (status != REDIS_OK) {
+        // hiredis frees the context itself after a failed connect
+        fprintf(stderr, "Could not connect to Redis at %s:%d: %s\n", node->endpoint.host, node->endpoint.port, ac->errstr);
+        drop_context(node);
+        schedule_reconnect(node);
+        return;
+    }
+
+    node->connected = TRUE;
+    node->reconnect_delay_ms = RECONNECT_MIN_MS;
+    if (node->control) {
+        request_topology(node->client);
+    } else if (node->lost) {
+        node->lost = 0;
+        RedisAsync *client = node->client;
+        if (client->connected_callback) client->connected_callback(client, client->user_data);
+    }
+}
+
+static void on_disconnect(const redisAsyncContext *ac, int status) {
+    AsyncNode *node = ac->data;
+    if (node == NULL) return;
+
+    gboolean unexpected = (status != REDIS_OK);
+    if (unexpected) fprintf(stderr, "Redis connection to %s:%d lost: %s\n", node->endpoint.host, node->endpoint.port, ac->errstr);
+    drop_context(node);
+    if (!unexpected) return;
+
+    // A node going away may be a failover: reconnect, and ask where the slots went
+    node->lost = !node->control;
+    schedule_reconnect(node);
+    if (!node->control) request_topology(node->client);
+}
+
+// hiredis' GLib adapter has no timer hook, so the connect timeout is enforced here
+static gboolean connect_timeout(gpointer data) {
+    AsyncNode *node = data;
+    node->connect_timeout_id = 0;
+    if (node->context && !node->connected) {
+        fprintf(stderr, "Connecting to Redis at %s:%d timed out after %d ms\n", node->endpoint.host, node->endpoint.port, node->client->timeout_ms);
+        redisAsyncContext *ac = node->context;
+        drop_context(node);
+        redisAsyncFree(ac);
+        schedule_reconnect(node);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+// Commands queued before the connect completes are sent as soon as it does
+static void start_connect(AsyncNode *node) {
+    redisOptions options = {0};
+    REDIS_OPTIONS_SET_TCP(&options, node->endpoint.host, node->endpoint.port);
+
+    redisAsyncContext *ac = redisAsyncConnectWithOptions(&options);
+    if (ac == NULL || ac->err) {
+        fprintf(stderr, "Could not connect to Redis: %s\n", ac ? ac->errstr : "Unknown error");
+        if (ac) redisAsyncFree(ac);
+        schedule_reconnect(node);
+        return;
+    }
+
+    ac->data = node;
+    node->context = ac;
+    node->source = redis_source_new(ac);
+    g_source_attach(node->source, NULL);
+    redisAsyncSetConnectCallback(ac, on_connect);
+    redisAsyncSetDisconnectCallback(ac, on_disconnect);
+    if (node->readonly) redisAsyncCommand(ac, NULL, NULL, "READONLY");
+    node->connect_timeout_id = g_timeout_add(node->client->timeout_ms, connect_timeout, node);
+}
+
+static AsyncNode *node_new(RedisAsync *client, const RedisEndpoint *endpoint, int readonly) {
+    AsyncNode *node = g_new0(AsyncNode, 1);
+    node->client = client;
+    node->endpoint = *endpoint;
+    node->readonly = readonly;
+    node->reconnect_delay_ms = RECONNECT_MIN_MS;
+    start_connect(node);
+    return node;
+}
+
+// Switch to a newly discovered topology, keeping the connections to nodes it still has
+static void apply_topology(RedisAsync *client, RedisTopology *topology) {
+    AsyncNode *nodes[REDIS_NODES_MAX] = { NULL };
+    for (size_t i = 0; i < topology->node_count; i++) {
+        const RedisNode *info = &topology->nodes[i];
+        if (info->primary >= 0 && !topology->read_replicas) continue;
+        int readonly = topology->cluster && info->primary >= 0;
+
+        for (size_t old = 0; client->topology && old < client->topology->node_count; old++) {
+            AsyncNode *node = client->nodes[old];
+            if (node && node->readonly == readonly && redis_endpoint_equal(&node->endpoint, &info->endpoint)) {
+                nodes[i] = node;
+                client->nodes[old] = NULL;
+                break;
+            }
+        }
+        if (nodes[i] == NULL) nodes[i] = node_new(client, &info->endpoint, readonly);
+    }
+
+    for (size_t old = 0; old < REDIS_NODES_MAX; old++) {
+        if (client->nodes[old] == NULL) continue;
+        close_node(client->nodes[old]);
+        g_free(client->nodes[old]);
+    }
+    memcpy(client->nodes, nodes, sizeof(nodes));
+    redis_topology_unref(client->topology);
+    client->topology = topology;
+}
+
+static int topology_equal(const RedisTopology *a, const RedisTopology *b) {
+    if (a == NULL || a->cluster != b->cluster || a->node_count != b->node_count) return 0;
+    for (size_t i = 0; i < a->node_count; i++) {
+        if (a->nodes[i].primary != b->nodes[i].primary || !redis_endpoint_equal(&a->nodes[i].endpoint, &b->nodes[i].endpoint)) return 0;
+    }
+    return !a->cluster || memcmp(a->slot_primary, b->slot_primary, sizeof(a->slot_primary)) == 0;
+}
+
+// CLUSTER SLOTS reply on the control node. A server that isn't a cluster refuses it; its
+// topology is then the seeds themselves, the first one primary and the rest its replicas.
+static void on_cluster_slots(redisAsyncContext *ac, void *r, void *privdata) {
+    RedisAsync *client = privdata;
+    redisReply *reply = r;
+    if (reply == NULL) return;  // Disconnected or freed; reconnecting asks again
+
+    RedisTopology *topology = NULL;
+    if (reply->type == REDIS_REPLY_ARRAY && reply->elements > 0) {
+        topology = redis_topology_from_slots(reply, client->control.endpoint.host, client->read_replicas);
+    }
+    if (topology == NULL) topology = redis_topology_standalone(client->seeds, client->seed_count, client->read_replicas);
+    if (topology == NULL) return;
+
+    int changed = !topology_equal(client->topology, topology);
+    apply_topology(client, topology);
+    if (changed) {
+        for (size_t i = 0; i < topology->node_count; i++) {
+            if (client->nodes[i]) client->nodes[i]->lost = 0;
+        }
+        if (client->connected_callback) client->connected_callback(client, client->user_data);
+    }
+}
+
+// Ask for the layout again, e.g. after a MOVED redirect or a lost node. Commands already
+// queued keep their nodes; new ones use the new layout once it arrives.
+static void request_topology(RedisAsync *client) {
+    if (client->control.connected) {
+        redisAsyncCommand(client->control.context, on_cluster_slots, client, "CLUSTER SLOTS");
+    }
+}
+
+// Open the connections; returns immediately and reports success through on_connected, again
+// after every reconnect. endpoints is "host:port[,host:port...]" as for redis_pool_init().
+RedisAsync *redis_async_new(const char *endpoints, int timeout_ms, int read_replicas,
+                            redis_async_connected_fn on_connected, void *user_data) {
+    RedisAsync *client = g_new0(RedisAsync, 1);
+    client->seed_count = redis_parse_endpoints(endpoints, client->seeds, REDIS_NODES_MAX);
+    if (client->seed_count == 0) {
+        g_strlcpy(client->seeds[0].host, "127.0.0.1", sizeof(client->seeds[0].host));
+        client->seeds[0].port = 6379;
+        client->seed_count = 1;
+    }
+    client->timeout_ms = timeout_ms > 0 ? timeout_ms : 2000;
+    client->read_replicas = read_replicas;
+    client->connected_callback = on_connected;
+    client->user_data = user_data;
+
+    client->control.client = client;
+    client->control.control = 1;
+    client->control.endpoint = client->seeds[0];
+    client->control.reconnect_delay_ms = RECONNECT_MIN_MS;
+    start_connect(&client->control);
+    return client;
+}
+
+// Close every connection; pending callbacks run with a NULL reply before this returns,
+// so listings on it should be cancelled first
+void redis_async_free(RedisAsync *client) {
+    if (client == NULL) return;
+    close_node(&client->control);
+    for (size_t i = 0; i < REDIS_NODES_MAX; i++) {
+        if (client->nodes[i] == NULL) continue;
+        close_node(client->nodes[i]);
+        g_free(client->nodes[i]);
+    }
+    redis_topology_unref(client->topology);
+    g_free(client);
+}
+
+// Usable once the nodes are known and none of them is down; commands for a node still
+// connecting are queued on it
+int redis_async_is_connected(RedisAsync *client) {
+    if (client == NULL || client->topology == NULL) return 0;
+    for (size_t i = 0; i < client->topology->node_count; i++) {
+        if (client->nodes[i] && client->nodes[i]->context == NULL) return 0;
+    }
+    return 1;
+}
+
+static AsyncNode *node_for_key(RedisAsync *client, const char *key, RedisRoute route) {
+    int index = redis_topology_route(client->topology, redis_key_slot(key, strlen(key)), route);
+    return index >= 0 ? client->nodes[index] : NULL;
+}
+
+// A command in flight, kept formatted so a MOVED or ASK reply can send it on to the node that
+// now has the key. With metrics on, the time to its final reply is recorded.
+typedef struct {
+    RedisAsync *client;
+    char *command;
+    size_t length;
+    int redirects;
+    redisCallbackFn *fn;
+    void *privdata;
+    uint64_t started_ns;
+} RoutedCommand;
+
+static void routed_free(RoutedCommand *routed) {
+    redisFreeCommand(routed->command);
+    g_free(routed);
+}
+
+static int send_routed(AsyncNode *node, RoutedCommand *routed);
+
+// Follow a redirect; 0 if the command was sent on
+static int follow_redirect(RoutedCommand *routed, const redisReply *reply) {
+    int ask;
+    RedisEndpoint target;
+    if (reply == NULL || reply->type != REDIS_REPLY_ERROR || routed->redirects >= REDIRECTS_MAX) return -1;
+    if (!redis_parse_redirect(reply->str, &ask, &target)) return -1;
+
+    RedisAsync *client = routed->client;
+    if (!ask) request_topology(client);
+    int index = client->topology ? redis_topology_find(client->topology, &target) : -1;
+    AsyncNode *node = index >= 0 ? client->nodes[index] : NULL;
+    if (node == NULL || node->context == NULL) return -1;  // A node we don't know yet; the refresh finds it
+
+    routed->redirects++;
+    if (ask) redisAsyncCommand(node->context, NULL, NULL, "ASKING");
+    return send_routed(node, routed);
+}
+
+static void on_routed_reply(redisAsyncContext *c, void *reply, void *privdata) {
+    RoutedCommand *routed = privdata;
+    if (follow_redirect(routed, reply) == 0) return;
+
+    if (routed->started_ns) metrics_end(METRIC_REDIS_ASYNC, routed->started_ns);
+    if (routed->fn) routed->fn(c, reply, routed->privdata);
+    routed_free(routed);
+}
+
+static int send_routed(AsyncNode *node, RoutedCommand *routed) {
+    if (node == NULL || node->context == NULL) return REDIS_ERR;
+    return redisAsyncFormattedCommand(node->context, on_routed_reply, routed, routed->command, routed->length);
+}
+
+// Send a formatted command to a node; takes ownership of command
+static int node_command(RedisAsync *client, AsyncNode *node, char *command, long long length, redisCallbackFn *fn, void *privdata) {
+    if (length < 0) return REDIS_ERR;
+    RoutedCommand *routed = g_new0(RoutedCommand, 1);
+    routed->client = client;
+    routed->command = command;
+    routed->length = (size_t)length;
+    routed->fn = fn;
+    routed->privdata = privdata;
+    routed->started_ns = metrics_begin();
+
+    int status = send_routed(node, routed);
+    if (status != REDIS_OK) routed_free(routed);
+    return status;
+}
+
+// Queue a command on the node that serves key; its reply (or NULL if the connection drops)
+// is delivered to fn on the main loop
+int redis_async_command(RedisAsync *client, const char *key, RedisRoute route, redisCallbackFn *fn, void *privdata,
+                        const char *format, ...) {
+    if (!redis_async_is_connected(client)) return REDIS_ERR;
+
+    char *command;
+    va_list ap;
+    va_start(ap, format);
+    int length = redisvFormatCommand(&command, format, ap);
+    va_end(ap);
+    return node_command(client, node_for_key(client, key, route), command, length, fn, privdata);
+}
+
+int redis_async_command_argv(RedisAsync *client, const char *key, RedisRoute route, redisCallbackFn *fn, void *privdata,
+                             int argc, const char **argv, const size_t *argvlen) {
+    if (!redis_async_is_connected(client)) return REDIS_ERR;
+
+    char *command;
+    long long length = redisFormatCommandArgv(&command, argc, argv, argvlen);
+    return node_command(client, node_for_key(client, key, route), command, length, fn, privdata);
+}
+
+// A fixed-rate timer that records how late it fires: the worst lateness bounds
+// how long anything (Redis reply handling included) held the main thread.
+static gboolean stall_probe(gpointer data) {
+    gint64 now = g_get_monotonic_time();
+    if (probe_expected_at != 0 && now - probe_expected_at > max_stall_us) max_stall_us = now - probe_expected_at;
+    probe_expected_at = now + STALL_PROBE_MS * 1000;
+    return G_SOURCE_CONTINUE;
+}
+
+void redis_async_start_stall_probe() {
+    g_timeout_add(STALL_PROBE_MS, stall_probe, NULL);
+}
+
+// Worst main-thread stall seen since the previous call
+double redis_async_take_max_stall_ms() {
+    double stall = max_stall_us / 1000.0;
+    max_stall_us = 0;
+    return stall;
+}
+
+// An in-progress SCAN listing. Every primary (or one of its replicas) is scanned with its own
+// cursor; SCAN and field commands share the pipelines and records are delivered from their
+// reply callbacks, so the main loop never waits on Redis.
+typedef struct {
+    struct RedisThreadListing *listing;
+    AsyncNode *node;
+    char cursor[32];
+} ScanCursor;
+
+struct RedisThreadListing {
+    RedisAsync *connection;
+    char board[256];
+    char pattern[300];
+    ScanCursor scans[REDIS_NODES_MAX];
+    size_t scan_nodes;
+    size_t scans_done;     // Cursors that wrapped back to 0
+    int scan_count;
+    int batch;
+    int cancelled;         // Cancelled by the caller, or failed; no further callbacks
+    int failed;
+    unsigned pending;      // Commands sent whose replies have not arrived yet
+    unsigned threads;
+    unsigned round_trips;
+    thread_record_fn on_record;
+    listing_done_fn on_done;
+    void *user_data;
+};
+
+// Thread IDs whose fields were requested together: one MGET on a single server, one GET per
+// key on a cluster, collected here until the last reply is in
+typedef struct {
+    RedisThreadListing *listing;  // NULL for a standalone redis_async_fetch_threads()
+    RedisAsync *connection;
+    thread_record_fn on_record;
+    void *user_data;
+    size_t n;
+    char (*ids)[THREAD_ID_MAX];
+    char **values;                // Cluster only: 3 per thread
+    size_t remaining;             // Cluster only: GET replies still to come
+    int failed;
+} FieldBatch;
+
+typedef struct {
+    FieldBatch *batch;
+    size_t index;
+} FieldValue;
+
+static void count_record(const char *thread_id, const char *title, int count, const char *status, void *user_data) {
+    FieldBatch *batch = user_data;
+    if (title) batch->listing->threads++;
+    batch->on_record(thread_id, title, count, status, batch->user_data);
+}
+
+// Report and free the listing once nothing is in flight
+static void finish_listing_if_idle(RedisThreadListing *listing) {
+    int scan_done = listing->scans_done == listing->scan_nodes;
+    if (listing->pending > 0 || !(listing->cancelled || listing->failed || scan_done)) return;
+
+    if (!listing->cancelled && listing->on_done) {
+        listing->on_done(!listing->failed, listing->threads, listing->round_trips, listing->user_data);
+    }
+    g_free(listing);
+}
+
+static void field_batch_free(FieldBatch *batch) {
+    if (batch->values) {
+        for (size_t i = 0; i < batch->n * 3; i++) g_free(batch->values[i]);
+        g_free(batch->values);
+    }
+    g_free(batch->ids);
+    g_free(batch);
+}
+
+// Deliver the batch's records unless it, or its listing, failed or was cancelled
+static void finish_field_batch(FieldBatch *batch, redisReply *mget) {
+    RedisThreadListing *listing = batch->listing;
+    if (!batch->failed && (listing == NULL || !(listing->cancelled || listing->failed))) {
+        thread_record_fn fn = listing ? count_record : batch->on_record;
+        void *user_data = listing ? (void *)batch : batch->user_data;
+        if (mget) deliver_thread_fields(mget, batch->ids, batch->n, fn, user_data);
+        else deliver_thread_values((const char *const *)batch->values, batch->ids, batch->n, fn, user_data);
+    }
+    if (batch->failed && listing) listing->failed = 1;
+
+    if (listing) {
+        listing->pending--;
+        finish_listing_if_idle(listing);
+    }
+    field_batch_free(batch);
+}
+
+static void report_field_error(redisAsyncContext *ac, redisReply *reply) {
+    fprintf(stderr, "Fetching thread fields failed: %s\n", reply && reply->type == REDIS_REPLY_ERROR ? reply->str : ac->errstr);
+}
+
+static void on_thread_fields(redisAsyncContext *ac, void *r, void *privdata) {
+    FieldBatch *batch = privdata;
+    redisReply *reply = r;
+    if (reply == NULL || reply->type != REDIS_REPLY_ARRAY) {
+        report_field_error(ac, reply);
+        batch->failed = 1;
+    }
+    finish_field_batch(batch, batch->failed ? NULL : reply);
+}
+
+static void on_thread_field_value(redisAsyncContext *ac, void *r, void *privdata) {
+    FieldValue *value = privdata;
+    FieldBatch *batch = value->batch;
+    redisReply *reply = r;
+    if (reply && reply->type == REDIS_REPLY_STRING) {
+        batch->values[value->index] = g_strndup(reply->str, reply->len);
+    } else if (reply == NULL || reply->type == REDIS_REPLY_ERROR) {
+        if (!batch->failed) report_field_error(ac, reply);
+        batch->failed = 1;
+    }
+    g_free(value);
+    if (--batch->remaining == 0) finish_field_batch(batch, NULL);
+}
+
+// Send the batch's commands; on failure the batch is freed and nothing is called
+static int request_thread_fields(const char *board, RedisRoute route, FieldBatch *batch) {
+    RedisAsync *client = batch->connection;
+    if (!redis_async_is_connected(client)) {
+        field_batch_free(batch);
+        return REDIS_ERR;
+    }
+
+    if (!client->topology->cluster) {
+        const char **argv;
+        int argc = build_thread_fields_argv(board, batch->ids, batch->n, &argv);
+        int status = redis_async_command_argv(client, argv[1], route, on_thread_fields, batch, argc, argv, NULL);
+        free_thread_fields_argv(argv, argc);  // hiredis has already formatted the command
+        if (status != REDIS_OK) field_batch_free(batch);
+        return status;
+    }
+
+    // A thread's three keys hash to different slots, so each goes to its own node. Once one
+    // GET is queued the batch is finished by the replies, even if a later one can't be sent.
+    static const char *fields[] = { "title", "count", "status" };
+    batch->values = g_new0(char *, batch->n * 3);
+    batch->remaining = batch->n * 3 + 1;
+    for (size_t i = 0; i < batch->n * 3; i++) {
+        char key[320];
+        format_thread_key(key, sizeof(key), board, batch->ids[i / 3], fields[i % 3]);
+        FieldValue *value = g_new(FieldValue, 1);
+        *value = (FieldValue){ batch, i };
+        if (redis_async_command(client, key, route, on_thread_field_value, value, "GET %s", key) != REDIS_OK) {
+            g_free(value);
+            batch->failed = 1;
+            batch->remaining -= batch->n * 3 - i;
+            break;
+        }
+    }
+    if (--batch->remaining > 0) return REDIS_OK;
+    // Nothing was sent
+    field_batch_free(batch);
+    return REDIS_ERR;
+}
+
+static void request_scan_step(ScanCursor *scan);
+
+// SCAN reply from one node: fetch fields for the keys in batch-sized groups and move that
+// node's cursor on straight away, so the next SCAN travels in the same pipeline.
+static void on_scan_reply(redisAsyncContext *ac, void *r, void *privdata) {
+    ScanCursor *scan = privdata;
+    RedisThreadListing *listing = scan->listing;
+    redisReply *reply = r;
+    listing->pending--;
+
+    if (!(listing->cancelled || listing->failed)) {
+        if (reply == NULL || reply->type != REDIS_REPLY_ARRAY || reply->elements != 2) {
+            fprintf(stderr, "SCAN failed: %s\n", reply && reply->type == REDIS_REPLY_ERROR ? reply->str : ac->errstr);
+            listing->failed = 1;
+        } else {
+            g_strlcpy(scan->cursor, reply->element[0]->str, sizeof(scan->cursor));
+
+            redisReply *keys = reply->element[1];
+            for (size_t first = 0; first < keys->elements && !listing->failed; first += listing->batch) {
+                FieldBatch *batch = g_new0(FieldBatch, 1);
+                batch->listing = listing;
+                batch->connection = listing->connection;
+                batch->on_record = listing->on_record;
+                batch->user_data = listing->user_data;
+                batch->ids = g_malloc0(sizeof(*batch->ids) * listing->batch);
+                for (size_t i = first; i < keys->elements && i < first + (size_t)listing->batch; i++) {
+                    if (extract_thread_id(keys->element[i]->str, batch->ids[batch->n], THREAD_ID_MAX)) batch->n++;
+                }
+
+                if (batch->n == 0) {
+                    field_batch_free(batch);
+                    continue;
+                }
+                listing->pending++;
+                if (request_thread_fields(listing->board, REDIS_ROUTE_READ, batch) == REDIS_OK) {
+                    listing->round_trips++;
+                } else {
+                    listing->pending--;
+                    listing->failed = 1;
+                }
+            }
+
+            if (strcmp(scan->cursor, "0") == 0) listing->scans_done++;
+            else if (!listing->failed) request_scan_step(scan);
+        }
+    }
+
+    finish_listing_if_idle(listing);
+}
+
+// SCAN goes to one node as it is, never routed by key
+static void request_scan_step(ScanCursor *scan) {
+    RedisThreadListing *listing = scan->listing;
+    char *command;
+    int length = redisFormatCommand(&command, "SCAN %s MATCH %s COUNT %d", scan->cursor, listing->pattern, listing->scan_count);
+    if (node_command(listing->connection, scan->node, command, length, on_scan_reply, scan) != REDIS_OK) {
+        listing->failed = 1;
+        return;
+    }
+    listing->pending++;
+    listing->round_trips++;
+}
+
+// Stream every thread of the board to on_record, then call on_done once.
+// Returns NULL (and calls nothing) if the connection isn't up.
+RedisThreadListing *redis_async_list_threads(RedisAsync *connection, const char *board, int scan_count, int batch,
+                                             thread_record_fn on_record, listing_done_fn on_done, void *user_data) {
+    if (!redis_async_is_connected(connection)) return NULL;
+
+    RedisThreadListing *listing = g_new0(RedisThreadListing, 1);
+    listing->connection = connection;
+    g_strlcpy(listing->board, board, sizeof(listing->board));
+    format_title_pattern(listing->pattern, sizeof(listing->pattern), board);
+    listing->scan_count = scan_count;
+    listing->batch = batch > 0 ? batch : 1;
+    listing->on_record = on_record;
+    listing->on_done = on_done;
+    listing->user_data = user_data;
+
+    int nodes[REDIS_NODES_MAX];
+    listing->scan_nodes = redis_topology_scan_nodes(connection->topology, REDIS_ROUTE_READ, connection->scan_spread++,
+                                                    nodes, REDIS_NODES_MAX);
+    for (size_t i = 0; i < listing->scan_nodes; i++) {
+        listing->scans[i].listing = listing;
+        listing->scans[i].node = connection->nodes[nodes[i]];
+        strcpy(listing->scans[i].cursor, "0");
+    }
+    for (size_t i = 0; i < listing->scan_nodes && !listing->failed; i++) request_scan_step(&listing->scans[i]);
+
+    if (listing->failed) {
+        // Replies to steps already sent still arrive; let them free the listing
+        listing->cancelled = 1;
+        finish_listing_if_idle(listing);
+        return NULL;
+    }
+    return listing;
+}
+
+// Stop delivering records; the listing frees itself when its last reply comes back
+void redis_async_cancel_listing(RedisThreadListing *listing) {
+    if (listing == NULL) return;
+    listing->cancelled = 1;
+    finish_listing_if_idle(listing);
+}
+
+// Fetch the fields of specific threads from their primaries, which have seen the change that
+// prompted the fetch; IDs are copied
+int redis_async_fetch_threads(RedisAsync *connection, const char *board, char (*ids)[THREAD_ID_MAX], size_t n,
+                              thread_record_fn on_record, void *user_data) {
+    if (n == 0) return REDIS_OK;
+
+    FieldBatch *batch = g_new0(FieldBatch, 1);
+    batch->connection = connection;
+    batch->on_record = on_record;
+    batch->user_data = user_data;
+    batch->n = n;
+    batch->ids = g_malloc(sizeof(*ids) * n);
+    memcpy(batch->ids, ids, sizeof(*ids) * n);
+    return request_thread_fields(board, REDIS_ROUTE_PRIMARY, batch);
+}
+
+// One page of a board's sorted index: ZCARD and ZRANGE pipelined, then HMGET of the rows of
+// the IDs that came back, all on the node that holds the index
+struct RedisIndexPage {
+    RedisAsync *connection;
+    char rows_key[320];
+    long long total;
+    char (*ids)[THREAD_ID_MAX];
+    size_t n;
+    unsigned pending;      // Commands sent whose replies have not arrived yet
+    int failed;
+    int cancelled;         // No further callbacks
+    thread_record_fn on_record;
+    index_page_fn on_done;
+    void *user_data;
+};
+
+static void finish_index_page_if_idle(RedisIndexPage *page) {
+    if (page->pending > 0) return;
+    if (!page->cancelled) page->on_done(!page->failed, page->total, page->n, page->user_data);
+    g_free(page->ids);
+    g_free(page);
+}
+
+static void report_index_error(redisAsyncContext *ac, redisReply *reply) {
+    fprintf(stderr, "Reading the sorted index failed: %s\n", reply && reply->type == REDIS_REPLY_ERROR ? reply->str : ac->errstr);
+}
+
+static void on_index_rows(redisAsyncContext *ac, void *r, void *privdata) {
+    RedisIndexPage *page = privdata;
+    redisReply *reply = r;
+    page->pending--;
+    if (reply == NULL || reply->type != REDIS_REPLY_ARRAY) {
+        if (!page->cancelled) report_index_error(ac, reply);
+        page->failed = 1;
+    } else if (!page->cancelled) {
+        deliver_index_rows(page->ids, page->n, reply, page->on_record, page->user_data);
+    }
+    finish_index_page_if_idle(page);
+}
+
+static void on_index_range(redisAsyncContext *ac, void *r, void *privdata) {
+    RedisIndexPage *page = privdata;
+    redisReply *reply = r;
+    page->pending--;
+    if (reply == NULL || reply->type != REDIS_REPLY_ARRAY) {
+        if (!page->cancelled) report_index_error(ac, reply);
+        page->failed = 1;
+    } else if (!page->cancelled && !page->failed && reply->elements > 0) {
+        page->n = reply->elements;
+        page->ids = g_malloc0(sizeof(*page->ids) * page->n);
+        const char **argv = g_new(const char *, page->n + 2);
+        argv[0] = "HMGET";
+        argv[1] = page->rows_key;
+        for (size_t i = 0; i < page->n; i++) {
+            g_strlcpy(page->ids[i], reply->element[i]->str, THREAD_ID_MAX);
+            argv[2 + i] = page->ids[i];
+        }
+        if (redis_async_command_argv(page->connection, page->rows_key, REDIS_ROUTE_READ, on_index_rows, page,
+                                     (int)page->n + 2, argv, NULL) == REDIS_OK) {
+            page->pending++;
+        } else {
+            page->failed = 1;
+        }
+        g_free(argv);
+    }
+    finish_index_page_if_idle(page);
+}
+
+static void on_index_total(redisAsyncContext *ac, void *r, void *privdata) {
+    RedisIndexPage *page = privdata;
+    redisReply *reply = r;
+    page->pending--;
+    if (reply && reply->type == REDIS_REPLY_INTEGER) page->total = reply->integer;
+    else page->failed = 1;
+    finish_index_page_if_idle(page);
+}
+
+// Stream threads [start, start + count) of the board's sorted index to on_record in index
+// order, then call on_done once with the size of the index, 0 if the board has none.
+// Returns NULL (and calls nothing) if the connection isn't up.
+RedisIndexPage *redis_async_fetch_index_page(RedisAsync *connection, const char *board, BoardIndexOrder order, int descending,
+                                             long start, long count, thread_record_fn on_record, index_page_fn on_done,
+                                             void *user_data) {
+    if (!redis_async_is_connected(connection)) return NULL;
+
+    char key[320];
+    format_board_index_key(key, sizeof(key), board, board_index_order_name(order));
+    RedisIndexPage *page = g_new0(RedisIndexPage, 1);
+    page->connection = connection;
+    format_board_index_key(page->rows_key, sizeof(page->rows_key), board, "threads");
+    page->on_record = on_record;
+    page->on_done = on_done;
+    page->user_data = user_data;
+
+    if (redis_async_command(connection, key, REDIS_ROUTE_READ, on_index_total, page, "ZCARD %s", key) != REDIS_OK) {
+        g_free(page);
+        return NULL;
+    }
+    page->pending++;
+    // Same key, same node: the ZCARD reply always arrives first
+    if (redis_async_command(connection, key, REDIS_ROUTE_READ, on_index_range, page, "%s %s %ld %ld",
+                            descending ? "ZREVRANGE" : "ZRANGE", key, start, start + count - 1) != REDIS_OK) {
+        page->cancelled = 1;  // The ZCARD reply frees it
+        return NULL;
+    }
+    page->pending++;
+    return page;
+}
+
+// Stop delivering records; the page frees itself when its last reply comes back
+void redis_async_cancel_index_page(RedisIndexPage *page) {
+    if (page == NULL) return;
+    page->cancelled = 1;
+    finish_index_page_if_idle(page);
+}
+
+// LLEN and LRANGE of one thread's post list, pipelined on the node that holds it (or a GET when
+// the posts are one string), then the dictionaries its compressed posts need if they aren't loaded yet
+typedef struct {
+    RedisAsync *connection;
+    char board[64];
+    char key[320];
+    long start;
+    int length_failed;
+    int is_string;         // WRONGTYPE: the whole thread is one string, read with GET
+    int abandoned;         // LRANGE couldn't be sent; the LLEN reply frees the request
+    long long total;
+    ThreadPostPage page;   // As stored, until every dictionary is loaded
+    uint32_t dictionary_id;
+    post_page_fn fn;
+    void *user_data;
+} PostsRequest;
+
+static void on_posts_length(redisAsyncContext *ac, void *r, void *privdata) {
+    PostsRequest *request = privdata;
+    redisReply *reply = r;
+    if (request->abandoned) {
+        g_free(request);
+        return;
+    }
+    if (reply && reply->type == REDIS_REPLY_INTEGER) request->total = reply->integer;
+    else if (reply && thread_posts_are_string(reply)) request->is_string = 1;
+    else request->length_failed = 1;
+}
+
+// Every dictionary is loaded by now, so decoding doesn't block the main loop
+static void deliver_posts(PostsRequest *request, int ok) {
+    if (ok && post_codec_decode_page(request->board, &request->page) != 0) ok = 0;
+    request->fn(ok, &request->page, request->user_data);
+    thread_post_page_free(&request->page);
+    g_free(request);
+}
+
+static void request_posts_dictionary(PostsRequest *request);
+
+static void on_posts_dictionary(redisAsyncContext *ac, void *r, void *privdata) {
+    PostsRequest *request = privdata;
+    redisReply *reply = r;
+    const redisReply *dictionary = reply && reply->type == REDIS_REPLY_ARRAY && reply->elements == 1 ? reply->element[0] : NULL;
+    if (dictionary == NULL || dictionary->type != REDIS_REPLY_STRING ||
+        post_codec_add_dictionary(request->board, request->dictionary_id, dictionary->str, dictionary->len) != 0) {
+        fprintf(stderr, "Dictionary %u of /%s/ is missing; its posts can't be read\n", (unsigned)request->dictionary_id, request->board);
+        deliver_posts(request, 0);
+        return;
+    }
+    request_posts_dictionary(request);
+}
+
+// Fetch the dictionaries the page's compressed posts name, one at a time; a page rarely needs more than one
+static void request_posts_dictionary(PostsRequest *request) {
+    request->dictionary_id = post_codec_missing_dictionary(request->board, &request->page);
+    if (request->dictionary_id == 0) {
+        deliver_posts(request, 1);
+        return;
+    }
+    char key[320], field[16];
+    format_post_dict_key(key, sizeof(key), request->board);
+    g_snprintf(field, sizeof(field), "%u", (unsigned)request->dictionary_id);
+    if (redis_async_command(request->connection, key, REDIS_ROUTE_PRIMARY, on_posts_dictionary, request, "HMGET %s %s", key, field) != REDIS_OK) {
+        deliver_posts(request, 0);
+    }
+}
+
+static void on_posts_string(redisAsyncContext *ac, void *r, void *privdata) {
+    PostsRequest *request = privdata;
+    redisReply *reply = r;
+    int ok = reply && thread_post_page_from_string(reply, request->start, &request->page) == 0;
+    if (!ok && reply == NULL) fprintf(stderr, "Fetching posts failed: %s\n", ac->errstr);
+    if (ok) request_posts_dictionary(request);
+    else deliver_posts(request, 0);
+}
+
+static void on_posts_range(redisAsyncContext *ac, void *r, void *privdata) {
+    PostsRequest *request = privdata;
+    redisReply *reply = r;
+    if (reply && request->is_string) {
+        if (redis_async_command(request->connection, request->key, REDIS_ROUTE_READ, on_posts_string, request, "GET %s",
+                                request->key) != REDIS_OK) {
+            deliver_posts(request, 0);
+        }
+        return;
+    }
+    redisReply length = { .type = REDIS_REPLY_INTEGER, .integer = request->total };
+
+    int ok = reply && !request->length_failed && thread_post_page_from_replies(&length, reply, request->start, &request->page) == 0;
+    if (!ok && reply == NULL) fprintf(stderr, "Fetching posts failed: %s\n", ac->errstr);
+    if (ok) request_posts_dictionary(request);
+    else deliver_posts(request, 0);
+}
+
+// Fetch posts [start, start + count) of a thread and the length of its list. fn is called
+// once on the main loop, and may take strings out of the page by setting them to NULL.
+int redis_async_fetch_posts(RedisAsync *connection, const char *board, const char *thread_id, long start, long count,
+                            post_page_fn fn, void *user_data) {
+    if (!redis_async_is_connected(connection)) return REDIS_ERR;
+
+    char key[320];
+    format_thread_key(key, sizeof(key), board, thread_id, "posts");
+    PostsRequest *request = g_new0(PostsRequest, 1);
+    request->connection = connection;
+    g_strlcpy(request->board, board, sizeof(request->board));
+    g_strlcpy(request->key, key, sizeof(request->key));
+    request->start = start;
+    request->fn = fn;
+    request->user_data = user_data;
+    if (redis_async_command(connection, key, REDIS_ROUTE_READ, on_posts_length, request, "LLEN %s", key) != REDIS_OK) {
+        g_free(request);
+        return REDIS_ERR;
+    }
+    // Same key, same node: the LLEN reply always arrives first
+    if (redis_async_command(connection, key, REDIS_ROUTE_READ, on_posts_range, request, "LRANGE %s %ld %ld", key, start, start + count - 1) != REDIS_OK) {
+        request->abandoned = 1;
+        return REDIS_ERR;
+    }
+    return REDIS_OK;
+}
@@ -0,0 +1,229 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <hiredis/hiredis.h>
+#include "../include/redis_cluster.h"
+
+// --- Hash slots --------------------------------------------------------------------------------
+
+// CRC16-CCITT (XMODEM), the checksum Redis Cluster maps keys with
+static const uint16_t crc16_table[256] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7, 0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+    0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6, 0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+    0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485, 0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+    0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4, 0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+    0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823, 0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+    0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12, 0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+    0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41, 0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+    0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70, 0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+    0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f, 0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+    0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e, 0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+    0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d, 0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+    0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c, 0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+    0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab, 0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+    0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a, 0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+    0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9, 0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+    0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8, 0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0,
+};
+
+static uint16_t crc16(const char *data, size_t length) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < length; i++) crc = (crc << 8) ^ crc16_table[((crc >> 8) ^ (unsigned char)data[i]) & 0xff];
+    return crc;
+}
+
+// Slot of a key; when the key has a non-empty {hash tag}, only the tag is hashed, so keys
+// sharing a tag always live together
+unsigned redis_key_slot(const char *key, size_t length) {
+    const char *open = memchr(key, '{', length);
+    if (open) {
+        size_t tag_start = open - key + 1;
+        const char *close = memchr(key + tag_start, '}', length - tag_start);
+        if (close && close > key + tag_start) return crc16(key + tag_start, close - key - tag_start) & (REDIS_CLUSTER_SLOTS - 1);
+    }
+    return crc16(key, length) & (REDIS_CLUSTER_SLOTS - 1);
+}
+
+// --- Endpoints ---------------------------------------------------------------------------------
+
+// "host:port,host:port,..." into endpoints; a missing port means 6379. Returns how many were read.
+size_t redis_parse_endpoints(const char *list, RedisEndpoint *endpoints, size_t max) {
+    size_t count = 0;
+    for (const char *p = list; *p && count < max;) {
+        p += strspn(p, ", \t");
+        size_t length = strcspn(p, ",");
+        while (length > 0 && (p[length - 1] == ' ' || p[length - 1] == '\t')) length--;
+        if (length == 0) break;
+
+        // The last colon splits off the port, so bracketless IPv6 hosts need one
+        const char *colon = NULL;
+        for (const char *c = p; c < p + length; c++) if (*c == ':') colon = c;
+        size_t host_length = colon ? (size_t)(colon - p) : length;
+        if (host_length > 0 && host_length < sizeof(endpoints[count].host)) {
+            memcpy(endpoints[count].host, p, host_length);
+            endpoints[count].host[host_length] = '\0';
+            endpoints[count].port = colon ? atoi(colon + 1) : 6379;
+            if (endpoints[count].port > 0) count++;
+        }
+        p += strcspn(p, ",");
+    }
+    return count;
+}
+
+int redis_endpoint_equal(const RedisEndpoint *a, const RedisEndpoint *b) {
+    return a->port == b->port && strcmp(a->host, b->host) == 0;
+}
+
+// "MOVED <slot> <host>:<port>" or "ASK <slot> <host>:<port>"; returns 1 and fills target for either
+int redis_parse_redirect(const char *error, int *ask, RedisEndpoint *target) {
+    if (error == NULL) return 0;
+    if (strncmp(error, "MOVED ", 6) == 0) *ask = 0;
+    else if (strncmp(error, "ASK ", 4) == 0) *ask = 1;
+    else return 0;
+
+    const char *address = strchr(error + (*ask ? 4 : 6), ' ');
+    return address && redis_parse_endpoints(address + 1, target, 1) == 1;
+}
+
+// --- Topology ----------------------------------------------------------------------------------
+
+static RedisTopology *topology_new(int cluster, int read_replicas) {
+    RedisTopology *topology = calloc(1, sizeof(RedisTopology));
+    if (topology == NULL) return NULL;
+    topology->refs = 1;
+    topology->cluster = cluster;
+    topology->read_replicas = read_replicas;
+    return topology;
+}
+
+int redis_topology_find(const RedisTopology *topology, const RedisEndpoint *endpoint) {
+    for (size_t i = 0; i < topology->node_count; i++) {
+        if (redis_endpoint_equal(&topology->nodes[i].endpoint, endpoint)) return (int)i;
+    }
+    return -1;
+}
+
+static int topology_add(RedisTopology *topology, const RedisEndpoint *endpoint, int primary) {
+    int found = redis_topology_find(topology, endpoint);
+    if (found >= 0 || topology->node_count == REDIS_NODES_MAX) return found;
+    RedisNode *node = &topology->nodes[topology->node_count];
+    node->endpoint = *endpoint;
+    node->primary = primary;
+    return (int)topology->node_count++;
+}
+
+// A single server: the first endpoint takes the writes, the rest are its replicas
+RedisTopology *redis_topology_standalone(const RedisEndpoint *endpoints, size_t count, int read_replicas) {
+    RedisTopology *topology = topology_new(0, read_replicas);
+    if (topology == NULL) return NULL;
+    for (size_t i = 0; i < count; i++) topology_add(topology, &endpoints[i], i == 0 ? -1 : 0);
+    return topology;
+}
+
+// Node of a CLUSTER SLOTS entry; an empty host means the node that was asked
+static int slots_endpoint(const redisReply *node, const char *queried_host, RedisEndpoint *endpoint) {
+    if (node->type != REDIS_REPLY_ARRAY || node->elements < 2) return 0;
+    const redisReply *host = node->element[0], *port = node->element[1];
+    if (host->type != REDIS_REPLY_STRING || port->type != REDIS_REPLY_INTEGER) return 0;
+    if (strcmp(host->str, "?") == 0) return 0;  // Address not known to the cluster yet
+    snprintf(endpoint->host, sizeof(endpoint->host), "%s", host->len ? host->str : queried_host);
+    endpoint->port = (int)port->integer;
+    return 1;
+}
+
+// Build a cluster topology from a CLUSTER SLOTS reply: [[first, last, primary, replica...]...]
+RedisTopology *redis_topology_from_slots(const redisReply *reply, const char *queried_host, int read_replicas) {
+    if (reply == NULL || reply->type != REDIS_REPLY_ARRAY || reply->elements == 0) return NULL;
+    RedisTopology *topology = topology_new(1, read_replicas);
+    if (topology == NULL) return NULL;
+
+    size_t covered = 0;
+    for (size_t i = 0; i < reply->elements; i++) {
+        const redisReply *range = reply->element[i];
+        if (range->type != REDIS_REPLY_ARRAY || range->elements < 3) continue;
+        if (range->element[0]->type != REDIS_REPLY_INTEGER || range->element[1]->type != REDIS_REPLY_INTEGER) continue;
+        long long first = range->element[0]->integer, last = range->element[1]->integer;
+        if (first < 0 || last >= REDIS_CLUSTER_SLOTS || first > last) continue;
+
+        RedisEndpoint endpoint;
+        if (!slots_endpoint(range->element[2], queried_host, &endpoint)) continue;
+        int primary = topology_add(topology, &endpoint, -1);
+        if (primary < 0) continue;
+        for (long long slot = first; slot <= last; slot++) topology->slot_primary[slot] = (uint16_t)primary;
+        covered += last - first + 1;
+
+        for (size_t r = 3; r < range->elements; r++) {
+            if (slots_endpoint(range->element[r], queried_host, &endpoint)) topology_add(topology, &endpoint, primary);
+        }
+    }
+
+    if (covered < REDIS_CLUSTER_SLOTS) fprintf(stderr, "Redis Cluster covers only %zu of %d slots\n", covered, REDIS_CLUSTER_SLOTS);
+    if (topology->node_count == 0) {
+        free(topology);
+        return NULL;
+    }
+    return topology;
+}
+
+// Ask the seeds in turn whether they are part of a cluster. Blocking; for worker threads.
+// NULL if none of them could be reached.
+RedisTopology *redis_topology_discover(const RedisEndpoint *seeds, size_t count, int timeout_ms, int read_replicas) {
+    struct timeval timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+    for (size_t i = 0; i < count; i++) {
+        redisContext *context = redisConnectWithTimeout(seeds[i].host, seeds[i].port, timeout);
+        if (context == NULL || context->err) {
+            fprintf(stderr, "Could not connect to Redis at %s:%d: %s\n", seeds[i].host, seeds[i].port,
+                    context ? context->errstr : "Unknown error");
+            if (context) redisFree(context);
+            continue;
+        }
+
+        redisReply *reply = redisCommand(context, "CLUSTER SLOTS");
+        RedisTopology *topology = NULL;
+        if (reply && reply->type == REDIS_REPLY_ARRAY) topology = redis_topology_from_slots(reply, seeds[i].host, read_replicas);
+        // "ERR This instance has cluster support disabled", or a server without CLUSTER
+        if (reply && topology == NULL) topology = redis_topology_standalone(seeds, count, read_replicas);
+        if (reply) freeReplyObject(reply);
+        redisFree(context);
+        if (topology) return topology;
+    }
+    return NULL;
+}
+
+RedisTopology *redis_topology_ref(RedisTopology *topology) {
+    if (topology) __atomic_add_fetch(&topology->refs, 1, __ATOMIC_RELAXED);
+    return topology;
+}
+
+void redis_topology_unref(RedisTopology *topology) {
+    if (topology && __atomic_sub_fetch(&topology->refs, 1, __ATOMIC_ACQ_REL) == 0) free(topology);
+}
+
+// One of the primary's replicas picked by spread, or the primary itself if it has none
+static int pick_replica(const RedisTopology *topology, int primary, unsigned spread) {
+    int replicas[REDIS_NODES_MAX];
+    size_t count = 0;
+    for (size_t i = 0; i < topology->node_count; i++) {
+        if (topology->nodes[i].primary == primary) replicas[count++] = (int)i;
+    }
+    return count ? replicas[spread % count] : primary;
+}
+
+// Node that serves a slot; reads are spread over the primary's replicas by slot
+int redis_topology_route(const RedisTopology *topology, unsigned slot, RedisRoute route) {
+    int primary = topology->cluster ? topology->slot_primary[slot % REDIS_CLUSTER_SLOTS] : 0;
+    if (route == REDIS_ROUTE_READ && topology->read_replicas) return pick_replica(topology, primary, slot);
+    return primary;
+}
+
+// One node per primary, together holding every key once: what a full SCAN has to visit
+size_t redis_topology_scan_nodes(const RedisTopology *topology, RedisRoute route, unsigned spread, int *nodes, size_t max) {
+    size_t count = 0;
+    for (size_t i = 0; i < topology->node_count && count < max; i++) {
+        if (topology->nodes[i].primary >= 0) continue;
+        nodes[count++] = route == REDIS_ROUTE_READ && topology->read_replicas ? pick_replica(topology, (int)i, spread) : (int)i;
+    }
+    return count;
+}
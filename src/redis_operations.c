@@ -1,37 +1,937 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
 #include <hiredis/hiredis.h>
 #include "../include/redis_operations.h"
 #include "../include/settings.h"
-static redisContext *redis_context = NULL;
+#include "../include/thread_snapshot.h"
+#include "../include/metrics.h"
+#include "../include/post_codec.h"
+#include "../include/json_scan.h"
+
+// Synchronous data-access layer for worker threads. Every operation borrows a connection from
+// a small pool, so several threads can talk to Redis at once without sharing a context. The
+// pool keeps up to pool_size connections per node and learns which nodes there are from the
+// first seed that answers; after a MOVED redirect it asks again.
+
+#define POOL_MAX 64
+#define REDIRECTS_MAX 5
+
+typedef struct {
+    redisContext *context;
+    RedisEndpoint endpoint;  // Node the context is connected to
+    int in_use;
+    unsigned generation;     // pool_generation when the context was opened
+} PooledConnection;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_available = PTHREAD_COND_INITIALIZER;
+static PooledConnection pool[POOL_MAX];
+static int pool_size = 0;
+static unsigned pool_generation = 0;  // Bumped by redis_pool_init so connections to an old server are dropped
+static RedisEndpoint pool_seeds[REDIS_NODES_MAX];
+static size_t pool_seed_count = 0;
+static int pool_timeout_ms;
+static int pool_read_replicas;
+static RedisTopology *pool_topology = NULL;  // NULL until discovered, and again after a redirect
+static int pool_discovering = 0;             // One thread asks the seeds; the others wait for it
+static unsigned pool_scan_spread = 0;        // Rotates full scans over a primary's replicas
+
+// Close every idle connection; called with pool_lock held
+static void close_idle_connections() {
+    for (int i = 0; i < POOL_MAX; i++) {
+        if (!pool[i].in_use && pool[i].context) {
+            redisFree(pool[i].context);
+            pool[i].context = NULL;
+        }
+    }
+}
+
+// (Re)configure the pool; connections are opened lazily on first use
+int redis_pool_init(const char *endpoints, int size, int timeout_ms, int read_replicas) {
+    pthread_mutex_lock(&pool_lock);
+    close_idle_connections();
+
+    pool_seed_count = redis_parse_endpoints(endpoints, pool_seeds, REDIS_NODES_MAX);
+    pool_timeout_ms = timeout_ms > 0 ? timeout_ms : 2000;
+    pool_read_replicas = read_replicas;
+    pool_size = size < 1 ? 1 : (size > POOL_MAX ? POOL_MAX : size);
+    redis_topology_unref(pool_topology);
+    pool_topology = NULL;
+    pool_generation++;
+    pthread_cond_broadcast(&pool_available);
+    pthread_mutex_unlock(&pool_lock);
+    return pool_seed_count > 0 ? 0 : -1;
+}
+
+void redis_pool_shutdown() {
+    pthread_mutex_lock(&pool_lock);
+    close_idle_connections();
+    pool_size = 0;
+    pool_seed_count = 0;
+    redis_topology_unref(pool_topology);
+    pool_topology = NULL;
+    pool_generation++;
+    pthread_cond_broadcast(&pool_available);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// The nodes as last discovered, asking the seeds first if nobody has yet. Blocking; the
+// caller drops the reference. NULL if no seed could be reached.
+static RedisTopology *pool_topology_get() {
+    pthread_mutex_lock(&pool_lock);
+    while (pool_topology == NULL && pool_discovering) pthread_cond_wait(&pool_available, &pool_lock);
+    if (pool_topology || pool_seed_count == 0) {
+        RedisTopology *topology = redis_topology_ref(pool_topology);
+        pthread_mutex_unlock(&pool_lock);
+        return topology;
+    }
+
+    pool_discovering = 1;
+    RedisEndpoint seeds[REDIS_NODES_MAX];
+    size_t seed_count = pool_seed_count;
+    memcpy(seeds, pool_seeds, sizeof(RedisEndpoint) * seed_count);
+    int timeout_ms = pool_timeout_ms, read_replicas = pool_read_replicas;
+    unsigned generation = pool_generation;
+    pthread_mutex_unlock(&pool_lock);
+
+    // Outside the lock: connections already handed out keep working while the seeds are asked
+    RedisTopology *topology = redis_topology_discover(seeds, seed_count, timeout_ms, read_replicas);
+
+    pthread_mutex_lock(&pool_lock);
+    pool_discovering = 0;
+    if (topology && generation == pool_generation) {
+        redis_topology_unref(pool_topology);
+        pool_topology = redis_topology_ref(topology);
+    } else if (topology) {
+        redis_topology_unref(topology);  // Reconfigured meanwhile; the answer is for the old servers
+        topology = NULL;
+    }
+    pthread_cond_broadcast(&pool_available);
+    pthread_mutex_unlock(&pool_lock);
+    return topology;
+}
+
+// Forget the nodes, e.g. after a MOVED redirect; the next command asks the seeds again
+void redis_pool_topology_changed() {
+    pthread_mutex_lock(&pool_lock);
+    redis_topology_unref(pool_topology);
+    pool_topology = NULL;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// Borrow a connection to one node, waiting while pool_size of them are busy. Replicas of a
+// cluster only serve reads after READONLY. Returns NULL if the node can't be reached.
+static redisContext *pool_acquire(const RedisEndpoint *endpoint, int readonly) {
+    pthread_mutex_lock(&pool_lock);
+    int slot = -1;
+    redisContext *evicted = NULL;
+    while (pool_size > 0) {
+        int reusable = -1, empty = -1, idle = -1, busy = 0;
+        for (int i = 0; i < POOL_MAX; i++) {
+            int same = redis_endpoint_equal(&pool[i].endpoint, endpoint);
+            if (pool[i].in_use) busy += same;
+            else if (pool[i].context && same && reusable < 0) reusable = i;
+            else if (pool[i].context == NULL && empty < 0) empty = i;
+            else if (pool[i].context && idle < 0) idle = i;
+        }
+        if (busy < pool_size) slot = reusable >= 0 ? reusable : (empty >= 0 ? empty : idle);
+        if (slot >= 0) break;
+        pthread_cond_wait(&pool_available, &pool_lock);
+    }
+    if (slot < 0) {
+        pthread_mutex_unlock(&pool_lock);
+        return NULL;
+    }
+
+    // An idle connection to another node makes room for this one
+    if (pool[slot].context && !redis_endpoint_equal(&pool[slot].endpoint, endpoint)) {
+        evicted = pool[slot].context;
+        pool[slot].context = NULL;
+    }
+    pool[slot].in_use = 1;
+    pool[slot].endpoint = *endpoint;
+    redisContext *context = pool[slot].context;
+    unsigned generation = pool_generation;
+    int timeout_ms = pool_timeout_ms;
+    pthread_mutex_unlock(&pool_lock);
+    if (evicted) redisFree(evicted);
+
+    // Connect outside the lock so one unreachable server doesn't serialize every caller
+    if (context == NULL) {
+        struct timeval timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+        context = redisConnectWithTimeout(endpoint->host, endpoint->port, timeout);
+        if (context == NULL || context->err) {
+            fprintf(stderr, "Could not connect to Redis at %s:%d: %s\n", endpoint->host, endpoint->port,
+                    context ? context->errstr : "Unknown error");
+            if (context) redisFree(context);
+            context = NULL;
+        } else if (readonly) {
+            redisReply *reply = redis_command(context, "READONLY");
+            if (reply) freeReplyObject(reply);
+        }
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    if (pool[slot].context != context) pool[slot].generation = generation;
+    pool[slot].context = context;
+    if (context == NULL) {
+        pool[slot].in_use = 0;
+        pthread_cond_broadcast(&pool_available);
+    }
+    pthread_mutex_unlock(&pool_lock);
+    return context;
+}
+
+// Connection to a node of the topology; a replica that can't be reached is stood in for by its primary
+static redisContext *acquire_node(const RedisTopology *topology, int node) {
+    const RedisNode *entry = &topology->nodes[node];
+    redisContext *context = pool_acquire(&entry->endpoint, topology->cluster && entry->primary >= 0);
+    if (context == NULL && entry->primary >= 0) context = pool_acquire(&topology->nodes[entry->primary].endpoint, 0);
+    return context;
+}
+
+// Borrow a connection to the primary (on a cluster, the one holding slot 0), for commands without keys.
+// Returns NULL if the pool is shut down or the server can't be reached.
+redisContext *redis_pool_acquire() {
+    RedisTopology *topology = pool_topology_get();
+    if (topology == NULL) return NULL;
+    redisContext *context = acquire_node(topology, redis_topology_route(topology, 0, REDIS_ROUTE_PRIMARY));
+    redis_topology_unref(topology);
+    return context;
+}
+
+// Borrow a connection to the node serving key
+redisContext *redis_pool_acquire_for_key(const char *key, RedisRoute route) {
+    RedisTopology *topology = pool_topology_get();
+    if (topology == NULL) return NULL;
+    redisContext *context = acquire_node(topology, redis_topology_route(topology, redis_key_slot(key, strlen(key)), route));
+    redis_topology_unref(topology);
+    return context;
+}
+
+// Borrow a connection to a node named by redis_pool_scan_nodes() or a redirect
+redisContext *redis_pool_acquire_endpoint(const RedisEndpoint *endpoint) {
+    RedisTopology *topology = pool_topology_get();
+    int node = topology ? redis_topology_find(topology, endpoint) : -1;
+    redisContext *context = node >= 0 ? acquire_node(topology, node) : pool_acquire(endpoint, 0);
+    redis_topology_unref(topology);
+    return context;
+}
+
+// The nodes a SCAN over every key has to visit: one per primary, or one of its replicas for
+// reads. Consecutive calls spread over the replicas.
+size_t redis_pool_scan_nodes(RedisRoute route, RedisEndpoint *endpoints, size_t max) {
+    RedisTopology *topology = pool_topology_get();
+    if (topology == NULL) return 0;
+    int nodes[REDIS_NODES_MAX];
+    unsigned spread = __atomic_fetch_add(&pool_scan_spread, 1, __ATOMIC_RELAXED);
+    size_t count = redis_topology_scan_nodes(topology, route, spread, nodes, max < REDIS_NODES_MAX ? max : REDIS_NODES_MAX);
+    for (size_t i = 0; i < count; i++) endpoints[i] = topology->nodes[nodes[i]].endpoint;
+    redis_topology_unref(topology);
+    return count;
+}
+
+int redis_pool_is_cluster() {
+    RedisTopology *topology = pool_topology_get();
+    int cluster = topology && topology->cluster;
+    redis_topology_unref(topology);
+    return cluster;
+}
+
+// Hand a context back; broken ones (I/O or protocol error) are closed and reopened on next use
+void redis_pool_release(redisContext *context) {
+    if (context == NULL) return;
+
+    pthread_mutex_lock(&pool_lock);
+    int found = 0;
+    for (int i = 0; i < POOL_MAX; i++) {
+        if (pool[i].context == context && pool[i].in_use) {
+            pool[i].in_use = 0;
+            if (context->err || pool_size == 0 || pool[i].generation != pool_generation) {
+                redisFree(context);
+                pool[i].context = NULL;
+            }
+            found = 1;
+            break;
+        }
+    }
+    if (!found) redisFree(context);
+    pthread_cond_broadcast(&pool_available);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// hiredis's blocking calls, with their latency recorded when metrics are on
+redisReply *redis_command(redisContext *context, const char *format, ...) {
+    uint64_t started = metrics_begin();
+    va_list ap;
+    va_start(ap, format);
+    redisReply *reply = redisvCommand(context, format, ap);
+    va_end(ap);
+    metrics_end(METRIC_REDIS_COMMAND, started);
+    return reply;
+}
+
+redisReply *redis_command_argv(redisContext *context, int argc, const char **argv, const size_t *argvlen) {
+    uint64_t started = metrics_begin();
+    redisReply *reply = redisCommandArgv(context, argc, argv, argvlen);
+    metrics_end(METRIC_REDIS_COMMAND, started);
+    return reply;
+}
+
+// Next reply of a pipeline; the first call also flushes the appended commands
+int redis_get_reply(redisContext *context, redisReply **reply) {
+    uint64_t started = metrics_begin();
+    int status = redisGetReply(context, (void **)reply);
+    metrics_end(METRIC_REDIS_PIPELINE, started);
+    return status;
+}
+
+// --- Batches -----------------------------------------------------------------------------------
+
+typedef struct {
+    char *command;    // Formatted for the wire by hiredis
+    long long length;
+    unsigned slot;
+    int ask;          // Index + 1 into the batch's ask_targets when an ASK redirect is pending
+    redisReply *reply;
+} BatchCommand;
+
+struct RedisBatch {
+    RedisRoute route;
+    RedisTopology *topology;  // Held for the batch's lifetime so appends and routing agree
+    BatchCommand *commands;
+    size_t count;
+    size_t capacity;
+    RedisEndpoint ask_targets[REDIRECTS_MAX];
+    size_t ask_count;
+    unsigned round_trips;
+    int failed;               // Out of memory while appending
+};
+
+// An empty batch; NULL if Redis can't be reached
+RedisBatch *redis_batch_new(RedisRoute route) {
+    RedisTopology *topology = pool_topology_get();
+    if (topology == NULL) return NULL;
+    RedisBatch *batch = calloc(1, sizeof(RedisBatch));
+    if (batch == NULL) {
+        redis_topology_unref(topology);
+        return NULL;
+    }
+    batch->route = route;
+    batch->topology = topology;
+    return batch;
+}
+
+// Drop the commands and replies; the batch can be filled again
+void redis_batch_clear(RedisBatch *batch) {
+    for (size_t i = 0; i < batch->count; i++) {
+        redisFreeCommand(batch->commands[i].command);
+        if (batch->commands[i].reply) freeReplyObject(batch->commands[i].reply);
+    }
+    batch->count = 0;
+    batch->ask_count = 0;
+    batch->failed = 0;
+}
+
+void redis_batch_free(RedisBatch *batch) {
+    if (batch == NULL) return;
+    redis_batch_clear(batch);
+    free(batch->commands);
+    redis_topology_unref(batch->topology);
+    free(batch);
+}
+
+static size_t batch_push(RedisBatch *batch, const char *key, char *command, long long length) {
+    if (batch->count == batch->capacity) {
+        size_t capacity = batch->capacity ? batch->capacity * 2 : 64;
+        BatchCommand *commands = realloc(batch->commands, capacity * sizeof(BatchCommand));
+        if (commands == NULL) {
+            redisFreeCommand(command);
+            batch->failed = 1;
+            return batch->count;
+        }
+        batch->commands = commands;
+        batch->capacity = capacity;
+    }
+    if (command == NULL || length < 0) {
+        batch->failed = 1;
+        return batch->count;
+    }
+    BatchCommand *entry = &batch->commands[batch->count];
+    entry->command = command;
+    entry->length = length;
+    entry->slot = key ? redis_key_slot(key, strlen(key)) : 0;
+    entry->ask = 0;
+    entry->reply = NULL;
+    return batch->count++;
+}
+
+// Queue a command that touches key (the slot it is routed by); returns the index of its reply
+size_t redis_batch_append(RedisBatch *batch, const char *key, const char *format, ...) {
+    char *command = NULL;
+    va_list ap;
+    va_start(ap, format);
+    int length = redisvFormatCommand(&command, format, ap);
+    va_end(ap);
+    return batch_push(batch, key, command, length);
+}
+
+size_t redis_batch_append_argv(RedisBatch *batch, const char *key, int argc, const char **argv, const size_t *argvlen) {
+    char *command = NULL;
+    long long length = redisFormatCommandArgv(&command, argc, argv, argvlen);
+    return batch_push(batch, key, command, length);
+}
+
+// A command over many keys whose replies add up, such as DEL, UNLINK or EXISTS: one command on a
+// single server, one per key on a cluster, where the keys rarely share a slot. Returns the
+// index of the first reply; the rest follow.
+size_t redis_batch_append_keys(RedisBatch *batch, const char *command, const char *const *keys, size_t n) {
+    size_t first = batch->count;
+    if (batch->topology->cluster) {
+        for (size_t i = 0; i < n; i++) {
+            const char *argv[] = { command, keys[i] };
+            redis_batch_append_argv(batch, keys[i], 2, argv, NULL);
+        }
+        return first;
+    }
+
+    const char **argv = malloc((n + 1) * sizeof(char *));
+    if (argv == NULL) {
+        batch->failed = 1;
+        return first;
+    }
+    argv[0] = command;
+    memcpy(argv + 1, keys, n * sizeof(char *));
+    redis_batch_append_argv(batch, n ? keys[0] : NULL, (int)n + 1, argv, NULL);
+    free(argv);
+    return first;
+}
+
+size_t redis_batch_count(const RedisBatch *batch) {
+    return batch->count;
+}
+
+int redis_batch_is_cluster(const RedisBatch *batch) {
+    return batch->topology->cluster;
+}
+
+unsigned redis_batch_round_trips(const RedisBatch *batch) {
+    return batch->round_trips;
+}
+
+// Reply of the command at index; NULL if its node could not be reached
+redisReply *redis_batch_reply(const RedisBatch *batch, size_t index) {
+    return index < batch->count ? batch->commands[index].reply : NULL;
+}
+
+// Send the unanswered commands meant for one node down a single pipeline and read their
+// replies. Redirected commands are left unanswered, marked for the next round.
+static int execute_on_node(RedisBatch *batch, int target, const int *targets, int *moved) {
+    const RedisEndpoint *endpoint = target >= 0 ? &batch->topology->nodes[target].endpoint : &batch->ask_targets[-target - 1];
+    redisContext *context = target >= 0 ? acquire_node(batch->topology, target) : redis_pool_acquire_endpoint(endpoint);
+    if (context == NULL) return -1;
+
+    size_t sent = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        BatchCommand *entry = &batch->commands[i];
+        if (entry->reply || targets[i] != target) continue;
+        if (entry->ask) redisAppendCommand(context, "ASKING");
+        redisAppendFormattedCommand(context, entry->command, entry->length);
+        sent++;
+    }
+
+    int result = 0;
+    for (size_t i = 0; i < batch->count && sent > 0; i++) {
+        BatchCommand *entry = &batch->commands[i];
+        if (entry->reply || targets[i] != target) continue;
+        redisReply *reply = NULL;
+        if (entry->ask) {
+            if (redis_get_reply(context, &reply) != REDIS_OK) break;
+            freeReplyObject(reply);
+            entry->ask = 0;
+        }
+        if (redis_get_reply(context, &reply) != REDIS_OK || reply == NULL) break;
+        sent--;
+
+        int ask;
+        RedisEndpoint redirect;
+        if (reply->type == REDIS_REPLY_ERROR && redis_parse_redirect(reply->str, &ask, &redirect)) {
+            // MOVED: the slot has a new owner for good; ASK: only this command goes elsewhere
+            if (!ask) *moved = 1;
+            else if (batch->ask_count < REDIRECTS_MAX) {
+                batch->ask_targets[batch->ask_count++] = redirect;
+                entry->ask = (int)batch->ask_count;
+            }
+            freeReplyObject(reply);
+            continue;
+        }
+        entry->reply = reply;
+    }
+    if (sent > 0) {
+        fprintf(stderr, "Redis pipeline to %s:%d failed: %s\n", endpoint->host, endpoint->port, context->errstr);
+        result = -1;
+    }
+    batch->round_trips++;
+    redis_pool_release(context);
+    return result;
+}
+
+// Run every queued command. Returns 0 once each one has a reply (which may be an error reply),
+// -1 if a node could not be reached or redirects did not settle.
+int redis_batch_execute(RedisBatch *batch) {
+    if (batch->failed) return -1;
+    int *targets = malloc((batch->count ? batch->count : 1) * sizeof(int));
+    if (targets == NULL) return -1;
+
+    int result = 0, rediscovered = 0;
+    for (int round = 0; round <= REDIRECTS_MAX; round++) {
+        // Target per command: a node of the topology, or -1 - i for the i-th ASK target
+        int pending = 0;
+        for (size_t i = 0; i < batch->count; i++) {
+            const BatchCommand *entry = &batch->commands[i];
+            if (entry->reply) continue;
+            targets[i] = entry->ask ? -entry->ask : redis_topology_route(batch->topology, entry->slot, batch->route);
+            pending = 1;
+        }
+        if (!pending) break;
+        if (round == REDIRECTS_MAX) {
+            fprintf(stderr, "Redis redirects did not settle after %d rounds\n", REDIRECTS_MAX);
+            result = -1;
+            break;
+        }
 
-void redis_connect() {
-    if (redis_context) {
-        redisFree(redis_context);
+        int moved = 0;
+        size_t node_count = batch->topology->node_count, ask_count = batch->ask_count;
+        for (int target = -(int)ask_count; target < (int)node_count; target++) {
+            int used = 0;
+            for (size_t i = 0; i < batch->count && !used; i++) used = !batch->commands[i].reply && targets[i] == target;
+            if (!used) continue;
+            if (execute_on_node(batch, target, targets, &moved) != 0) result = -1;
+        }
+        if (result != 0) break;
+
+        // Slots moved: learn the new owners once per execution, then retry what bounced
+        if (moved && !rediscovered) {
+            redis_pool_topology_changed();
+            RedisTopology *topology = pool_topology_get();
+            if (topology == NULL) {
+                result = -1;
+                break;
+            }
+            redis_topology_unref(batch->topology);
+            batch->topology = topology;
+            rediscovered = 1;
+        }
     }
+    free(targets);
+    return result;
+}
+
+// --- Threads ---------------------------------------------------------------------------------
 
-    redis_context = redisConnect(redis_host, redis_port);
-    if (redis_context == NULL || redis_context->err) {
-        fprintf(stderr, "Could not connect to Redis: %s\n", redis_context ? redis_context->errstr : "Unknown error");
+void format_thread_key(char *buf, size_t size, const char *board, const char *thread_id, const char *field) {
+    snprintf(buf, size, "%s%s_%s", board, thread_id, field);
+}
+
+// Matches the title key of every thread of the board
+void format_title_pattern(char *buf, size_t size, const char *board) {
+    snprintf(buf, size, "%s*_title", board);
+}
+
+// Pull the numeric thread ID out of a key such as "adv123456_title"
+int extract_thread_id(const char *key, char *thread_id, size_t size) {
+    const char *digits = key + strcspn(key, "0123456789");
+    size_t len = strspn(digits, "0123456789");
+    if (len == 0 || len >= size) return 0;
+    memcpy(thread_id, digits, len);
+    thread_id[len] = '\0';
+    return 1;
+}
+
+// MGET of title, count and status for n threads; argv strings are owned by the caller
+int build_thread_fields_argv(const char *board, char (*ids)[THREAD_ID_MAX], size_t n, const char ***argv) {
+    static const char *fields[] = { "title", "count", "status" };
+    int argc = 1 + (int)n * 3;
+    const char **args = malloc(sizeof(char *) * argc);
+    args[0] = strdup("MGET");
+    for (size_t i = 0; i < n; i++) {
+        for (int f = 0; f < 3; f++) {
+            char key[320];
+            format_thread_key(key, sizeof(key), board, ids[i], fields[f]);
+            args[1 + i * 3 + f] = strdup(key);
+        }
     }
+    *argv = args;
+    return argc;
 }
 
-void fetch_thread_list() {
-    // Code to fetch list of threads from Redis
+void free_thread_fields_argv(const char **argv, int argc) {
+    for (int i = 0; i < argc; i++) free((char *)argv[i]);
+    free(argv);
 }
 
-void fetch_thread_details(const char *thread_id) {
-    // Code to fetch messages of a given thread
+// Hand each thread's title, count and status (three values per thread, NULL where a key is
+// missing) to fn; a missing title means the thread is gone
+void deliver_thread_values(const char *const *values, char (*ids)[THREAD_ID_MAX], size_t n, thread_record_fn fn, void *user_data) {
+    for (size_t i = 0; i < n; i++) {
+        const char *title = values[i * 3], *count = values[i * 3 + 1], *status = values[i * 3 + 2];
+        if (title) fn(ids[i], title, count ? atoi(count) : 0, status ? status : "Unknown", user_data);
+        else fn(ids[i], NULL, 0, NULL, user_data);
+    }
 }
 
-void update_thread_title(const char *thread_id, const char *new_title) {
-    // Code to update thread title in Redis
+static const char *string_value(const redisReply *reply) {
+    return reply && reply->type == REDIS_REPLY_STRING ? reply->str : NULL;
 }
 
-void delete_thread(const char *thread_id) {
-    // Code to delete a thread and its data from Redis
+// Hand each thread of an MGET reply to fn
+void deliver_thread_fields(redisReply *reply, char (*ids)[THREAD_ID_MAX], size_t n, thread_record_fn fn, void *user_data) {
+    if (reply == NULL || reply->type != REDIS_REPLY_ARRAY || reply->elements != n * 3) return;
+
+    const char **values = malloc(n * 3 * sizeof(char *));
+    if (values == NULL) return;
+    for (size_t i = 0; i < n * 3; i++) values[i] = string_value(reply->element[i]);
+    deliver_thread_values(values, ids, n, fn, user_data);
+    free(values);
 }
 
-void delete_message(const char *thread_id, const char *message_id) {
-    // Code to delete an individual message within a thread
+// Title, count and status of n threads: one MGET on a single server, one GET per key on a
+// cluster, where a thread's three keys hash to different slots. Returns the index of the first reply.
+size_t redis_batch_append_thread_fields(RedisBatch *batch, const char *board, char (*ids)[THREAD_ID_MAX], size_t n) {
+    size_t first = redis_batch_count(batch);
+    if (redis_batch_is_cluster(batch)) {
+        static const char *fields[] = { "title", "count", "status" };
+        for (size_t i = 0; i < n; i++) {
+            for (int f = 0; f < 3; f++) {
+                char key[320];
+                format_thread_key(key, sizeof(key), board, ids[i], fields[f]);
+                redis_batch_append(batch, key, "GET %s", key);
+            }
+        }
+        return first;
+    }
+
+    const char **argv;
+    int argc = build_thread_fields_argv(board, ids, n, &argv);
+    redis_batch_append_argv(batch, argv[1], argc, argv, NULL);
+    free_thread_fields_argv(argv, argc);
+    return first;
+}
+
+// Reply for one field (0 title, 1 count, 2 status) of one thread queued by
+// redis_batch_append_thread_fields(); NULL if it never came
+const redisReply *redis_batch_thread_field(const RedisBatch *batch, size_t first, size_t n, size_t thread, int field) {
+    if (redis_batch_is_cluster(batch)) return redis_batch_reply(batch, first + thread * 3 + field);
+    const redisReply *reply = redis_batch_reply(batch, first);
+    if (reply == NULL || reply->type != REDIS_REPLY_ARRAY || reply->elements != n * 3) return NULL;
+    return reply->element[thread * 3 + field];
+}
+
+void redis_batch_deliver_thread_fields(const RedisBatch *batch, size_t first, char (*ids)[THREAD_ID_MAX], size_t n,
+                                       thread_record_fn fn, void *user_data) {
+    const char **values = malloc(n * 3 * sizeof(char *));
+    if (values == NULL) return;
+    for (size_t i = 0; i < n; i++) {
+        for (int f = 0; f < 3; f++) values[i * 3 + f] = string_value(redis_batch_thread_field(batch, first, n, i, f));
+    }
+    deliver_thread_values(values, ids, n, fn, user_data);
+    free(values);
+}
+
+// Fetch the fields of one batch of threads and deliver them; returns -1 if Redis failed
+static int fetch_thread_batch(RedisRoute route, const char *board, char (*ids)[THREAD_ID_MAX], size_t n,
+                              thread_record_fn fn, void *user_data) {
+    RedisBatch *batch = redis_batch_new(route);
+    if (batch == NULL) return -1;
+    size_t first = redis_batch_append_thread_fields(batch, board, ids, n);
+    int status = redis_batch_execute(batch);
+    if (status == 0) {
+        for (size_t i = first; i < redis_batch_count(batch) && status == 0; i++) {
+            if (redis_batch_reply(batch, i)->type == REDIS_REPLY_ERROR) {
+                fprintf(stderr, "Fetching thread fields failed: %s\n", redis_batch_reply(batch, i)->str);
+                status = -1;
+            }
+        }
+    }
+    if (status == 0) redis_batch_deliver_thread_fields(batch, first, ids, n, fn, user_data);
+    redis_batch_free(batch);
+    return status;
+}
+
+static void append_to_snapshot(const char *thread_id, const char *title, int count, const char *status, void *user_data) {
+    if (title) thread_snapshot_append(user_data, strtoull(thread_id, NULL, 10), title, count, status);
+}
+
+// One SCAN step on a node; NULL (with the reason printed) if it failed
+redisReply *redis_scan_step(const RedisEndpoint *node, const char *cursor, const char *pattern, int count) {
+    redisContext *context = redis_pool_acquire_endpoint(node);
+    if (context == NULL) return NULL;
+    redisReply *reply = redis_command(context, "SCAN %s MATCH %s COUNT %d", cursor, pattern, count);
+    if (reply == NULL || reply->type != REDIS_REPLY_ARRAY || reply->elements != 2) {
+        fprintf(stderr, "SCAN on %s:%d failed: %s\n", node->host, node->port,
+                reply && reply->type == REDIS_REPLY_ERROR ? reply->str : context->errstr);
+        if (reply) freeReplyObject(reply);
+        reply = NULL;
+    }
+    redis_pool_release(context);
+    return reply;
+}
+
+// Walk every thread of the board with SCAN, fetching fields in batch-sized pipelines, into one
+// snapshot. On a cluster every primary (or a replica of it) is scanned in turn. Blocking; meant
+// for worker threads. Returns NULL if Redis failed part-way.
+ThreadSnapshot *fetch_thread_list(const char *board, int scan_count, int batch) {
+    RedisEndpoint nodes[REDIS_NODES_MAX];
+    size_t node_count = redis_pool_scan_nodes(REDIS_ROUTE_READ, nodes, REDIS_NODES_MAX);
+    if (node_count == 0) return NULL;
+
+    ThreadSnapshot *snapshot = thread_snapshot_new(0);  // Both blocks grow by doubling: O(log n) allocations
+    char pattern[300];
+    format_title_pattern(pattern, sizeof(pattern), board);
+    char (*ids)[THREAD_ID_MAX] = malloc(sizeof(*ids) * (batch > 0 ? batch : 1));
+    int failed = (snapshot == NULL || ids == NULL);
+
+    for (size_t node = 0; node < node_count && !failed; node++) {
+        char cursor[32] = "0";
+        do {
+            // Each step borrows its connection anew; a SCAN cursor lives on the server, not the connection
+            redisReply *reply = redis_scan_step(&nodes[node], cursor, pattern, scan_count);
+            if (reply == NULL) {
+                failed = 1;
+                break;
+            }
+            snprintf(cursor, sizeof(cursor), "%s", reply->element[0]->str);
+
+            redisReply *keys = reply->element[1];
+            size_t n = 0;
+            for (size_t i = 0; i < keys->elements && !failed; i++) {
+                if (extract_thread_id(keys->element[i]->str, ids[n], THREAD_ID_MAX)) n++;
+                if (n == (size_t)batch || (i + 1 == keys->elements && n > 0)) {
+                    failed = fetch_thread_batch(REDIS_ROUTE_READ, board, ids, n, append_to_snapshot, snapshot) < 0;
+                    n = 0;
+                }
+            }
+            freeReplyObject(reply);
+        } while (!failed && strcmp(cursor, "0") != 0);
+    }
+
+    free(ids);
+    if (failed) {
+        thread_snapshot_unref(snapshot);
+        return NULL;
+    }
+    return snapshot;
+}
+
+// Read one thread's fields from the primary; fn gets a NULL title if it doesn't exist
+int fetch_thread_record(const char *board, const char *thread_id, thread_record_fn fn, void *user_data) {
+    char ids[1][THREAD_ID_MAX];
+    snprintf(ids[0], sizeof(ids[0]), "%s", thread_id);
+    return fetch_thread_batch(REDIS_ROUTE_PRIMARY, board, ids, 1, fn, user_data);
+}
+
+// Fill page from the replies to LLEN and LRANGE of the same list; 0 on success, with the
+// reason printed otherwise. The posts are copied as stored, so the replies can be freed;
+// compressed entries are decoded with post_codec_decode_page.
+int thread_post_page_from_replies(const redisReply *llen, const redisReply *lrange, long start, ThreadPostPage *page) {
+    memset(page, 0, sizeof(*page));
+    page->start = start;
+    const redisReply *failed = llen->type != REDIS_REPLY_INTEGER ? llen : lrange->type != REDIS_REPLY_ARRAY ? lrange : NULL;
+    if (failed) {
+        fprintf(stderr, "Fetching posts failed: %s\n", failed->type == REDIS_REPLY_ERROR ? failed->str : "unexpected reply");
+        return -1;
+    }
+
+    page->total = llen->integer;
+    if (lrange->elements == 0) return 0;
+    page->posts = calloc(lrange->elements, sizeof(char *));
+    page->lengths = calloc(lrange->elements, sizeof(size_t));
+    if (page->posts == NULL || page->lengths == NULL) {
+        thread_post_page_free(page);
+        return -1;
+    }
+    for (size_t i = 0; i < lrange->elements; i++) {
+        const redisReply *post = lrange->element[i];
+        if (post->type != REDIS_REPLY_STRING) continue;
+        page->posts[page->count] = malloc(post->len + 1);
+        if (page->posts[page->count] == NULL) {
+            thread_post_page_free(page);
+            return -1;
+        }
+        memcpy(page->posts[page->count], post->str, post->len + 1);
+        page->lengths[page->count++] = post->len;
+    }
+    return 0;
+}
+
+// Some scraper versions store _posts as a single string holding the whole thread; LLEN on it
+// fails with WRONGTYPE, and it is read with GET instead
+int thread_posts_are_string(const redisReply *llen) {
+    return llen->type == REDIS_REPLY_ERROR && strncmp(llen->str, "WRONGTYPE", 9) == 0;
+}
+
+// Fill page from the GET of a string-typed _posts key: one entry, as archive.c stores it
+int thread_post_page_from_string(const redisReply *get, long start, ThreadPostPage *page) {
+    memset(page, 0, sizeof(*page));
+    page->start = start;
+    if (get->type == REDIS_REPLY_NIL) return 0;  // Deleted in between
+    if (get->type != REDIS_REPLY_STRING) {
+        fprintf(stderr, "Fetching posts failed: %s\n", get->type == REDIS_REPLY_ERROR ? get->str : "unexpected reply");
+        return -1;
+    }
+    page->total = 1;
+    if (start > 0) return 0;
+    page->posts = calloc(1, sizeof(char *));
+    page->lengths = calloc(1, sizeof(size_t));
+    if (page->posts && page->lengths) page->posts[0] = malloc(get->len + 1);
+    if (page->posts == NULL || page->lengths == NULL || page->posts[0] == NULL) {
+        thread_post_page_free(page);
+        return -1;
+    }
+    memcpy(page->posts[0], get->str, get->len + 1);
+    page->lengths[page->count++] = get->len;
+    return 0;
+}
+
+void thread_post_page_free(ThreadPostPage *page) {
+    for (size_t i = 0; page->posts && i < page->count; i++) free(page->posts[i]);
+    free(page->posts);
+    free(page->lengths);
+    memset(page, 0, sizeof(*page));
+}
+
+// Read one page of a thread's posts and the length of the whole list in one round trip, so a
+// viewer can size itself from the first page and fetch the rest as it is scrolled to.
+// Returns -1 if Redis failed.
+int fetch_thread_details(const char *board, const char *thread_id, long start, long count, ThreadPostPage *page) {
+    memset(page, 0, sizeof(*page));
+    RedisBatch *batch = redis_batch_new(REDIS_ROUTE_READ);
+    if (batch == NULL) return -1;
+
+    char key[320];
+    format_thread_key(key, sizeof(key), board, thread_id, "posts");
+    size_t llen = redis_batch_append(batch, key, "LLEN %s", key);
+    redis_batch_append(batch, key, "LRANGE %s %ld %ld", key, start, start + count - 1);
+    int status = redis_batch_execute(batch);
+    if (status == 0 && thread_posts_are_string(redis_batch_reply(batch, llen))) {
+        redis_batch_clear(batch);
+        redis_batch_append(batch, key, "GET %s", key);
+        status = redis_batch_execute(batch);
+        if (status == 0) status = thread_post_page_from_string(redis_batch_reply(batch, 0), start, page);
+    } else if (status == 0) {
+        status = thread_post_page_from_replies(redis_batch_reply(batch, llen), redis_batch_reply(batch, llen + 1), start, page);
+    }
+    if (status == 0 && post_codec_decode_page(board, page) != 0) {
+        thread_post_page_free(page);
+        status = -1;
+    }
+    redis_batch_free(batch);
+    return status;
+}
+
+int update_thread_title(const char *board, const char *thread_id, const char *new_title) {
+    RedisBatch *batch = redis_batch_new(REDIS_ROUTE_PRIMARY);
+    if (batch == NULL) return -1;
+
+    char key[320];
+    format_thread_key(key, sizeof(key), board, thread_id, "title");
+    size_t index = redis_batch_append(batch, key, "SET %s %s", key, new_title);
+    int status = redis_batch_execute(batch) == 0 && redis_batch_reply(batch, index)->type != REDIS_REPLY_ERROR ? 0 : -1;
+
+    redis_batch_free(batch);
+    return status;
+}
+
+// Delete the keys of the thread, derived from its ID, in one pipeline: a single UNLINK, or one
+// per key on a cluster. Returns the number of keys removed.
+int delete_thread(const char *board, const char *thread_id) {
+    RedisBatch *batch = redis_batch_new(REDIS_ROUTE_PRIMARY);
+    if (batch == NULL) return -1;
+
+    static const char *fields[] = { "title", "count", "status", "posts" };
+    char keys[4][320];
+    const char *key_list[4];
+    for (int f = 0; f < 4; f++) {
+        format_thread_key(keys[f], sizeof(keys[f]), board, thread_id, fields[f]);
+        key_list[f] = keys[f];
+    }
+    redis_batch_append_keys(batch, "UNLINK", key_list, 4);
+
+    int deleted = redis_batch_execute(batch) == 0 ? 0 : -1;
+    for (size_t i = 0; i < redis_batch_count(batch) && deleted >= 0; i++) {
+        redisReply *reply = redis_batch_reply(batch, i);
+        if (reply->type == REDIS_REPLY_INTEGER) deleted += (int)reply->integer;
+        else deleted = -1;
+    }
+
+    redis_batch_free(batch);
+    return deleted;
+}
+
+// Index of the entry of a LRANGE reply whose post has the given "no", decoding compressed
+// entries; -1 if none has it or an entry can't be decoded
+static long find_post(const char *board, const redisReply *list, unsigned long long post_no) {
+    for (size_t i = 0; i < list->elements; i++) {
+        const redisReply *entry = list->element[i];
+        if (entry->type != REDIS_REPLY_STRING) continue;
+        char *decoded = NULL;
+        size_t length;
+        if (post_codec_decode(board, entry->str, entry->len, &decoded, &length) != 0) return -1;
+        const char *value = json_object_find(decoded ? decoded : entry->str, "no");
+        int found = value && strtoull(value, NULL, 10) == post_no;
+        free(decoded);
+        if (found) return (long)i;
+    }
+    return -1;
+}
+
+// Delete one post of a thread: find its entry in <board><id>_posts by post number, then LREM
+// that exact entry and DECR _count in one pipeline. Returns 1 once removed, 0 if the thread
+// has no such post, -1 if Redis failed.
+int delete_message(const char *board, const char *thread_id, const char *post_no) {
+    unsigned long long no = strtoull(post_no, NULL, 10);
+    if (no == 0) return 0;
+    RedisBatch *batch = redis_batch_new(REDIS_ROUTE_PRIMARY);
+    if (batch == NULL) return -1;
+
+    char posts_key[320], count_key[320];
+    format_thread_key(posts_key, sizeof(posts_key), board, thread_id, "posts");
+    format_thread_key(count_key, sizeof(count_key), board, thread_id, "count");
+    redis_batch_append(batch, posts_key, "LRANGE %s 0 -1", posts_key);
+    const redisReply *list = redis_batch_execute(batch) == 0 ? redis_batch_reply(batch, 0) : NULL;
+    int result = list && list->type == REDIS_REPLY_ARRAY ? 0 : -1;
+    if (result != 0) list = NULL;
+    long index = list ? find_post(board, list, no) : -1;
+
+    if (index >= 0) {
+        // The entry as stored, so LREM matches it byte for byte; the LRANGE reply stays alive
+        // until the batch is freed, so it is copied before the batch is cleared
+        const redisReply *entry = list->element[index];
+        size_t length = entry->len;
+        char *stored = malloc(length ? length : 1);
+        if (stored) memcpy(stored, entry->str, length);
+        redis_batch_clear(batch);
+        if (stored) {
+            redis_batch_append(batch, posts_key, "LREM %s 1 %b", posts_key, stored, length);
+            redis_batch_append(batch, count_key, "DECR %s", count_key);
+        }
+        const redisReply *reply = stored && redis_batch_execute(batch) == 0 ? redis_batch_reply(batch, 0) : NULL;
+        result = reply && reply->type == REDIS_REPLY_INTEGER ? 0 : -1;
+        int removed = result == 0 && reply->integer > 0;
+        if (result == 0 && !removed) {
+            // Rewritten between the read and the LREM; undo the DECR
+            redis_batch_clear(batch);
+            redis_batch_append(batch, count_key, "INCR %s", count_key);
+            redis_batch_execute(batch);
+        }
+        free(stored);
+        if (result == 0) result = removed;
+    }
+    redis_batch_free(batch);
+    return result;
 }
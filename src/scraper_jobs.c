@@ -0,0 +1,524 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "../include/scraper_jobs.h"
+#include "../include/scraper_rpc.h"
+#include "../include/thread_ingest.h"
+#include "../include/archive.h"
+#include "../include/board_index.h"
+#include "../include/board_export.h"
+#include "../include/post_codec.h"
+#include "../include/redis_operations.h"
+#include "../include/settings.h"
+
+// --- Scraper backend -------------------------------------------------------------------------
+
+static char *read_file(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+    char *data = NULL;
+    size_t used = 0, capacity = 0, n;
+    char chunk[16384];
+    while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        if (used + n + 1 > capacity) {
+            capacity = (used + n + 1) * 2;
+            char *grown = realloc(data, capacity);
+            if (grown == NULL) break;
+            data = grown;
+        }
+        memcpy(data + used, chunk, n);
+        used += n;
+    }
+    fclose(file);
+    if (data) data[used] = '\0';
+    return data;
+}
+
+void scraper_jobs_start_worker() {
+    char concurrency[16];
+    snprintf(concurrency, sizeof(concurrency), "%d", job_workers);
+
+    if (strcmp(scraper_worker, "local") == 0) {
+        char *argv[] = { "python3", "-u", scraper_worker_script, "--concurrency", concurrency, NULL };
+        scraper_rpc_start(argv);
+    } else if (strcmp(scraper_worker, "container") == 0) {
+        // Passed inline, so nothing has to be installed in the container
+        char *source = read_file(scraper_worker_script);
+        if (source == NULL) {
+            fprintf(stderr, "Cannot read %s; scraper commands will use docker exec\n", scraper_worker_script);
+            return;
+        }
+        char *argv[] = { "/usr/bin/docker", "exec", "-i", "4chan_scraper-scraper-1", "python", "-u", "-c", source,
+                         "--concurrency", concurrency, NULL };
+        scraper_rpc_start(argv);
+        free(source);
+    }
+}
+
+static void on_worker_output(const char *line, void *user_data) {
+    job_queue_output((unsigned)(uintptr_t)user_data, line);
+}
+
+// Job run hook: hand the command to the persistent scraper worker. argv stays the
+// docker exec command line, which the queue falls back to while no worker is ready.
+static int run_in_scraper_worker(unsigned job_id, char *const *argv, const int *cancelled, void *user_data) {
+    size_t i = 0;
+    while (argv[i] && strcmp(argv[i], "FourChanScraper.py") != 0) i++;
+    if (argv[i] == NULL || argv[i + 1] == NULL) return JOB_RUN_UNAVAILABLE;
+
+    int exit_code = scraper_rpc_call(argv[i + 1], &argv[i + 2], cancelled, on_worker_output, (void *)(uintptr_t)job_id, NULL);
+    return exit_code == SCRAPER_RPC_UNAVAILABLE ? JOB_RUN_UNAVAILABLE : exit_code;
+}
+
+// Job run hook for native_ingest: import the thread JSON directly instead of calling the
+// scraper. The job keeps the scraper's name and argv, so it deduplicates against scraper
+// adds and falls back to docker exec if the import cannot start.
+static int run_native_ingest(unsigned job_id, char *const *argv, const int *cancelled, void *user_data) {
+    size_t i = 0;
+    while (argv[i] && strcmp(argv[i], "scrape_thread") != 0) i++;
+    if (argv[i] == NULL || argv[i + 1] == NULL || argv[i + 2] == NULL) return JOB_RUN_UNAVAILABLE;
+
+    IngestStats stats;
+    int result = thread_ingest_from_api(argv[i + 1], ingest_base_url, argv[i + 2], cancelled, &stats);
+    if (result != 0 && stats.posts == 0 && stats.bytes == 0 && !__atomic_load_n(cancelled, __ATOMIC_RELAXED)) return JOB_RUN_UNAVAILABLE;
+
+    char line[256];
+    if (result == 0) thread_ingest_report(&stats, line, sizeof(line));
+    else snprintf(line, sizeof(line), "Ingest of thread %s failed after %u posts\n", argv[i + 2], stats.posts);
+    job_queue_output(job_id, line);
+    return result == 0 ? 0 : 1;
+}
+
+// --- Scraper commands ------------------------------------------------------------------------
+
+// Add a thread using the scraper script, or the built-in importer when native_ingest is set
+unsigned submit_add_thread(const char *board, const char *thread_id, job_done_fn on_done, void *user_data) {
+    char *argv[] = { SCRAPER_ARGV, "scrape_thread", (char *)board, (char *)thread_id, NULL };
+    JobSpec spec = { "scrape_thread", board, thread_id, argv, native_ingest ? run_native_ingest : run_in_scraper_worker, NULL, on_done, user_data };
+    return job_queue_submit(&spec);
+}
+
+unsigned submit_delete_thread(const char *board, const char *thread_id, job_done_fn on_done, void *user_data) {
+    char *argv[] = { SCRAPER_ARGV, "delete_thread", (char *)board, (char *)thread_id, NULL };
+    JobSpec spec = { "delete_thread", board, thread_id, argv, run_in_scraper_worker, NULL, on_done, user_data };
+    return job_queue_submit(&spec);
+}
+
+unsigned submit_set_title(const char *board, const char *thread_id, const char *title, job_done_fn on_done, void *user_data) {
+    // Passed as its own argument, so quotes in the title need no escaping
+    char *argv[] = { SCRAPER_ARGV, "set_title", (char *)board, (char *)thread_id, (char *)title, NULL };
+    JobSpec spec = { "set_title", board, thread_id, argv, run_in_scraper_worker, NULL, on_done, user_data };
+    return job_queue_submit(&spec);
+}
+
+unsigned submit_update_threads(const char *board, job_done_fn on_done, void *user_data) {
+    char *argv[] = { SCRAPER_ARGV, "update_stored_threads", (char *)board, NULL };
+    JobSpec spec = { "update_stored_threads", board, NULL, argv, run_in_scraper_worker, NULL, on_done, user_data };
+    return job_queue_submit(&spec);
+}
+
+unsigned submit_generate_audio(const char *board, const char *thread_id, job_check_fn check, job_done_fn on_done, void *user_data) {
+    char *argv[] = { "/usr/bin/docker", "exec", "4chan_scraper-scraper-1", "python3", "FourChanScraper.py",
+                     "generate_audio", (char *)board, (char *)thread_id, NULL };
+    JobSpec spec = { "generate_audio", board, thread_id, argv, run_in_scraper_worker, check, on_done, user_data };
+    return job_queue_submit(&spec);
+}
+
+// --- Archive moves ---------------------------------------------------------------------------
+
+static int index_archived_threads(FtsIndex *index, const char *path, const char *const *ids, size_t n);
+
+// Job run hook: argv is { "archive_threads", board, id... }
+static int run_archive_move(unsigned job_id, char *const *argv, const int *cancelled, void *user_data) {
+    size_t n = 0;
+    while (argv[2 + n]) n++;
+    char (*ids)[THREAD_ID_MAX] = calloc(n ? n : 1, sizeof(*ids));
+    if (ids == NULL) return 1;
+    for (size_t i = 0; i < n; i++) snprintf(ids[i], THREAD_ID_MAX, "%s", argv[2 + i]);
+
+    char path[512], line[768];
+    format_archive_path(path, sizeof(path), archive_dir, argv[1]);
+    if (mkdir(archive_dir, 0755) != 0 && errno != EEXIST) fprintf(stderr, "Failed to create %s: %s\n", archive_dir, strerror(errno));
+    ArchiveMoveStats stats;
+    int result = archive_move_threads(argv[1], path, ids, n, cancelled, &stats);
+    free(ids);
+    // Re-read from the archive: the copy there may be newer than the one indexed, or never
+    // indexed at all when the external scraper wrote the thread
+    FtsIndex *index = stats.moved ? board_search_index(argv[1]) : NULL;
+    if (index && index_archived_threads(index, path, (const char *const *)&argv[2], n) != 0) {
+        job_queue_output(job_id, "The search index could not be updated from the archive");
+    }
+
+    snprintf(line, sizeof(line), "Moved %u threads (%u posts, %zu KiB) to %s%s", stats.moved, stats.posts, stats.bytes / 1024, path,
+             result == 0 ? "" : " before stopping");
+    job_queue_output(job_id, line);
+    if (stats.missing) {
+        snprintf(line, sizeof(line), "%u threads were no longer in Redis", stats.missing);
+        job_queue_output(job_id, line);
+    }
+    return result == 0 ? 0 : 1;
+}
+
+// thread_id names the job for deduplication when a single thread is moved, NULL for a batch
+unsigned submit_archive_move(const char *board, const char *thread_id, const char *const *ids, size_t n,
+                             job_done_fn on_done, void *user_data) {
+    char **argv = calloc(n + 3, sizeof(char *));
+    if (argv == NULL) return 0;
+    argv[0] = "archive_threads";
+    argv[1] = (char *)board;
+    for (size_t i = 0; i < n; i++) argv[2 + i] = (char *)ids[i];
+
+    JobSpec spec = { "archive_threads", board, thread_id, argv, run_archive_move, NULL, on_done, user_data };
+    unsigned id = job_queue_submit(&spec);
+    free(argv);
+    return id;
+}
+
+// --- Search index ----------------------------------------------------------------------------
+
+typedef struct BoardIndex {
+    char board[64];
+    FtsIndex *index;
+    struct BoardIndex *next;
+} BoardIndex;
+
+static pthread_mutex_t indexes_lock = PTHREAD_MUTEX_INITIALIZER;
+static BoardIndex *board_indexes = NULL;
+
+// The board's post index, opened on first use; safe to call from job workers
+FtsIndex *board_search_index(const char *board) {
+    pthread_mutex_lock(&indexes_lock);
+    BoardIndex *entry = board_indexes;
+    while (entry && strcmp(entry->board, board) != 0) entry = entry->next;
+    if (entry == NULL && (entry = calloc(1, sizeof(BoardIndex))) != NULL) {
+        char dir[512];
+        snprintf(dir, sizeof(dir), "%s/%s", index_dir, board);
+        entry->index = fts_index_open(dir);
+        if (entry->index) {
+            snprintf(entry->board, sizeof(entry->board), "%s", board);
+            entry->next = board_indexes;
+            board_indexes = entry;
+        } else {
+            free(entry);
+            entry = NULL;
+        }
+    }
+    pthread_mutex_unlock(&indexes_lock);
+    return entry ? entry->index : NULL;
+}
+
+#define INDEX_REBUILD_BATCH 1024
+
+// (Re-)index every thread of the board that is in Redis; 0 on success
+static int index_live_threads(FtsIndex *index, const char *board, const int *cancelled) {
+    ThreadSnapshot *snapshot = fetch_thread_list(board, scan_count, fetch_batch);
+    int result = snapshot ? 0 : 1;
+    if (snapshot) {
+        char (*ids)[THREAD_ID_MAX] = malloc(sizeof(*ids) * INDEX_REBUILD_BATCH);
+        const char *id_pointers[INDEX_REBUILD_BATCH];
+        size_t n = 0;
+        for (size_t i = 0; i <= snapshot->count && result == 0 && ids; i++) {
+            if (n == INDEX_REBUILD_BATCH || (i == snapshot->count && n > 0)) {
+                if (__atomic_load_n(cancelled, __ATOMIC_RELAXED)) break;
+                result = fts_index_add_from_redis(index, board, id_pointers, n);
+                n = 0;
+            }
+            if (i == snapshot->count || (snapshot->records[i].flags & THREAD_RECORD_DELETED)) continue;
+            snprintf(ids[n], THREAD_ID_MAX, "%" PRIu64, snapshot->records[i].id);
+            id_pointers[n] = ids[n];
+            n++;
+        }
+        if (ids == NULL) result = 1;
+        free(ids);
+        thread_snapshot_unref(snapshot);
+    }
+    return result;
+}
+
+// Index archived threads straight from the mapping, the given IDs or with ids NULL all of them;
+// Redis has no copy of them. Commits; 0 on success.
+static int index_archived_threads(FtsIndex *index, const char *path, const char *const *ids, size_t n) {
+    Archive *archive = archive_open(path);
+    if (ids == NULL) n = archive_thread_count(archive);
+    int result = 0;
+    size_t posts_capacity = 0;
+    const char **posts = NULL;
+    size_t *lengths = NULL;
+    for (size_t i = 0; i < n && archive && result == 0; i++) {
+        ArchiveThread thread;
+        if (ids == NULL) archive_thread_at(archive, i, &thread);
+        else if (archive_find(archive, strtoull(ids[i], NULL, 10), &thread) != 0) continue;
+        if (thread.post_count > posts_capacity) {
+            posts_capacity = thread.post_count;
+            free(posts);
+            free(lengths);
+            posts = malloc(sizeof(*posts) * posts_capacity);
+            lengths = malloc(sizeof(*lengths) * posts_capacity);
+            if (posts == NULL || lengths == NULL) {
+                result = 1;
+                break;
+            }
+        }
+        for (uint32_t p = 0; p < thread.post_count; p++) posts[p] = archive_thread_post(&thread, p, &lengths[p]);
+        result = fts_index_add_thread(index, thread.id, posts, lengths, thread.post_count);
+    }
+    free(posts);
+    free(lengths);
+    archive_close(archive);
+    return result == 0 ? fts_index_commit(index) : result;
+}
+
+// Keep the board's post index in step with a finished job. Runs on the job's worker, so the
+// CLI's batch waits for it.
+void update_search_index(const JobInfo *job) {
+    if (job->state != JOB_SUCCEEDED) return;
+    int added = strcmp(job->name, "scrape_thread") == 0;
+    int deleted = strcmp(job->name, "delete_thread") == 0;
+    // Both rewrite threads the index has not seen, or not in their current form. archive_threads
+    // re-indexes from the archive in its own run hook, which knows the IDs; compress_board
+    // changes only how posts are stored, not their text.
+    int board_wide = strcmp(job->name, "update_stored_threads") == 0 || strcmp(job->name, "import_board") == 0;
+    if (!board_wide && ((!added && !deleted) || job->thread_id[0] == '\0')) return;
+
+    FtsIndex *index = board_search_index(job->board);
+    if (index == NULL) return;
+    if (board_wide) {
+        static const int not_cancelled = 0;
+        index_live_threads(index, job->board, &not_cancelled);  // Commits batch by batch
+    } else if (added) {
+        const char *thread_id = job->thread_id;
+        fts_index_add_from_redis(index, job->board, &thread_id, 1);
+    } else {
+        fts_index_remove_thread(index, strtoull(job->thread_id, NULL, 10));
+        fts_index_commit(index);
+    }
+}
+
+// Job run hook: re-index every thread of the board, from Redis and from the archive
+static int run_index_rebuild(unsigned job_id, char *const *argv, const int *cancelled, void *user_data) {
+    const char *board = argv[1];
+    FtsIndex *index = board_search_index(board);
+    if (index == NULL) return 1;
+    int64_t started = job_now_ms();
+    fts_index_clear(index);
+
+    int result = index_live_threads(index, board, cancelled);
+    char path[512];
+    format_archive_path(path, sizeof(path), archive_dir, board);
+    if (result == 0) result = index_archived_threads(index, path, NULL, 0);
+
+    FtsIndexStats stats;
+    fts_index_stats(index, &stats);
+    char line[256];
+    snprintf(line, sizeof(line), "Indexed %zu threads, %zu posts in %.1f s: %zu segments, %zu KiB",
+             stats.threads, stats.posts, (job_now_ms() - started) / 1000.0, stats.segments, stats.bytes / 1024);
+    job_queue_output(job_id, line);
+    return result == 0 ? 0 : 1;
+}
+
+unsigned submit_index_rebuild(const char *board, job_done_fn on_done, void *user_data) {
+    char *argv[] = { "index_board", (char *)board, NULL };
+    JobSpec spec = { "index_board", board, NULL, argv, run_index_rebuild, NULL, on_done, user_data };
+    return job_queue_submit(&spec);
+}
+
+// Job run hook: argv is { "index_threads", board, id... }
+static int run_index_threads(unsigned job_id, char *const *argv, const int *cancelled, void *user_data) {
+    size_t n = 0;
+    while (argv[2 + n]) n++;
+    const char *const *ids = (const char *const *)&argv[2];
+    int result = board_index_refresh(argv[1], ids, n);
+    FtsIndex *index = board_search_index(argv[1]);
+    if (index == NULL || fts_index_add_from_redis(index, argv[1], ids, n) != 0) result = -1;
+    return result == 0 ? 0 : 1;
+}
+
+// Bring the sorted index and the post index up to date for threads changed outside the app,
+// e.g. by the external scraper
+unsigned submit_index_threads(const char *board, const char *const *ids, size_t n, job_done_fn on_done, void *user_data) {
+    char **argv = calloc(n + 3, sizeof(char *));
+    if (argv == NULL) return 0;
+    argv[0] = "index_threads";
+    argv[1] = (char *)board;
+    for (size_t i = 0; i < n; i++) argv[2 + i] = (char *)ids[i];
+
+    JobSpec spec = { "index_threads", board, NULL, argv, run_index_threads, NULL, on_done, user_data };
+    unsigned id = job_queue_submit(&spec);
+    free(argv);
+    return id;
+}
+
+// --- Sorted index ----------------------------------------------------------------------------
+
+void update_board_index(const JobInfo *job) {
+    if (job->state != JOB_SUCCEEDED) return;
+    if (strcmp(job->name, "update_stored_threads") == 0) {
+        board_index_refresh_all(job->board, fetch_batch);
+        return;
+    }
+    int touches_thread = strcmp(job->name, "scrape_thread") == 0 || strcmp(job->name, "delete_thread") == 0 ||
+                         strcmp(job->name, "set_title") == 0;
+    if (!touches_thread || job->thread_id[0] == '\0') return;
+    const char *thread_id = job->thread_id;
+    board_index_refresh(job->board, &thread_id, 1);
+}
+
+// Job run hook: build the board's sorted index from a full listing
+static int run_board_index_rebuild(unsigned job_id, char *const *argv, const int *cancelled, void *user_data) {
+    int64_t started = job_now_ms();
+    BoardIndexStats stats;
+    int result = board_index_rebuild(argv[1], scan_count, fetch_batch, cancelled, &stats);
+
+    char line[256];
+    if (result == 0) {
+        snprintf(line, sizeof(line), "Sorted index of /%s/: %zu threads in %.1f s, %u write round trips", argv[1], stats.threads,
+                 (job_now_ms() - started) / 1000.0, stats.round_trips);
+    } else {
+        snprintf(line, sizeof(line), "Sorted index of /%s/ not rebuilt; the previous one, if any, is unchanged", argv[1]);
+    }
+    job_queue_output(job_id, line);
+    return result == 0 ? 0 : 1;
+}
+
+unsigned submit_board_index_rebuild(const char *board, job_done_fn on_done, void *user_data) {
+    char *argv[] = { "sort_index_board", (char *)board, NULL };
+    JobSpec spec = { "sort_index_board", board, NULL, argv, run_board_index_rebuild, NULL, on_done, user_data };
+    return job_queue_submit(&spec);
+}
+
+// argv[2] is "--retrain" to replace the board's dictionary
+static int run_post_recompress(unsigned job_id, char *const *argv, const int *cancelled, void *user_data) {
+    int64_t started = job_now_ms();
+    PostRecompressStats stats;
+    int result = post_codec_recompress(argv[1], argv[2] != NULL, scan_count, fetch_batch, cancelled, &stats);
+    post_codec_reload_current(argv[1]);  // Another process may have retrained meanwhile
+    double seconds = (job_now_ms() - started) / 1000.0;
+
+    char line[320];
+    snprintf(line, sizeof(line),
+             "Compressed /%s/%s: %zu of %zu threads rewritten, %" PRIu64 " posts, %.1f MiB -> %.1f MiB (%.2fx) with dictionary %" PRIu32
+             " in %.1f s (%.1f MiB/s), %u round trips",
+             argv[1], result == 0 ? "" : " partly", stats.rewritten, stats.threads, stats.posts, stats.bytes_before / 1048576.0,
+             stats.bytes_after / 1048576.0, stats.bytes_after ? (double)stats.bytes_before / stats.bytes_after : 1.0,
+             stats.dictionary_id, seconds, seconds > 0 ? stats.bytes_before / 1048576.0 / seconds : 0.0, stats.round_trips);
+    job_queue_output(job_id, line);
+    return result == 0 ? 0 : 1;
+}
+
+unsigned submit_post_recompress(const char *board, int retrain, job_done_fn on_done, void *user_data) {
+    char *argv[] = { "compress_board", (char *)board, retrain ? "--retrain" : NULL, NULL };
+    JobSpec spec = { "compress_board", board, NULL, argv, run_post_recompress, NULL, on_done, user_data };
+    return job_queue_submit(&spec);
+}
+
+// --- Export and import -----------------------------------------------------------------------
+
+// what is e.g. "Export of /g/ to g.fcboard"
+static void report_board_transfer(unsigned job_id, const char *what, int result, int64_t started, const BoardExportStats *stats) {
+    double seconds = (job_now_ms() - started) / 1000.0;
+    char line[1400];
+    snprintf(line, sizeof(line),
+             "%s%s: %" PRIu64 " threads, %" PRIu64 " posts, %.1f MiB of posts, %.1f MiB file in %.1f s "
+             "(%.0f posts/s, %.1f MiB/s), %u round trips",
+             what, result == 0 ? "" : " failed", stats->threads, stats->posts, stats->post_bytes / 1048576.0,
+             stats->file_bytes / 1048576.0, seconds, seconds > 0 ? stats->posts / seconds : 0.0,
+             seconds > 0 ? stats->post_bytes / 1048576.0 / seconds : 0.0, stats->round_trips);
+    job_queue_output(job_id, line);
+}
+
+// argv[2] is the file, argv[3] "--compress" for a zstd-compressed one
+static int run_board_export(unsigned job_id, char *const *argv, const int *cancelled, void *user_data) {
+    int64_t started = job_now_ms();
+    BoardExportStats stats;
+    unsigned flags = argv[3] != NULL ? BOARD_EXPORT_ZSTD : 0;
+    int result = board_export(argv[1], argv[2], flags, scan_count, fetch_batch, cancelled, &stats);
+    char what[1100];
+    snprintf(what, sizeof(what), "Export of /%s/ to %s", argv[1], argv[2]);
+    report_board_transfer(job_id, what, result, started, &stats);
+    return result == 0 ? 0 : 1;
+}
+
+// No thread ID: the dedup key is name, board and argv, and argv holds the path, so only an
+// export of the same board to the same file while one is queued or running is folded into it
+unsigned submit_board_export(const char *board, const char *path, int compress, job_done_fn on_done, void *user_data) {
+    char *argv[] = { "export_board", (char *)board, (char *)path, compress ? "--compress" : NULL, NULL };
+    JobSpec spec = { "export_board", board, NULL, argv, run_board_export, NULL, on_done, user_data };
+    return job_queue_submit(&spec);
+}
+
+// Threads written per pipeline, fewer when their posts are long. Far more than fetch_batch:
+// nothing is read back, so a larger pipeline only costs the memory of the queued commands.
+#define IMPORT_BATCH 2048
+
+static int run_board_import(unsigned job_id, char *const *argv, const int *cancelled, void *user_data) {
+    int64_t started = job_now_ms();
+    BoardExportStats stats;
+    int result = board_import(argv[1], argv[2], IMPORT_BATCH, cancelled, &stats);
+    char what[1100];
+    snprintf(what, sizeof(what), "Import into /%s/ from %s", argv[1], argv[2]);
+    report_board_transfer(job_id, what, result, started, &stats);
+    if (result == 0 && strcmp(stats.board, argv[1]) != 0) {
+        char line[160];
+        snprintf(line, sizeof(line), "The file was exported from /%s/", stats.board);
+        job_queue_output(job_id, line);
+    }
+    return result == 0 ? 0 : 1;
+}
+
+// Deduplicated on board and path through argv, like an export
+unsigned submit_board_import(const char *board, const char *path, job_done_fn on_done, void *user_data) {
+    char *argv[] = { "import_board", (char *)board, (char *)path, NULL };
+    JobSpec spec = { "import_board", board, NULL, argv, run_board_import, NULL, on_done, user_data };
+    return job_queue_submit(&spec);
+}
+
+// --- Timing ----------------------------------------------------------------------------------
+
+static uint64_t exec_runs = 0;      // Jobs that fell back to docker exec, and their total run time
+static uint64_t exec_total_ms = 0;
+static uint64_t ingest_runs = 0;    // Threads added by the built-in importer
+static uint64_t ingest_total_ms = 0;
+
+const char *job_transport(const JobInfo *job) {
+    if (!job->used_runner) return "docker exec";
+    if (strcmp(job->name, "scrape_thread") == 0 && native_ingest) return "native ingest";
+    if (strcmp(job->name, "archive_threads") == 0 || strcmp(job->name, "index_board") == 0 || strcmp(job->name, "index_threads") == 0 ||
+        strcmp(job->name, "sort_index_board") == 0 || strcmp(job->name, "compress_board") == 0 ||
+        strcmp(job->name, "export_board") == 0 || strcmp(job->name, "import_board") == 0) {
+        return "built-in";
+    }
+    return "scraper worker";
+}
+
+// One timing line per finished command, with the running average for its transport
+int format_job_timing(const JobInfo *job, char *out, size_t size) {
+    if (job->started_at_ms == 0 || job->state == JOB_SKIPPED || job->state == JOB_CANCELLED) return 0;
+
+    long long ms = job->finished_at_ms - job->started_at_ms;
+    const char *transport = job_transport(job);
+    if (strcmp(transport, "native ingest") == 0) {
+        uint64_t runs = __atomic_add_fetch(&ingest_runs, 1, __ATOMIC_RELAXED);
+        uint64_t total = __atomic_add_fetch(&ingest_total_ms, (uint64_t)ms, __ATOMIC_RELAXED);
+        snprintf(out, size, "%s finished in %lld ms via native ingest (average %.0f ms over %" PRIu64 " runs)\n",
+                 job->name, ms, (double)total / runs, runs);
+    } else if (strcmp(transport, "scraper worker") == 0) {
+        ScraperRpcStats stats;
+        scraper_rpc_stats(&stats);
+        snprintf(out, size, "%s finished in %lld ms via scraper worker (average %.0f ms over %" PRIu64 " calls)\n",
+                 job->name, ms, stats.calls ? stats.total_ms / stats.calls : 0.0, stats.calls);
+    } else if (strcmp(transport, "docker exec") == 0) {
+        uint64_t runs = __atomic_add_fetch(&exec_runs, 1, __ATOMIC_RELAXED);
+        uint64_t total = __atomic_add_fetch(&exec_total_ms, (uint64_t)ms, __ATOMIC_RELAXED);
+        snprintf(out, size, "%s finished in %lld ms via docker exec (average %.0f ms over %" PRIu64 " runs)\n",
+                 job->name, ms, (double)total / runs, runs);
+    } else {
+        snprintf(out, size, "%s finished in %lld ms\n", job->name, ms);
+    }
+    return 1;
+}
@@ -0,0 +1,408 @@
+#define _GNU_SOURCE  // pipe2
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "../include/scraper_rpc.h"
+#include "../include/json_scan.h"
+#include "../include/metrics.h"
+
+// Client for scripts/scraper_worker.py: one long-lived scraper process that takes JSON-line
+// requests on stdin and answers on stdout, so commands skip the interpreter start-up and
+// imports that `docker exec python FourChanScraper.py` pays every time. The worker forks a
+// child per call, so each command has an interpreter to itself and a cancel can kill it.
+//
+// A supervisor thread owns the process: it starts it, reads every response line, and when
+// the process exits it fails the calls in flight and starts a new one after a backoff.
+// Calls made while no worker is ready return SCRAPER_RPC_UNAVAILABLE right away.
+
+#define RPC_BACKOFF_MIN_MS 250
+#define RPC_BACKOFF_MAX_MS 30000
+#define RPC_STABLE_MS 10000     // A worker that lived this long resets the backoff
+#define RPC_POLL_MS 100         // How often a waiting call checks its cancel flag
+
+typedef struct PendingCall {
+    unsigned id;
+    int done;
+    int lost;             // The worker exited before answering
+    int exit_code;
+    double backend_ms;
+    rpc_output_fn on_output;
+    void *user_data;
+    struct PendingCall *next;
+} PendingCall;
+
+static pthread_mutex_t rpc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rpc_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t supervisor;
+static int supervisor_running = 0;
+static int stopping = 0;
+static int ready = 0;           // Worker announced itself and its stdin is open
+static pid_t worker_pid = 0;
+static int request_fd = -1;     // Worker's stdin
+static char **worker_argv = NULL;
+static unsigned next_request_id = 1;
+static PendingCall *pending = NULL;
+static ScraperRpcStats rpc_stats;
+
+static int64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Condition wait that gives up after timeout_ms
+static void wait_ms(int timeout_ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(&rpc_cond, &rpc_lock, &deadline);
+}
+
+// --- JSON lines ----------------------------------------------------------------------------
+
+typedef struct {
+    long id;              // -1 when absent
+    char type[16];
+    char *line;           // Decoded "line", sized for the whole message
+    int exit_code;
+    double elapsed_ms;
+    double load_ms;
+} RpcMessage;
+
+static int parse_message(const char *text, RpcMessage *message) {
+    const char *p = json_skip_space(text);
+    if (*p++ != '{') return -1;
+
+    for (;;) {
+        char key[32];
+        p = json_skip_space(p);
+        if (*p == '}') return 0;
+        p = json_parse_string(p, key, sizeof(key));
+        if (p == NULL) return -1;
+        p = json_skip_space(p);
+        if (*p++ != ':') return -1;
+        p = json_skip_space(p);
+
+        if (strcmp(key, "type") == 0 && *p == '"') {
+            p = json_parse_string(p, message->type, sizeof(message->type));
+        } else if (strcmp(key, "line") == 0 && *p == '"') {
+            p = json_parse_string(p, message->line, strlen(text) + 1);
+        } else if (strcmp(key, "id") == 0) {
+            message->id = strtol(p, NULL, 10);
+            p = json_skip_value(p);
+        } else if (strcmp(key, "exit_code") == 0) {
+            message->exit_code = (int)strtol(p, NULL, 10);
+            p = json_skip_value(p);
+        } else if (strcmp(key, "elapsed_ms") == 0) {
+            message->elapsed_ms = strtod(p, NULL);
+            p = json_skip_value(p);
+        } else if (strcmp(key, "load_ms") == 0) {
+            message->load_ms = strtod(p, NULL);
+            p = json_skip_value(p);
+        } else {
+            p = json_skip_value(p);
+        }
+        if (p == NULL) return -1;
+
+        p = json_skip_space(p);
+        if (*p == ',') p++;
+        else if (*p == '}') return 0;
+        else return -1;
+    }
+}
+
+// --- Worker process --------------------------------------------------------------------------
+
+static PendingCall *find_call(long id) {
+    for (PendingCall *call = pending; call; call = call->next) {
+        if ((long)call->id == id) return call;
+    }
+    return NULL;
+}
+
+static void handle_message(const char *text) {
+    RpcMessage message = { .id = -1 };
+    message.line = malloc(strlen(text) + 1);
+    if (message.line == NULL) return;
+    message.line[0] = '\0';
+
+    if (parse_message(text, &message) != 0) {
+        fprintf(stderr, "Scraper worker sent a malformed line: %s", text);
+    } else if (strcmp(message.type, "ready") == 0) {
+        pthread_mutex_lock(&rpc_lock);
+        ready = 1;
+        pthread_mutex_unlock(&rpc_lock);
+        fprintf(stderr, "Scraper worker ready in %.0f ms\n", message.load_ms);
+    } else if (strcmp(message.type, "output") == 0) {
+        pthread_mutex_lock(&rpc_lock);
+        PendingCall *call = find_call(message.id);
+        rpc_output_fn on_output = call ? call->on_output : NULL;
+        void *user_data = call ? call->user_data : NULL;
+        pthread_mutex_unlock(&rpc_lock);
+        if (on_output) on_output(message.line, user_data);
+    } else if (strcmp(message.type, "done") == 0) {
+        pthread_mutex_lock(&rpc_lock);
+        PendingCall *call = find_call(message.id);
+        if (call) {
+            call->done = 1;
+            call->exit_code = message.exit_code;
+            call->backend_ms = message.elapsed_ms;
+            pthread_cond_broadcast(&rpc_cond);
+        }
+        pthread_mutex_unlock(&rpc_lock);
+    }
+    free(message.line);
+}
+
+// Start the worker with pipes on its stdin and stdout; called with the lock held
+static FILE *spawn_worker() {
+    int to_worker[2], from_worker[2];
+    if (pipe2(to_worker, O_CLOEXEC) != 0) {
+        fprintf(stderr, "Failed to create scraper worker pipe: %s\n", strerror(errno));
+        return NULL;
+    }
+    if (pipe2(from_worker, O_CLOEXEC) != 0) {
+        fprintf(stderr, "Failed to create scraper worker pipe: %s\n", strerror(errno));
+        close(to_worker[0]);
+        close(to_worker[1]);
+        return NULL;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(to_worker[0], STDIN_FILENO);
+        dup2(from_worker[1], STDOUT_FILENO);
+        execvp(worker_argv[0], worker_argv);
+        _exit(127);
+    }
+
+    close(to_worker[0]);
+    close(from_worker[1]);
+    if (pid < 0) {
+        fprintf(stderr, "Failed to start scraper worker: %s\n", strerror(errno));
+        close(to_worker[1]);
+        close(from_worker[0]);
+        return NULL;
+    }
+
+    worker_pid = pid;
+    request_fd = to_worker[1];
+    return fdopen(from_worker[0], "r");
+}
+
+// The worker is gone: fail its calls and reap it; called with the lock held
+static void worker_down() {
+    ready = 0;
+    if (request_fd >= 0) close(request_fd);
+    request_fd = -1;
+
+    for (PendingCall *call = pending; call; call = call->next) {
+        if (!call->done) {
+            call->done = 1;
+            call->lost = 1;
+            call->exit_code = -1;
+        }
+    }
+    pthread_cond_broadcast(&rpc_cond);
+
+    if (worker_pid > 0) {
+        pid_t pid = worker_pid;
+        worker_pid = 0;
+        pthread_mutex_unlock(&rpc_lock);
+        kill(pid, SIGTERM);  // Closed its stdout but may still be running
+        while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {}
+        pthread_mutex_lock(&rpc_lock);
+    }
+}
+
+static void *supervisor_main(void *arg) {
+    int backoff_ms = RPC_BACKOFF_MIN_MS;
+    int started_once = 0;
+
+    pthread_mutex_lock(&rpc_lock);
+    while (!stopping) {
+        int64_t started_at = now_ms();
+        if (started_once) rpc_stats.restarts++;
+        started_once = 1;
+        FILE *responses = spawn_worker();
+        pthread_mutex_unlock(&rpc_lock);
+
+        if (responses) {
+            char *line = NULL;
+            size_t capacity = 0;
+            while (getline(&line, &capacity, responses) > 0) handle_message(line);
+            free(line);
+            fclose(responses);
+        }
+
+        pthread_mutex_lock(&rpc_lock);
+        worker_down();
+        if (stopping) break;
+
+        if (now_ms() - started_at > RPC_STABLE_MS) backoff_ms = RPC_BACKOFF_MIN_MS;
+        fprintf(stderr, "Scraper worker exited; restarting in %d ms\n", backoff_ms);
+        int64_t restart_at = now_ms() + backoff_ms;
+        while (!stopping && now_ms() < restart_at) wait_ms((int)(restart_at - now_ms()));
+        backoff_ms = backoff_ms * 2 > RPC_BACKOFF_MAX_MS ? RPC_BACKOFF_MAX_MS : backoff_ms * 2;
+    }
+    pthread_mutex_unlock(&rpc_lock);
+    return NULL;
+}
+
+// Start supervising a worker run with argv (copied); it is restarted whenever it exits
+int scraper_rpc_start(char *const *argv) {
+    if (supervisor_running) return 0;
+
+    // A write to a worker that just died must fail with EPIPE instead of killing the app
+    signal(SIGPIPE, SIG_IGN);
+
+    size_t argc = 0;
+    while (argv[argc]) argc++;
+    worker_argv = calloc(argc + 1, sizeof(char *));
+    if (worker_argv == NULL) return -1;
+    for (size_t i = 0; i < argc; i++) worker_argv[i] = strdup(argv[i]);
+
+    stopping = 0;
+    if (pthread_create(&supervisor, NULL, supervisor_main, NULL) != 0) {
+        fprintf(stderr, "Failed to start scraper worker supervisor\n");
+        return -1;
+    }
+    supervisor_running = 1;
+    return 0;
+}
+
+// Close the worker's stdin so it finishes, terminate it, and wait for the supervisor
+void scraper_rpc_stop() {
+    if (!supervisor_running) return;
+
+    pthread_mutex_lock(&rpc_lock);
+    stopping = 1;
+    ready = 0;
+    if (request_fd >= 0) close(request_fd);
+    request_fd = -1;
+    if (worker_pid > 0) kill(worker_pid, SIGTERM);
+    pthread_cond_broadcast(&rpc_cond);
+    pthread_mutex_unlock(&rpc_lock);
+
+    pthread_join(supervisor, NULL);
+    supervisor_running = 0;
+
+    for (char **arg = worker_argv; arg && *arg; arg++) free(*arg);
+    free(worker_argv);
+    worker_argv = NULL;
+}
+
+int scraper_rpc_is_ready() {
+    pthread_mutex_lock(&rpc_lock);
+    int result = ready;
+    pthread_mutex_unlock(&rpc_lock);
+    return result;
+}
+
+static int write_all(int fd, const char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += written;
+        length -= written;
+    }
+    return 0;
+}
+
+// Run one scraper command in the worker and wait for it. Output lines (without newline) go to
+// on_output as they arrive. Returns the command's exit code, -1 if it was cancelled through
+// *cancelled or the worker died mid-call, or SCRAPER_RPC_UNAVAILABLE if no worker is ready.
+int scraper_rpc_call(const char *command, char *const *args, const int *cancelled,
+                     rpc_output_fn on_output, void *user_data, double *elapsed_ms) {
+    JsonBuffer request = { 0 };
+    PendingCall call = { 0 };
+    call.on_output = on_output;
+    call.user_data = user_data;
+
+    pthread_mutex_lock(&rpc_lock);
+    if (!ready) {
+        pthread_mutex_unlock(&rpc_lock);
+        return SCRAPER_RPC_UNAVAILABLE;
+    }
+    call.id = next_request_id++;
+
+    char head[64];
+    snprintf(head, sizeof(head), "{\"id\":%u,\"type\":\"call\",\"command\":", call.id);
+    int failed = json_append(&request, head, strlen(head)) || json_append_string(&request, command) ||
+                 json_append(&request, ",\"args\":[", 9);
+    for (size_t i = 0; args[i] && !failed; i++) {
+        failed = (i > 0 && json_append(&request, ",", 1)) || json_append_string(&request, args[i]);
+    }
+    failed = failed || json_append(&request, "]}\n", 3);
+
+    if (failed || write_all(request_fd, request.data, request.length) != 0) {
+        pthread_mutex_unlock(&rpc_lock);
+        free(request.data);
+        return SCRAPER_RPC_UNAVAILABLE;
+    }
+    free(request.data);
+
+    call.next = pending;
+    pending = &call;
+    int64_t started_at = now_ms();
+    uint64_t metrics_started = metrics_begin();
+
+    int was_cancelled = 0;
+    while (!call.done) {
+        if (cancelled && __atomic_load_n(cancelled, __ATOMIC_RELAXED)) {
+            // The worker drops it if it hasn't started, or kills the child process running it
+            char cancel[64];
+            snprintf(cancel, sizeof(cancel), "{\"id\":%u,\"type\":\"cancel\"}\n", call.id);
+            if (request_fd >= 0) write_all(request_fd, cancel, strlen(cancel));
+            was_cancelled = 1;
+            break;
+        }
+        wait_ms(RPC_POLL_MS);
+    }
+
+    for (PendingCall **link = &pending; *link; link = &(*link)->next) {
+        if (*link == &call) {
+            *link = call.next;
+            break;
+        }
+    }
+
+    double elapsed = (double)(now_ms() - started_at);
+    if (was_cancelled || call.lost) {
+        rpc_stats.failures++;
+    } else {
+        rpc_stats.calls++;
+        rpc_stats.total_ms += elapsed;
+        rpc_stats.backend_ms += call.backend_ms;
+        if (elapsed > rpc_stats.max_ms) rpc_stats.max_ms = elapsed;
+        metrics_end(METRIC_SCRAPER_RPC, metrics_started);
+        if (metrics_started) metrics_record_ns(METRIC_SCRAPER_BACKEND, (uint64_t)(call.backend_ms * 1e6));
+    }
+    pthread_mutex_unlock(&rpc_lock);
+
+    if (elapsed_ms) *elapsed_ms = elapsed;
+    return was_cancelled || call.lost ? -1 : call.exit_code;
+}
+
+void scraper_rpc_stats(ScraperRpcStats *stats) {
+    pthread_mutex_lock(&rpc_lock);
+    *stats = rpc_stats;
+    pthread_mutex_unlock(&rpc_lock);
+}
@@ -1,17 +1,107 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "../include/settings.h"
 
 char redis_host[256] = "localhost";
 int redis_port = 6379;
+char redis_endpoints[256] = "";  // More host:port pairs: cluster seeds, or replicas of host:port
+int read_from_replicas = 0;       // Serve listings and other lag-tolerant reads from replicas
 char board[256] = "adv";
+char boards[256] = "";  // Comma-separated boards opened as tabs; empty for just board
+int scan_count = 500;  // COUNT hint passed to SCAN when listing threads
+int fetch_batch = 256; // Threads whose fields are fetched per pipelined round-trip
+int list_page_size = 0; // Threads read per page from a board's sorted index; 0 lists the whole board with SCAN
+int redis_pool_size = 4;        // Connections shared by worker threads
+int connect_timeout_ms = 2000;  // Give up on a Redis connect attempt after this long, then retry with backoff
+int output_scrollback_lines = 2000;  // Oldest output lines are trimmed beyond this
+int job_workers = 2;  // Scraper commands run at the same time
+char scraper_worker[16] = "container";  // Where the persistent scraper backend runs: container, local or off
+char scraper_worker_script[256] = "scripts/scraper_worker.py";
+int native_ingest = 0;  // Add threads with the built-in importer instead of the scraper
+char ingest_base_url[256] = "https://a.4cdn.org";  // Thread JSON is read from <base>/<board>/thread/<id>.json
+char archive_dir[256] = "archive";  // Holds <board>.archive and its index
+char index_dir[256] = "index";      // Holds one post search index directory per board
+char thumbnail_base_url[256] = "https://i.4cdn.org";  // Thumbnails are read from <base>/<board>/<tim>s.jpg
+char media_dir[256] = "media";  // Content-addressed disk cache of downloaded thumbnails
+int media_disk_mb = 512;        // Least recently used thumbnails are deleted beyond this
+int thumbnail_memory_mb = 64;   // Decoded thumbnails kept in memory
+int decode_workers = 2;         // Threads fetching and decoding thumbnails
+int compress_posts = 0;         // Store posts written by the importer zstd-compressed
+int compress_level = 3;         // zstd level for compressed posts
+int metrics_enabled = 0;            // Record latency histograms for the Stats dialog and export
+char metrics_export[256] = "";      // Prometheus text target: a file path or unix:/path; empty for none
+int metrics_export_interval_s = 10; // How often the export file is rewritten
 
 void load_settings() {
     FILE *file = fopen("config.ini", "r");
     if (file) {
-        fscanf(file, "host = %255s\n", redis_host);
-        fscanf(file, "port = %d\n", &redis_port);
-        fscanf(file, "board = %255s\n", board);
+        // One "key = value" pair per line; unknown keys are ignored so older binaries can share the file
+        char line[512];
+        while (fgets(line, sizeof(line), file) != NULL) {
+            char key[64], value[256];
+            if (sscanf(line, " %63[^= \t] = %255s", key, value) != 2) continue;
+
+            if (strcmp(key, "host") == 0) {
+                strncpy(redis_host, value, sizeof(redis_host) - 1);
+            } else if (strcmp(key, "port") == 0) {
+                redis_port = atoi(value);
+            } else if (strcmp(key, "endpoints") == 0) {
+                strncpy(redis_endpoints, value, sizeof(redis_endpoints) - 1);
+            } else if (strcmp(key, "read_from_replicas") == 0) {
+                read_from_replicas = atoi(value);
+            } else if (strcmp(key, "board") == 0) {
+                strncpy(board, value, sizeof(board) - 1);
+            } else if (strcmp(key, "boards") == 0) {
+                strncpy(boards, value, sizeof(boards) - 1);
+            } else if (strcmp(key, "scan_count") == 0) {
+                scan_count = atoi(value) > 0 ? atoi(value) : scan_count;
+            } else if (strcmp(key, "fetch_batch") == 0) {
+                fetch_batch = atoi(value) > 0 ? atoi(value) : fetch_batch;
+            } else if (strcmp(key, "list_page_size") == 0) {
+                list_page_size = atoi(value) >= 0 ? atoi(value) : list_page_size;
+            } else if (strcmp(key, "pool_size") == 0) {
+                redis_pool_size = atoi(value) > 0 ? atoi(value) : redis_pool_size;
+            } else if (strcmp(key, "connect_timeout_ms") == 0) {
+                connect_timeout_ms = atoi(value) > 0 ? atoi(value) : connect_timeout_ms;
+            } else if (strcmp(key, "output_scrollback_lines") == 0) {
+                output_scrollback_lines = atoi(value) > 0 ? atoi(value) : output_scrollback_lines;
+            } else if (strcmp(key, "job_workers") == 0) {
+                job_workers = atoi(value) > 0 ? atoi(value) : job_workers;
+            } else if (strcmp(key, "scraper_worker") == 0) {
+                strncpy(scraper_worker, value, sizeof(scraper_worker) - 1);
+            } else if (strcmp(key, "scraper_worker_script") == 0) {
+                strncpy(scraper_worker_script, value, sizeof(scraper_worker_script) - 1);
+            } else if (strcmp(key, "native_ingest") == 0) {
+                native_ingest = atoi(value);
+            } else if (strcmp(key, "ingest_base_url") == 0) {
+                strncpy(ingest_base_url, value, sizeof(ingest_base_url) - 1);
+            } else if (strcmp(key, "archive_dir") == 0) {
+                strncpy(archive_dir, value, sizeof(archive_dir) - 1);
+            } else if (strcmp(key, "index_dir") == 0) {
+                strncpy(index_dir, value, sizeof(index_dir) - 1);
+            } else if (strcmp(key, "thumbnail_base_url") == 0) {
+                strncpy(thumbnail_base_url, value, sizeof(thumbnail_base_url) - 1);
+            } else if (strcmp(key, "media_dir") == 0) {
+                strncpy(media_dir, value, sizeof(media_dir) - 1);
+            } else if (strcmp(key, "media_disk_mb") == 0) {
+                media_disk_mb = atoi(value) > 0 ? atoi(value) : media_disk_mb;
+            } else if (strcmp(key, "thumbnail_memory_mb") == 0) {
+                thumbnail_memory_mb = atoi(value) > 0 ? atoi(value) : thumbnail_memory_mb;
+            } else if (strcmp(key, "decode_workers") == 0) {
+                decode_workers = atoi(value) > 0 ? atoi(value) : decode_workers;
+            } else if (strcmp(key, "compress_posts") == 0) {
+                compress_posts = atoi(value) != 0;
+            } else if (strcmp(key, "compress_level") == 0) {
+                compress_level = atoi(value) > 0 ? atoi(value) : compress_level;
+            } else if (strcmp(key, "metrics") == 0) {
+                metrics_enabled = atoi(value);
+            } else if (strcmp(key, "metrics_export") == 0) {
+                strncpy(metrics_export, value, sizeof(metrics_export) - 1);
+            } else if (strcmp(key, "metrics_export_interval_s") == 0) {
+                metrics_export_interval_s = atoi(value) > 0 ? atoi(value) : metrics_export_interval_s;
+            }
+        }
         fclose(file);
     }
 
@@ -27,7 +117,39 @@ void save_settings(const char *host, int port, const char *new_board) {
     if (file) {
         fprintf(file, "host = %s\n", redis_host);
         fprintf(file, "port = %d\n", redis_port);
+        if (redis_endpoints[0]) fprintf(file, "endpoints = %s\n", redis_endpoints);
+        fprintf(file, "read_from_replicas = %d\n", read_from_replicas);
         fprintf(file, "board = %s\n", board);
+        if (boards[0]) fprintf(file, "boards = %s\n", boards);
+        fprintf(file, "scan_count = %d\n", scan_count);
+        fprintf(file, "fetch_batch = %d\n", fetch_batch);
+        fprintf(file, "list_page_size = %d\n", list_page_size);
+        fprintf(file, "pool_size = %d\n", redis_pool_size);
+        fprintf(file, "connect_timeout_ms = %d\n", connect_timeout_ms);
+        fprintf(file, "output_scrollback_lines = %d\n", output_scrollback_lines);
+        fprintf(file, "job_workers = %d\n", job_workers);
+        fprintf(file, "scraper_worker = %s\n", scraper_worker);
+        fprintf(file, "scraper_worker_script = %s\n", scraper_worker_script);
+        fprintf(file, "native_ingest = %d\n", native_ingest);
+        fprintf(file, "ingest_base_url = %s\n", ingest_base_url);
+        fprintf(file, "archive_dir = %s\n", archive_dir);
+        fprintf(file, "index_dir = %s\n", index_dir);
+        fprintf(file, "thumbnail_base_url = %s\n", thumbnail_base_url);
+        fprintf(file, "media_dir = %s\n", media_dir);
+        fprintf(file, "media_disk_mb = %d\n", media_disk_mb);
+        fprintf(file, "thumbnail_memory_mb = %d\n", thumbnail_memory_mb);
+        fprintf(file, "decode_workers = %d\n", decode_workers);
+        fprintf(file, "compress_posts = %d\n", compress_posts);
+        fprintf(file, "compress_level = %d\n", compress_level);
+        fprintf(file, "metrics = %d\n", metrics_enabled);
+        if (metrics_export[0]) fprintf(file, "metrics_export = %s\n", metrics_export);
+        fprintf(file, "metrics_export_interval_s = %d\n", metrics_export_interval_s);
         fclose(file);
     }
 }
+
+// host:port followed by the extra endpoints, in the form redis_pool_init() takes
+void format_redis_endpoints(char *buf, size_t size) {
+    if (redis_endpoints[0]) snprintf(buf, size, "%s:%d,%s", redis_host, redis_port, redis_endpoints);
+    else snprintf(buf, size, "%s:%d", redis_host, redis_port);
+}
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../include/thread_cache.h"
+
+// Client-side copy of a board's thread list so filtering never has to go back to Redis.
+// Rows live in a ThreadSnapshot; deleted threads stay in it as tombstones until the next reload.
+//
+// An open-addressing index from thread ID to record position sits next to the rows, so
+// single-row updates from keyspace events don't have to scan the whole cache.
+#define SLOT_EMPTY 0
+#define SLOT_DELETED SIZE_MAX
+
+struct ThreadCache {
+    ThreadSnapshot *snapshot;
+    int valid;
+    int dropped;           // An add failed since the last clear, so a listing cannot make the cache valid
+    size_t *id_slots;      // Holds record index + 1, SLOT_EMPTY or SLOT_DELETED
+    size_t slot_capacity;  // Always a power of two
+    size_t slots_used;     // Live entries plus tombstones
+};
+
+static size_t hash_id(uint64_t id) {
+    id ^= id >> 33;
+    id *= 0xff51afd7ed558ccdULL;
+    id ^= id >> 33;
+    return (size_t)id;
+}
+
+// Slot holding id, or the first free slot for it if absent
+static size_t find_slot(const ThreadCache *cache, uint64_t id, int *found) {
+    size_t mask = cache->slot_capacity - 1;
+    size_t slot = hash_id(id) & mask;
+    size_t first_free = SIZE_MAX;
+
+    for (;;) {
+        size_t entry = cache->id_slots[slot];
+        if (entry == SLOT_EMPTY) {
+            *found = 0;
+            return first_free != SIZE_MAX ? first_free : slot;
+        }
+        if (entry == SLOT_DELETED) {
+            if (first_free == SIZE_MAX) first_free = slot;
+        } else if (cache->snapshot->records[entry - 1].id == id) {
+            *found = 1;
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+// Keeps the old table when the new one cannot be allocated
+static int rebuild_index(ThreadCache *cache, size_t capacity) {
+    size_t *slots = calloc(capacity, sizeof(size_t));
+    if (slots == NULL) return -1;
+    free(cache->id_slots);
+    cache->id_slots = slots;
+    cache->slot_capacity = capacity;
+    cache->slots_used = 0;
+
+    const ThreadSnapshot *snapshot = cache->snapshot;
+    for (size_t i = 0; i < snapshot->count; i++) {
+        if (snapshot->records[i].flags & THREAD_RECORD_DELETED) continue;
+        int found;
+        cache->id_slots[find_slot(cache, snapshot->records[i].id, &found)] = i + 1;
+        cache->slots_used++;
+    }
+    return 0;
+}
+
+// Copy-on-write: a snapshot handed to another thread is never modified under it
+static int ensure_writable(ThreadCache *cache) {
+    if (cache->snapshot == NULL) {
+        cache->snapshot = thread_snapshot_new(0);
+    } else if (thread_snapshot_is_shared(cache->snapshot)) {
+        ThreadSnapshot *copy = thread_snapshot_copy(cache->snapshot);
+        if (copy == NULL) return -1;
+        thread_snapshot_unref(cache->snapshot);
+        cache->snapshot = copy;
+    }
+    return cache->snapshot ? 0 : -1;
+}
+
+ThreadCache *thread_cache_new() {
+    return calloc(1, sizeof(ThreadCache));
+}
+
+void thread_cache_free(ThreadCache *cache) {
+    if (cache == NULL) return;
+    thread_snapshot_unref(cache->snapshot);
+    free(cache->id_slots);
+    free(cache);
+}
+
+void thread_cache_clear(ThreadCache *cache) {
+    thread_snapshot_unref(cache->snapshot);
+    cache->snapshot = thread_snapshot_new(0);
+    cache->valid = 0;
+    cache->dropped = 0;
+    if (cache->id_slots) memset(cache->id_slots, 0, cache->slot_capacity * sizeof(size_t));
+    cache->slots_used = 0;
+}
+
+static long find_index(const ThreadCache *cache, const char *id) {
+    if (cache->slot_capacity == 0 || cache->snapshot == NULL) return -1;
+    int found;
+    size_t slot = find_slot(cache, strtoull(id, NULL, 10), &found);
+    return found ? (long)cache->id_slots[slot] - 1 : -1;
+}
+
+const ThreadSnapshotRecord *thread_cache_find(ThreadCache *cache, const char *id) {
+    long index = find_index(cache, id);
+    return index >= 0 ? &cache->snapshot->records[index] : NULL;
+}
+
+static const ThreadSnapshotRecord *add_record(ThreadCache *cache, const char *id, const char *title, int count, const char *status) {
+    if (ensure_writable(cache) < 0) return NULL;
+    ThreadSnapshot *snapshot = cache->snapshot;
+
+    long index = find_index(cache, id);
+    if (index >= 0) {
+        return thread_snapshot_update(snapshot, index, title, count, status) == 0 ? &snapshot->records[index] : NULL;
+    }
+
+    // Keep the index at most half full, counting tombstones
+    if ((cache->slots_used + 1) * 2 > cache->slot_capacity &&
+        rebuild_index(cache, cache->slot_capacity ? cache->slot_capacity * 2 : 2048) < 0) {
+        fprintf(stderr, "Out of memory growing thread cache index\n");
+        return NULL;
+    }
+
+    index = thread_snapshot_append(snapshot, strtoull(id, NULL, 10), title, count, status);
+    if (index < 0) {
+        fprintf(stderr, "Out of memory growing thread cache\n");
+        return NULL;
+    }
+
+    int found;
+    size_t slot = find_slot(cache, snapshot->records[index].id, &found);
+    if (cache->id_slots[slot] == SLOT_EMPTY) cache->slots_used++;
+    cache->id_slots[slot] = index + 1;
+    return &snapshot->records[index];
+}
+
+// Insert a thread, or replace the fields of the cached one with the same ID. NULL when out of
+// memory: the thread is then missing from the cache, and the caller must not show a row for it.
+const ThreadSnapshotRecord *thread_cache_add(ThreadCache *cache, const char *id, const char *title, int count, const char *status) {
+    const ThreadSnapshotRecord *record = add_record(cache, id, title, count, status);
+    if (record == NULL) {
+        cache->dropped = 1;
+        cache->valid = 0;
+    }
+    return record;
+}
+
+// Mark one thread deleted; record positions never move
+int thread_cache_remove(ThreadCache *cache, const char *id) {
+    long index = find_index(cache, id);
+    if (index < 0 || ensure_writable(cache) < 0) return 0;
+
+    int found;
+    cache->id_slots[find_slot(cache, cache->snapshot->records[index].id, &found)] = SLOT_DELETED;
+    cache->snapshot->records[index].flags |= THREAD_RECORD_DELETED;
+    return 1;
+}
+
+// Borrowed view of the cache, valid until the next call that modifies it
+ThreadSnapshot *thread_cache_snapshot(ThreadCache *cache) {
+    if (cache->snapshot == NULL) cache->snapshot = thread_snapshot_new(0);
+    return cache->snapshot;
+}
+
+// New reference for another thread; later cache updates go to a private copy
+ThreadSnapshot *thread_cache_share(ThreadCache *cache) {
+    return thread_snapshot_ref(thread_cache_snapshot(cache));
+}
+
+// The cache is valid once a full listing has completed and until something invalidates it
+int thread_cache_is_valid(const ThreadCache *cache) {
+    return cache->valid;
+}
+
+void thread_cache_set_valid(ThreadCache *cache, int valid) {
+    cache->valid = valid && !cache->dropped;
+}
+
+// Same rule the list used when it filtered against Redis: substring of the title or the thread ID
+int thread_record_matches(const ThreadSnapshot *snapshot, const ThreadSnapshotRecord *record, const char *filter) {
+    if (record->flags & THREAD_RECORD_DELETED) return 0;
+    if (filter == NULL || *filter == '\0') return 1;
+
+    char id[32];
+    snprintf(id, sizeof(id), "%llu", (unsigned long long)record->id);
+    return strstr(thread_snapshot_title(snapshot, record), filter) != NULL || strstr(id, filter) != NULL;
+}
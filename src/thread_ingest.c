@@ -0,0 +1,469 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <curl/curl.h>
+#include "../include/thread_ingest.h"
+#include "../include/json_scan.h"
+#include "../include/post_codec.h"
+
+// Imports a thread in the 4chan API format ({"posts": [{...}, ...]}) into Redis without the
+// Python scraper. The document is scanned byte by byte as it arrives, tracking only nesting
+// and string state; the raw JSON of the post being read is the only thing buffered, and it is
+// stored as-is as one entry of the <board><id>_posts list. Writes are pipelined with at most
+// INGEST_IN_FLIGHT commands waiting for replies.
+
+#define INGEST_BATCH 64        // Posts per RPUSH
+#define INGEST_IN_FLIGHT 4     // Commands sent before waiting for the oldest reply
+#define INGEST_TITLE_MAX 256
+#define INGEST_EXCERPT_MAX 80  // Title taken from the opening post's text when it has no subject
+
+typedef struct {
+    // Structure of the document seen so far
+    int depth;
+    int in_string;
+    int escaped;
+    int expect_key;          // Next string at depth 1 is a key of the root object
+    int reading_key;
+    char key[16];
+    size_t key_length;
+    int in_posts;            // Inside the root "posts" array
+    int capturing;           // Inside a post object
+    JsonBuffer post;
+    char *opening_post;      // Kept for the title and status written at the end
+
+    // Thread being written
+    const char *board;
+    char thread_id[THREAD_ID_MAX];
+    redisContext *context;
+    char *batch[INGEST_BATCH];
+    size_t batch_length[INGEST_BATCH];
+    size_t batched;
+    size_t batch_bytes;      // Bytes of the entries in batch
+    unsigned in_flight;
+    int failed;
+    const int *cancelled;    // Set by the caller to stop between chunks; may be NULL
+    IngestStats *stats;
+} Ingest;
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// --- Redis pipeline --------------------------------------------------------------------------
+
+static void read_reply(Ingest *ingest) {
+    redisReply *reply = NULL;
+    if (redis_get_reply(ingest->context, &reply) != REDIS_OK || reply == NULL) {
+        fprintf(stderr, "Ingest of thread %s lost its Redis connection\n", ingest->thread_id);
+        ingest->failed = 1;
+    } else if (reply->type == REDIS_REPLY_ERROR) {
+        fprintf(stderr, "Ingest of thread %s: %s\n", ingest->thread_id, reply->str);
+        ingest->failed = 1;
+    }
+    if (reply) freeReplyObject(reply);
+    ingest->in_flight--;
+}
+
+static void send_command(Ingest *ingest, int argc, const char **argv, const size_t *argvlen) {
+    if (ingest->failed) return;
+    if (redisAppendCommandArgv(ingest->context, argc, argv, argvlen) != REDIS_OK) {
+        ingest->failed = 1;
+        return;
+    }
+    if (++ingest->in_flight >= INGEST_IN_FLIGHT) {
+        ingest->stats->round_trips++;
+        read_reply(ingest);  // Flushes everything appended so far, waits for the oldest reply
+    }
+}
+
+// Replies are read even after a failure so the connection goes back to the pool clean
+static void drain_replies(Ingest *ingest) {
+    if (ingest->context == NULL) return;
+    if (ingest->in_flight > 0) ingest->stats->round_trips++;
+    while (ingest->in_flight > 0 && !ingest->context->err) read_reply(ingest);
+}
+
+// The staging list shares the post list's {hash tag}, so on a cluster both are on the same node
+// and RENAME can swap them
+static void format_staging_key(const Ingest *ingest, char *buf, size_t size) {
+    char posts[320];
+    format_thread_key(posts, sizeof(posts), ingest->board, ingest->thread_id, "posts");
+    snprintf(buf, size, "{%s}_ingest", posts);
+}
+
+// Drop the half-written staging list of a failed or cancelled import
+static void discard_staging(Ingest *ingest) {
+    if (ingest->context == NULL || ingest->context->err) return;
+
+    char key[340];
+    format_staging_key(ingest, key, sizeof(key));
+    redisReply *reply = redis_command(ingest->context, "DEL %s", key);
+    ingest->stats->round_trips++;
+    if (reply) freeReplyObject(reply);
+}
+
+static void flush_batch(Ingest *ingest) {
+    if (ingest->batched == 0) return;
+
+    char key[340];
+    format_staging_key(ingest, key, sizeof(key));
+    const char *argv[INGEST_BATCH + 2];
+    size_t argvlen[INGEST_BATCH + 2];
+    argv[0] = "RPUSH";
+    argvlen[0] = 5;
+    argv[1] = key;
+    argvlen[1] = strlen(key);
+    for (size_t i = 0; i < ingest->batched; i++) {
+        argv[i + 2] = ingest->batch[i];
+        argvlen[i + 2] = ingest->batch_length[i];
+    }
+    send_command(ingest, (int)ingest->batched + 2, argv, argvlen);
+
+    for (size_t i = 0; i < ingest->batched; i++) free(ingest->batch[i]);
+    ingest->batched = 0;
+    ingest->batch_bytes = 0;
+}
+
+// Track the most post data this import holds at once: the batch plus the post being read
+static void note_buffered(Ingest *ingest) {
+    size_t buffered = ingest->batch_bytes + ingest->post.length;
+    if (buffered > ingest->stats->peak_buffered_bytes) ingest->stats->peak_buffered_bytes = buffered;
+}
+
+// --- Opening post ----------------------------------------------------------------------------
+
+// In-place: drop HTML tags (a <br> becomes a space) and decode the entities 4chan emits
+void html_to_text(char *text) {
+    static const struct { const char *entity; char c; } entities[] = {
+        { "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' }, { "&quot;", '"' }, { "&#039;", '\'' }, { "&#39;", '\'' },
+    };
+    char *out = text;
+    for (const char *p = text; *p;) {
+        if (*p == '<') {
+            if (strncmp(p, "<br", 3) == 0 && out > text && out[-1] != ' ') *out++ = ' ';
+            while (*p && *p != '>') p++;
+            if (*p) p++;
+            continue;
+        }
+        if (*p == '&') {
+            size_t i;
+            for (i = 0; i < sizeof(entities) / sizeof(entities[0]); i++) {
+                size_t length = strlen(entities[i].entity);
+                if (strncmp(p, entities[i].entity, length) == 0) {
+                    *out++ = entities[i].c;
+                    p += length;
+                    break;
+                }
+            }
+            if (i < sizeof(entities) / sizeof(entities[0])) continue;
+        }
+        *out++ = *p++;
+    }
+    *out = '\0';
+}
+
+// Cut to at most max bytes without splitting a UTF-8 sequence
+static void truncate_utf8(char *text, size_t max) {
+    size_t length = strlen(text);
+    if (length <= max) return;
+    while (max > 0 && ((unsigned char)text[max] & 0xC0) == 0x80) max--;
+    text[max] = '\0';
+}
+
+static int flag_set(const char *post, const char *key) {
+    const char *value = json_object_find(post, key);
+    return value && strtol(value, NULL, 10) != 0;
+}
+
+// The opening post names the thread; remove any half-written list from an earlier attempt
+static void begin_thread(Ingest *ingest, const char *post) {
+    const char *value = json_object_find(post, "no");
+    unsigned long long no = value ? strtoull(value, NULL, 10) : 0;
+    if (no == 0) {
+        fprintf(stderr, "Ingest: opening post has no \"no\" field\n");
+        ingest->failed = 1;
+        return;
+    }
+    snprintf(ingest->thread_id, sizeof(ingest->thread_id), "%llu", no);
+    snprintf(ingest->stats->thread_id, sizeof(ingest->stats->thread_id), "%llu", no);
+
+    // Every write until the fields goes to the node holding the post list
+    char posts[320], key[340];
+    format_thread_key(posts, sizeof(posts), ingest->board, ingest->thread_id, "posts");
+    ingest->context = redis_pool_acquire_for_key(posts, REDIS_ROUTE_PRIMARY);
+    if (ingest->context == NULL) {
+        ingest->failed = 1;
+        return;
+    }
+    format_staging_key(ingest, key, sizeof(key));
+    const char *argv[] = { "DEL", key };
+    size_t argvlen[] = { 3, strlen(key) };
+    send_command(ingest, 2, argv, argvlen);
+}
+
+// Title, post count and status, written together once the whole thread is in
+static void finish_thread(Ingest *ingest, const char *opening_post) {
+    char title[INGEST_TITLE_MAX] = "";
+    const char *value = json_object_find(opening_post, "sub");
+    if (value && *value == '"') json_parse_string(value, title, sizeof(title));
+    if (title[0] == '\0' && (value = json_object_find(opening_post, "com")) && *value == '"') {
+        json_parse_string(value, title, sizeof(title));
+        html_to_text(title);
+        truncate_utf8(title, INGEST_EXCERPT_MAX);
+    } else {
+        html_to_text(title);
+    }
+
+    const char *status = flag_set(opening_post, "archived") ? "archived" : flag_set(opening_post, "closed") ? "closed" : "active";
+    char count[16];
+    snprintf(count, sizeof(count), "%u", ingest->stats->posts);
+
+    char staging[340], posts[320], title_key[320], count_key[320], status_key[320];
+    format_staging_key(ingest, staging, sizeof(staging));
+    format_thread_key(posts, sizeof(posts), ingest->board, ingest->thread_id, "posts");
+    format_thread_key(title_key, sizeof(title_key), ingest->board, ingest->thread_id, "title");
+    format_thread_key(count_key, sizeof(count_key), ingest->board, ingest->thread_id, "count");
+    format_thread_key(status_key, sizeof(status_key), ingest->board, ingest->thread_id, "status");
+
+    // The staged list replaces the old one in one step, so readers never see it half-written
+    const char *rename[] = { "RENAME", staging, posts };
+    size_t rename_len[] = { 6, strlen(staging), strlen(posts) };
+    send_command(ingest, 3, rename, rename_len);
+    drain_replies(ingest);
+    if (ingest->failed) return;
+    redis_pool_release(ingest->context);  // The batch borrows its own connections
+    ingest->context = NULL;
+
+    // The fields only appear once the posts are in place. A cluster keeps them on other nodes.
+    RedisBatch *batch = redis_batch_new(REDIS_ROUTE_PRIMARY);
+    if (batch == NULL) {
+        ingest->failed = 1;
+        return;
+    }
+    const char *mset[] = { "MSET", title_key, title, count_key, count, status_key, status };
+    if (redis_batch_is_cluster(batch)) {
+        for (int i = 1; i < 7; i += 2) redis_batch_append(batch, mset[i], "SET %s %s", mset[i], mset[i + 1]);
+    } else {
+        redis_batch_append_argv(batch, title_key, 7, mset, NULL);
+    }
+    if (redis_batch_execute(batch) != 0) ingest->failed = 1;
+    for (size_t i = 0; i < redis_batch_count(batch) && !ingest->failed; i++) {
+        if (redis_batch_reply(batch, i)->type == REDIS_REPLY_ERROR) {
+            fprintf(stderr, "Ingest of thread %s: %s\n", ingest->thread_id, redis_batch_reply(batch, i)->str);
+            ingest->failed = 1;
+        }
+    }
+    ingest->stats->round_trips += redis_batch_round_trips(batch);
+    redis_batch_free(batch);
+}
+
+// --- Streaming scan ----------------------------------------------------------------------------
+
+static void handle_post(Ingest *ingest) {
+    if (ingest->failed) return;
+    note_buffered(ingest);
+
+    if (ingest->stats->posts == 0) {
+        begin_thread(ingest, ingest->post.data);
+        ingest->opening_post = strdup(ingest->post.data);
+        if (ingest->opening_post == NULL) ingest->failed = 1;
+        if (ingest->failed) return;
+    }
+
+    // With compress_posts set the entry is the compressed post, and the JSON is dropped here
+    char *compressed;
+    size_t compressed_length;
+    if (post_codec_encode(ingest->board, ingest->post.data, ingest->post.length, &compressed, &compressed_length) != 0) {
+        ingest->failed = 1;
+        return;
+    }
+    if (compressed) {
+        free(ingest->post.data);
+        ingest->post.data = compressed;
+        ingest->post.length = compressed_length;
+    }
+
+    ingest->batch[ingest->batched] = ingest->post.data;  // The list entry takes over the buffer
+    ingest->batch_length[ingest->batched] = ingest->post.length;
+    ingest->batched++;
+    ingest->batch_bytes += ingest->post.length;
+    ingest->stats->stored_bytes += ingest->post.length;
+    ingest->post = (JsonBuffer){ 0 };
+    ingest->stats->posts++;
+
+    if (ingest->batched == INGEST_BATCH) flush_batch(ingest);
+}
+
+// Feed the next chunk of the document; chunks may split tokens anywhere
+static void ingest_feed(Ingest *ingest, const char *data, size_t length) {
+    size_t capture_from = 0;
+    ingest->stats->bytes += length;
+    if (ingest->cancelled && __atomic_load_n(ingest->cancelled, __ATOMIC_RELAXED)) ingest->failed = 1;
+
+    for (size_t i = 0; i < length && !ingest->failed; i++) {
+        char c = data[i];
+
+        if (ingest->in_string) {
+            if (ingest->escaped) {
+                ingest->escaped = 0;
+            } else if (c == '\\') {
+                ingest->escaped = 1;
+            } else if (c == '"') {
+                ingest->in_string = 0;
+                if (ingest->reading_key) {
+                    ingest->key[ingest->key_length] = '\0';
+                    ingest->reading_key = 0;
+                }
+            } else if (ingest->reading_key && ingest->key_length < sizeof(ingest->key) - 1) {
+                ingest->key[ingest->key_length++] = c;
+            }
+            continue;
+        }
+
+        switch (c) {
+        case '"':
+            ingest->in_string = 1;
+            if (ingest->depth == 1 && ingest->expect_key) {
+                ingest->reading_key = 1;
+                ingest->key_length = 0;
+                ingest->expect_key = 0;
+            }
+            break;
+        case '{':
+        case '[':
+            if (ingest->in_posts && ingest->depth == 2 && c == '{') {
+                ingest->capturing = 1;
+                capture_from = i;
+            }
+            if (ingest->depth == 1 && c == '[' && strcmp(ingest->key, "posts") == 0) ingest->in_posts = 1;
+            if (++ingest->depth == 1) ingest->expect_key = 1;
+            break;
+        case '}':
+        case ']':
+            ingest->depth--;
+            if (ingest->capturing && ingest->depth == 2) {
+                ingest->capturing = 0;
+                if (json_append(&ingest->post, data + capture_from, i + 1 - capture_from) != 0) ingest->failed = 1;
+                else handle_post(ingest);
+            }
+            if (ingest->depth == 1 && c == ']') ingest->in_posts = 0;
+            break;
+        case ',':
+            if (ingest->depth == 1) ingest->expect_key = 1;
+            break;
+        }
+    }
+
+    // Post continues in the next chunk
+    if (ingest->capturing && !ingest->failed) {
+        if (json_append(&ingest->post, data + capture_from, length - capture_from) != 0) ingest->failed = 1;
+        else note_buffered(ingest);
+    }
+}
+
+// --- Sources -----------------------------------------------------------------------------------
+
+static size_t on_http_data(char *data, size_t size, size_t count, void *user_data) {
+    Ingest *ingest = user_data;
+    ingest_feed(ingest, data, size * count);
+    return ingest->failed ? 0 : size * count;  // 0 aborts the transfer
+}
+
+static pthread_once_t curl_once = PTHREAD_ONCE_INIT;
+
+static void init_curl() {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+}
+
+static int read_url(Ingest *ingest, const char *url) {
+    pthread_once(&curl_once, init_curl);
+    CURL *curl = curl_easy_init();
+    if (curl == NULL) return -1;
+
+    char error[CURL_ERROR_SIZE] = "";
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, on_http_data);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, ingest);
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");  // Whatever the server compresses with
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "FourChanArchiver");
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, 10000L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 60L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);  // Called from worker threads
+
+    CURLcode result = curl_easy_perform(curl);
+    curl_easy_cleanup(curl);
+    if (result != CURLE_OK && !ingest->failed) {
+        fprintf(stderr, "Failed to fetch %s: %s\n", url, error[0] ? error : curl_easy_strerror(result));
+        return -1;
+    }
+    return 0;
+}
+
+static int read_file(Ingest *ingest, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return -1;
+    }
+    char chunk[64 * 1024];
+    size_t length;
+    while (!ingest->failed && (length = fread(chunk, 1, sizeof(chunk), file)) > 0) ingest_feed(ingest, chunk, length);
+    fclose(file);
+    return 0;
+}
+
+// Import one thread from source, a URL (anything libcurl fetches, including file://) or a
+// local path, into board. Returns 0 once every write has been acknowledged. A cancelled or
+// failed import leaves the previous post list in place.
+int thread_ingest(const char *board, const char *source, const int *cancelled, IngestStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    double started = now_ms();
+
+    Ingest ingest = { 0 };
+    ingest.board = board;
+    ingest.cancelled = cancelled;
+    ingest.stats = stats;
+
+    int result = strstr(source, "://") ? read_url(&ingest, source) : read_file(&ingest, source);
+    if (result == 0 && !ingest.failed && stats->posts == 0) {
+        fprintf(stderr, "No posts found in %s\n", source);
+        result = -1;
+    }
+    if (result == 0 && !ingest.failed) {
+        flush_batch(&ingest);
+        finish_thread(&ingest, ingest.opening_post);
+    }
+    drain_replies(&ingest);
+    if (result != 0 || ingest.failed) discard_staging(&ingest);
+
+    for (size_t i = 0; i < ingest.batched; i++) free(ingest.batch[i]);
+    free(ingest.post.data);
+    free(ingest.opening_post);
+    redis_pool_release(ingest.context);
+
+    stats->elapsed_ms = now_ms() - started;
+    return result == 0 && !ingest.failed ? 0 : -1;
+}
+
+// Import thread_id of board from a server laid out like the 4chan API: <base>/<board>/thread/<id>.json
+int thread_ingest_from_api(const char *board, const char *base_url, const char *thread_id, const int *cancelled, IngestStats *stats) {
+    char source[1024];
+    snprintf(source, sizeof(source), "%s/%s/thread/%s.json", base_url, board, thread_id);
+    return thread_ingest(board, source, cancelled, stats);
+}
+
+void thread_ingest_report(const IngestStats *stats, char *out, size_t size) {
+    snprintf(out, size, "Ingested %u posts of thread %s (%zu KiB, %zu KiB stored) in %.1f ms: %.0f posts/s, %u round-trips, at most %zu KiB of posts held\n",
+             stats->posts, stats->thread_id, stats->bytes / 1024, stats->stored_bytes / 1024, stats->elapsed_ms,
+             stats->elapsed_ms > 0 ? stats->posts * 1000.0 / stats->elapsed_ms : 0.0, stats->round_trips,
+             (stats->peak_buffered_bytes + 1023) / 1024);
+}
@@ -0,0 +1,452 @@
+#include <gtk/gtk.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/thread_list_model.h"
+#include "../include/metrics.h"
+
+// GtkTreeModel that reads rows straight out of a ThreadSnapshot. The only per-row state is the
+// vector of visible record indices (filtered, then sorted by permutation) and its inverse,
+// so no strings are copied into the model and refiltering never rebuilds a store.
+//
+// The snapshot is borrowed: every call that passes one replaces the previous pointer, and the
+// caller must pass the new one before the old snapshot is modified or freed.
+
+struct _ThreadListModel {
+    GObject parent_instance;
+
+    const ThreadSnapshot *snapshot;
+    guint known_records;    // Snapshot records already considered for the visible rows
+    guint *rows;            // Visible position -> record index
+    guint n_rows;
+    guint rows_capacity;
+    gint *positions;        // Record index -> visible position, -1 when hidden
+    guint positions_capacity;
+
+    gint sort_column;       // GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID or a THREAD_LIST_COLUMN_*
+    GtkSortType sort_order;
+    gint stamp;
+
+    ThreadListFilterFunc filter_func;
+    gpointer filter_data;
+    ThreadListRankFunc rank_func;   // Orders unsorted rows when set
+    gpointer rank_data;
+};
+
+static void thread_list_model_tree_model_init(GtkTreeModelIface *iface);
+static void thread_list_model_sortable_init(GtkTreeSortableIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(ThreadListModel, thread_list_model, G_TYPE_OBJECT,
+                        G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL, thread_list_model_tree_model_init)
+                        G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_SORTABLE, thread_list_model_sortable_init))
+
+static void thread_list_model_finalize(GObject *object) {
+    ThreadListModel *model = THREAD_LIST_MODEL(object);
+    g_free(model->rows);
+    g_free(model->positions);
+    G_OBJECT_CLASS(thread_list_model_parent_class)->finalize(object);
+}
+
+static void thread_list_model_class_init(ThreadListModelClass *klass) {
+    G_OBJECT_CLASS(klass)->finalize = thread_list_model_finalize;
+}
+
+static void thread_list_model_init(ThreadListModel *model) {
+    model->sort_column = GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID;
+    model->sort_order = GTK_SORT_ASCENDING;
+    model->stamp = g_random_int();
+}
+
+ThreadListModel *thread_list_model_new(void) {
+    return g_object_new(THREAD_TYPE_LIST_MODEL, NULL);
+}
+
+void thread_list_model_set_filter_func(ThreadListModel *model, ThreadListFilterFunc func, gpointer user_data) {
+    model->filter_func = func;
+    model->filter_data = user_data;
+}
+
+// Takes effect at the next refilter
+void thread_list_model_set_rank_func(ThreadListModel *model, ThreadListRankFunc func, gpointer user_data) {
+    model->rank_func = func;
+    model->rank_data = user_data;
+}
+
+guint thread_list_model_get_n_rows(ThreadListModel *model) {
+    return model->n_rows;
+}
+
+// Snapshot record shown at iter
+guint thread_list_model_get_record_index(ThreadListModel *model, GtkTreeIter *iter) {
+    return model->rows[GPOINTER_TO_UINT(iter->user_data)];
+}
+
+static gboolean record_visible(ThreadListModel *model, guint index) {
+    const ThreadSnapshotRecord *record = &model->snapshot->records[index];
+    if (record->flags & THREAD_RECORD_DELETED) return FALSE;
+    return model->filter_func == NULL || model->filter_func(model->snapshot, record, model->filter_data);
+}
+
+static void reserve(ThreadListModel *model, guint rows, guint records) {
+    if (rows > model->rows_capacity) {
+        model->rows_capacity = MAX(rows, model->rows_capacity * 2);
+        model->rows = g_renew(guint, model->rows, model->rows_capacity);
+    }
+    if (records > model->positions_capacity) {
+        guint old = model->positions_capacity;
+        model->positions_capacity = MAX(records, old * 2);
+        model->positions = g_renew(gint, model->positions, model->positions_capacity);
+        for (guint i = old; i < model->positions_capacity; i++) model->positions[i] = -1;
+    }
+}
+
+static void update_positions(ThreadListModel *model, guint from) {
+    for (guint pos = from; pos < model->n_rows; pos++) model->positions[model->rows[pos]] = pos;
+}
+
+// --- Sorting -----------------------------------------------------------------------------
+
+// Total order for the current sort column; ties fall back to the thread ID so positions are stable
+static int compare_records(ThreadListModel *model, guint a, guint b) {
+    const ThreadSnapshotRecord *ra = &model->snapshot->records[a];
+    const ThreadSnapshotRecord *rb = &model->snapshot->records[b];
+    int result = 0;
+
+    switch (model->sort_column) {
+    case THREAD_LIST_COLUMN_TITLE:
+        result = strcmp(thread_snapshot_title(model->snapshot, ra), thread_snapshot_title(model->snapshot, rb));
+        break;
+    case THREAD_LIST_COLUMN_COUNT:
+        result = (ra->count > rb->count) - (ra->count < rb->count);
+        break;
+    case THREAD_LIST_COLUMN_STATUS:
+        result = (ra->status_offset == rb->status_offset) ? 0 :
+                 strcmp(thread_snapshot_status(model->snapshot, ra), thread_snapshot_status(model->snapshot, rb));
+        break;
+    case THREAD_LIST_COLUMN_ID:
+        break;
+    default:
+        if (model->rank_func) {  // Unsorted with a rank: best first
+            double rank_a = model->rank_func(model->snapshot, ra, model->rank_data);
+            double rank_b = model->rank_func(model->snapshot, rb, model->rank_data);
+            if (rank_a != rank_b) return rank_a < rank_b ? 1 : -1;
+        }
+        return (a > b) - (a < b);  // Unsorted: snapshot order
+    }
+    if (result == 0) result = (ra->id > rb->id) - (ra->id < rb->id);
+    return model->sort_order == GTK_SORT_DESCENDING ? -result : result;
+}
+
+static int compare_rows(gconstpointer a, gconstpointer b, gpointer data) {
+    return compare_records(data, *(const guint *)a, *(const guint *)b);
+}
+
+static void sort_indices(ThreadListModel *model, guint *indices, guint n) {
+    g_qsort_with_data(indices, n, sizeof(guint), compare_rows, model);
+}
+
+// First visible position whose record sorts after record_index
+static guint insertion_point(ThreadListModel *model, guint record_index) {
+    guint low = 0, high = model->n_rows;
+    while (low < high) {
+        guint mid = low + (high - low) / 2;
+        if (compare_records(model, model->rows[mid], record_index) < 0) low = mid + 1;
+        else high = mid;
+    }
+    return low;
+}
+
+// --- Row signals -------------------------------------------------------------------------
+
+static void emit_row_inserted(ThreadListModel *model, guint pos) {
+    GtkTreeIter iter = { model->stamp, GUINT_TO_POINTER(pos), NULL, NULL };
+    GtkTreePath *path = gtk_tree_path_new_from_indices(pos, -1);
+    gtk_tree_model_row_inserted(GTK_TREE_MODEL(model), path, &iter);
+    gtk_tree_path_free(path);
+}
+
+static void emit_row_deleted(ThreadListModel *model, guint pos) {
+    GtkTreePath *path = gtk_tree_path_new_from_indices(pos, -1);
+    gtk_tree_model_row_deleted(GTK_TREE_MODEL(model), path);
+    gtk_tree_path_free(path);
+}
+
+static void emit_row_changed(ThreadListModel *model, guint pos) {
+    GtkTreeIter iter = { model->stamp, GUINT_TO_POINTER(pos), NULL, NULL };
+    GtkTreePath *path = gtk_tree_path_new_from_indices(pos, -1);
+    gtk_tree_model_row_changed(GTK_TREE_MODEL(model), path, &iter);
+    gtk_tree_path_free(path);
+}
+
+static void remove_row(ThreadListModel *model, guint pos) {
+    model->positions[model->rows[pos]] = -1;
+    memmove(&model->rows[pos], &model->rows[pos + 1], (model->n_rows - pos - 1) * sizeof(guint));
+    model->n_rows--;
+    update_positions(model, pos);
+    emit_row_deleted(model, pos);
+}
+
+static void insert_row(ThreadListModel *model, guint record_index) {
+    reserve(model, model->n_rows + 1, record_index + 1);
+    guint pos = insertion_point(model, record_index);
+    memmove(&model->rows[pos + 1], &model->rows[pos], (model->n_rows - pos) * sizeof(guint));
+    model->rows[pos] = record_index;
+    model->n_rows++;
+    update_positions(model, pos);
+    emit_row_inserted(model, pos);
+}
+
+// --- Public updates ----------------------------------------------------------------------
+
+// Rebuild the visible rows from scratch (new snapshot or new filter). Views should be
+// detached while this runs on large lists; attached views get one row-deleted per old row.
+void thread_list_model_refilter(ThreadListModel *model, const ThreadSnapshot *snapshot) {
+    uint64_t started = metrics_begin();
+    while (model->n_rows > 0) {
+        model->n_rows--;
+        emit_row_deleted(model, model->n_rows);
+    }
+
+    model->snapshot = snapshot;
+    model->known_records = snapshot->count;
+    model->stamp++;
+    reserve(model, snapshot->count, snapshot->count);
+
+    for (guint i = 0; i < model->positions_capacity; i++) model->positions[i] = -1;
+    for (guint i = 0; i < snapshot->count; i++) {
+        if (record_visible(model, i)) model->rows[model->n_rows++] = i;
+    }
+    sort_indices(model, model->rows, model->n_rows);
+    update_positions(model, 0);
+
+    for (guint pos = 0; pos < model->n_rows; pos++) emit_row_inserted(model, pos);
+    metrics_end(METRIC_LIST_REBUILD, started);
+}
+
+// Merge records appended to the snapshot since the last call: the new matches are sorted on
+// their own and merged in one pass, so a streaming listing costs O(n + k log k) per batch.
+void thread_list_model_sync(ThreadListModel *model, const ThreadSnapshot *snapshot) {
+    model->snapshot = snapshot;
+    if (snapshot->count <= model->known_records) return;
+
+    uint64_t started = metrics_begin();
+    guint *added = g_new(guint, snapshot->count - model->known_records);
+    guint n_added = 0;
+    for (guint i = model->known_records; i < snapshot->count; i++) {
+        if (record_visible(model, i)) added[n_added++] = i;
+    }
+    guint first_new = model->known_records;
+    model->known_records = snapshot->count;
+    reserve(model, model->n_rows + n_added, snapshot->count);
+    sort_indices(model, added, n_added);
+
+    // Merge from the back so the row vector can be filled in place
+    guint i = model->n_rows, j = n_added, out = model->n_rows + n_added;
+    while (j > 0) {
+        if (i > 0 && compare_records(model, model->rows[i - 1], added[j - 1]) > 0) model->rows[--out] = model->rows[--i];
+        else model->rows[--out] = added[--j];
+    }
+    model->n_rows += n_added;
+    update_positions(model, 0);
+
+    // Signal the new rows in ascending order; each path is valid once the earlier ones exist
+    for (guint pos = 0; pos < model->n_rows && n_added > 0; pos++) {
+        if (model->rows[pos] >= first_new) emit_row_inserted(model, pos);
+    }
+
+    g_free(added);
+    metrics_end(METRIC_LIST_REBUILD, started);
+}
+
+// One record was updated in place, deleted or undeleted. Returns FALSE for records the
+// model hasn't seen yet; those are picked up by thread_list_model_sync().
+gboolean thread_list_model_record_changed(ThreadListModel *model, const ThreadSnapshot *snapshot, guint record_index) {
+    model->snapshot = snapshot;
+    if (record_index >= model->known_records) return FALSE;
+
+    gint pos = model->positions[record_index];
+    gboolean visible = record_visible(model, record_index);
+
+    if (pos >= 0 && !visible) {
+        remove_row(model, pos);
+    } else if (pos < 0 && visible) {
+        insert_row(model, record_index);
+    } else if (pos >= 0) {
+        // Still visible: change in place unless the new value moved it out of sort order
+        gboolean in_order = (pos == 0 || compare_records(model, model->rows[pos - 1], record_index) < 0) &&
+                            ((guint)pos + 1 == model->n_rows || compare_records(model, record_index, model->rows[pos + 1]) < 0);
+        if (in_order) {
+            emit_row_changed(model, pos);
+        } else {
+            remove_row(model, pos);
+            insert_row(model, record_index);
+        }
+    }
+    return TRUE;
+}
+
+// --- GtkTreeModel ------------------------------------------------------------------------
+
+static GtkTreeModelFlags thread_list_model_get_flags(GtkTreeModel *tree_model) {
+    return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint thread_list_model_get_n_columns(GtkTreeModel *tree_model) {
+    return THREAD_LIST_N_COLUMNS;
+}
+
+static GType thread_list_model_get_column_type(GtkTreeModel *tree_model, gint column) {
+    return column == THREAD_LIST_COLUMN_COUNT ? G_TYPE_INT : G_TYPE_STRING;
+}
+
+static gboolean set_iter(ThreadListModel *model, GtkTreeIter *iter, guint pos) {
+    if (pos >= model->n_rows) {
+        iter->stamp = 0;
+        return FALSE;
+    }
+    iter->stamp = model->stamp;
+    iter->user_data = GUINT_TO_POINTER(pos);
+    return TRUE;
+}
+
+static gboolean thread_list_model_get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path) {
+    if (gtk_tree_path_get_depth(path) != 1) return FALSE;
+    return set_iter(THREAD_LIST_MODEL(tree_model), iter, gtk_tree_path_get_indices(path)[0]);
+}
+
+static GtkTreePath *thread_list_model_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    return gtk_tree_path_new_from_indices(GPOINTER_TO_UINT(iter->user_data), -1);
+}
+
+static void thread_list_model_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter, gint column, GValue *value) {
+    ThreadListModel *model = THREAD_LIST_MODEL(tree_model);
+    guint pos = GPOINTER_TO_UINT(iter->user_data);
+    g_return_if_fail(iter->stamp == model->stamp && pos < model->n_rows);
+
+    const ThreadSnapshotRecord *record = &model->snapshot->records[model->rows[pos]];
+    switch (column) {
+    case THREAD_LIST_COLUMN_ID:
+        g_value_init(value, G_TYPE_STRING);
+        g_value_take_string(value, g_strdup_printf("%" G_GUINT64_FORMAT, record->id));
+        break;
+    case THREAD_LIST_COLUMN_TITLE:
+        g_value_init(value, G_TYPE_STRING);
+        g_value_set_string(value, thread_snapshot_title(model->snapshot, record));
+        break;
+    case THREAD_LIST_COLUMN_COUNT:
+        g_value_init(value, G_TYPE_INT);
+        g_value_set_int(value, record->count);
+        break;
+    case THREAD_LIST_COLUMN_STATUS:
+        g_value_init(value, G_TYPE_STRING);
+        g_value_set_string(value, thread_snapshot_status(model->snapshot, record));
+        break;
+    }
+}
+
+static gboolean thread_list_model_iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    return set_iter(THREAD_LIST_MODEL(tree_model), iter, GPOINTER_TO_UINT(iter->user_data) + 1);
+}
+
+static gboolean thread_list_model_iter_previous(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    guint pos = GPOINTER_TO_UINT(iter->user_data);
+    if (pos == 0) {
+        iter->stamp = 0;
+        return FALSE;
+    }
+    return set_iter(THREAD_LIST_MODEL(tree_model), iter, pos - 1);
+}
+
+static gboolean thread_list_model_iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent) {
+    if (parent) return FALSE;
+    return set_iter(THREAD_LIST_MODEL(tree_model), iter, 0);
+}
+
+static gboolean thread_list_model_iter_has_child(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    return FALSE;
+}
+
+static gint thread_list_model_iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter) {
+    return iter ? 0 : (gint)THREAD_LIST_MODEL(tree_model)->n_rows;
+}
+
+static gboolean thread_list_model_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *parent, gint n) {
+    if (parent || n < 0) return FALSE;
+    return set_iter(THREAD_LIST_MODEL(tree_model), iter, n);
+}
+
+static gboolean thread_list_model_iter_parent(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child) {
+    return FALSE;
+}
+
+static void thread_list_model_tree_model_init(GtkTreeModelIface *iface) {
+    iface->get_flags = thread_list_model_get_flags;
+    iface->get_n_columns = thread_list_model_get_n_columns;
+    iface->get_column_type = thread_list_model_get_column_type;
+    iface->get_iter = thread_list_model_get_iter;
+    iface->get_path = thread_list_model_get_path;
+    iface->get_value = thread_list_model_get_value;
+    iface->iter_next = thread_list_model_iter_next;
+    iface->iter_previous = thread_list_model_iter_previous;
+    iface->iter_children = thread_list_model_iter_children;
+    iface->iter_has_child = thread_list_model_iter_has_child;
+    iface->iter_n_children = thread_list_model_iter_n_children;
+    iface->iter_nth_child = thread_list_model_iter_nth_child;
+    iface->iter_parent = thread_list_model_iter_parent;
+}
+
+// --- GtkTreeSortable ---------------------------------------------------------------------
+
+static gboolean thread_list_model_get_sort_column_id(GtkTreeSortable *sortable, gint *sort_column_id, GtkSortType *order) {
+    ThreadListModel *model = THREAD_LIST_MODEL(sortable);
+    if (sort_column_id) *sort_column_id = model->sort_column;
+    if (order) *order = model->sort_order;
+    return model->sort_column != GTK_TREE_SORTABLE_UNSORTED_SORT_COLUMN_ID &&
+           model->sort_column != GTK_TREE_SORTABLE_DEFAULT_SORT_COLUMN_ID;
+}
+
+// Re-sort the index vector and tell views where each row moved
+static void thread_list_model_set_sort_column_id(GtkTreeSortable *sortable, gint sort_column_id, GtkSortType order) {
+    ThreadListModel *model = THREAD_LIST_MODEL(sortable);
+    if (model->sort_column == sort_column_id && model->sort_order == order) return;
+
+    model->sort_column = sort_column_id;
+    model->sort_order = order;
+
+    if (model->n_rows > 0) {
+        sort_indices(model, model->rows, model->n_rows);
+
+        gint *new_order = g_new(gint, model->n_rows);
+        for (guint pos = 0; pos < model->n_rows; pos++) new_order[pos] = model->positions[model->rows[pos]];
+        update_positions(model, 0);
+
+        GtkTreePath *path = gtk_tree_path_new();
+        gtk_tree_model_rows_reordered(GTK_TREE_MODEL(model), path, NULL, new_order);
+        gtk_tree_path_free(path);
+        g_free(new_order);
+    }
+
+    gtk_tree_sortable_sort_column_changed(sortable);
+}
+
+// Sorting is built in per column; custom sort functions are not supported
+static void thread_list_model_set_sort_func(GtkTreeSortable *sortable, gint sort_column_id,
+                                            GtkTreeIterCompareFunc func, gpointer data, GDestroyNotify destroy) {
+    g_warning("ThreadListModel does not support custom sort functions");
+}
+
+static void thread_list_model_set_default_sort_func(GtkTreeSortable *sortable, GtkTreeIterCompareFunc func,
+                                                    gpointer data, GDestroyNotify destroy) {
+    g_warning("ThreadListModel does not support a default sort function");
+}
+
+static gboolean thread_list_model_has_default_sort_func(GtkTreeSortable *sortable) {
+    return FALSE;
+}
+
+static void thread_list_model_sortable_init(GtkTreeSortableIface *iface) {
+    iface->get_sort_column_id = thread_list_model_get_sort_column_id;
+    iface->set_sort_column_id = thread_list_model_set_sort_column_id;
+    iface->set_sort_func = thread_list_model_set_sort_func;
+    iface->set_default_sort_func = thread_list_model_set_default_sort_func;
+    iface->has_default_sort_func = thread_list_model_has_default_sort_func;
+}
@@ -0,0 +1,146 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "../include/thread_snapshot.h"
+
+// Statuses repeat across nearly every thread ("active", "archived", ...), so they are
+// interned: the arena keeps one copy of each and records share its offset.
+#define INTERN_SLOTS 16
+
+static int grow(void **block, size_t *capacity, size_t needed, size_t element_size, size_t *allocations) {
+    if (needed <= *capacity) return 0;
+    size_t new_capacity = *capacity ? *capacity : 1024;
+    while (new_capacity < needed) new_capacity *= 2;
+
+    void *grown = realloc(*block, new_capacity * element_size);
+    if (grown == NULL) return -1;
+    *block = grown;
+    *capacity = new_capacity;
+    (*allocations)++;
+    return 0;
+}
+
+// Copy a NUL-terminated string into the arena and return its offset
+static long arena_store(ThreadSnapshot *snapshot, const char *text) {
+    size_t length = strlen(text) + 1;
+    if (grow((void **)&snapshot->arena, &snapshot->arena_capacity, snapshot->arena_used + length, 1, &snapshot->allocations) < 0) return -1;
+
+    long offset = (long)snapshot->arena_used;
+    memcpy(snapshot->arena + offset, text, length);
+    snapshot->arena_used += length;
+    return offset;
+}
+
+// Offset of the status string, reusing an earlier copy when one of the last few statuses matches
+static long intern_status(ThreadSnapshot *snapshot, const char *status) {
+    size_t start = snapshot->count > INTERN_SLOTS ? snapshot->count - INTERN_SLOTS : 0;
+    for (size_t i = snapshot->count; i > start; i--) {
+        uint32_t offset = snapshot->records[i - 1].status_offset;
+        if (strcmp(snapshot->arena + offset, status) == 0) return offset;
+    }
+    return arena_store(snapshot, status);
+}
+
+// Sizes both blocks up front when the thread count is known, so building costs two allocations
+ThreadSnapshot *thread_snapshot_new(size_t expected_threads) {
+    ThreadSnapshot *snapshot = calloc(1, sizeof(ThreadSnapshot));
+    if (snapshot == NULL) return NULL;
+    snapshot->refcount = 1;
+    snapshot->allocations = 1;
+
+    if (expected_threads > 0) {
+        grow((void **)&snapshot->records, &snapshot->capacity, expected_threads, sizeof(ThreadSnapshotRecord), &snapshot->allocations);
+        grow((void **)&snapshot->arena, &snapshot->arena_capacity, expected_threads * 64, 1, &snapshot->allocations);
+    }
+    return snapshot;
+}
+
+ThreadSnapshot *thread_snapshot_ref(ThreadSnapshot *snapshot) {
+    if (snapshot) __atomic_add_fetch(&snapshot->refcount, 1, __ATOMIC_RELAXED);
+    return snapshot;
+}
+
+// Dropping the last reference frees the whole snapshot with three free() calls, whatever its size
+void thread_snapshot_unref(ThreadSnapshot *snapshot) {
+    if (snapshot == NULL) return;
+    if (__atomic_sub_fetch(&snapshot->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(snapshot->records);
+        free(snapshot->arena);
+        free(snapshot);
+    }
+}
+
+int thread_snapshot_is_shared(ThreadSnapshot *snapshot) {
+    return __atomic_load_n(&snapshot->refcount, __ATOMIC_ACQUIRE) > 1;
+}
+
+// Private copy with the same record positions, for writers holding a shared snapshot
+ThreadSnapshot *thread_snapshot_copy(const ThreadSnapshot *snapshot) {
+    ThreadSnapshot *copy = thread_snapshot_new(0);
+    if (copy == NULL) return NULL;
+
+    if (grow((void **)&copy->records, &copy->capacity, snapshot->count, sizeof(ThreadSnapshotRecord), &copy->allocations) < 0 ||
+        grow((void **)&copy->arena, &copy->arena_capacity, snapshot->arena_used, 1, &copy->allocations) < 0) {
+        thread_snapshot_unref(copy);
+        return NULL;
+    }
+    memcpy(copy->records, snapshot->records, snapshot->count * sizeof(ThreadSnapshotRecord));
+    memcpy(copy->arena, snapshot->arena, snapshot->arena_used);
+    copy->count = snapshot->count;
+    copy->arena_used = snapshot->arena_used;
+    return copy;
+}
+
+// Add a thread; returns its index, or -1 when out of memory. Invalidates string pointers.
+long thread_snapshot_append(ThreadSnapshot *snapshot, uint64_t id, const char *title, int count, const char *status) {
+    if (grow((void **)&snapshot->records, &snapshot->capacity, snapshot->count + 1, sizeof(ThreadSnapshotRecord), &snapshot->allocations) < 0) return -1;
+
+    long title_offset = arena_store(snapshot, title);
+    long status_offset = title_offset < 0 ? -1 : intern_status(snapshot, status);
+    if (status_offset < 0) return -1;
+
+    ThreadSnapshotRecord *record = &snapshot->records[snapshot->count];
+    record->id = id;
+    record->title_offset = (uint32_t)title_offset;
+    record->status_offset = (uint32_t)status_offset;
+    record->count = count;
+    record->flags = 0;
+    return (long)snapshot->count++;
+}
+
+// Rewrite one record in place; unchanged strings keep their arena copy, changed ones are appended
+int thread_snapshot_update(ThreadSnapshot *snapshot, size_t index, const char *title, int count, const char *status) {
+    if (index >= snapshot->count) return -1;
+
+    if (strcmp(snapshot->arena + snapshot->records[index].title_offset, title) != 0) {
+        long offset = arena_store(snapshot, title);
+        if (offset < 0) return -1;
+        snapshot->records[index].title_offset = (uint32_t)offset;
+    }
+    if (strcmp(snapshot->arena + snapshot->records[index].status_offset, status) != 0) {
+        long offset = intern_status(snapshot, status);
+        if (offset < 0) return -1;
+        snapshot->records[index].status_offset = (uint32_t)offset;
+    }
+    snapshot->records[index].count = count;
+    snapshot->records[index].flags &= ~THREAD_RECORD_DELETED;
+    return 0;
+}
+
+const char *thread_snapshot_title(const ThreadSnapshot *snapshot, const ThreadSnapshotRecord *record) {
+    return snapshot->arena + record->title_offset;
+}
+
+const char *thread_snapshot_status(const ThreadSnapshot *snapshot, const ThreadSnapshotRecord *record) {
+    return snapshot->arena + record->status_offset;
+}
+
+// One line of memory figures: the snapshot's own footprint and allocations, plus process peak RSS
+void thread_snapshot_report(const ThreadSnapshot *snapshot, FILE *out) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(out, "Snapshot: %zu threads, %zu KiB records + %zu KiB strings, %zu allocations, peak RSS %ld KiB\n",
+            snapshot->count, snapshot->capacity * sizeof(ThreadSnapshotRecord) / 1024, snapshot->arena_capacity / 1024,
+            snapshot->allocations, usage.ru_maxrss);
+}
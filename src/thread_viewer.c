@@ -0,0 +1,417 @@
+#include <gtk/gtk.h>
+#include <string.h>
+#include "../include/thread_viewer.h"
+#include "../include/archive.h"
+#include "../include/json_scan.h"
+#include "../include/thread_ingest.h"
+#include "../include/settings.h"
+#include "../include/media_store.h"
+#include "../include/thumbnail_cache.h"
+
+// Posts are fetched with LRANGE a page at a time as they scroll into view, and the page after
+// the last visible one is prefetched. Rows of pages not loaded yet are placeholders, and a
+// post's comment is only decoded once its page is on screen, so opening a long thread costs
+// one page. Loaded posts stay in a small LRU of recently opened threads: reopening one, or
+// opening it twice, paints without a round trip. Thumbnails of a page's posts are requested
+// from the thumbnail cache when the page is rendered and fill in as they are decoded.
+
+#define VIEWER_PAGE_POSTS 50
+#define VIEWER_CACHE_THREADS 16
+#define VIEWER_PLACEHOLDER "<i>Loading…</i>"
+
+enum { PAGE_NONE, PAGE_REQUESTED, PAGE_LOADED };
+enum { COLUMN_MARKUP, COLUMN_THUMBNAIL, N_COLUMNS };
+
+// Posts of one thread, shared by the LRU, its viewers and the fetches in flight
+typedef struct {
+    int refs;
+    char board[256];
+    char thread_id[THREAD_ID_MAX];
+    long long total;        // Posts in the thread; -1 until the first page arrives
+    gboolean first_requested;
+    gboolean failed;        // The last fetch failed; scrolling tries again
+    char **posts;           // total entries, NULL until loaded
+    guint8 *pages;          // PAGE_* of each page
+    gboolean from_archive;
+    GList *viewers;
+} ThreadPosts;
+
+typedef struct {
+    ThreadPosts *thread;
+    RedisAsync *connection;   // NULL once the board's connection is closed
+    GtkWidget *window;
+    GtkWidget *tree_view;
+    GtkWidget *status_label;
+    GtkCellRenderer *renderer;
+    GtkTreeViewColumn *thumbnail_column;
+    GtkListStore *store;
+    guint8 *rendered;         // Per page: its rows hold decoded posts
+    size_t rendered_pages;
+    gint64 opened_at;
+    double first_paint_ms;    // From opening to the first page on screen; 0 until then
+    guint check_id;
+} ThreadViewer;
+
+static GQueue recent_threads = G_QUEUE_INIT;  // ThreadPosts, most recently opened first
+static GList *open_viewers = NULL;
+
+static size_t page_count(long long total) {
+    return total > 0 ? (size_t)((total + VIEWER_PAGE_POSTS - 1) / VIEWER_PAGE_POSTS) : 0;
+}
+
+static ThreadPosts *thread_posts_new(const char *board, const char *thread_id) {
+    ThreadPosts *thread = g_new0(ThreadPosts, 1);
+    thread->refs = 1;
+    g_strlcpy(thread->board, board, sizeof(thread->board));
+    g_strlcpy(thread->thread_id, thread_id, sizeof(thread->thread_id));
+    thread->total = -1;
+    return thread;
+}
+
+static ThreadPosts *thread_posts_ref(ThreadPosts *thread) {
+    thread->refs++;
+    return thread;
+}
+
+static void thread_posts_unref(ThreadPosts *thread) {
+    if (--thread->refs > 0) return;
+    for (long long i = 0; i < thread->total; i++) g_free(thread->posts[i]);
+    g_free(thread->posts);
+    g_free(thread->pages);
+    g_free(thread);
+}
+
+// Cached posts of a thread, moved to the front of the LRU; a new entry if there are none
+static ThreadPosts *recent_thread(const char *board, const char *thread_id) {
+    for (GList *link = recent_threads.head; link; link = link->next) {
+        ThreadPosts *thread = link->data;
+        if (strcmp(thread->board, board) == 0 && strcmp(thread->thread_id, thread_id) == 0) {
+            g_queue_unlink(&recent_threads, link);
+            g_queue_push_head_link(&recent_threads, link);
+            return thread;
+        }
+    }
+
+    ThreadPosts *thread = thread_posts_new(board, thread_id);
+    g_queue_push_head(&recent_threads, thread);
+    while (g_queue_get_length(&recent_threads) > VIEWER_CACHE_THREADS) thread_posts_unref(g_queue_pop_tail(&recent_threads));
+    return thread;
+}
+
+// Grow to the length the latest page reported; posts already loaded keep their place
+static void resize_thread(ThreadPosts *thread, long long total) {
+    long long old_total = thread->total > 0 ? thread->total : 0;
+    if (total <= old_total) {
+        if (thread->total < 0) thread->total = 0;
+        return;
+    }
+    size_t old_pages = page_count(old_total), pages = page_count(total);
+    thread->posts = g_renew(char *, thread->posts, total);
+    memset(thread->posts + old_total, 0, sizeof(char *) * (total - old_total));
+    thread->pages = g_renew(guint8, thread->pages, pages);
+    memset(thread->pages + old_pages, PAGE_NONE, pages - old_pages);
+    // The old last page was short; it has more posts now
+    if (old_pages > 0 && old_total % VIEWER_PAGE_POSTS) thread->pages[old_pages - 1] = PAGE_NONE;
+    thread->total = total;
+}
+
+// Copy every post of the archived thread; 0 if it was found
+static int load_from_archive(ThreadPosts *thread) {
+    char path[512];
+    format_archive_path(path, sizeof(path), archive_dir, thread->board);
+    Archive *archive = archive_open(path);
+    ArchiveThread archived;
+    if (archive == NULL || archive_find(archive, g_ascii_strtoull(thread->thread_id, NULL, 10), &archived) != 0) {
+        archive_close(archive);
+        return -1;
+    }
+
+    resize_thread(thread, archived.post_count);
+    for (uint32_t i = 0; i < archived.post_count; i++) {
+        size_t length;
+        const char *post = archive_thread_post(&archived, i, &length);
+        g_free(thread->posts[i]);
+        thread->posts[i] = g_strndup(post, length);
+    }
+    memset(thread->pages, PAGE_LOADED, page_count(thread->total));
+    thread->from_archive = TRUE;
+    archive_close(archive);
+    return 0;
+}
+
+// "No.<id>" in bold over the comment as plain text
+static char *post_markup(const char *post) {
+    size_t length = strlen(post);
+    const char *no = json_object_find(post, "no");
+    const char *com = json_object_find(post, "com");
+    char *text = g_malloc(length + 1);
+    text[0] = '\0';
+    if (com && *com == '"') json_parse_string(com, text, length + 1);
+    html_to_text(text);
+
+    char *escaped = g_markup_escape_text(text, -1);
+    char *markup = g_strdup_printf("<b>No.%" G_GUINT64_FORMAT "</b>\n%s", no ? g_ascii_strtoull(no, NULL, 10) : 0, escaped);
+    g_free(escaped);
+    g_free(text);
+    return markup;
+}
+
+static void set_status(ThreadViewer *viewer) {
+    ThreadPosts *thread = viewer->thread;
+    char text[256], paint[64] = "";
+    if (viewer->first_paint_ms > 0) g_snprintf(paint, sizeof(paint), ", first page in %.1f ms", viewer->first_paint_ms);
+    if (thread->total < 0 && viewer->connection == NULL) g_snprintf(text, sizeof(text), "Not in the archive, and Redis is not connected");
+    else if (thread->total < 0 && thread->failed) g_snprintf(text, sizeof(text), "Could not read the posts");
+    else if (thread->total < 0) g_snprintf(text, sizeof(text), "Loading…");
+    else if (thread->total == 0) g_snprintf(text, sizeof(text), "No posts in Redis or the archive");
+    else g_snprintf(text, sizeof(text), "%lld posts%s%s%s", thread->total, thread->from_archive ? " (archive)" : "",
+                    paint, thread->failed ? "; fetching a page failed, scroll to retry" : "");
+    gtk_label_set_text(GTK_LABEL(viewer->status_label), text);
+}
+
+// One placeholder row per post the list now has
+static void sync_rows(ThreadViewer *viewer) {
+    ThreadPosts *thread = viewer->thread;
+    gint rows = gtk_tree_model_iter_n_children(GTK_TREE_MODEL(viewer->store), NULL);
+    for (long long i = rows; i < thread->total; i++) {
+        GtkTreeIter iter;
+        gtk_list_store_insert_with_values(viewer->store, &iter, -1, COLUMN_MARKUP, VIEWER_PLACEHOLDER, -1);
+    }
+
+    size_t pages = page_count(thread->total);
+    if (pages > viewer->rendered_pages) {
+        viewer->rendered = g_renew(guint8, viewer->rendered, pages);
+        memset(viewer->rendered + viewer->rendered_pages, 0, pages - viewer->rendered_pages);
+        // A short last page may have gained posts
+        if (viewer->rendered_pages > 0) viewer->rendered[viewer->rendered_pages - 1] = 0;
+        viewer->rendered_pages = pages;
+    }
+    set_status(viewer);
+}
+
+static void on_thumbnail(GdkPixbuf *pixbuf, gpointer owner, gpointer user_data) {
+    ThreadViewer *viewer = owner;
+    GtkTreeIter iter;
+    if (pixbuf && gtk_tree_model_iter_nth_child(GTK_TREE_MODEL(viewer->store), &iter, NULL, GPOINTER_TO_INT(user_data))) {
+        gtk_list_store_set(viewer->store, &iter, COLUMN_THUMBNAIL, pixbuf, -1);
+    }
+}
+
+// Posts with a file have its upload time in "tim", which names the thumbnail
+static void request_thumbnail(ThreadViewer *viewer, const char *post, long long index) {
+    const char *tim = json_object_find(post, "tim");
+    if (tim == NULL) return;
+    char id[32], url[600];
+    g_snprintf(id, sizeof(id), "%" G_GUINT64_FORMAT, g_ascii_strtoull(tim, NULL, 10));
+    format_thumbnail_url(url, sizeof(url), viewer->thread->board, id);
+    thumbnail_cache_request(url, viewer, on_thumbnail, GINT_TO_POINTER((gint)index));
+}
+
+static void render_page(ThreadViewer *viewer, size_t page) {
+    ThreadPosts *thread = viewer->thread;
+    GtkTreeIter iter;
+    long long first = (long long)page * VIEWER_PAGE_POSTS;
+    if (!gtk_tree_model_iter_nth_child(GTK_TREE_MODEL(viewer->store), &iter, NULL, (gint)first)) return;
+
+    for (long long i = first; i < first + VIEWER_PAGE_POSTS && i < thread->total; i++) {
+        if (thread->posts[i]) {
+            char *markup = post_markup(thread->posts[i]);
+            gtk_list_store_set(viewer->store, &iter, COLUMN_MARKUP, markup, -1);
+            g_free(markup);
+            request_thumbnail(viewer, thread->posts[i], i);
+        }
+        if (!gtk_tree_model_iter_next(GTK_TREE_MODEL(viewer->store), &iter)) break;
+    }
+    viewer->rendered[page] = 1;
+
+    if (viewer->first_paint_ms == 0) {
+        viewer->first_paint_ms = MAX((g_get_monotonic_time() - viewer->opened_at) / 1000.0, 0.1);
+        set_status(viewer);
+    }
+}
+
+static void request_page(ThreadViewer *viewer, size_t page);
+static void schedule_check(ThreadViewer *viewer);
+
+static void on_page(int ok, ThreadPostPage *page, void *user_data) {
+    ThreadPosts *thread = user_data;
+    int first = thread->total < 0;
+    thread->failed = !ok;
+
+    if (ok && first && page->total == 0 && load_from_archive(thread) == 0) {
+        // Moved to the archive since the list was loaded
+    } else if (ok) {
+        resize_thread(thread, page->total);
+        for (size_t i = 0; i < page->count && page->start + (long long)i < thread->total; i++) {
+            long long index = page->start + i;
+            g_free(thread->posts[index]);
+            thread->posts[index] = page->posts[i];
+            page->posts[i] = NULL;
+        }
+        size_t loaded = page->start / VIEWER_PAGE_POSTS;
+        if (loaded < page_count(thread->total)) thread->pages[loaded] = PAGE_LOADED;
+    } else if (thread->pages && page_count(thread->total) > (size_t)(page->start / VIEWER_PAGE_POSTS)) {
+        thread->pages[page->start / VIEWER_PAGE_POSTS] = PAGE_NONE;
+    }
+    if (first && !ok) thread->first_requested = FALSE;
+
+    for (GList *link = thread->viewers; link; link = link->next) {
+        sync_rows(link->data);
+        if (ok) schedule_check(link->data);
+    }
+    thread_posts_unref(thread);
+}
+
+static void request_page(ThreadViewer *viewer, size_t page) {
+    ThreadPosts *thread = viewer->thread;
+    if (viewer->connection == NULL) return;
+    if (thread->total < 0) {
+        if (thread->first_requested) return;
+        thread->first_requested = TRUE;
+    } else {
+        if (thread->pages[page] != PAGE_NONE) return;
+        thread->pages[page] = PAGE_REQUESTED;
+    }
+
+    long start = (long)page * VIEWER_PAGE_POSTS;
+    if (redis_async_fetch_posts(viewer->connection, thread->board, thread->thread_id, start, VIEWER_PAGE_POSTS,
+                                on_page, thread_posts_ref(thread)) != REDIS_OK) {
+        thread_posts_unref(thread);
+        if (thread->total < 0) thread->first_requested = FALSE;
+        else thread->pages[page] = PAGE_NONE;
+        thread->failed = TRUE;
+        set_status(viewer);
+    }
+}
+
+// Decode the visible pages that are loaded, and fetch those that aren't plus the next one
+static gboolean check_visible(gpointer data) {
+    ThreadViewer *viewer = data;
+    ThreadPosts *thread = viewer->thread;
+    viewer->check_id = 0;
+    if (thread->total < 0) {
+        request_page(viewer, 0);
+        return G_SOURCE_REMOVE;
+    }
+
+    size_t first = 0, last = 0, pages = page_count(thread->total);
+    GtkTreePath *start_path, *end_path;
+    if (gtk_tree_view_get_visible_range(GTK_TREE_VIEW(viewer->tree_view), &start_path, &end_path)) {
+        first = gtk_tree_path_get_indices(start_path)[0] / VIEWER_PAGE_POSTS;
+        last = gtk_tree_path_get_indices(end_path)[0] / VIEWER_PAGE_POSTS;
+        gtk_tree_path_free(start_path);
+        gtk_tree_path_free(end_path);
+    }
+
+    for (size_t page = first; page <= last + 1 && page < pages; page++) {
+        if (thread->pages[page] != PAGE_LOADED) request_page(viewer, page);
+        else if (page <= last && !viewer->rendered[page]) render_page(viewer, page);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static void schedule_check(ThreadViewer *viewer) {
+    if (viewer->check_id == 0) viewer->check_id = g_idle_add(check_visible, viewer);
+}
+
+static void on_scrolled(GtkAdjustment *adjustment, gpointer data) {
+    schedule_check(data);
+}
+
+// Wrap posts to the width of the list
+static void on_tree_size_allocate(GtkWidget *widget, GdkRectangle *allocation, gpointer data) {
+    ThreadViewer *viewer = data;
+    gint wrap_width = MAX(allocation->width - gtk_tree_view_column_get_width(viewer->thumbnail_column) - 24, 100), current;
+    g_object_get(viewer->renderer, "wrap-width", &current, NULL);
+    if (current != wrap_width) {
+        g_object_set(viewer->renderer, "wrap-width", wrap_width, NULL);
+        gtk_tree_view_columns_autosize(GTK_TREE_VIEW(viewer->tree_view));
+    }
+    schedule_check(viewer);
+}
+
+static void on_viewer_destroy(GtkWidget *widget, gpointer data) {
+    ThreadViewer *viewer = data;
+    if (viewer->check_id) g_source_remove(viewer->check_id);
+    thumbnail_cache_cancel(viewer);
+    viewer->thread->viewers = g_list_remove(viewer->thread->viewers, viewer);
+    open_viewers = g_list_remove(open_viewers, viewer);
+    thread_posts_unref(viewer->thread);
+    g_object_unref(viewer->store);
+    g_free(viewer->rendered);
+    g_free(viewer);
+}
+
+// Show a thread's posts in a new window. Returns at once: the first page is painted when
+// it arrives, or straight away if the thread is cached or read from the archive.
+void thread_viewer_open(RedisAsync *connection, const char *board, const char *thread_id, const char *title) {
+    ThreadViewer *viewer = g_new0(ThreadViewer, 1);
+    viewer->opened_at = g_get_monotonic_time();
+    viewer->connection = connection;
+    viewer->thread = thread_posts_ref(recent_thread(board, thread_id));
+    if (viewer->thread->total < 0 && (connection == NULL || !redis_async_is_connected(connection))) {
+        load_from_archive(viewer->thread);
+    }
+
+    char window_title[512];
+    g_snprintf(window_title, sizeof(window_title), "/%s/ %s", board, title && *title ? title : thread_id);
+    viewer->window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title(GTK_WINDOW(viewer->window), window_title);
+    gtk_window_set_default_size(GTK_WINDOW(viewer->window), 600, 500);
+
+    viewer->store = gtk_list_store_new(N_COLUMNS, G_TYPE_STRING, GDK_TYPE_PIXBUF);
+    viewer->tree_view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(viewer->store));
+    gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(viewer->tree_view), FALSE);
+    GtkCellRenderer *thumbnail_renderer = gtk_cell_renderer_pixbuf_new();
+    g_object_set(thumbnail_renderer, "yalign", 0.0, "ypad", 6, NULL);
+    viewer->thumbnail_column = gtk_tree_view_column_new_with_attributes("Thumbnail", thumbnail_renderer, "pixbuf", COLUMN_THUMBNAIL, NULL);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(viewer->tree_view), viewer->thumbnail_column);
+    viewer->renderer = gtk_cell_renderer_text_new();
+    g_object_set(viewer->renderer, "wrap-mode", PANGO_WRAP_WORD_CHAR, "wrap-width", 560, "ypad", 6, NULL);
+    gtk_tree_view_append_column(GTK_TREE_VIEW(viewer->tree_view),
+                                gtk_tree_view_column_new_with_attributes("Post", viewer->renderer, "markup", COLUMN_MARKUP, NULL));
+
+    GtkWidget *scrolled_window = gtk_scrolled_window_new(NULL, NULL);
+    gtk_container_add(GTK_CONTAINER(scrolled_window), viewer->tree_view);
+    viewer->status_label = gtk_label_new(NULL);
+    gtk_widget_set_halign(viewer->status_label, GTK_ALIGN_START);
+    GtkWidget *box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 5);
+    gtk_box_pack_start(GTK_BOX(box), scrolled_window, TRUE, TRUE, 0);
+    gtk_box_pack_start(GTK_BOX(box), viewer->status_label, FALSE, FALSE, 5);
+    gtk_container_add(GTK_CONTAINER(viewer->window), box);
+
+    g_signal_connect(gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(scrolled_window)), "value-changed", G_CALLBACK(on_scrolled), viewer);
+    g_signal_connect(viewer->tree_view, "size-allocate", G_CALLBACK(on_tree_size_allocate), viewer);
+    g_signal_connect(viewer->window, "destroy", G_CALLBACK(on_viewer_destroy), viewer);
+
+    viewer->thread->viewers = g_list_prepend(viewer->thread->viewers, viewer);
+    open_viewers = g_list_prepend(open_viewers, viewer);
+    sync_rows(viewer);
+    if (viewer->thread->total >= 0) {
+        for (size_t page = 0; page < viewer->rendered_pages && page < 2; page++) {
+            if (viewer->thread->pages[page] == PAGE_LOADED) render_page(viewer, page);
+        }
+    }
+    schedule_check(viewer);
+    gtk_widget_show_all(viewer->window);
+}
+
+// Forget the cached posts of a thread that changed; open viewers keep what they show
+void thread_viewer_invalidate(const char *board, const char *thread_id) {
+    for (GList *link = recent_threads.head; link; link = link->next) {
+        ThreadPosts *thread = link->data;
+        if (strcmp(thread->board, board) == 0 && strcmp(thread->thread_id, thread_id) == 0) {
+            g_queue_delete_link(&recent_threads, link);
+            thread_posts_unref(thread);
+            return;
+        }
+    }
+}
+
+// Stop fetching through a connection that is about to be freed
+void thread_viewer_detach(RedisAsync *connection) {
+    for (GList *link = open_viewers; link; link = link->next) {
+        ThreadViewer *viewer = link->data;
+        if (viewer->connection == connection) viewer->connection = NULL;
+    }
+}
@@ -0,0 +1,211 @@
+#include <gtk/gtk.h>
+#include <string.h>
+#include "../include/thumbnail_cache.h"
+#include "../include/media_store.h"
+#include "../include/metrics.h"
+
+// Decoding never happens on the main thread: a worker reads the bytes from the disk tier or
+// the network, decodes them scaled down to THUMBNAIL_MAX_SIZE, and hands the pixbuf back
+// through an idle callback. The pending table holds one job per URL in flight, so a thumbnail
+// wanted by several rows or windows at once is fetched and decoded once.
+
+#define THUMBNAIL_MAX_SIZE 125  // Longest side in pixels, as 4chan's reply thumbnails
+
+typedef struct {
+    char *url;
+    GdkPixbuf *pixbuf;
+    gsize bytes;
+    GList *link;        // In lru
+} CachedThumbnail;
+
+typedef struct {
+    gpointer owner;
+    thumbnail_ready_fn fn;
+    gpointer user_data;
+} Waiter;
+
+// One URL being fetched; the worker only reads url and sets pixbuf
+typedef struct {
+    char *url;
+    GList *waiters;     // Waiter, in request order
+    GdkPixbuf *pixbuf;
+} DecodeJob;
+
+static GHashTable *cached = NULL;    // URL to CachedThumbnail
+static GQueue lru = G_QUEUE_INIT;    // CachedThumbnail, most recently used first
+static gsize cached_bytes = 0;
+static gsize memory_limit = 0;
+static GHashTable *pending = NULL;   // URL to DecodeJob
+static GThreadPool *decoders = NULL;
+static guint64 memory_hits = 0, misses = 0, coalesced = 0;
+
+static void cached_thumbnail_free(gpointer data) {
+    CachedThumbnail *thumbnail = data;
+    g_object_unref(thumbnail->pixbuf);
+    g_free(thumbnail->url);
+    g_free(thumbnail);
+}
+
+static void decode_job_free(gpointer data) {
+    DecodeJob *job = data;
+    g_list_free_full(job->waiters, g_free);
+    if (job->pixbuf) g_object_unref(job->pixbuf);
+    g_free(job->url);
+    g_free(job);
+}
+
+// --- Memory tier -----------------------------------------------------------------------------
+
+static void evict(gsize limit) {
+    while (cached_bytes > limit && lru.tail) {
+        CachedThumbnail *thumbnail = lru.tail->data;
+        g_queue_delete_link(&lru, lru.tail);
+        cached_bytes -= thumbnail->bytes;
+        g_hash_table_remove(cached, thumbnail->url);  // Frees it
+    }
+}
+
+static void remember(const char *url, GdkPixbuf *pixbuf) {
+    gsize bytes = gdk_pixbuf_get_byte_length(pixbuf) + sizeof(CachedThumbnail) + strlen(url);
+    if (bytes > memory_limit || g_hash_table_contains(cached, url)) return;
+
+    CachedThumbnail *thumbnail = g_new0(CachedThumbnail, 1);
+    thumbnail->url = g_strdup(url);
+    thumbnail->pixbuf = g_object_ref(pixbuf);
+    thumbnail->bytes = bytes;
+    g_queue_push_head(&lru, thumbnail);
+    thumbnail->link = lru.head;
+    g_hash_table_insert(cached, thumbnail->url, thumbnail);
+    cached_bytes += bytes;
+    evict(memory_limit);
+}
+
+// --- Decode workers --------------------------------------------------------------------------
+
+// Let the decoder scale while it decodes, which for JPEG skips most of the work
+static void on_size_prepared(GdkPixbufLoader *loader, gint width, gint height, gpointer data) {
+    if (width <= THUMBNAIL_MAX_SIZE && height <= THUMBNAIL_MAX_SIZE) return;
+    double scale = (double)THUMBNAIL_MAX_SIZE / MAX(width, height);
+    gdk_pixbuf_loader_set_size(loader, MAX((gint)(width * scale), 1), MAX((gint)(height * scale), 1));
+}
+
+static GdkPixbuf *decode(const MediaBlob *blob) {
+    GdkPixbufLoader *loader = gdk_pixbuf_loader_new();
+    g_signal_connect(loader, "size-prepared", G_CALLBACK(on_size_prepared), NULL);
+    GdkPixbuf *pixbuf = NULL;
+    gboolean written = gdk_pixbuf_loader_write(loader, blob->data, blob->length, NULL);
+    if (gdk_pixbuf_loader_close(loader, NULL) && written) {
+        pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+        if (pixbuf) g_object_ref(pixbuf);
+    }
+    g_object_unref(loader);
+    return pixbuf;
+}
+
+static gboolean deliver(gpointer data) {
+    DecodeJob *job = data;
+    g_hash_table_steal(pending, job->url);
+    if (job->pixbuf) remember(job->url, job->pixbuf);
+    for (GList *link = job->waiters; link; link = link->next) {
+        Waiter *waiter = link->data;
+        waiter->fn(job->pixbuf, waiter->owner, waiter->user_data);
+    }
+    decode_job_free(job);
+    return G_SOURCE_REMOVE;
+}
+
+static void decode_worker(gpointer data, gpointer pool_data) {
+    DecodeJob *job = data;
+    MediaBlob blob;
+    if (media_store_fetch(job->url, &blob) == 0) {
+        guint64 started = metrics_begin();
+        job->pixbuf = decode(&blob);
+        metrics_end(METRIC_THUMBNAIL_DECODE, started);
+        if (job->pixbuf == NULL) g_printerr("Failed to decode %s\n", job->url);
+        media_blob_free(&blob);
+    }
+    g_idle_add(deliver, job);
+}
+
+// --- Requests --------------------------------------------------------------------------------
+
+void thumbnail_cache_init(gsize memory_bytes, int workers) {
+    memory_limit = memory_bytes;
+    cached = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, cached_thumbnail_free);
+    pending = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, decode_job_free);
+    decoders = g_thread_pool_new(decode_worker, NULL, MAX(workers, 1), FALSE, NULL);
+}
+
+// Drops queued fetches and waits for those running; their callbacks never run
+void thumbnail_cache_shutdown() {
+    if (decoders == NULL) return;
+    g_thread_pool_free(decoders, TRUE, TRUE);
+    decoders = NULL;
+    g_hash_table_destroy(pending);
+    evict(0);
+    g_hash_table_destroy(cached);
+    pending = cached = NULL;
+}
+
+// Call fn with the thumbnail at url. A cached thumbnail is passed before this returns, and
+// TRUE is returned; otherwise fn runs on the main loop once a worker has it.
+gboolean thumbnail_cache_request(const char *url, gpointer owner, thumbnail_ready_fn fn, gpointer user_data) {
+    if (decoders == NULL) {
+        fn(NULL, owner, user_data);
+        return TRUE;
+    }
+
+    CachedThumbnail *thumbnail = g_hash_table_lookup(cached, url);
+    if (thumbnail) {
+        g_queue_unlink(&lru, thumbnail->link);
+        g_queue_push_head_link(&lru, thumbnail->link);
+        memory_hits++;
+        fn(thumbnail->pixbuf, owner, user_data);
+        return TRUE;
+    }
+
+    Waiter *waiter = g_new(Waiter, 1);
+    waiter->owner = owner;
+    waiter->fn = fn;
+    waiter->user_data = user_data;
+    DecodeJob *job = g_hash_table_lookup(pending, url);
+    if (job) {
+        coalesced++;
+        job->waiters = g_list_append(job->waiters, waiter);
+        return FALSE;
+    }
+
+    misses++;
+    job = g_new0(DecodeJob, 1);
+    job->url = g_strdup(url);
+    job->waiters = g_list_append(NULL, waiter);
+    g_hash_table_insert(pending, job->url, job);
+    g_thread_pool_push(decoders, job, NULL);
+    return FALSE;
+}
+
+// Forget owner's waiting requests, as when its window closes. Fetches still run and fill the cache.
+void thumbnail_cache_cancel(gpointer owner) {
+    if (pending == NULL) return;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, pending);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        DecodeJob *job = value;
+        for (GList *link = job->waiters, *next; link; link = next) {
+            next = link->next;
+            Waiter *waiter = link->data;
+            if (waiter->owner != owner) continue;
+            g_free(waiter);
+            job->waiters = g_list_delete_link(job->waiters, link);
+        }
+    }
+}
+
+void thumbnail_cache_stats(ThumbnailCacheStats *stats) {
+    stats->memory_hits = memory_hits;
+    stats->misses = misses;
+    stats->coalesced = coalesced;
+    stats->cached = g_queue_get_length(&lru);
+    stats->cached_bytes = cached_bytes;
+}
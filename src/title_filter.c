@@ -0,0 +1,491 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <regex.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "../include/title_filter.h"
+
+// Index layout: one entry per snapshot record, in record order, each stored in the packed
+// buffer as "<lower-cased title>\0<decimal id>\0". A query token never contains a NUL, so a
+// scan over the whole buffer can't match across entries, and the first hit of a token in a
+// range is mapped back to its entry by walking the offsets forward.
+//
+// Substring and word queries scan the buffer for their longest token and fully score only the
+// entries it hits. Fuzzy and regex queries score every entry. Large indexes are split into
+// contiguous entry ranges, one per thread; each range writes its own part of scores[].
+
+#define TITLE_MAX_TOKENS 16
+#define TITLE_PARALLEL_MIN 65536  // Fewer entries than this are searched on the calling thread
+#define TITLE_THREADS_MAX 8
+
+// --- Queries ---------------------------------------------------------------------------------
+
+typedef struct {
+    char *text;
+    size_t length;
+} Token;
+
+struct TitleQuery {
+    TitleMatchMode mode;
+    Token tokens[TITLE_MAX_TOKENS];  // Longest first; fuzzy and regex queries have one
+    int token_count;
+    int digits_only;                 // Fuzzy: an all-digit query may also match the ID
+    char *pattern;                   // Regex source; each search thread compiles its own copy
+    regex_t regex;                   // For title_query_score
+};
+
+static unsigned char lower_table[256];
+static pthread_once_t lower_once = PTHREAD_ONCE_INIT;
+
+static void init_lower_table() {
+    for (int c = 0; c < 256; c++) lower_table[c] = (c >= 'A' && c <= 'Z') ? (unsigned char)(c + 32) : (unsigned char)c;
+}
+
+static void lower_copy(char *dest, const char *src, size_t length) {
+    for (size_t i = 0; i < length; i++) dest[i] = (char)lower_table[(unsigned char)src[i]];
+}
+
+static int is_word_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || (unsigned char)c >= 0x80;
+}
+
+static int add_token(TitleQuery *query, const char *text, size_t length) {
+    if (length == 0 || query->token_count == TITLE_MAX_TOKENS) return 0;
+    Token *token = &query->tokens[query->token_count];
+    token->text = malloc(length + 1);
+    if (token->text == NULL) return -1;
+    lower_copy(token->text, text, length);
+    token->text[length] = '\0';
+    token->length = length;
+    query->token_count++;
+    return 0;
+}
+
+static int compare_tokens(const void *a, const void *b) {
+    const Token *x = a, *y = b;
+    return (y->length > x->length) - (y->length < x->length);
+}
+
+// Words split on whitespace; a double-quoted run is one token, spaces included
+static int tokenize_words(TitleQuery *query, const char *text) {
+    const char *p = text;
+    while (*p) {
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '\0') break;
+        const char *start = p;
+        if (*p == '"') {
+            start = ++p;
+            while (*p && *p != '"') p++;
+            if (add_token(query, start, (size_t)(p - start)) < 0) return -1;
+            if (*p == '"') p++;
+        } else {
+            while (*p && *p != ' ' && *p != '\t') p++;
+            if (add_token(query, start, (size_t)(p - start)) < 0) return -1;
+        }
+    }
+    qsort(query->tokens, query->token_count, sizeof(Token), compare_tokens);
+    return 0;
+}
+
+TitleQuery *title_query_new(const char *text, TitleMatchMode mode, char *error, size_t error_size) {
+    pthread_once(&lower_once, init_lower_table);
+    if (error_size) error[0] = '\0';
+    if (text == NULL || *text == '\0') return NULL;
+
+    TitleQuery *query = calloc(1, sizeof(TitleQuery));
+    if (query == NULL) return NULL;
+    query->mode = mode;
+
+    int failed = 0;
+    if (mode == TITLE_MATCH_WORDS) {
+        failed = tokenize_words(query, text);
+    } else if (mode == TITLE_MATCH_FUZZY) {
+        // Spaces carry no information in a subsequence match
+        char *compact = malloc(strlen(text) + 1);
+        size_t length = 0;
+        for (const char *p = text; compact && *p; p++) {
+            if (*p != ' ' && *p != '\t') compact[length++] = *p;
+        }
+        failed = compact == NULL || add_token(query, compact, length) < 0;
+        free(compact);
+        query->digits_only = length > 0 && strspn(query->token_count ? query->tokens[0].text : "", "0123456789") == length;
+    } else if (mode == TITLE_MATCH_REGEX) {
+        query->pattern = strdup(text);
+        int status = query->pattern ? regcomp(&query->regex, text, REG_EXTENDED | REG_ICASE) : REG_ESPACE;
+        if (status != 0) {
+            if (error_size) regerror(status, query->pattern ? &query->regex : NULL, error, error_size);
+            free(query->pattern);
+            free(query);
+            return NULL;
+        }
+    } else {
+        failed = add_token(query, text, strlen(text)) < 0;
+    }
+
+    if (failed || (mode != TITLE_MATCH_REGEX && query->token_count == 0)) {
+        title_query_free(query);
+        return NULL;
+    }
+    return query;
+}
+
+void title_query_free(TitleQuery *query) {
+    if (query == NULL) return;
+    for (int i = 0; i < query->token_count; i++) free(query->tokens[i].text);
+    if (query->pattern) {
+        regfree(&query->regex);
+        free(query->pattern);
+    }
+    free(query);
+}
+
+// --- Matching kernels ------------------------------------------------------------------------
+
+// First occurrence of needle in [text, end), or NULL. With SSE2, 16 positions are tested at once
+// against the needle's first and last bytes, and only positions where both agree are compared
+// in full; rare pairs make that a few instructions per 16 bytes of title text.
+static const char *find_token(const char *text, const char *end, const char *needle, size_t n) {
+    if (n == 0) return text;
+    if ((size_t)(end - text) < n) return NULL;
+    size_t length = (size_t)(end - text);
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[n - 1]);
+    for (; i + n - 1 + 16 <= length; i += 16) {
+        __m128i block_first = _mm_loadu_si128((const __m128i *)(text + i));
+        __m128i block_last = _mm_loadu_si128((const __m128i *)(text + i + n - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block_first, first), _mm_cmpeq_epi8(block_last, last)));
+        while (mask) {
+            unsigned bit = (unsigned)__builtin_ctz(mask);
+            if (n <= 2 || memcmp(text + i + bit + 1, needle + 1, n - 2) == 0) return text + i + bit;
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i + n <= length; i++) {
+        if (text[i] == needle[0] && text[i + n - 1] == needle[n - 1] && memcmp(text + i, needle, n) == 0) return text + i;
+    }
+    return NULL;
+}
+
+// Position and word alignment of one token in a lower-cased string; 0 if absent
+static float token_score(const char *text, size_t length, const Token *token) {
+    const char *hit = find_token(text, text + length, token->text, token->length);
+    if (hit == NULL) return 0;
+    size_t position = (size_t)(hit - text);
+    float score = 16;
+    if (position == 0 || !is_word_char(text[position - 1])) score += 8;
+    if (position + token->length == length || !is_word_char(text[position + token->length])) score += 8;
+    return score + 4.0f * (1.0f - (float)position / (float)length);
+}
+
+// Subsequence match in the tightest window that ends earliest: the forward pass finds where
+// the greedy match ends, the backward pass pulls its start as late as possible. Each matched
+// character scores, with bonuses for runs and word starts and a penalty per skipped character.
+static float fuzzy_score(const char *text, size_t length, const Token *token) {
+    const char *pattern = token->text;
+    size_t n = token->length, end = 0;
+    for (size_t p = 0; p < n; p++) {
+        const char *found = memchr(text + end, pattern[p], length - end);
+        if (found == NULL) return 0;
+        end = (size_t)(found - text) + 1;
+    }
+    size_t start = end;
+    for (size_t p = n; p-- > 0;) {
+        do start--; while (text[start] != pattern[p]);
+    }
+
+    float score = start == 0 ? 8 : 0;
+    int run = 0;
+    for (size_t i = start, p = 0; i < end; i++) {
+        if (p < n && text[i] == pattern[p]) {
+            score += 16;
+            if (i == 0 || !is_word_char(text[i - 1])) score += 8;
+            if (run) score += 8;
+            run = 1;
+            p++;
+        } else {
+            score -= 1;
+            run = 0;
+        }
+    }
+    return score > 1 ? score : 1;
+}
+
+// Score one entry given its lower-cased title and decimal ID
+static float score_entry(const TitleQuery *query, const regex_t *regex, const char *title, size_t title_length,
+                         const char *id, size_t id_length) {
+    if (query->mode == TITLE_MATCH_REGEX) {
+        regmatch_t match;
+        if (regexec(regex, title, 1, &match, 0) == 0) {
+            float score = 16 + 8.0f * (1.0f - (float)match.rm_so / (float)(title_length ? title_length : 1));
+            return match.rm_so == 0 ? score + 8 : score;
+        }
+        return regexec(regex, id, 0, NULL, 0) == 0 ? 8 : 0;
+    }
+
+    if (query->mode == TITLE_MATCH_FUZZY) {
+        float score = fuzzy_score(title, title_length, &query->tokens[0]);
+        if (score == 0 && query->digits_only && token_score(id, id_length, &query->tokens[0]) > 0) score = 8;
+        return score;
+    }
+
+    // Substring and words: every token in the title, or failing that in the ID
+    float total = 0;
+    for (int t = 0; t < query->token_count; t++) {
+        float score = token_score(title, title_length, &query->tokens[t]);
+        if (score == 0) score = token_score(id, id_length, &query->tokens[t]) / 2;
+        if (score == 0) return 0;
+        total += score;
+    }
+    if (query->token_count == 1 && query->tokens[0].length == title_length) total += 16;  // Exact title
+    return total;
+}
+
+float title_query_score(const TitleQuery *query, const char *title, uint64_t id) {
+    if (query == NULL) return 1;
+    size_t title_length = strlen(title);
+    char stack_buffer[512];
+    char *lowered = title_length < sizeof(stack_buffer) ? stack_buffer : malloc(title_length + 1);
+    if (lowered == NULL) return 0;
+    lower_copy(lowered, title, title_length + 1);
+
+    char id_text[24];
+    int id_length = snprintf(id_text, sizeof(id_text), "%llu", (unsigned long long)id);
+    float score = score_entry(query, &query->regex, lowered, title_length, id_text, (size_t)id_length);
+    if (lowered != stack_buffer) free(lowered);
+    return score;
+}
+
+// --- Index -----------------------------------------------------------------------------------
+
+struct TitleIndex {
+    char *buffer;
+    size_t used;
+    size_t capacity;
+    uint32_t *offsets;        // Entry i spans [offsets[i], offsets[i + 1]); count + 1 values
+    uint32_t *title_offsets;  // Snapshot title_offset the entry was built from
+    uint32_t *id_offsets;     // Start of the entry's ID within the buffer
+    size_t count;
+    size_t entry_capacity;
+    uint64_t first_id;        // Record 0's ID, to notice a snapshot that was replaced
+    size_t arena_seen;        // Snapshot arena size at the last update; it only grows
+    unsigned char *stale;     // Entries whose title changed since they were packed
+    size_t stale_count;
+};
+
+TitleIndex *title_index_new() {
+    pthread_once(&lower_once, init_lower_table);
+    return calloc(1, sizeof(TitleIndex));
+}
+
+void title_index_free(TitleIndex *index) {
+    if (index == NULL) return;
+    free(index->buffer);
+    free(index->offsets);
+    free(index->title_offsets);
+    free(index->id_offsets);
+    free(index->stale);
+    free(index);
+}
+
+static void reset_index(TitleIndex *index) {
+    index->used = 0;
+    index->count = 0;
+    index->stale_count = 0;
+    index->arena_seen = 0;
+}
+
+static int reserve_entries(TitleIndex *index, size_t entries) {
+    if (entries <= index->entry_capacity) return 0;
+    size_t capacity = index->entry_capacity ? index->entry_capacity : 1024;
+    while (capacity < entries) capacity *= 2;
+
+    uint32_t *offsets = realloc(index->offsets, (capacity + 1) * sizeof(uint32_t));
+    if (offsets) index->offsets = offsets;
+    uint32_t *title_offsets = realloc(index->title_offsets, capacity * sizeof(uint32_t));
+    if (title_offsets) index->title_offsets = title_offsets;
+    uint32_t *id_offsets = realloc(index->id_offsets, capacity * sizeof(uint32_t));
+    if (id_offsets) index->id_offsets = id_offsets;
+    unsigned char *stale = realloc(index->stale, capacity);
+    if (stale) index->stale = stale;
+    if (!offsets || !title_offsets || !id_offsets || !stale) return -1;
+    index->entry_capacity = capacity;
+    return 0;
+}
+
+// The buffer keeps 16 spare bytes so the SIMD kernel's unaligned loads never need a bounds check
+static int reserve_bytes(TitleIndex *index, size_t bytes) {
+    if (index->used + bytes + 16 <= index->capacity) return 0;
+    size_t capacity = index->capacity ? index->capacity : 65536;
+    while (capacity < index->used + bytes + 16) capacity *= 2;
+    if (capacity > UINT32_MAX) return -1;
+    char *buffer = realloc(index->buffer, capacity);
+    if (buffer == NULL) return -1;
+    index->buffer = buffer;
+    index->capacity = capacity;
+    return 0;
+}
+
+static int append_entry(TitleIndex *index, const ThreadSnapshot *snapshot, const ThreadSnapshotRecord *record) {
+    const char *title = thread_snapshot_title(snapshot, record);
+    size_t title_length = strlen(title);
+    if (reserve_entries(index, index->count + 1) < 0 || reserve_bytes(index, title_length + 24) < 0) return -1;
+
+    size_t entry = index->count;
+    index->offsets[entry] = (uint32_t)index->used;
+    index->title_offsets[entry] = record->title_offset;
+    index->stale[entry] = 0;
+    lower_copy(index->buffer + index->used, title, title_length);
+    index->used += title_length;
+    index->buffer[index->used++] = '\0';
+    index->id_offsets[entry] = (uint32_t)index->used;
+    index->used += (size_t)snprintf(index->buffer + index->used, 24, "%llu", (unsigned long long)record->id) + 1;
+    index->offsets[entry + 1] = (uint32_t)index->used;
+    index->count++;
+    return 0;
+}
+
+// Bring the index in line with the snapshot: append new records, note changed titles, and
+// repack from scratch when the snapshot was replaced or too many titles went stale
+void title_index_update(TitleIndex *index, const ThreadSnapshot *snapshot) {
+    if (snapshot->count < index->count || (index->count > 0 && snapshot->records[0].id != index->first_id)) {
+        reset_index(index);
+    }
+
+    if (snapshot->arena_used != index->arena_seen && index->count > 0) {
+        for (size_t i = 0; i < index->count; i++) {
+            if (!index->stale[i] && snapshot->records[i].title_offset != index->title_offsets[i]) {
+                index->stale[i] = 1;
+                index->stale_count++;
+            }
+        }
+        if (index->stale_count > index->count / 8) reset_index(index);
+    }
+
+    while (index->count < snapshot->count) {
+        if (append_entry(index, snapshot, &snapshot->records[index->count]) < 0) break;  // Searched unindexed instead
+    }
+    if (index->count > 0) index->first_id = snapshot->records[0].id;
+    index->arena_seen = snapshot->arena_used;
+}
+
+// --- Search ----------------------------------------------------------------------------------
+
+typedef struct {
+    const TitleIndex *index;
+    const ThreadSnapshot *snapshot;
+    const TitleQuery *query;
+    float *scores;
+    size_t first;   // Entry range [first, last)
+    size_t last;
+    size_t matches;
+} SearchRange;
+
+static float score_index_entry(const SearchRange *range, const regex_t *regex, size_t entry) {
+    const TitleIndex *index = range->index;
+    const char *title = index->buffer + index->offsets[entry];
+    const char *id = index->buffer + index->id_offsets[entry];
+    size_t title_length = index->id_offsets[entry] - index->offsets[entry] - 1;
+    size_t id_length = index->offsets[entry + 1] - index->id_offsets[entry] - 1;
+    return score_entry(range->query, regex, title, title_length, id, id_length);
+}
+
+static void search_range(SearchRange *range) {
+    const TitleIndex *index = range->index;
+    const TitleQuery *query = range->query;
+    const ThreadSnapshotRecord *records = range->snapshot->records;
+    float *scores = range->scores;
+    memset(scores + range->first, 0, (range->last - range->first) * sizeof(float));
+
+    // regexec serializes callers that share a regex_t, so each range compiles its own
+    regex_t regex;
+    if (query->mode == TITLE_MATCH_REGEX && regcomp(&regex, query->pattern, REG_EXTENDED | REG_ICASE) != 0) return;
+
+    if (query->mode == TITLE_MATCH_SUBSTRING || query->mode == TITLE_MATCH_WORDS) {
+        const Token *token = &query->tokens[0];
+        const char *end = index->buffer + index->offsets[range->last];
+        const char *p = index->buffer + index->offsets[range->first];
+        size_t entry = range->first;
+        while ((p = find_token(p, end, token->text, token->length)) != NULL) {
+            uint32_t position = (uint32_t)(p - index->buffer);
+            while (index->offsets[entry + 1] <= position) entry++;
+            if (!index->stale[entry] && !(records[entry].flags & THREAD_RECORD_DELETED)) {
+                scores[entry] = score_index_entry(range, NULL, entry);
+            }
+            p = index->buffer + index->offsets[entry + 1];  // One hit per entry is enough
+        }
+    } else {
+        for (size_t entry = range->first; entry < range->last; entry++) {
+            if (index->stale[entry] || (records[entry].flags & THREAD_RECORD_DELETED)) continue;
+            scores[entry] = score_index_entry(range, &regex, entry);
+        }
+    }
+
+    // Titles changed since they were packed are scored from the snapshot
+    for (size_t entry = range->first; entry < range->last && index->stale_count > 0; entry++) {
+        if (index->stale[entry] && !(records[entry].flags & THREAD_RECORD_DELETED)) {
+            scores[entry] = title_query_score(query, thread_snapshot_title(range->snapshot, &records[entry]), records[entry].id);
+        }
+    }
+
+    for (size_t entry = range->first; entry < range->last; entry++) range->matches += scores[entry] > 0;
+    if (query->mode == TITLE_MATCH_REGEX) regfree(&regex);
+}
+
+static void *search_thread(void *arg) {
+    search_range(arg);
+    return NULL;
+}
+
+static int search_threads(size_t entries) {
+    if (entries < TITLE_PARALLEL_MIN) return 1;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus > 0 ? (int)cpus : 1;
+    if (threads > TITLE_THREADS_MAX) threads = TITLE_THREADS_MAX;
+    if ((size_t)threads > entries / (TITLE_PARALLEL_MIN / 4)) threads = (int)(entries / (TITLE_PARALLEL_MIN / 4));
+    return threads > 0 ? threads : 1;
+}
+
+size_t title_index_search(TitleIndex *index, const ThreadSnapshot *snapshot, const TitleQuery *query, float *scores) {
+    title_index_update(index, snapshot);
+    if (query == NULL) {
+        for (size_t i = 0; i < snapshot->count; i++) scores[i] = (snapshot->records[i].flags & THREAD_RECORD_DELETED) ? 0 : 1;
+        return snapshot->count;
+    }
+
+    int threads = search_threads(index->count);
+    SearchRange ranges[TITLE_THREADS_MAX];
+    pthread_t workers[TITLE_THREADS_MAX];
+    int started[TITLE_THREADS_MAX] = { 0 };
+    for (int t = 0; t < threads; t++) {
+        ranges[t] = (SearchRange){ index, snapshot, query, scores, index->count * t / threads, index->count * (t + 1) / threads, 0 };
+    }
+    // The calling thread takes the first range; a thread that fails to start is run inline
+    for (int t = 1; t < threads; t++) started[t] = pthread_create(&workers[t], NULL, search_thread, &ranges[t]) == 0;
+    search_range(&ranges[0]);
+
+    size_t matches = 0;
+    for (int t = 0; t < threads; t++) {
+        if (t > 0 && started[t]) pthread_join(workers[t], NULL);
+        else if (t > 0) search_range(&ranges[t]);
+        matches += ranges[t].matches;
+    }
+
+    // Records the index could not take (out of memory)
+    for (size_t i = index->count; i < snapshot->count; i++) {
+        const ThreadSnapshotRecord *record = &snapshot->records[i];
+        scores[i] = (record->flags & THREAD_RECORD_DELETED) ? 0 : title_query_score(query, thread_snapshot_title(snapshot, record), record->id);
+        matches += scores[i] > 0;
+    }
+    return matches;
+}